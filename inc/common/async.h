@@ -18,8 +18,6 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #pragma once
 
-#if USE_CLIENT
-
 typedef struct asyncwork_s {
     void (*work_cb)(void *);
     void (*done_cb)(void *);
@@ -27,14 +25,16 @@ typedef struct asyncwork_s {
     struct asyncwork_s *next;
 } asyncwork_t;
 
+typedef void (*parallel_cb_t)(void *arg, int begin, int end);
+
+void Com_InitAsyncWork(void);
 void Com_QueueAsyncWork(asyncwork_t *work);
 void Com_CompleteAsyncWork(void);
 void Com_ShutdownAsyncWork(void);
 
-#else
-
-#define Com_QueueAsyncWork(work)    (void)0
-#define Com_CompleteAsyncWork()     (void)0
-#define Com_ShutdownAsyncWork()     (void)0
-
-#endif
+// Runs func over [0, count) split into chunks of grain indices, on the
+// main thread and a pool of workers. Callbacks run concurrently and must
+// not use the zone allocator, filesystem or console. Runs serially until
+// Com_InitAsyncWork has been called.
+void Com_ParallelFor(int count, int grain, parallel_cb_t func, void *arg);
+int Com_ParallelThreads(void);
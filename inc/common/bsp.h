@@ -101,8 +101,10 @@ typedef struct mface_s {
     int             texnum[2];
     int             statebits;
     int             firstvert;
+    int             firstindex;
+    int             batchnum;
     int             light_s, light_t;
-    float           stylecache[MAX_LIGHTMAPS];
+    uint32_t        lightsig;
 #else
     struct surfcache_s    *cachespots[MIPLEVELS]; // surface generation data
 #endif
@@ -148,7 +150,6 @@ typedef struct {
     int                 contents;
     int                 numsides;
     mbrushside_t        *firstbrushside;
-    unsigned            checkcount;         // to avoid repeated testings
 } mbrush_t;
 
 typedef struct {
@@ -33,6 +33,7 @@ typedef struct {
     int         override_bits;
     int         checksum;
     char        *entitystring;
+    struct brushtree_s  *brushtree;
 } cm_t;
 
 void        CM_Init(void);
@@ -54,6 +55,22 @@ mleaf_t     *CM_LeafNum(cm_t *cm, int number);
 // creates a clipping hull for an arbitrary box
 mnode_t     *CM_HeadnodeForBox(const vec3_t mins, const vec3_t maxs);
 
+// private box hull for callers that can't share the one above, such as
+// traces running on several threads. The shared hull is never rotated,
+// so transformed traces against a private one should pass zero angles.
+typedef struct {
+    cplane_t        planes[12];
+    mnode_t         nodes[6];
+    mbrush_t        brush;
+    mbrush_t        *leafbrush;
+    mbrushside_t    brushsides[6];
+    mleaf_t         leaf;
+    mleaf_t         emptyleaf;
+} boxhull_t;
+
+void        CM_InitBoxHull(boxhull_t *hull);
+mnode_t     *CM_HeadnodeForBoxHull(boxhull_t *hull, const vec3_t mins, const vec3_t maxs);
+
 // returns an ORed contents mask
 int         CM_PointContents(const vec3_t p, mnode_t *headnode);
 int         CM_TransformedPointContents(const vec3_t p, mnode_t *headnode,
@@ -68,6 +85,11 @@ void        CM_TransformedBoxTrace(trace_t *trace,
                                    const vec3_t mins, const vec3_t maxs,
                                    mnode_t *headnode, int brushmask,
                                    const vec3_t origin, const vec3_t angles);
+// traces a bundle of boxes of the same size through nearby space
+void        CM_BoxTraceBundle(trace_t *traces,
+                              const vec3_t *starts, const vec3_t *ends, int count,
+                              const vec3_t mins, const vec3_t maxs,
+                              mnode_t *headnode, int brushmask);
 void        CM_ClipEntity(trace_t *dst, const trace_t *src, struct edict_s *ent);
 
 // call with topnode set to the headnode, returns with topnode
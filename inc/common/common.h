@@ -137,9 +137,7 @@ extern cvar_t   *z_perturb;
 extern cvar_t   *developer;
 #endif
 extern cvar_t   *dedicated;
-#if USE_CLIENT
 extern cvar_t   *host_speeds;
-#endif
 extern cvar_t   *com_version;
 
 #if USE_CLIENT
@@ -110,9 +110,7 @@ void    FS_Shutdown(void);
 void    FS_Restart(bool total);
 void    FS_AddConfigFiles(bool init);
 
-#if USE_CLIENT
 int FS_RenameFile(const char *from, const char *to);
-#endif
 
 int FS_CreatePath(char *path);
 
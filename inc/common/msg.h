@@ -79,6 +79,7 @@ typedef enum {
     MSG_ES_BEAMORIGIN   = (1 << 5),     // client has RF_BEAM old_origin fix
     MSG_ES_SHORTANGLES  = (1 << 6),     // higher precision angles encoding
     MSG_ES_REMOVE       = (1 << 7),     // entity is removed (MVD stream only)
+    MSG_ES_PACKED       = (1 << 8),     // bit packed origin/angles deltas
 } msgEsFlags_t;
 
 extern sizebuf_t    msg_write;
@@ -102,9 +103,9 @@ void    MSG_WriteLong64(int64_t c);
 void    MSG_WriteString(const char *s);
 void    MSG_WritePos(const vec3_t pos);
 void    MSG_WriteAngle(float f);
-#if USE_CLIENT
 void    MSG_FlushBits(void);
 void    MSG_WriteBits(int value, int bits);
+#if USE_CLIENT
 int     MSG_WriteDeltaUsercmd(const usercmd_t *from, const usercmd_t *cmd, int version);
 int     MSG_WriteDeltaUsercmd_Enhanced(const usercmd_t *from, const usercmd_t *cmd);
 #endif
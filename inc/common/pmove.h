@@ -43,7 +43,17 @@ typedef struct {
     float       flyfriction;
 } pmoveParams_t;
 
+// collision callbacks with an explicit context, for callers that can't
+// use the pmove_t ones because several moves run at once
+typedef struct {
+    void    (*trace)(void *arg, trace_t *tr, const vec3_t start, const vec3_t mins,
+                     const vec3_t maxs, const vec3_t end);
+    int     (*pointcontents)(void *arg, const vec3_t point);
+    void    *arg;
+} pmoveWorld_t;
+
 void Pmove(pmove_t *pmove, pmoveParams_t *params);
+void PmoveWorld(pmove_t *pmove, const pmoveParams_t *params, const pmoveWorld_t *world);
 
 void PmoveInit(pmoveParams_t *pmp);
 void PmoveEnableQW(pmoveParams_t *pmp);
@@ -47,6 +47,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define PROTOCOL_VERSION_Q2PRO_CINEMATICS       1023    // r2263
 #define PROTOCOL_VERSION_Q2PRO_CURRENT          1023    // r2263
 
+// Bit packed entity deltas are negotiated separately, with an extra connect
+// parameter acknowledged by `pe=1' in client_connect. Minor versions above
+// 1023 are taken by upstream Q2PRO extensions.
+
 #define PROTOCOL_VERSION_MVD_MINIMUM            2009    // r168
 #define PROTOCOL_VERSION_MVD_CURRENT            2010    // r177
 
@@ -67,7 +67,7 @@ typedef enum
 } pixelformat_t;
 
 typedef struct image_s {
-    list_t          entry;
+    unsigned        hash; // registry key of name and type
     char            name[MAX_QPATH]; // game path
     int             baselen; // without extension
     imagetype_t     type;
@@ -112,6 +112,7 @@ void IMG_ReloadAll(void);
 image_t *IMG_Find(const char *name, imagetype_t type, imageflags_t flags);
 image_t *IMG_FindExisting(const char *name, imagetype_t type);
 image_t *IMG_Clone(image_t *image, const char* new_name);
+void IMG_Release(image_t *image);
 void IMG_FreeUnused(void);
 void IMG_FreeAll(void);
 void IMG_Init(void);
@@ -122,9 +123,21 @@ image_t *IMG_ForHandle(qhandle_t h);
 
 int IMG_GetDimensions(const char* name, int* width, int* height);
 
+// these are implemented in src/refresh/imgproc.c
+#define IMG_FILTER_LINEAR   BIT(0)  // filter color in linear space
+#define IMG_FILTER_KAISER   BIT(1)  // Kaiser windowed sinc instead of box
+
+extern float img_srgb_to_linear[256];
+
+void IMG_InitProcessing(void);
+byte IMG_LinearToSrgb(float x);
 void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
                          byte *out, int outwidth, int outheight);
 void IMG_MipMap(byte *out, byte *in, int width, int height);
+void IMG_MipMapEx(byte *out, byte *in, int width, int height, int flags);
+void IMG_FilterFloat(float *pixels, int num_comps, const float *kernel,
+                     int kernel_size, int width, int height);
+void IMG_Upsample2xFloat(float *out, const float *in, int num_comps, int width, int height);
 
 // these are implemented in src/refresh/[gl,sw]/images.c
 extern void (*IMG_Unload)(image_t *image);
@@ -174,6 +174,10 @@ int MOD_ValidateMD2(struct dmd2header_s *header, size_t length);
 
 int MOD_LoadIQM_Base(model_t* mod, const void* rawdata, size_t length, const char* mod_name);
 bool R_ComputeIQMTransforms(const iqm_model_t* model, const entity_t* entity, float* pose_matrices);
+void R_ComputeIQMPose(const iqm_model_t* model, int frame, int oldframe, float backlerp, float* pose_matrices);
+#if USE_TESTS
+void R_ComputeIQMPoseScalar(const iqm_model_t* model, int frame, int oldframe, float backlerp, float* pose_matrices);
+#endif
 
 // these are implemented in [gl,sw]_models.c
 typedef int (*mod_load_t)(model_t *, const void *, size_t, const char*);
@@ -35,7 +35,9 @@ void    Sys_FreeLibrary(void *handle);
 void    *Sys_GetProcAddress(void *handle, const char *sym);
 
 unsigned Sys_Milliseconds(void);
+uint64_t Sys_Microseconds(void);
 void     Sys_Sleep(int msec);
+int      Sys_NumCPUs(void);
 
 void    Sys_Init(void);
 void    Sys_AddDefaultConfig(void);
@@ -167,6 +167,17 @@ typedef struct {
 #define CL_KEYLERPFRAC  cl.lerpfrac
 #endif
 
+#define MAX_PREDICT_ENTITIES    64
+
+// solid entity state that player movement depends on
+typedef struct {
+    int         number;
+    int         solid;
+    int         modelindex;
+    vec3_t      origin;
+    vec3_t      angles;
+} predict_entity_t;
+
 //
 // the client_state_t structure is wiped completely at every
 // server map change
@@ -195,6 +206,20 @@ typedef struct client_state_s {
     vec3_t      predicted_velocity;
     vec3_t      prediction_error;
 
+    // results of previously predicted cmds, reused while server
+    // acknowledges the predicted states and nearby entities don't change
+    struct {
+        bool                valid;
+        unsigned            base, last;     // cmds (base, last] are cached
+        int                 serverframe;    // frame cache was validated against
+        pmove_state_t       states[CMD_BACKUP];
+        vec3_t              viewangles[CMD_BACKUP];
+        vec3_t              bounds[CMD_BACKUP][2];  // area each move may touch
+        vec3_t              mins, maxs;     // area covered by entity list
+        int                 numentities;    // -1 if moves left the area
+        predict_entity_t    entities[MAX_PREDICT_ENTITIES];
+    } predict;
+
     // rebuilt each valid frame
     centity_t       *solidEntities[MAX_PACKET_ENTITIES];
     int             numSolidEntities;
@@ -430,6 +455,7 @@ typedef struct client_static_s {
     netchan_t   netchan;
     int         serverProtocol;     // in case we are doing some kind of version hack
     int         protocolVersion;    // minor version
+    bool        packedEntities;     // server acknowledged packed entity deltas
 
     int         challenge;          // from the server to use for connecting
 
@@ -463,6 +489,8 @@ typedef struct client_static_s {
         qhandle_t   recording;
         unsigned    time_start;
         unsigned    time_frames;
+        uint64_t    time_bytes;         // bytes of server messages parsed during timedemo
+        uint64_t    time_parse;         // microseconds spent parsing them
         int         last_server_frame;  // number of server frame the last svc_frame was written
         int         frames_written;     // number of frames written to demo file
         int         frames_dropped;     // number of svc_frames that didn't fit
@@ -807,6 +835,7 @@ void CL_InitTEnts(void);
 //
 // predict.c
 //
+void CL_InitPrediction(void);
 void CL_PredictAngles(void);
 void CL_PredictMovement(void);
 void CL_CheckPredictionError(void);
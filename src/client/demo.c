@@ -28,6 +28,14 @@ static cvar_t   *cl_demosnaps;
 static cvar_t   *cl_demomsglen;
 static cvar_t   *cl_demowait;
 static cvar_t   *cl_demosuspendtoggle;
+static cvar_t   *cl_demokeyframes;
+static cvar_t   *cl_demokeycache;
+
+#if USE_ZLIB
+static void emit_keyframe(void);
+#else
+#define emit_keyframe()     (void)0
+#endif
 
 // =========================================================================
 
@@ -64,6 +72,7 @@ bool CL_WriteDemoMessage(sizebuf_t *buf)
     Com_DDPrintf("%s: wrote %zu bytes\n", __func__, buf->cursize);
 
     SZ_Clear(buf);
+    emit_keyframe();
     return true;
 
 fail:
@@ -178,6 +187,519 @@ static void emit_delta_frame(server_frame_t *from, server_frame_t *to,
 #define FRAME_PRE   (cls.demo.frames_written)
 #define FRAME_CUR   (cls.demo.frames_written + 1)
 
+/*
+Demo keyframes.
+
+When cl_demokeyframes is set, the recorder periodically saves the same kind
+of state snapshot that CL_EmitDemoSnapshot builds during playback. Keyframes
+are deflated, each using the previous one as preset dictionary except every
+KEYFRAME_GROUP-th, and appended after the EOF marker together with an index.
+Other demo players stop reading at the marker.
+
+On playback, the index is used instead of building snapshots. Keyframes are
+read from the file on demand and kept decompressed in a LRU cache limited to
+cl_demokeycache kilobytes.
+*/
+
+#if USE_ZLIB
+
+#define KEYFRAME_MAGIC      MakeRawLong('D','M','K','1')
+#define KEYFRAME_GROUP      16
+#define KEYFRAME_MAXLEN     0x100000
+#define KEYFRAME_MAXCOUNT   0x100000
+
+#define KEYFRAME_DICT       1   // compressed against previous keyframe
+
+// index entry, little endian on disk
+typedef struct {
+    int32_t     framenum;
+    uint32_t    filepos;
+    uint32_t    offset;
+    uint32_t    complen;
+    uint32_t    msglen;
+    uint32_t    flags;
+} demokey_t;
+
+typedef struct {
+    list_t      entry;
+    int         index;
+    demosnap_t  snap;
+} keycache_t;
+
+static struct {
+    char        (*baseconfigstrings)[MAX_QPATH];
+    int         last_keyframe;
+    demokey_t   *index;
+    int         count;
+    byte        *data;          // compressed keyframes
+    size_t      datalen;
+    byte        *prev;          // uncompressed previous keyframe
+    size_t      prevlen;
+} keyrec;
+
+static struct {
+    demokey_t   *index;
+    int         count;
+    list_t      cache;
+    size_t      cachesize;
+} keyplay = { .cache = { &keyplay.cache, &keyplay.cache } };
+
+static void start_keyframes(unsigned mode)
+{
+    if (cl_demokeyframes->integer <= 0)
+        return;
+
+    // can't seek in compressed files efficiently
+    if (mode & FS_FLAG_GZIP)
+        return;
+
+    keyrec.baseconfigstrings = Z_Malloc(sizeof(cl.configstrings));
+    keyrec.last_keyframe = INT_MIN;
+}
+
+// called once the first frame is written, at the same point where
+// CL_FirstDemoFrame saves base configstrings on playback
+static void save_keyframe_base(void)
+{
+    if (keyrec.baseconfigstrings)
+        memcpy(keyrec.baseconfigstrings, cl.configstrings, sizeof(cl.configstrings));
+}
+
+static void compress_keyframe(int64_t pos)
+{
+    z_stream z;
+    demokey_t *key;
+    size_t bound;
+    bool dict;
+    int ret;
+
+    memset(&z, 0, sizeof(z));
+    if (deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 9,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+        return;
+
+    dict = keyrec.count % KEYFRAME_GROUP && keyrec.prev;
+    if (dict)
+        deflateSetDictionary(&z, keyrec.prev, keyrec.prevlen);
+
+    bound = deflateBound(&z, msg_write.cursize);
+    keyrec.data = Z_Realloc(keyrec.data, ALIGN(keyrec.datalen + bound, 0x10000));
+
+    z.next_in = msg_write.data;
+    z.avail_in = msg_write.cursize;
+    z.next_out = keyrec.data + keyrec.datalen;
+    z.avail_out = bound;
+
+    ret = deflate(&z, Z_FINISH);
+    deflateEnd(&z);
+
+    if (ret != Z_STREAM_END) {
+        Com_WPrintf("Error %d compressing demo keyframe\n", ret);
+        return;
+    }
+
+    keyrec.index = Z_Realloc(keyrec.index, sizeof(keyrec.index[0]) * ALIGN(keyrec.count + 1, 64));
+    key = &keyrec.index[keyrec.count++];
+    key->framenum = cls.demo.frames_written;
+    key->filepos = pos;
+    key->offset = keyrec.datalen;
+    key->complen = z.total_out;
+    key->msglen = msg_write.cursize;
+    key->flags = dict ? KEYFRAME_DICT : 0;
+
+    keyrec.datalen += z.total_out;
+
+    keyrec.prev = Z_Realloc(keyrec.prev, msg_write.cursize);
+    keyrec.prevlen = msg_write.cursize;
+    memcpy(keyrec.prev, msg_write.data, msg_write.cursize);
+
+    Com_DPrintf("[%d] keyframe %zu bytes, %u compressed%s\n", key->framenum,
+                msg_write.cursize, key->complen, dict ? " (delta)" : "");
+}
+
+/*
+====================
+emit_keyframe
+
+Called after each demo message is written. Builds a fake demo packet with
+the last written frame, configstrings and layout, similar to
+CL_EmitDemoSnapshot.
+====================
+*/
+static void emit_keyframe(void)
+{
+    server_frame_t *frame;
+    int64_t pos;
+    char *from, *to;
+    size_t len;
+    int i;
+
+    if (!keyrec.baseconfigstrings || cls.demo.last_server_frame == -1)
+        return;
+
+    if (cl_demokeyframes->integer <= 0)
+        return;
+
+    if (cls.demo.frames_written < keyrec.last_keyframe + cl_demokeyframes->integer * 10)
+        return;
+
+    if (keyrec.count >= KEYFRAME_MAXCOUNT || msg_write.cursize)
+        return;
+
+    frame = &cl.frames[cls.demo.last_server_frame & UPDATE_MASK];
+    if (frame->number != cls.demo.last_server_frame || !frame->valid ||
+        cl.numEntityStates - frame->firstEntity > MAX_PARSE_ENTITIES)
+        return;
+
+    // index uses 32-bit offsets
+    pos = FS_Tell(cls.demo.recording);
+    if (pos <= 0 || pos + keyrec.datalen > INT32_MAX)
+        return;
+
+    // next demo frame is delta compressed from this one
+    emit_delta_frame(NULL, frame, -1, FRAME_PRE);
+
+    // write configstrings
+    for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
+        from = keyrec.baseconfigstrings[i];
+        to = cl.configstrings[i];
+
+        if (!strcmp(from, to))
+            continue;
+
+        len = Q_strnlen(to, MAX_QPATH);
+        if (msg_write.cursize + len + 4 > msg_write.maxsize)
+            goto overflow;
+
+        MSG_WriteByte(svc_configstring);
+        MSG_WriteShort(i);
+        MSG_WriteData(to, len);
+        MSG_WriteByte(0);
+    }
+
+    // write layout
+    len = strlen(cl.layout);
+    if (msg_write.cursize + len + 2 > msg_write.maxsize)
+        goto overflow;
+
+    MSG_WriteByte(svc_layout);
+    MSG_WriteString(cl.layout);
+
+    compress_keyframe(pos);
+    keyrec.last_keyframe = cls.demo.frames_written;
+    SZ_Clear(&msg_write);
+    return;
+
+overflow:
+    Com_DPrintf("[%d] keyframe overflowed\n", cls.demo.frames_written);
+    keyrec.last_keyframe = cls.demo.frames_written;
+    SZ_Clear(&msg_write);
+}
+
+// stop taking keyframes, configstrings are reset on level change
+static void stop_keyframes(void)
+{
+    Z_Freep((void **)&keyrec.baseconfigstrings);
+}
+
+// appends keyframes and index after the EOF marker
+static void finish_keyframes(qhandle_t f, int64_t end)
+{
+    uint32_t trailer[4];
+    int64_t base, indexofs;
+    demokey_t *key;
+    int i, ret;
+
+    if (!keyrec.count)
+        goto done;
+
+    base = FS_Tell(f);
+    indexofs = base + keyrec.datalen;
+    if (base <= 0 || indexofs > INT32_MAX)
+        goto done;
+
+    ret = FS_Write(keyrec.data, keyrec.datalen, f);
+    if (ret != keyrec.datalen)
+        goto fail;
+
+    for (i = 0, key = keyrec.index; i < keyrec.count; i++, key++) {
+        key->framenum = LittleLong(key->framenum);
+        key->filepos = LittleLong(key->filepos);
+        key->offset = LittleLong(key->offset + base);
+        key->complen = LittleLong(key->complen);
+        key->msglen = LittleLong(key->msglen);
+        key->flags = LittleLong(key->flags);
+    }
+
+    ret = FS_Write(keyrec.index, sizeof(keyrec.index[0]) * keyrec.count, f);
+    if (ret != sizeof(keyrec.index[0]) * keyrec.count)
+        goto fail;
+
+    trailer[0] = LittleLong(keyrec.count);
+    trailer[1] = LittleLong(indexofs);
+    trailer[2] = LittleLong(end);
+    trailer[3] = KEYFRAME_MAGIC;
+
+    ret = FS_Write(trailer, sizeof(trailer), f);
+    if (ret != sizeof(trailer))
+        goto fail;
+
+    Com_DPrintf("Wrote %d keyframes, %zu bytes\n", keyrec.count, keyrec.datalen);
+    goto done;
+
+fail:
+    Com_EPrintf("Couldn't write demo keyframes: %s\n", Q_ErrorString(ret));
+done:
+    Z_Free(keyrec.baseconfigstrings);
+    Z_Free(keyrec.index);
+    Z_Free(keyrec.data);
+    Z_Free(keyrec.prev);
+    memset(&keyrec, 0, sizeof(keyrec));
+}
+
+static void free_keyframes(void)
+{
+    keycache_t *kc, *next;
+
+    LIST_FOR_EACH_SAFE(keycache_t, kc, next, &keyplay.cache, entry)
+        Z_Free(kc);
+
+    List_Init(&keyplay.cache);
+    keyplay.cachesize = 0;
+
+    Z_Freep((void **)&keyplay.index);
+    keyplay.count = 0;
+}
+
+/*
+====================
+load_keyframes
+
+Loads keyframe index from the end of demo file. Returns offset of the EOF
+marker if found, otherwise length of the file.
+====================
+*/
+static int64_t load_keyframes(qhandle_t f, int64_t len, int64_t ofs)
+{
+    uint32_t trailer[4];
+    uint32_t count, indexofs, end;
+    demokey_t *key;
+    int i;
+
+    free_keyframes();
+
+    if (len < ofs + sizeof(trailer) || len > INT32_MAX)
+        return len;
+
+    if (FS_Seek(f, len - sizeof(trailer), SEEK_SET) < 0)
+        goto fail;
+    if (FS_Read(trailer, sizeof(trailer), f) != sizeof(trailer))
+        goto fail;
+    if (trailer[3] != KEYFRAME_MAGIC)
+        goto fail;
+
+    count = LittleLong(trailer[0]);
+    indexofs = LittleLong(trailer[1]);
+    end = LittleLong(trailer[2]);
+    if (!count || count > KEYFRAME_MAXCOUNT)
+        goto fail;
+    if (indexofs + (uint64_t)count * sizeof(*key) != len - sizeof(trailer))
+        goto fail;
+    if (end < ofs || end + 4 > indexofs)
+        goto fail;
+
+    keyplay.index = Z_Malloc(sizeof(*key) * count);
+    if (FS_Seek(f, indexofs, SEEK_SET) < 0)
+        goto fail;
+    if (FS_Read(keyplay.index, sizeof(*key) * count, f) != sizeof(*key) * count)
+        goto fail;
+
+    for (i = 0; i < count; i++) {
+        key = &keyplay.index[keyplay.count];
+        key->framenum = LittleLong(keyplay.index[i].framenum);
+        key->filepos = LittleLong(keyplay.index[i].filepos);
+        key->offset = LittleLong(keyplay.index[i].offset);
+        key->complen = LittleLong(keyplay.index[i].complen);
+        key->msglen = LittleLong(keyplay.index[i].msglen);
+        key->flags = LittleLong(keyplay.index[i].flags);
+
+        if (key->offset < end + 4 || key->complen > indexofs - key->offset ||
+            key->msglen > KEYFRAME_MAXLEN || key->filepos > end)
+            goto fail;
+
+        if (keyplay.count && (key->framenum <= key[-1].framenum ||
+                              key->filepos <= key[-1].filepos))
+            goto fail;
+
+        // skip keyframes of previous levels
+        if (key->filepos < ofs)
+            continue;
+
+        // first keyframe must be self-contained
+        if (!keyplay.count && (key->flags & KEYFRAME_DICT))
+            continue;
+
+        keyplay.count++;
+    }
+
+    // keyframes are only recorded for the first level, but demo data of
+    // later levels still ends at the EOF marker
+    if (keyplay.count)
+        Com_DPrintf("Loaded %d demo keyframes\n", keyplay.count);
+    else
+        free_keyframes();
+
+    FS_Seek(f, ofs, SEEK_SET);
+    return end;
+
+fail:
+    free_keyframes();
+    FS_Seek(f, ofs, SEEK_SET);
+    return len;
+}
+
+static keycache_t *find_cached_keyframe(int index)
+{
+    keycache_t *kc;
+
+    LIST_FOR_EACH(keycache_t, kc, &keyplay.cache, entry) {
+        if (kc->index == index) {
+            // move to front
+            List_Remove(&kc->entry);
+            List_Insert(&keyplay.cache, &kc->entry);
+            return kc;
+        }
+    }
+
+    return NULL;
+}
+
+static keycache_t *read_keyframe(int index, const keycache_t *prev)
+{
+    const demokey_t *key = &keyplay.index[index];
+    qhandle_t f = cls.demo.playback;
+    int64_t pos = FS_Tell(f);
+    keycache_t *kc = NULL;
+    byte *data;
+    z_stream z;
+    int ret;
+
+    data = Z_Malloc(key->complen);
+    if (FS_Seek(f, key->offset, SEEK_SET) < 0 ||
+        FS_Read(data, key->complen, f) != key->complen) {
+        Com_EPrintf("Couldn't read demo keyframe\n");
+        goto done;
+    }
+
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, -MAX_WBITS) != Z_OK)
+        goto done;
+
+    if (key->flags & KEYFRAME_DICT)
+        inflateSetDictionary(&z, prev->snap.data, prev->snap.msglen);
+
+    kc = Z_Malloc(sizeof(*kc) + key->msglen - 1);
+    z.next_in = data;
+    z.avail_in = key->complen;
+    z.next_out = kc->snap.data;
+    z.avail_out = key->msglen;
+
+    ret = inflate(&z, Z_FINISH);
+    inflateEnd(&z);
+
+    if (ret != Z_STREAM_END || z.total_out != key->msglen) {
+        Com_EPrintf("Error %d decompressing demo keyframe\n", ret);
+        Z_Freep((void **)&kc);
+        goto done;
+    }
+
+    kc->index = index;
+    kc->snap.framenum = key->framenum;
+    kc->snap.filepos = key->filepos;
+    kc->snap.msglen = key->msglen;
+    List_Insert(&keyplay.cache, &kc->entry);
+    keyplay.cachesize += key->msglen;
+
+done:
+    Z_Free(data);
+    FS_Seek(f, pos, SEEK_SET);
+    return kc;
+}
+
+static demosnap_t *get_keyframe(int index)
+{
+    keycache_t *kc, *prev;
+    size_t budget;
+    int i;
+
+    // walk back to cached or self-contained keyframe
+    for (i = index; i > 0; i--) {
+        if (find_cached_keyframe(i))
+            break;
+        if (!(keyplay.index[i].flags & KEYFRAME_DICT))
+            break;
+    }
+
+    // decompress the chain up to requested keyframe
+    for (prev = NULL; i <= index; i++, prev = kc) {
+        kc = find_cached_keyframe(i);
+        if (!kc)
+            kc = read_keyframe(i, prev);
+        if (!kc)
+            return NULL;
+    }
+
+    // evict least recently used
+    budget = Cvar_ClampInteger(cl_demokeycache, 0, 1 << 20) * 1024;
+    while (keyplay.cachesize > budget) {
+        kc = LIST_LAST(keycache_t, &keyplay.cache, entry);
+        if (kc == prev)
+            break;
+        List_Remove(&kc->entry);
+        keyplay.cachesize -= kc->snap.msglen;
+        Z_Free(kc);
+    }
+
+    return &prev->snap;
+}
+
+static inline bool have_keyframes(void)
+{
+    return keyplay.count > 0;
+}
+
+// returns the most recent keyframe not past the destination
+static demosnap_t *find_keyframe(int64_t dest, bool byte_seek)
+{
+    int l = 0;
+    int r = keyplay.count - 1;
+
+    while (l <= r) {
+        int m = (l + r) / 2;
+        demokey_t *key = &keyplay.index[m];
+        int64_t pos = byte_seek ? key->filepos : key->framenum;
+        if (pos <= dest)
+            l = m + 1;
+        else
+            r = m - 1;
+    }
+
+    return get_keyframe(max(r, 0));
+}
+
+#else
+
+#define start_keyframes(mode)           (void)0
+#define save_keyframe_base()            (void)0
+#define stop_keyframes()                (void)0
+#define finish_keyframes(f, end)        (void)0
+#define free_keyframes()                (void)0
+#define load_keyframes(f, len, ofs)     (len)
+#define find_keyframe(dest, byte_seek)  NULL
+#define have_keyframes()                false
+
+#endif
+
 /*
 ====================
 CL_EmitDemoFrame
@@ -224,11 +746,14 @@ void CL_EmitDemoFrame(void)
         SZ_Write(&cls.demo.buffer, msg_write.data, msg_write.cursize);
         cls.demo.last_server_frame = cl.frame.number;
         cls.demo.frames_written++;
+        if (cls.demo.frames_written == 1)
+            save_keyframe_base();
     }
 
     SZ_Clear(&msg_write);
 }
 
+
 static size_t format_demo_size(char *buffer, size_t size)
 {
     return Com_FormatSizeLong(buffer, size, FS_Tell(cls.demo.recording));
@@ -270,6 +795,7 @@ stop recording a demo
 void CL_Stop_f(void)
 {
     uint32_t msglen;
+    int64_t end;
     char buffer[MAX_QPATH];
 
     if (!cls.demo.recording) {
@@ -278,9 +804,13 @@ void CL_Stop_f(void)
     }
 
 // finish up
+    end = FS_Tell(cls.demo.recording);
     msglen = (uint32_t)-1;
     FS_Write(&msglen, 4, cls.demo.recording);
 
+// append keyframes after the EOF marker
+    finish_keyframes(cls.demo.recording, end);
+
     format_demo_size(buffer, sizeof(buffer));
 
 // close demofile
@@ -382,6 +912,8 @@ static void CL_Record_f(void)
     cls.demo.recording = f;
     cls.demo.paused = false;
 
+    start_keyframes(mode);
+
     // the first frame will be delta uncompressed
     cls.demo.last_server_frame = -1;
 
@@ -675,7 +1207,14 @@ static int parse_next_message(int wait)
         return -1;
     }
 
-    CL_ParseServerMessage();
+    if (com_timedemo->integer) {
+        uint64_t start = Sys_Microseconds();
+        CL_ParseServerMessage();
+        cls.demo.time_parse += Sys_Microseconds() - start;
+        cls.demo.time_bytes += msg_read.cursize;
+    } else {
+        CL_ParseServerMessage();
+    }
 
     // if recording demo, write the message out
     if (cls.demo.recording && !cls.demo.paused && CL_FRAMESYNC) {
@@ -783,6 +1322,10 @@ void CL_EmitDemoSnapshot(void)
     if (cl_demosnaps->integer <= 0)
         return;
 
+    // demo has recorded keyframes
+    if (have_keyframes())
+        return;
+
     if (cls.demo.frames_read < cls.demo.last_snapshot + cl_demosnaps->integer * 10)
         return;
 
@@ -894,6 +1437,7 @@ void CL_FirstDemoFrame(void)
     len = FS_Length(cls.demo.playback);
     ofs = FS_Tell(cls.demo.playback);
     if (ofs > 0 && ofs < len) {
+        len = load_keyframes(cls.demo.playback, len, ofs);
         cls.demo.file_offset = ofs;
         cls.demo.file_size = len - ofs;
     }
@@ -907,6 +1451,8 @@ void CL_FirstDemoFrame(void)
         }
 
         cls.demo.time_frames = 0;
+        cls.demo.time_bytes = 0;
+        cls.demo.time_parse = 0;
         cls.demo.time_start = Sys_Milliseconds();
     }
 
@@ -926,6 +1472,9 @@ void CL_FreeDemoSnapshots(void)
     cls.demo.numsnapshots = 0;
 
     Z_Freep((void**)&cls.demo.snapshots);
+
+    free_keyframes();
+    stop_keyframes();
 }
 
 /*
@@ -1023,42 +1572,48 @@ static void CL_Seek_f(void)
     Com_DPrintf("[%d] seeking to %"PRId64"\n", cls.demo.frames_read, dest);
 
     // seek to the previous most recent snapshot
-    if (back_seek || cls.demo.last_snapshot > cls.demo.frames_read) {
+    snap = NULL;
+    if (have_keyframes()) {
+        // recorded keyframes allow skipping forward too
+        snap = find_keyframe(dest, byte_seek);
+        if (snap && !back_seek && snap->framenum <= cls.demo.frames_read)
+            snap = NULL;
+    } else if (back_seek || cls.demo.last_snapshot > cls.demo.frames_read) {
         snap = find_snapshot(dest, byte_seek);
+    }
 
-        if (snap) {
-            Com_DPrintf("found snap at %d\n", snap->framenum);
-            ret = FS_Seek(cls.demo.playback, snap->filepos, SEEK_SET);
-            if (ret < 0) {
-                Com_EPrintf("Couldn't seek demo: %s\n", Q_ErrorString(ret));
-                goto done;
-            }
+    if (snap) {
+        Com_DPrintf("found snap at %d\n", snap->framenum);
+        ret = FS_Seek(cls.demo.playback, snap->filepos, SEEK_SET);
+        if (ret < 0) {
+            Com_EPrintf("Couldn't seek demo: %s\n", Q_ErrorString(ret));
+            goto done;
+        }
 
-            // clear end-of-file flag
-            cls.demo.eof = false;
+        // clear end-of-file flag
+        cls.demo.eof = false;
 
-            // reset configstrings
-            for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
-                from = cl.baseconfigstrings[i];
-                to = cl.configstrings[i];
+        // reset configstrings
+        for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
+            from = cl.baseconfigstrings[i];
+            to = cl.configstrings[i];
 
-                if (!strcmp(from, to))
-                    continue;
+            if (!strcmp(from, to))
+                continue;
 
-                Q_SetBit(cl.dcs, i);
-                strcpy(to, from);
-            }
+            Q_SetBit(cl.dcs, i);
+            strcpy(to, from);
+        }
 
-            SZ_Init(&msg_read, snap->data, snap->msglen);
-            msg_read.cursize = snap->msglen;
+        SZ_Init(&msg_read, snap->data, snap->msglen);
+        msg_read.cursize = snap->msglen;
 
-            CL_SeekDemoMessage();
-            cls.demo.frames_read = snap->framenum;
-            Com_DPrintf("[%d] after snap parse %d\n", cls.demo.frames_read, cl.frame.number);
-        } else if (back_seek) {
-            Com_Printf("Couldn't seek backwards without snapshots!\n");
-            goto done;
-        }
+        CL_SeekDemoMessage();
+        cls.demo.frames_read = snap->framenum;
+        Com_DPrintf("[%d] after snap parse %d\n", cls.demo.frames_read, cl.frame.number);
+    } else if (back_seek) {
+        Com_Printf("Couldn't seek backwards without snapshots!\n");
+        goto done;
     }
 
     // skip forward to destination frame/position
@@ -1244,6 +1799,13 @@ void CL_CleanupDemos(void)
             if (msec > cls.demo.time_start) {
                 cls.timedemo.results[cls.timedemo.run_current] = msec - cls.demo.time_start;
 
+                if (cls.demo.time_parse) {
+                    double mb = cls.demo.time_bytes / (1024.0 * 1024.0);
+                    double sec = cls.demo.time_parse * 1e-6;
+
+                    Com_Printf("%.2f MB parsed, %3.2f seconds: %.1f MB/s\n", mb, sec, mb / sec);
+                }
+
                 cls.timedemo.run_current++;
                 if (cls.timedemo.run_current >= cls.timedemo.runs_total) {
                     // Print timedemo results
@@ -1332,6 +1894,8 @@ void CL_InitDemos(void)
     cl_demomsglen = Cvar_Get("cl_demomsglen", va("%d", MAX_PACKETLEN_WRITABLE_DEFAULT), 0);
     cl_demowait = Cvar_Get("cl_demowait", "0", 0);
     cl_demosuspendtoggle = Cvar_Get("cl_demosuspendtoggle", "1", 0);
+    cl_demokeyframes = Cvar_Get("cl_demokeyframes", "0", 0);
+    cl_demokeycache = Cvar_Get("cl_demokeycache", "4096", 0);
 
     Cmd_Register(c_demo);
 }
@@ -444,7 +444,7 @@ void CL_CheckForResend(void)
         cls.quakePort = net_qport->integer & 0xff;
         break;
     case PROTOCOL_VERSION_Q2PRO:
-        Q_snprintf(tail, sizeof(tail), " %d %d %d %d",
+        Q_snprintf(tail, sizeof(tail), " %d %d %d %d 1",
                    maxmsglen, net_chantype->integer, USE_ZLIB,
                    PROTOCOL_VERSION_Q2PRO_CURRENT);
         cls.quakePort = net_qport->integer & 0xff;
@@ -724,6 +724,7 @@ void CL_Disconnect(error_type_t type)
     //cls.connect_time = 0;
     //cls.connect_count = 0;
     cls.passive = false;
+    cls.packedEntities = false;
 #if USE_ICMP
     cls.errorReceived = false;
 #endif
@@ -1332,6 +1333,7 @@ static void CL_ConnectionlessPacket(void)
         }
 
         mapname[0] = 0;
+        cls.packedEntities = false;
 
         // parse additional parameters
         j = Cmd_Argc();
@@ -1351,6 +1353,8 @@ static void CL_ConnectionlessPacket(void)
                                   "Server returned invalid netchan type");
                     }
                 }
+            } else if (!strncmp(s, "pe=", 3)) {
+                cls.packedEntities = cls.serverProtocol == PROTOCOL_VERSION_Q2PRO && atoi(s + 3);
             } else if (!strncmp(s, "map=", 4)) {
                 Q_strlcpy(mapname, s + 4, sizeof(mapname));
             } else if (!strncmp(s, "dlserver=", 9)) {
@@ -2655,6 +2659,7 @@ static void CL_InitLocal(void)
     CL_InitAscii();
     CL_InitEffects();
     CL_InitTEnts();
+    CL_InitPrediction();
     CL_InitDownloads();
     CL_GTV_Init();
 
@@ -3172,7 +3177,7 @@ unsigned CL_Frame(unsigned msec)
         // everything ticks in sync with refresh
         if (main_extra < main_msec) {
             if (!cl.sendPacketNow) {
-                return 0;
+                return main_msec - main_extra;
             }
             ref_frame = false;
         }
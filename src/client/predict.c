@@ -18,6 +18,25 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "client.h"
 
+// margin around a single move that covers player bbox and all traces
+// made by Pmove
+#define PREDICT_MARGIN  64
+
+// extra room for moves made before the next snapshot arrives
+#define PREDICT_SLACK   192
+
+static cvar_t   *cl_predict_cache;
+
+static struct {
+    unsigned    moves;      // Pmove calls for acknowledged cmds
+    unsigned    reused;     // snapshots that kept cached moves
+    unsigned    rebuilt;    // cmds re-simulated from server state
+    unsigned    checked;    // server frames compared with prediction
+    unsigned    misses;     // prediction errors
+    unsigned    mismatches; // cached results that differ from full run
+    float       error_total, error_max;
+} predict_stats;
+
 /*
 ===================
 CL_CheckPredictionError
@@ -51,12 +70,17 @@ void CL_CheckPredictionError(void)
 
     // save the prediction error for interpolation
     len = abs(delta[0]) + abs(delta[1]) + abs(delta[2]);
+    predict_stats.checked++;
     if (len < 1 || len > 640) {
         // > 80 world units is a teleport or something
         VectorClear(cl.prediction_error);
         return;
     }
 
+    predict_stats.misses++;
+    predict_stats.error_total += len * 0.125f;
+    predict_stats.error_max = max(predict_stats.error_max, len * 0.125f);
+
     SHOWMISS("prediction miss on %i: %i (%d %d %d)\n",
              cl.frame.number, len, delta[0], delta[1], delta[2]);
 
@@ -172,11 +196,216 @@ void CL_PredictAngles(void)
     cl.predicted_angles[2] = cl.viewangles[2] + SHORT2ANGLE(cl.frame.ps.pmove.delta_angles[2]);
 }
 
+static bool pmove_state_equal(const pmove_state_t *a, const pmove_state_t *b)
+{
+    return a->pm_type == b->pm_type
+        && VectorCompare(a->origin, b->origin)
+        && VectorCompare(a->velocity, b->velocity)
+        && a->pm_flags == b->pm_flags
+        && a->pm_time == b->pm_time
+        && a->gravity == b->gravity
+        && VectorCompare(a->delta_angles, b->delta_angles);
+}
+
+static bool entity_bounds(const centity_t *ent, vec3_t mins, vec3_t maxs)
+{
+    const entity_state_t *s = &ent->current;
+    mmodel_t *cmodel;
+    int i;
+
+    if (s->solid != PACKED_BSP) {
+        VectorAdd(s->origin, ent->mins, mins);
+        VectorAdd(s->origin, ent->maxs, maxs);
+        return true;
+    }
+
+    cmodel = cl.model_clip[s->modelindex];
+    if (!cmodel)
+        return false;
+
+    if (VectorEmpty(s->angles)) {
+        VectorAdd(s->origin, cmodel->mins, mins);
+        VectorAdd(s->origin, cmodel->maxs, maxs);
+    } else {
+        for (i = 0; i < 3; i++) {
+            mins[i] = s->origin[i] - cmodel->radius;
+            maxs[i] = s->origin[i] + cmodel->radius;
+        }
+    }
+
+    return true;
+}
+
+// returns -1 if there are too many entities to track
+static int collect_entities(predict_entity_t *list, const vec3_t mins, const vec3_t maxs)
+{
+    const centity_t *ent;
+    predict_entity_t *p;
+    vec3_t emins, emaxs;
+    int i, count = 0;
+
+    for (i = 0; i < cl.numSolidEntities; i++) {
+        ent = cl.solidEntities[i];
+
+        if (!entity_bounds(ent, emins, emaxs))
+            continue;
+
+        if (emins[0] > maxs[0] || emins[1] > maxs[1] || emins[2] > maxs[2] ||
+            emaxs[0] < mins[0] || emaxs[1] < mins[1] || emaxs[2] < mins[2])
+            continue;
+
+        if (count == MAX_PREDICT_ENTITIES)
+            return -1;
+
+        p = &list[count++];
+        p->number = ent->current.number;
+        p->solid = ent->current.solid;
+        p->modelindex = ent->current.modelindex;
+        VectorCopy(ent->current.origin, p->origin);
+        VectorCopy(ent->current.angles, p->angles);
+    }
+
+    return count;
+}
+
+// recalculates area covered by cached moves and records entities within it
+static void update_predict_area(void)
+{
+    const pmove_state_t *base = &cl.predict.states[cl.predict.base & CMD_MASK];
+    unsigned num;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        cl.predict.mins[i] = base->origin[i] * 0.125f - PREDICT_MARGIN;
+        cl.predict.maxs[i] = base->origin[i] * 0.125f + PREDICT_MARGIN;
+    }
+
+    for (num = cl.predict.base + 1; num - cl.predict.base <= cl.predict.last - cl.predict.base; num++) {
+        AddPointToBounds(cl.predict.bounds[num & CMD_MASK][0], cl.predict.mins, cl.predict.maxs);
+        AddPointToBounds(cl.predict.bounds[num & CMD_MASK][1], cl.predict.mins, cl.predict.maxs);
+    }
+
+    for (i = 0; i < 3; i++) {
+        cl.predict.mins[i] -= PREDICT_SLACK;
+        cl.predict.maxs[i] += PREDICT_SLACK;
+    }
+
+    cl.predict.numentities = collect_entities(cl.predict.entities, cl.predict.mins, cl.predict.maxs);
+}
+
+// checks if cached moves are still valid after new server frame arrived
+static bool validate_predict_cache(unsigned ack, const pmove_state_t *base)
+{
+    predict_entity_t entities[MAX_PREDICT_ENTITIES];
+    int numentities;
+
+    if (!cl.predict.valid)
+        return false;
+
+    // must have been predicted from the same server state
+    if (ack - cl.predict.base > cl.predict.last - cl.predict.base)
+        return false;
+    if (!pmove_state_equal(base, &cl.predict.states[ack & CMD_MASK]))
+        return false;
+
+    // entities moves could have touched must not have changed
+    if (cl.predict.numentities < 0)
+        return false;
+    numentities = collect_entities(entities, cl.predict.mins, cl.predict.maxs);
+    if (numentities != cl.predict.numentities)
+        return false;
+    if (memcmp(entities, cl.predict.entities, numentities * sizeof(entities[0])))
+        return false;
+
+    return true;
+}
+
+static void predict_cmd(pmove_t *pm, unsigned num)
+{
+    vec_t *mins = cl.predict.bounds[num & CMD_MASK][0];
+    vec_t *maxs = cl.predict.bounds[num & CMD_MASK][1];
+    vec3_t start, end;
+    int i;
+
+    // bound the origin before and after the move, and where the
+    // velocity would have taken it
+    VectorScale(pm->s.origin, 0.125f, start);
+    VectorMA(start, cl.cmds[num & CMD_MASK].msec * 0.001f * 0.125f, pm->s.velocity, end);
+    ClearBounds(mins, maxs);
+    AddPointToBounds(start, mins, maxs);
+    AddPointToBounds(end, mins, maxs);
+
+    pm->cmd = cl.cmds[num & CMD_MASK];
+    Pmove(pm, &cl.pmp);
+    predict_stats.moves++;
+
+    VectorScale(pm->s.origin, 0.125f, end);
+    AddPointToBounds(end, mins, maxs);
+    for (i = 0; i < 3; i++) {
+        mins[i] -= PREDICT_MARGIN;
+        maxs[i] += PREDICT_MARGIN;
+    }
+
+    // can't verify entities if moved out of tracked area
+    if (mins[0] < cl.predict.mins[0] || mins[1] < cl.predict.mins[1] || mins[2] < cl.predict.mins[2] ||
+        maxs[0] > cl.predict.maxs[0] || maxs[1] > cl.predict.maxs[1] || maxs[2] > cl.predict.maxs[2])
+        cl.predict.numentities = -1;
+
+    cl.predict.states[num & CMD_MASK] = pm->s;
+    VectorCopy(pm->viewangles, cl.predict.viewangles[num & CMD_MASK]);
+
+    // save for debug checking
+    VectorCopy(pm->s.origin, cl.predicted_origins[num & CMD_MASK]);
+}
+
+static void predict_pending_cmd(pmove_t *pm)
+{
+    pm->cmd = cl.cmd;
+    pm->cmd.forwardmove = cl.localmove[0];
+    pm->cmd.sidemove = cl.localmove[1];
+    pm->cmd.upmove = cl.localmove[2];
+    Pmove(pm, &cl.pmp);
+}
+
+static void init_pmove(pmove_t *pm, const pmove_state_t *s)
+{
+    memset(pm, 0, sizeof(*pm));
+    pm->trace = CL_PMTrace;
+    pm->pointcontents = CL_PointContents;
+    pm->s = *s;
+}
+
+// runs all cmds from server state and compares with cached result
+static void verify_prediction(const pmove_t *result, unsigned ack, const pmove_state_t *base)
+{
+    pmove_t pm;
+
+    init_pmove(&pm, base);
+
+    while (++ack <= cl.cmdNumber) {
+        pm.cmd = cl.cmds[ack & CMD_MASK];
+        Pmove(&pm, &cl.pmp);
+    }
+
+    if (cl.cmd.msec) {
+        predict_pending_cmd(&pm);
+    } else {
+        VectorCopy(result->viewangles, pm.viewangles);
+    }
+
+    if (!pmove_state_equal(&pm.s, &result->s) || !VectorCompare(pm.viewangles, result->viewangles)) {
+        SHOWMISS("%i: cached prediction mismatch\n", cl.frame.number);
+        predict_stats.mismatches++;
+    }
+}
+
 void CL_PredictMovement(void)
 {
     unsigned    ack, current, frame;
+    pmove_state_t   base;
     pmove_t     pm;
     int         step, oldz;
+    bool        rebuild;
 
     if (cls.state != ca_active) {
         return;
@@ -210,40 +439,65 @@ void CL_PredictMovement(void)
         return;
     }
 
-    // copy current state to pmove
-    memset(&pm, 0, sizeof(pm));
-    pm.trace = CL_PMTrace;
-    pm.pointcontents = CL_PointContents;
-
-    pm.s = cl.frame.ps.pmove;
+    // current server state
+    base = cl.frame.ps.pmove;
 #if USE_SMOOTH_DELTA_ANGLES
-    VectorCopy(cl.delta_angles, pm.s.delta_angles);
+    VectorCopy(cl.delta_angles, base.delta_angles);
 #endif
 
-    // run frames
-    while (++ack <= current) {
-        pm.cmd = cl.cmds[ack & CMD_MASK];
-        Pmove(&pm, &cl.pmp);
+    if (!cl_predict_cache->integer) {
+        cl.predict.valid = false;
+    } else if (cl.predict.serverframe != cl.frame.number) {
+        // new server frame, keep cached moves if it agrees with them
+        if (validate_predict_cache(ack, &base)) {
+            cl.predict.base = ack;
+            cl.predict.serverframe = cl.frame.number;
+            predict_stats.reused++;
+        } else {
+            cl.predict.valid = false;
+        }
+    } else if (!pmove_state_equal(&base, &cl.predict.states[cl.predict.base & CMD_MASK])) {
+        cl.predict.valid = false;
+    }
 
-        // save for debug checking
-        VectorCopy(pm.s.origin, cl.predicted_origins[ack & CMD_MASK]);
+    rebuild = !cl.predict.valid;
+    if (rebuild) {
+        // start over from server state
+        cl.predict.valid = true;
+        cl.predict.base = cl.predict.last = ack;
+        cl.predict.serverframe = cl.frame.number;
+        cl.predict.states[ack & CMD_MASK] = base;
+        predict_stats.rebuilt += current - ack;
+    }
+
+    // run cmds not predicted yet
+    init_pmove(&pm, &cl.predict.states[cl.predict.last & CMD_MASK]);
+    while (cl.predict.last != current) {
+        predict_cmd(&pm, ++cl.predict.last);
+    }
+
+    // entities are unchanged since cached moves were made, so it's safe
+    // to record them over an updated area
+    if (rebuild || cl.predict.numentities < 0) {
+        update_predict_area();
     }
 
     // run pending cmd
     if (cl.cmd.msec) {
-        pm.cmd = cl.cmd;
-        pm.cmd.forwardmove = cl.localmove[0];
-        pm.cmd.sidemove = cl.localmove[1];
-        pm.cmd.upmove = cl.localmove[2];
-        Pmove(&pm, &cl.pmp);
+        predict_pending_cmd(&pm);
         frame = current;
 
         // save for debug checking
         VectorCopy(pm.s.origin, cl.predicted_origins[(current + 1) & CMD_MASK]);
     } else {
+        VectorCopy(cl.predict.viewangles[current & CMD_MASK], pm.viewangles);
         frame = current - 1;
     }
 
+    if (cl_predict_cache->integer > 1) {
+        verify_prediction(&pm, ack, &base);
+    }
+
     if (pm.s.pm_type != PM_SPECTATOR && (pm.s.pm_flags & PMF_ON_GROUND)) {
         oldz = cl.predicted_origins[cl.predicted_step_frame & CMD_MASK][2];
         step = pm.s.origin[2] - oldz;
@@ -264,3 +518,26 @@ void CL_PredictMovement(void)
     VectorCopy(pm.viewangles, cl.predicted_angles);
 }
 
+static void CL_PredictStats_f(void)
+{
+    Com_Printf("Moves predicted  : %u\n", predict_stats.moves);
+    Com_Printf("Moves rebuilt    : %u\n", predict_stats.rebuilt);
+    Com_Printf("Frames reused    : %u\n", predict_stats.reused);
+    Com_Printf("Frames checked   : %u\n", predict_stats.checked);
+    Com_Printf("Prediction misses: %u\n", predict_stats.misses);
+    Com_Printf("Average error    : %.3f\n", predict_stats.misses ?
+               predict_stats.error_total / predict_stats.misses : 0.0f);
+    Com_Printf("Maximum error    : %.3f\n", predict_stats.error_max);
+    Com_Printf("Cache mismatches : %u\n", predict_stats.mismatches);
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(&predict_stats, 0, sizeof(predict_stats));
+    }
+}
+
+void CL_InitPrediction(void)
+{
+    cl_predict_cache = Cvar_Get("cl_predict_cache", "1", 0);
+
+    Cmd_AddCommand("predictstats", CL_PredictStats_f);
+}
@@ -45,45 +45,25 @@ SOUND LOADING
 ===============================================================================
 */
 
-#define RESAMPLE \
-    for (i = frac = 0; j = frac >> 8, i < outcount; i++, frac += fracstep)
-
+// samples have already been converted to 16 bit at dma.speed by S_LoadSound
 static sfxcache_t *DMA_UploadSfx(sfx_t *sfx)
 {
-    float stepscale = (float)s_info.rate / dma.speed;   // this is usually 0.5, 1, or 2
-    int i, j, frac, fracstep = stepscale * 256;
-
-    int outcount = s_info.samples / stepscale;
-    if (!outcount) {
-        Com_DPrintf("%s resampled to zero length\n", s_info.name);
-        sfx->error = Q_ERR_TOO_FEW;
-        return NULL;
-    }
+    Q_assert(s_info.rate == dma.speed && s_info.width == 2);
 
-    int size = outcount * s_info.width * s_info.channels;
+    int size = s_info.samples * s_info.width * s_info.channels;
     sfxcache_t *sc = sfx->cache = S_Malloc(sizeof(*sc) + size - 1);
 
-    sc->length = outcount;
-    sc->loopstart = s_info.loopstart == -1 ? -1 : s_info.loopstart / stepscale;
+    sc->length = s_info.samples;
+    sc->loopstart = s_info.loopstart;
     sc->width = s_info.width;
     sc->channels = s_info.channels;
     sc->size = size;
 
-// resample / decimate to the current source rate
-    if (stepscale == 1) // fast special case
-        memcpy(sc->data, s_info.data, size);
-    else if (sc->width == 1 && sc->channels == 1)
-        RESAMPLE sc->data[i] = s_info.data[j];
-    else if (sc->width == 2 && sc->channels == 2)
-        RESAMPLE WL32(sc->data + i * 4, RL32(s_info.data + j * 4));
-    else
-        RESAMPLE ((uint16_t *)sc->data)[i] = ((uint16_t *)s_info.data)[j];
+    memcpy(sc->data, s_info.data, size);
 
     return sc;
 }
 
-#undef RESAMPLE
-
 static void DMA_PageInSfx(sfx_t *sfx)
 {
     sfxcache_t *sc = sfx->cache;
@@ -323,42 +303,6 @@ typedef void (*paintfunc_t)(channel_t *, sfxcache_t *, int, samplepair_t *);
 #define PAINTFUNC(name) \
     static void name(channel_t *ch, sfxcache_t *sc, int count, samplepair_t *samp)
 
-PAINTFUNC(PaintMono8)
-{
-    float leftvol = ch->leftvol * snd_vol * 256;
-    float rightvol = ch->rightvol * snd_vol * 256;
-    uint8_t *sfx = sc->data + ch->pos;
-
-    for (int i = 0; i < count; i++, samp++, sfx++) {
-        samp->left += (*sfx - 128) * leftvol;
-        samp->right += (*sfx - 128) * rightvol;
-    }
-}
-
-PAINTFUNC(PaintStereoDmix8)
-{
-    float leftvol = ch->leftvol * snd_vol * (256 * M_SQRT1_2);
-    float rightvol = ch->rightvol * snd_vol * (256 * M_SQRT1_2);
-    uint8_t *sfx = sc->data + ch->pos * 2;
-
-    for (int i = 0; i < count; i++, samp++, sfx += 2) {
-        int sum = (sfx[0] - 128) + (sfx[1] - 128);
-        samp->left += sum * leftvol;
-        samp->right += sum * rightvol;
-    }
-}
-
-PAINTFUNC(PaintStereoFull8)
-{
-    float vol = ch->leftvol * snd_vol * 256;
-    uint8_t *sfx = sc->data + ch->pos * 2;
-
-    for (int i = 0; i < count; i++, samp++, sfx += 2) {
-        samp->left += (sfx[0] - 128) * vol;
-        samp->right += (sfx[1] - 128) * vol;
-    }
-}
-
 PAINTFUNC(PaintMono16)
 {
     float leftvol = ch->leftvol * snd_vol;
@@ -396,9 +340,6 @@ PAINTFUNC(PaintStereoFull16)
 }
 
 static const paintfunc_t paintfuncs[] = {
-    PaintMono8,
-    PaintStereoDmix8,
-    PaintStereoFull8,
     PaintMono16,
     PaintStereoDmix16,
     PaintStereoFull16,
@@ -443,18 +384,22 @@ static void PaintChannels(int endtime)
                 if (!ch->sfx || (!ch->leftvol && !ch->rightvol))
                     break;
 
-                sfxcache_t *sc = S_LoadSound(ch->sfx);
-                if (!sc)
+                // the mixer never loads sounds, see S_QueueSounds
+                sfxcache_t *sc = ch->sfx->cache;
+                if (!sc) {
+                    s_loadstats.misses++;
+                    ch->sfx = NULL;
                     break;
+                }
 
-                Q_assert(sc->width == 1 || sc->width == 2);
+                Q_assert(sc->width == 2);
                 Q_assert(sc->channels == 1 || sc->channels == 2);
 
                 // max painting is to the end of the buffer
                 int count = min(end, ch->end) - ltime;
 
                 if (count > 0) {
-                    int func = (sc->width - 1) * 3 + (sc->channels - 1) * (S_IsFullVolume(ch) + 1);
+                    int func = (sc->channels - 1) * (S_IsFullVolume(ch) + 1);
                     paintfuncs[func](ch, sc, count, &paintbuffer[ltime - s_paintedtime]);
                     ch->pos += count;
                     ltime += count;
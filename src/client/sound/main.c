@@ -102,6 +102,8 @@ static void S_SoundList_f(void)
         } else {
             if (sfx->name[0] == '*')
                 Com_Printf("  placeholder : %s\n", sfx->name);
+            else if (sfx->pending)
+                Com_Printf("  pending     : %s\n", sfx->name);
             else
                 Com_Printf("  not loaded  : %s (%s)\n",
                            sfx->name, Q_ErrorString(sfx->error));
@@ -110,6 +112,9 @@ static void S_SoundList_f(void)
     }
     Com_Printf("Total sounds: %d (out of %d slots)\n", count, num_sfx);
     Com_Printf("Total resident: %zu\n", total);
+    Com_Printf("Loaded: %u async, %u sync (%u batches pending)\n",
+               s_loadstats.async, s_loadstats.sync, s_loadstats.batches);
+    Com_Printf("Cache misses: %u\n", s_loadstats.misses);
 }
 
 static const cmdreg_t c_sound[] = {
@@ -488,7 +493,8 @@ S_EndRegistration
 */
 void S_EndRegistration(void)
 {
-    int     i;
+    sfx_t   *list[MAX_SFX];
+    int     i, count;
     sfx_t   *sfx;
 
     S_RegisterSexedSounds();
@@ -510,12 +516,13 @@ void S_EndRegistration(void)
             s_api.page_in_sfx(sfx);
     }
 
-    // load everything in
-    for (i = 0, sfx = known_sfx; i < num_sfx; i++, sfx++) {
+    // load everything in on the async work thread
+    for (i = count = 0, sfx = known_sfx; i < num_sfx; i++, sfx++) {
         if (!sfx->name[0])
             continue;
-        S_LoadSound(sfx);
+        list[count++] = sfx;
     }
+    S_QueueSounds(list, count);
 
     s_registering = false;
 }
@@ -629,9 +636,11 @@ void S_IssuePlaysound(playsound_t *ps)
         return;
     }
 
-    sc = S_LoadSound(ps->sfx);
+    // never load from here, this may be called by the mixer
+    sc = ps->sfx->cache;
     if (!sc) {
-        Com_Printf("S_IssuePlaysound: couldn't load %s\n", ps->sfx->name);
+        s_loadstats.misses++;
+        Com_DPrintf("S_IssuePlaysound: %s not resident\n", ps->sfx->name);
         S_FreePlaysound(ps);
         return;
     }
@@ -689,6 +698,8 @@ void S_StartSound(const vec3_t origin, int entnum, int entchannel, qhandle_t hSf
     }
 
     // make sure the sound is loaded
+    if (!sfx->cache && !sfx->error)
+        s_loadstats.misses++;
     sc = S_LoadSound(sfx);
     if (!sc)
         return;     // couldn't load the sound's data
@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // snd_mem.c: sound caching
 
 #include "sound.h"
+#include "common/async.h"
 #include "common/intreadwrite.h"
 
 #define FORMAT_PCM  1
@@ -56,26 +57,26 @@ static int FindChunk(sizebuf_t *sz, uint32_t search)
     return 0;
 }
 
-static bool GetWavinfo(sizebuf_t *sz)
+static bool GetWavinfo(wavinfo_t *info, sizebuf_t *sz)
 {
     int tag, samples, width, chunk_len, next_chunk;
 
     tag = SZ_ReadLong(sz);
 
-    if (tag == MakeLittleLong('O','g','g','S') || !COM_CompareExtension(s_info.name, ".ogg")) {
+    if (tag == MakeLittleLong('O','g','g','S') || !COM_CompareExtension(info->name, ".ogg")) {
         sz->readcount = 0;
-        return OGG_Load(sz);
+        return OGG_Load(info, sz);
     }
 
 // find "RIFF" chunk
     if (tag != TAG_RIFF) {
-        Com_DPrintf("%s has missing/invalid RIFF chunk\n", s_info.name);
+        info->error = "has missing/invalid RIFF chunk";
         return false;
     }
 
     sz->readcount += 4;
     if (SZ_ReadLong(sz) != TAG_WAVE) {
-        Com_DPrintf("%s has missing/invalid WAVE chunk\n", s_info.name);
+        info->error = "has missing/invalid WAVE chunk";
         return false;
     }
 
@@ -84,25 +85,25 @@ static bool GetWavinfo(sizebuf_t *sz)
 
 // find "fmt " chunk
     if (!FindChunk(sz, TAG_fmt)) {
-        Com_DPrintf("%s has missing/invalid fmt chunk\n", s_info.name);
+        info->error = "has missing/invalid fmt chunk";
         return false;
     }
 
-    s_info.format = SZ_ReadShort(sz);
-    if (s_info.format != FORMAT_PCM) {
-        Com_DPrintf("%s has unsupported format\n", s_info.name);
+    info->format = SZ_ReadShort(sz);
+    if (info->format != FORMAT_PCM) {
+        info->error = "has unsupported format";
         return false;
     }
 
-    s_info.channels = SZ_ReadShort(sz);
-    if (s_info.channels < 1 || s_info.channels > 2) {
-        Com_DPrintf("%s has bad number of channels\n", s_info.name);
+    info->channels = SZ_ReadShort(sz);
+    if (info->channels < 1 || info->channels > 2) {
+        info->error = "has bad number of channels";
         return false;
     }
 
-    s_info.rate = SZ_ReadLong(sz);
-    if (s_info.rate < 8000 || s_info.rate > 48000) {
-        Com_DPrintf("%s has bad rate\n", s_info.name);
+    info->rate = SZ_ReadLong(sz);
+    if (info->rate < 8000 || info->rate > 48000) {
+        info->error = "has bad rate";
         return false;
     }
 
@@ -110,13 +111,13 @@ static bool GetWavinfo(sizebuf_t *sz)
     width = SZ_ReadShort(sz);
     switch (width) {
     case 8:
-        s_info.width = 1;
+        info->width = 1;
         break;
     case 16:
-        s_info.width = 2;
+        info->width = 2;
         break;
     default:
-        Com_DPrintf("%s has bad width\n", s_info.name);
+        info->error = "has bad width";
         return false;
     }
 
@@ -124,19 +125,19 @@ static bool GetWavinfo(sizebuf_t *sz)
     sz->readcount = next_chunk;
     chunk_len = FindChunk(sz, TAG_data);
     if (!chunk_len) {
-        Com_DPrintf("%s has missing/invalid data chunk\n", s_info.name);
+        info->error = "has missing/invalid data chunk";
         return false;
     }
 
 // calculate length in samples
-    s_info.samples = chunk_len / (s_info.width * s_info.channels);
-    if (!s_info.samples) {
-        Com_DPrintf("%s has zero length\n", s_info.name);
+    info->samples = chunk_len / (info->width * info->channels);
+    if (!info->samples) {
+        info->error = "has zero length";
         return false;
     }
 
-    s_info.data = sz->data + sz->readcount;
-    s_info.loopstart = -1;
+    info->data = sz->data + sz->readcount;
+    info->loopstart = -1;
 
 // find "cue " chunk
     sz->readcount = next_chunk;
@@ -150,11 +151,11 @@ static bool GetWavinfo(sizebuf_t *sz)
 
     sz->readcount += 24;
     samples = SZ_ReadLong(sz);
-    if (samples < 0 || samples >= s_info.samples) {
-        Com_DPrintf("%s has bad loop start\n", s_info.name);
+    if (samples < 0 || samples >= info->samples) {
+        info->error = "has bad loop start";
         return true;
     }
-    s_info.loopstart = samples;
+    info->loopstart = samples;
 
 // if the next chunk is a "LIST" chunk, look for a cue length marker
     sz->readcount = next_chunk;
@@ -170,26 +171,162 @@ static bool GetWavinfo(sizebuf_t *sz)
 // this is not a proper parse, but it works with cooledit...
     sz->readcount -= 8;
     samples = SZ_ReadLong(sz);  // samples in loop
-    if (samples < 1 || samples > s_info.samples - s_info.loopstart) {
-        Com_DPrintf("%s has bad loop length\n", s_info.name);
+    if (samples < 1 || samples > info->samples - info->loopstart) {
+        info->error = "has bad loop length";
         return true;
     }
-    s_info.samples = s_info.loopstart + samples;
+    info->samples = info->loopstart + samples;
 
     return true;
 }
 
+/*
+===============================================================================
+
+DECODING
+
+Sounds are decoded and converted to the mixer's native format (16 bit at the
+output rate for DMA) either synchronously or on the async work thread. The
+code below may run on the worker, so it must not touch the zone allocator,
+the filesystem or the console. Errors and warnings are reported through
+wavinfo_t::error and printed by the caller.
+
+===============================================================================
+*/
+
+#define RESAMPLE \
+    for (i = frac = 0; j = frac >> 8, i < outcount; i++, frac += fracstep)
+
+// resample / decimate to the given rate, expanding 8 bit samples to 16 bit.
+// rate of 0 means the backend does its own resampling.
+static int NormalizeSfx(wavinfo_t *info, int rate)
+{
+    float stepscale;
+    int i, j, frac, fracstep, outcount;
+    int16_t *out;
+
+    if (!rate)
+        return Q_ERR_SUCCESS;
+
+    stepscale = (float)info->rate / rate;   // this is usually 0.5, 1, or 2
+    if (stepscale == 1 && info->width == 2)
+        return Q_ERR_SUCCESS;
+
+    outcount = info->samples / stepscale;
+    if (!outcount) {
+        info->error = "resampled to zero length";
+        return Q_ERR_TOO_FEW;
+    }
+
+    out = malloc(outcount * info->channels * sizeof(*out));
+    if (!out) {
+        info->error = "couldn't allocate resample buffer";
+        return Q_ERR(ENOMEM);
+    }
+
+    fracstep = stepscale * 256;
+    if (info->width == 1) {
+        const uint8_t *in = info->data;
+        if (info->channels == 2) {
+            RESAMPLE {
+                out[i * 2 + 0] = (in[j * 2 + 0] - 128) * 256;
+                out[i * 2 + 1] = (in[j * 2 + 1] - 128) * 256;
+            }
+        } else {
+            RESAMPLE out[i] = (in[j] - 128) * 256;
+        }
+    } else {
+        const int16_t *in = (const int16_t *)info->data;
+        if (info->channels == 2) {
+            RESAMPLE {
+                out[i * 2 + 0] = in[j * 2 + 0];
+                out[i * 2 + 1] = in[j * 2 + 1];
+            }
+        } else {
+            RESAMPLE out[i] = in[j];
+        }
+    }
+
+    free(info->buffer);
+    info->buffer = out;
+    info->data = (byte *)out;
+    if (info->loopstart != -1)
+        info->loopstart /= stepscale;
+    info->samples = outcount;
+    info->rate = rate;
+    info->width = 2;
+
+    return Q_ERR_SUCCESS;
+}
+
+#undef RESAMPLE
+
+static int DecodeSound(wavinfo_t *info, byte *data, int len, int rate)
+{
+    sizebuf_t sz;
+
+    SZ_Init(&sz, data, len);
+    sz.cursize = len;
+
+    if (!GetWavinfo(info, &sz))
+        return Q_ERR_INVALID_FORMAT;
+
+#if USE_BIG_ENDIAN
+    if (info->format == FORMAT_PCM && info->width == 2) {
+        uint16_t *data = (uint16_t *)info->data;
+        int count = info->samples * info->channels;
+
+        for (int i = 0; i < count; i++)
+            data[i] = LittleShort(data[i]);
+    }
+#endif
+
+    return NormalizeSfx(info, rate);
+}
+
+// rate sounds are converted to before upload
+static int SampleRate(void)
+{
+#if USE_SNDDMA
+    if (s_started == SS_DMA)
+        return dma.speed;
+#endif
+    return 0;
+}
+
+static sfxcache_t *UploadSound(sfx_t *s, wavinfo_t *info, int ret)
+{
+    sfxcache_t *sc = NULL;
+
+    if (info->error)
+        Com_DPrintf("%s %s\n", info->name, info->error);
+
+    if (ret) {
+        s->error = ret;
+    } else {
+        s_info = *info;
+        sc = s_api.upload_sfx(s);
+    }
+
+    free(info->buffer);
+    info->buffer = NULL;
+    return sc;
+}
+
 /*
 ==============
 S_LoadSound
+
+Synchronously loads the sound if it is not resident yet. Any background
+decode still in flight for this sound will be discarded.
 ==============
 */
 sfxcache_t *S_LoadSound(sfx_t *s)
 {
-    sizebuf_t   sz;
+    wavinfo_t   info;
     byte        *data;
     sfxcache_t  *sc;
-    int         len;
+    int         len, ret;
     char        *name;
 
     if (s->name[0] == '*')
@@ -210,40 +347,159 @@ sfxcache_t *S_LoadSound(sfx_t *s)
     else
         name = s->name;
 
+    s->pending = 0;
+    s_loadstats.sync++;
+
     len = FS_LoadFile(name, (void **)&data);
     if (!data) {
         s->error = len;
         return NULL;
     }
 
-    memset(&s_info, 0, sizeof(s_info));
-    s_info.name = name;
+    memset(&info, 0, sizeof(info));
+    info.name = name;
 
-    SZ_Init(&sz, data, len);
-    sz.cursize = len;
+    ret = DecodeSound(&info, data, len, SampleRate());
+    sc = UploadSound(s, &info, ret);
 
-    if (!GetWavinfo(&sz)) {
-        s->error = Q_ERR_INVALID_FORMAT;
-        goto fail;
-    }
+    FS_FreeFile(data);
+    return sc;
+}
 
-#if USE_BIG_ENDIAN
-    if (s_info.format == FORMAT_PCM && s_info.width == 2) {
-        uint16_t *data = (uint16_t *)s_info.data;
-        int count = s_info.samples * s_info.channels;
+/*
+===============================================================================
 
-        for (int i = 0; i < count; i++)
-            data[i] = LittleShort(data[i]);
+BACKGROUND LOADING
+
+===============================================================================
+*/
+
+#define MAX_LOAD_BATCH  32
+
+typedef struct {
+    sfx_t       *sfx;
+    unsigned    id;
+    byte        *data;
+    int         len;
+    int         error;
+    char        name[MAX_QPATH];
+    wavinfo_t   info;
+} sfxload_t;
+
+typedef struct {
+    int         rate;
+    int         count;
+    sfxload_t   loads[MAX_LOAD_BATCH];
+} sfxbatch_t;
+
+sfxstats_t  s_loadstats;
+
+static unsigned s_load_id;
+
+static void load_work_cb(void *arg)
+{
+    sfxbatch_t *batch = arg;
+
+    for (int i = 0; i < batch->count; i++) {
+        sfxload_t *load = &batch->loads[i];
+        load->error = DecodeSound(&load->info, load->data, load->len, batch->rate);
     }
-#endif
+}
 
-    sc = s_api.upload_sfx(s);
+static void load_done_cb(void *arg)
+{
+    sfxbatch_t *batch = arg;
+
+    for (int i = 0; i < batch->count; i++) {
+        sfxload_t *load = &batch->loads[i];
+        sfx_t *s = load->sfx;
+
+        // sound may have been freed or loaded synchronously meanwhile
+        if (s->pending == load->id) {
+            s->pending = 0;
+            UploadSound(s, &load->info, load->error);
+            s_loadstats.async++;
+        } else {
+            free(load->info.buffer);
+        }
+
+        FS_FreeFile(load->data);
+    }
 
-    if (s_info.format != FORMAT_PCM)
-        FS_FreeTempMem(s_info.data);
+    Z_Free(batch);
+    s_loadstats.batches--;
+}
 
-fail:
-    FS_FreeFile(data);
-    return sc;
+static void QueueBatch(sfxbatch_t *batch)
+{
+    asyncwork_t work = {
+        .work_cb = load_work_cb,
+        .done_cb = load_done_cb,
+        .cb_arg = batch,
+    };
+
+    Com_QueueAsyncWork(&work);
+    s_loadstats.batches++;
 }
 
+/*
+==============
+S_QueueSounds
+
+Reads sound files on the main thread and queues them for decoding on the
+async work thread. Sounds become resident as batches complete.
+==============
+*/
+void S_QueueSounds(sfx_t **list, int count)
+{
+    sfxbatch_t  *batch = NULL;
+    sfxload_t   *load;
+    byte        *data;
+    int         i, len;
+    char        *name;
+    sfx_t       *s;
+
+    for (i = 0; i < count; i++) {
+        s = list[i];
+        if (s->name[0] == '*' || s->cache || s->error || s->pending)
+            continue;
+
+        if (s->truename)
+            name = s->truename;
+        else
+            name = s->name;
+
+        len = FS_LoadFile(name, (void **)&data);
+        if (!data) {
+            s->error = len;
+            continue;
+        }
+
+        if (!batch) {
+            batch = S_Malloc(sizeof(*batch));
+            batch->rate = SampleRate();
+            batch->count = 0;
+        }
+
+        if (!++s_load_id)
+            s_load_id = 1;
+
+        load = &batch->loads[batch->count++];
+        load->sfx = s;
+        load->id = s->pending = s_load_id;
+        load->data = data;
+        load->len = len;
+        load->error = Q_ERR_SUCCESS;
+        Q_strlcpy(load->name, name, sizeof(load->name));
+        memset(&load->info, 0, sizeof(load->info));
+        load->info.name = load->name;
+
+        if (batch->count == MAX_LOAD_BATCH) {
+            QueueBatch(batch);
+            batch = NULL;
+        }
+    }
+
+    if (batch)
+        QueueBatch(batch);
+}
@@ -50,6 +50,7 @@ typedef struct sfx_s {
     sfxcache_t  *cache;
     char        *truename;
     int         error;
+    unsigned    pending;        // id of background load in flight, if any
 } sfx_t;
 
 #define PS_FIRST(list)      LIST_FIRST(playsound_t, list, entry)
@@ -98,8 +99,17 @@ typedef struct {
     int         loopstart;
     int         samples;
     byte        *data;
+    void        *buffer;        // decoded samples owned by this wavinfo, if any
+    const char  *error;         // deferred error or warning message
 } wavinfo_t;
 
+typedef struct {
+    unsigned    async;          // sounds decoded on the async work thread
+    unsigned    sync;           // sounds decoded synchronously
+    unsigned    misses;         // playback requested a sound that wasn't resident
+    unsigned    batches;        // background load batches in flight
+} sfxstats_t;
+
 /*
 ====================================================================
 
@@ -155,6 +165,7 @@ extern int          s_paintedtime;
 extern list_t       s_pendingplays;
 
 extern wavinfo_t    s_info;
+extern sfxstats_t   s_loadstats;
 
 extern cvar_t       *s_volume;
 extern cvar_t       *s_ambient;
@@ -181,8 +192,9 @@ static inline int clip16(int v)
 
 sfx_t *S_SfxForHandle(qhandle_t hSfx);
 sfxcache_t *S_LoadSound(sfx_t *s);
+void S_QueueSounds(sfx_t **list, int count);
 channel_t *S_PickChannel(int entnum, int entchannel);
 void S_IssuePlaysound(playsound_t *ps);
 void S_BuildSoundList(int *sounds);
 
-bool OGG_Load(sizebuf_t *sz);
+bool OGG_Load(wavinfo_t *info, sizebuf_t *sz);
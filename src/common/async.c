@@ -18,8 +18,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "shared/shared.h"
 #include "common/async.h"
+#include "common/common.h"
+#include "common/cvar.h"
 #include "common/zone.h"
 #include "system/pthread.h"
+#include "system/system.h"
 
 static bool work_initialized;
 static bool work_terminate;
@@ -98,8 +101,183 @@ void Com_CompleteAsyncWork(void)
     pthread_mutex_unlock(&work_lock);
 }
 
+/*
+===============================================================================
+
+PARALLEL FOR
+
+A small pool of worker threads that split a range of indices into chunks.
+The calling thread participates and returns when all chunks are done.
+
+===============================================================================
+*/
+
+#define MAX_POOL_THREADS    32
+
+static cvar_t   *com_threads;
+
+static struct {
+    bool            initialized;
+    bool            terminate;
+    int             num_threads;
+    pthread_t       threads[MAX_POOL_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t  start_cond;
+    pthread_cond_t  done_cond;
+    parallel_cb_t   func;
+    void            *arg;
+    int             count;
+    int             grain;
+    int             next;
+    int             busy;
+} pool;
+
+// called with pool lock held
+static bool run_chunk(void)
+{
+    parallel_cb_t func = pool.func;
+    void *arg = pool.arg;
+    int begin, end;
+
+    if (pool.next >= pool.count)
+        return false;
+
+    begin = pool.next;
+    end = min(begin + pool.grain, pool.count);
+    pool.next = end;
+    pool.busy++;
+
+    pthread_mutex_unlock(&pool.lock);
+    func(arg, begin, end);
+    pthread_mutex_lock(&pool.lock);
+
+    pool.busy--;
+    return true;
+}
+
+static void *pool_func(void *arg)
+{
+    pthread_mutex_lock(&pool.lock);
+    while (1) {
+        while (!pool.terminate && pool.next >= pool.count)
+            pthread_cond_wait(&pool.start_cond, &pool.lock);
+
+        if (pool.terminate)
+            break;
+
+        while (run_chunk())
+            ;
+
+        if (!pool.busy)
+            pthread_cond_signal(&pool.done_cond);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    return NULL;
+}
+
+static void init_pool(void)
+{
+    int i, count;
+
+    com_threads = Cvar_Get("com_threads", "0", 0);
+
+    // 0 = one worker per CPU, excluding the calling thread
+    count = com_threads->integer;
+    if (count <= 0)
+        count = Sys_NumCPUs();
+    count = min(count - 1, MAX_POOL_THREADS);
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.start_cond, NULL);
+    pthread_cond_init(&pool.done_cond, NULL);
+
+    for (i = 0; i < count; i++)
+        if (pthread_create(&pool.threads[i], NULL, pool_func, NULL))
+            break;
+
+    pool.num_threads = i;
+    pool.initialized = true;
+}
+
+// called from main thread before first use
+void Com_InitAsyncWork(void)
+{
+    if (!pool.initialized)
+        init_pool();
+}
+
+void Com_ParallelFor(int count, int grain, parallel_cb_t func, void *arg)
+{
+    if (count <= 0)
+        return;
+
+    grain = max(grain, 1);
+
+    if (!pool.num_threads || count <= grain) {
+        func(arg, 0, count);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+
+    // nested call from a callback, run serially
+    if (pool.func) {
+        pthread_mutex_unlock(&pool.lock);
+        func(arg, 0, count);
+        return;
+    }
+
+    pool.func = func;
+    pool.arg = arg;
+    pool.count = count;
+    pool.grain = grain;
+    pool.next = 0;
+    pthread_cond_broadcast(&pool.start_cond);
+
+    while (run_chunk())
+        ;
+
+    while (pool.busy)
+        pthread_cond_wait(&pool.done_cond, &pool.lock);
+
+    pool.func = NULL;
+    pool.arg = NULL;
+    pool.count = pool.next = 0;
+
+    pthread_mutex_unlock(&pool.lock);
+}
+
+int Com_ParallelThreads(void)
+{
+    return pool.num_threads + 1;
+}
+
+static void shutdown_pool(void)
+{
+    int i;
+
+    if (!pool.initialized)
+        return;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.terminate = true;
+    pthread_cond_broadcast(&pool.start_cond);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (i = 0; i < pool.num_threads; i++)
+        Q_assert(!pthread_join(pool.threads[i], NULL));
+
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.start_cond);
+    pthread_cond_destroy(&pool.done_cond);
+    memset(&pool, 0, sizeof(pool));
+}
+
 void Com_ShutdownAsyncWork(void)
 {
+    shutdown_pool();
+
     if (!work_initialized)
         return;
 
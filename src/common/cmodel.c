@@ -34,13 +34,15 @@ mtexinfo_t nulltexinfo;
 static mleaf_t      nullleaf;
 
 static unsigned     floodvalid;
-static unsigned     checkcount;
 
 static cvar_t       *map_noareas;
 static cvar_t       *map_allsolid_bug;
 static cvar_t       *map_override_path;
+static cvar_t       *map_bvh;
 
 static void    FloodAreaConnections(cm_t *cm);
+static struct brushtree_s *CM_AllocBrushTree(bsp_t *bsp);
+static void    CM_FreeBrushTree(struct brushtree_s *tree);
 
 //=======================================================================
 
@@ -178,6 +180,7 @@ void CM_FreeMap(cm_t *cm)
     if (cm->override_bits & OVERRIDE_ENTS)
         Z_Free(cm->entitystring);
 
+    CM_FreeBrushTree(cm->brushtree);
     BSP_Free(cm->cache);
 
     memset(cm, 0, sizeof(*cm));
@@ -208,6 +211,9 @@ int CM_LoadMap(cm_t *cm, const char *name)
     cm->portalopen = Z_TagMallocz(sizeof(cm->portalopen[0]) * cm->cache->numportals, TAG_CMODEL);
     FloodAreaConnections(cm);
 
+    if (map_bvh->integer)
+        cm->brushtree = CM_AllocBrushTree(cm->cache);
+
     return Q_ERR_SUCCESS;
 }
 
@@ -240,14 +246,8 @@ mleaf_t *CM_LeafNum(cm_t *cm, int number)
 
 //=======================================================================
 
-static cplane_t box_planes[12];
-static mnode_t  box_nodes[6];
-static mnode_t  *box_headnode;
-static mbrush_t box_brush;
-static mbrush_t *box_leafbrush;
-static mbrushside_t box_brushsides[6];
-static mleaf_t  box_leaf;
-static mleaf_t  box_emptyleaf;
+static boxhull_t    box_hull;
+static mnode_t      *box_headnode;
 
 /*
 ===================
@@ -257,7 +257,7 @@ Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
 ===================
 */
-static void CM_InitBoxHull(void)
+void CM_InitBoxHull(boxhull_t *hull)
 {
     int         i;
     int         side;
@@ -265,41 +265,41 @@ static void CM_InitBoxHull(void)
     cplane_t    *p;
     mbrushside_t    *s;
 
-    box_headnode = &box_nodes[0];
+    memset(hull, 0, sizeof(*hull));
 
-    box_brush.numsides = 6;
-    box_brush.firstbrushside = &box_brushsides[0];
-    box_brush.contents = CONTENTS_MONSTER;
+    hull->brush.numsides = 6;
+    hull->brush.firstbrushside = &hull->brushsides[0];
+    hull->brush.contents = CONTENTS_MONSTER;
 
-    box_leaf.contents = CONTENTS_MONSTER;
-    box_leaf.firstleafbrush = &box_leafbrush;
-    box_leaf.numleafbrushes = 1;
+    hull->leaf.contents = CONTENTS_MONSTER;
+    hull->leaf.firstleafbrush = &hull->leafbrush;
+    hull->leaf.numleafbrushes = 1;
 
-    box_leafbrush = &box_brush;
+    hull->leafbrush = &hull->brush;
 
     for (i = 0; i < 6; i++) {
         side = i & 1;
 
         // brush sides
-        s = &box_brushsides[i];
-        s->plane = &box_planes[i * 2 + side];
+        s = &hull->brushsides[i];
+        s->plane = &hull->planes[i * 2 + side];
         s->texinfo = &nulltexinfo;
 
         // nodes
-        c = &box_nodes[i];
-        c->plane = &box_planes[i * 2];
-        c->children[side] = (mnode_t *)&box_emptyleaf;
+        c = &hull->nodes[i];
+        c->plane = &hull->planes[i * 2];
+        c->children[side] = (mnode_t *)&hull->emptyleaf;
         if (i != 5)
-            c->children[side ^ 1] = &box_nodes[i + 1];
+            c->children[side ^ 1] = &hull->nodes[i + 1];
         else
-            c->children[side ^ 1] = (mnode_t *)&box_leaf;
+            c->children[side ^ 1] = (mnode_t *)&hull->leaf;
 
         // planes
-        p = &box_planes[i * 2];
+        p = &hull->planes[i * 2];
         p->type = i >> 1;
         p->normal[i >> 1] = 1;
 
-        p = &box_planes[i * 2 + 1];
+        p = &hull->planes[i * 2 + 1];
         p->type = 3 + (i >> 1);
         p->signbits = 1 << (i >> 1);
         p->normal[i >> 1] = -1;
@@ -308,28 +308,42 @@ static void CM_InitBoxHull(void)
 
 /*
 ===================
-CM_HeadnodeForBox
+CM_HeadnodeForBoxHull
 
 To keep everything totally uniform, bounding boxes are turned into small
 BSP trees instead of being compared directly.
 ===================
 */
+mnode_t *CM_HeadnodeForBoxHull(boxhull_t *hull, const vec3_t mins, const vec3_t maxs)
+{
+    cplane_t *p = hull->planes;
+
+    p[0].dist = maxs[0];
+    p[1].dist = -maxs[0];
+    p[2].dist = mins[0];
+    p[3].dist = -mins[0];
+    p[4].dist = maxs[1];
+    p[5].dist = -maxs[1];
+    p[6].dist = mins[1];
+    p[7].dist = -mins[1];
+    p[8].dist = maxs[2];
+    p[9].dist = -maxs[2];
+    p[10].dist = mins[2];
+    p[11].dist = -mins[2];
+
+    return &hull->nodes[0];
+}
+
+/*
+===================
+CM_HeadnodeForBox
+
+Same as above, using the shared hull.
+===================
+*/
 mnode_t *CM_HeadnodeForBox(const vec3_t mins, const vec3_t maxs)
 {
-    box_planes[0].dist = maxs[0];
-    box_planes[1].dist = -maxs[0];
-    box_planes[2].dist = mins[0];
-    box_planes[3].dist = -mins[0];
-    box_planes[4].dist = maxs[1];
-    box_planes[5].dist = -maxs[1];
-    box_planes[6].dist = mins[1];
-    box_planes[7].dist = -mins[1];
-    box_planes[8].dist = maxs[2];
-    box_planes[9].dist = -maxs[2];
-    box_planes[10].dist = mins[2];
-    box_planes[11].dist = -mins[2];
-
-    return box_headnode;
+    return CM_HeadnodeForBoxHull(&box_hull, mins, maxs);
 }
 
 mleaf_t *CM_PointLeaf(cm_t *cm, const vec3_t p)
@@ -347,33 +361,35 @@ CM_BoxLeafnums
 Fills in a list of all the leafs touched
 =============
 */
-static int          leaf_count, leaf_maxcount;
-static mleaf_t      **leaf_list;
-static const vec_t  *leaf_mins, *leaf_maxs;
-static mnode_t      *leaf_topnode;
-
-static void CM_BoxLeafs_r(mnode_t *node)
+typedef struct {
+    int         count, maxcount;
+    mleaf_t     **list;
+    const vec_t *mins, *maxs;
+    mnode_t     *topnode;
+} leafwork_t;
+
+static void CM_BoxLeafs_r(leafwork_t *lw, mnode_t *node)
 {
     int     s;
 
     while (node->plane) {
-        s = BoxOnPlaneSideFast(leaf_mins, leaf_maxs, node->plane);
+        s = BoxOnPlaneSideFast(lw->mins, lw->maxs, node->plane);
         if (s == BOX_INFRONT) {
             node = node->children[0];
         } else if (s == BOX_BEHIND) {
             node = node->children[1];
         } else {
             // go down both
-            if (!leaf_topnode) {
-                leaf_topnode = node;
+            if (!lw->topnode) {
+                lw->topnode = node;
             }
-            CM_BoxLeafs_r(node->children[0]);
+            CM_BoxLeafs_r(lw, node->children[0]);
             node = node->children[1];
         }
     }
 
-    if (leaf_count < leaf_maxcount) {
-        leaf_list[leaf_count++] = (mleaf_t *)node;
+    if (lw->count < lw->maxcount) {
+        lw->list[lw->count++] = (mleaf_t *)node;
     }
 }
 
@@ -381,20 +397,19 @@ static int CM_BoxLeafs_headnode(const vec3_t mins, const vec3_t maxs,
                                 mleaf_t **list, int listsize,
                                 mnode_t *headnode, mnode_t **topnode)
 {
-    leaf_list = list;
-    leaf_count = 0;
-    leaf_maxcount = listsize;
-    leaf_mins = mins;
-    leaf_maxs = maxs;
-
-    leaf_topnode = NULL;
+    leafwork_t lw = {
+        .maxcount = listsize,
+        .list = list,
+        .mins = mins,
+        .maxs = maxs,
+    };
 
-    CM_BoxLeafs_r(headnode);
+    CM_BoxLeafs_r(&lw, headnode);
 
     if (topnode)
-        *topnode = leaf_topnode;
+        *topnode = lw.topnode;
 
-    return leaf_count;
+    return lw.count;
 }
 
 int CM_BoxLeafs(cm_t *cm, const vec3_t mins, const vec3_t maxs,
@@ -457,28 +472,116 @@ BOX TRACING
 // 1/32 epsilon to keep floating point happy
 #define DIST_EPSILON    0.03125f
 
-static vec3_t   trace_start, trace_end;
-static vec3_t   trace_offsets[8];
-static vec3_t   trace_extents;
+// must be power of two
+#define MAX_CHECKED_BRUSHES     128
+
+// brushes up to this many are kept in a list, so that most traces don't
+// need to clear the hash table
+#define MAX_LISTED_BRUSHES      8
+
+// All state of a single trace lives on the stack, so that traces against
+// the same (possibly shared) BSP can run on multiple threads at once.
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      offsets[8];
+    vec3_t      extents;
+    vec3_t      invdir;         // for brush tree, 0 on axes without movement
+
+    trace_t     *trace;
+    int         contents;
+    bool        ispoint;        // optimized case
+
+    // brush tree only: equally near brushes resolve to the lowest numbered
+    // one, so the result doesn't depend on the order brushes are tested in
+    bool        tiebreak;
+    mbrush_t    *brush;         // brush the trace has stopped at
+    float       exact;          // where it really enters that brush
+
+    // brushes already tested in another leaf. Listed first, then hashed.
+    // When the set is full, brushes may be tested again, which doesn't
+    // change the result.
+    int         numchecked;
+    mbrush_t    *checked[MAX_CHECKED_BRUSHES];
+} tracework_t;
+
+static bool CM_HashBrush(tracework_t *tw, mbrush_t *brush)
+{
+    unsigned hash = ((uintptr_t)brush / sizeof(*brush)) & (MAX_CHECKED_BRUSHES - 1);
+
+    while (tw->checked[hash]) {
+        if (tw->checked[hash] == brush)
+            return true;
+        hash = (hash + 1) & (MAX_CHECKED_BRUSHES - 1);
+    }
+
+    // keep some free slots to terminate probing
+    if (tw->numchecked < MAX_CHECKED_BRUSHES * 3 / 4) {
+        tw->checked[hash] = brush;
+        tw->numchecked++;
+    }
+
+    return false;
+}
+
+// returns true if brush was already tested by this trace
+static bool CM_CheckBrush(tracework_t *tw, mbrush_t *brush)
+{
+    mbrush_t    *list[MAX_LISTED_BRUSHES];
+    int         i;
+
+    if (tw->numchecked > MAX_LISTED_BRUSHES)
+        return CM_HashBrush(tw, brush);
 
-static trace_t  *trace_trace;
-static int      trace_contents;
-static bool     trace_ispoint;      // optimized case
+    for (i = 0; i < tw->numchecked; i++)
+        if (tw->checked[i] == brush)
+            return true;
+
+    if (tw->numchecked < MAX_LISTED_BRUSHES) {
+        tw->checked[tw->numchecked++] = brush;
+        return false;
+    }
+
+    // list is full, move it to the hash table
+    memcpy(list, tw->checked, sizeof(list));
+    memset(tw->checked, 0, sizeof(tw->checked));
+    tw->numchecked = 0;
+    for (i = 0; i < MAX_LISTED_BRUSHES; i++)
+        CM_HashBrush(tw, list[i]);
+
+    return CM_HashBrush(tw, brush);
+}
+
+// returns true if brush entered at exact and hit at frac replaces the current
+// trace result. Brushes are ordered by where the box really enters them, as
+// frac is pulled back by DIST_EPSILON along the brush plane and can be any
+// nearer for planes the trace is almost parallel to.
+static inline bool CM_NearerHit(const tracework_t *tw, float exact, float frac, const mbrush_t *brush)
+{
+    if (exact != tw->exact)
+        return exact < tw->exact;
+    if (!tw->tiebreak)
+        return frac < tw->trace->fraction;
+    frac = max(frac, 0);
+    if (frac != tw->trace->fraction)
+        return frac < tw->trace->fraction;
+    return tw->brush && brush < tw->brush;
+}
 
 /*
 ================
 CM_ClipBoxToBrush
 ================
 */
-static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace, mbrush_t *brush)
+static void CM_ClipBoxToBrush(tracework_t *tw, const vec3_t p1, const vec3_t p2, trace_t *trace, mbrush_t *brush)
 {
     int         i;
     cplane_t    *plane, *clipplane;
     float       dist;
     float       enterfrac, leavefrac;
+    float       enterexact, leaveexact;
     float       d1, d2;
     bool        getout, startout;
-    float       f;
+    float       f, idist;
     mbrushside_t    *side, *leadside;
 
     if (!brush->numsides)
@@ -486,6 +589,8 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
 
     enterfrac = -1;
     leavefrac = 1;
+    enterexact = -1;
+    leaveexact = 1;
     clipplane = NULL;
 
     getout = false;
@@ -497,10 +602,10 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
         plane = side->plane;
 
         // FIXME: special case for axial
-        if (!trace_ispoint) {
+        if (!tw->ispoint) {
             // general box case
             // push the plane out apropriately for mins/maxs
-            dist = DotProduct(trace_offsets[plane->signbits], plane->normal);
+            dist = DotProduct(tw->offsets[plane->signbits], plane->normal);
             dist = plane->dist - dist;
         } else {
             // special point case
@@ -523,19 +628,22 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
             continue;
 
         // crosses face
+        idist = 1.0f / (d1 - d2);
         if (d1 > d2) {
             // enter
-            f = (d1 - DIST_EPSILON) / (d1 - d2);
+            f = (d1 - DIST_EPSILON) * idist;
             if (f > enterfrac) {
                 enterfrac = f;
                 clipplane = plane;
                 leadside = side;
             }
+            enterexact = max(enterexact, d1 * idist);
         } else {
             // leave
-            f = (d1 + DIST_EPSILON) / (d1 - d2);
+            f = (d1 + DIST_EPSILON) * idist;
             if (f < leavefrac)
                 leavefrac = f;
+            leaveexact = min(leaveexact, d1 * idist);
         }
     }
 
@@ -544,22 +652,37 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
         trace->startsolid = true;
         if (!getout) {
             trace->allsolid = true;
-            if (!map_allsolid_bug->integer) {
+            if (!map_allsolid_bug->integer && (!tw->tiebreak || CM_NearerHit(tw, 0, 0, brush))) {
                 // original Q2 didn't set these
                 trace->fraction = 0;
                 trace->contents = brush->contents;
+                tw->exact = 0;
+                if (tw->tiebreak) {
+                    // don't keep plane and surface of another brush
+                    memset(&trace->plane, 0, sizeof(trace->plane));
+                    trace->surface = &nulltexinfo.c;
+                    tw->brush = brush;
+                }
             }
         }
         return;
     }
+
+    // box must really get inside of the brush. Brushes it only passes
+    // within DIST_EPSILON of may or may not be in the leafs the trace
+    // visits, so ignore them to not depend on BSP (or brush tree) layout.
+    if (enterexact >= leaveexact)
+        return;
     if (enterfrac < leavefrac) {
-        if (enterfrac > -1 && enterfrac < trace->fraction) {
+        if (enterfrac > -1 && CM_NearerHit(tw, enterexact, enterfrac, brush)) {
             if (enterfrac < 0)
                 enterfrac = 0;
             trace->fraction = enterfrac;
             trace->plane = *clipplane;
             trace->surface = &(leadside->texinfo->c);
             trace->contents = brush->contents;
+            tw->brush = brush;
+            tw->exact = enterexact;
         }
     }
 }
@@ -569,7 +692,7 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
 CM_TestBoxInBrush
 ================
 */
-static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, mbrush_t *brush)
+static void CM_TestBoxInBrush(const tracework_t *tw, const vec3_t p1, trace_t *trace, mbrush_t *brush)
 {
     int         i;
     cplane_t    *plane;
@@ -587,7 +710,7 @@ static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, mbrush_t *brush)
         // FIXME: special case for axial
         // general box case
         // push the plane out apropriately for mins/maxs
-        dist = DotProduct(trace_offsets[plane->signbits], plane->normal);
+        dist = DotProduct(tw->offsets[plane->signbits], plane->normal);
         dist = plane->dist - dist;
 
         d1 = DotProduct(p1, plane->normal) - dist;
@@ -608,25 +731,24 @@ static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, mbrush_t *brush)
 CM_TraceToLeaf
 ================
 */
-static void CM_TraceToLeaf(mleaf_t *leaf)
+static void CM_TraceToLeaf(tracework_t *tw, mleaf_t *leaf)
 {
     int         k;
     mbrush_t    *b, **leafbrush;
 
-    if (!(leaf->contents & trace_contents))
+    if (!(leaf->contents & tw->contents))
         return;
     // trace line against all brushes in the leaf
     leafbrush = leaf->firstleafbrush;
     for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
         b = *leafbrush;
-        if (b->checkcount == checkcount)
+        if (CM_CheckBrush(tw, b))
             continue;   // already checked this brush in another leaf
-        b->checkcount = checkcount;
 
-        if (!(b->contents & trace_contents))
+        if (!(b->contents & tw->contents))
             continue;
-        CM_ClipBoxToBrush(trace_start, trace_end, trace_trace, b);
-        if (!trace_trace->fraction)
+        CM_ClipBoxToBrush(tw, tw->start, tw->end, tw->trace, b);
+        if (!tw->trace->fraction)
             return;
     }
 }
@@ -636,25 +758,24 @@ static void CM_TraceToLeaf(mleaf_t *leaf)
 CM_TestInLeaf
 ================
 */
-static void CM_TestInLeaf(mleaf_t *leaf)
+static void CM_TestInLeaf(tracework_t *tw, mleaf_t *leaf)
 {
     int         k;
     mbrush_t    *b, **leafbrush;
 
-    if (!(leaf->contents & trace_contents))
+    if (!(leaf->contents & tw->contents))
         return;
     // trace line against all brushes in the leaf
     leafbrush = leaf->firstleafbrush;
     for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
         b = *leafbrush;
-        if (b->checkcount == checkcount)
+        if (CM_CheckBrush(tw, b))
             continue;   // already checked this brush in another leaf
-        b->checkcount = checkcount;
 
-        if (!(b->contents & trace_contents))
+        if (!(b->contents & tw->contents))
             continue;
-        CM_TestBoxInBrush(trace_start, trace_trace, b);
-        if (!trace_trace->fraction)
+        CM_TestBoxInBrush(tw, tw->start, tw->trace, b);
+        if (!tw->trace->fraction)
             return;
     }
 }
@@ -665,7 +786,7 @@ CM_RecursiveHullCheck
 
 ==================
 */
-static void CM_RecursiveHullCheck(mnode_t *node, float p1f, float p2f, const vec3_t p1, const vec3_t p2)
+static void CM_RecursiveHullCheck(tracework_t *tw, mnode_t *node, float p1f, float p2f, const vec3_t p1, const vec3_t p2)
 {
     cplane_t    *plane;
     float       t1, t2, offset;
@@ -675,14 +796,14 @@ static void CM_RecursiveHullCheck(mnode_t *node, float p1f, float p2f, const vec
     int         side;
     float       midf;
 
-    if (trace_trace->fraction <= p1f)
+    if (tw->exact <= p1f)
         return;     // already hit something nearer
 
 recheck:
     // if plane is NULL, we are in a leaf node
     plane = node->plane;
     if (!plane) {
-        CM_TraceToLeaf((mleaf_t *)node);
+        CM_TraceToLeaf(tw, (mleaf_t *)node);
         return;
     }
 
@@ -693,16 +814,16 @@ recheck:
     if (plane->type < 3) {
         t1 = p1[plane->type] - plane->dist;
         t2 = p2[plane->type] - plane->dist;
-        offset = trace_extents[plane->type];
+        offset = tw->extents[plane->type];
     } else {
         t1 = PlaneDiff(p1, plane);
         t2 = PlaneDiff(p2, plane);
-        if (trace_ispoint)
+        if (tw->ispoint)
             offset = 0;
         else
-            offset = fabsf(trace_extents[0] * plane->normal[0]) +
-                     fabsf(trace_extents[1] * plane->normal[1]) +
-                     fabsf(trace_extents[2] * plane->normal[2]);
+            offset = fabsf(tw->extents[0] * plane->normal[0]) +
+                     fabsf(tw->extents[1] * plane->normal[1]) +
+                     fabsf(tw->extents[2] * plane->normal[2]);
     }
 
     // see which sides we need to consider
@@ -715,12 +836,14 @@ recheck:
         goto recheck;
     }
 
-    // put the crosspoint DIST_EPSILON pixels on the near side
+    // overlap both sides by DIST_EPSILON pixels past the crosspoint. Original
+    // Q2 stopped short of the plane when moving to the front side, missing
+    // brushes the box gets into right behind the plane.
     if (t1 < t2) {
         idist = 1.0f / (t1 - t2);
         side = 1;
         frac2 = (t1 + offset + DIST_EPSILON) * idist;
-        frac = (t1 - offset + DIST_EPSILON) * idist;
+        frac = (t1 - offset - DIST_EPSILON) * idist;
     } else if (t1 > t2) {
         idist = 1.0f / (t1 - t2);
         side = 0;
@@ -736,17 +859,463 @@ recheck:
     midf = p1f + (p2f - p1f) * clamp(frac, 0, 1);
     LerpVector(p1, p2, frac, mid);
 
-    CM_RecursiveHullCheck(node->children[side], p1f, midf, p1, mid);
+    CM_RecursiveHullCheck(tw, node->children[side], p1f, midf, p1, mid);
 
     // go past the node
     midf = p1f + (p2f - p1f) * clamp(frac2, 0, 1);
     LerpVector(p1, p2, frac2, mid);
 
-    CM_RecursiveHullCheck(node->children[side ^ 1], midf, p2f, mid, p2);
+    CM_RecursiveHullCheck(tw, node->children[side ^ 1], midf, p2f, mid, p2);
+}
+
+/*
+===============================================================================
+
+BRUSH TREE
+
+Optional bounding volume hierarchy over world brushes (map_bvh). Brushes are
+still clipped by CM_ClipBoxToBrush, and boxes are conservative, so results
+match CM_RecursiveHullCheck except for the choice between equally near
+brushes. Both only report brushes the box really gets into, nearest by
+where it enters them, so near misses within DIST_EPSILON that only one of
+them happens to test don't count. The BSP walk reports the first one it
+tests. The tree visits every brush that could still tie, even after a hit
+at fraction 0, and reports the lowest numbered one, so its result doesn't
+depend on tree layout.
+
+===============================================================================
+*/
+
+#define MAX_BRUSH_TREES     4
+#define TREE_LEAF_BRUSHES   4
+#define TREE_STACK          64
+
+// slack for box tests, must be larger than DIST_EPSILON
+#define TREE_EPSILON        1.0f
+
+// bounds of space outside of the world
+#define TREE_MAX_EXTENT     1e6f
+
+typedef struct {
+    vec3_t      mins, maxs;
+    int         index;      // first brush for leafs, second child for nodes
+    uint16_t    count;      // number of brushes for leafs, 0 for nodes
+    uint16_t    axis;       // split axis for nodes
+} treenode_t;
+
+typedef struct {
+    vec3_t      mins, maxs;
+    mbrush_t    *brush;
+    int         contents;   // combined contents of leafs brush is in
+} treebrush_t;
+
+typedef struct brushtree_s {
+    mnode_t     *headnode;
+    int         refcount;
+    int         numnodes;
+    int         numbrushes;
+    treenode_t  *nodes;
+    treebrush_t *brushes;
+} brushtree_t;
+
+typedef struct {
+    float       key;
+    int         index;
+} treesort_t;
+
+typedef struct {
+    bsp_t       *bsp;
+    treebrush_t *brushes;   // indexed by brush number during build
+    treebrush_t *temp;
+    treesort_t  *sort;
+} treework_t;
+
+// trees are shared by all users of the same BSP (i.e. client and server)
+static brushtree_t  *brushtrees[MAX_BRUSH_TREES];
+
+static brushtree_t *CM_FindBrushTree(const mnode_t *headnode)
+{
+    int i;
+
+    for (i = 0; i < MAX_BRUSH_TREES; i++)
+        if (brushtrees[i] && brushtrees[i]->headnode == headnode)
+            return brushtrees[i];
+
+    return NULL;
+}
+
+// accumulates conservative bounds of leafs each brush is in
+static void CM_LeafBounds_r(treework_t *tw, mnode_t *node, const vec3_t mins, const vec3_t maxs)
+{
+    vec3_t      m1, m2;
+    cplane_t    *plane;
+    mleaf_t     *leaf;
+    treebrush_t *b;
+    int         i, k;
+
+    VectorCopy(mins, m1);
+    VectorCopy(maxs, m2);
+
+    while ((plane = node->plane)) {
+        if (plane->type < 3) {
+            vec3_t  back;
+
+            // back side is below plane
+            VectorCopy(m2, back);
+            back[plane->type] = min(back[plane->type], plane->dist);
+            if (m1[plane->type] <= back[plane->type])
+                CM_LeafBounds_r(tw, node->children[1], m1, back);
+
+            m1[plane->type] = max(m1[plane->type], plane->dist);
+            if (m1[plane->type] > m2[plane->type])
+                return;
+        } else {
+            CM_LeafBounds_r(tw, node->children[1], m1, m2);
+        }
+        node = node->children[0];
+    }
+
+    leaf = (mleaf_t *)node;
+    for (k = 0; k < leaf->numleafbrushes; k++) {
+        b = &tw->brushes[leaf->firstleafbrush[k] - tw->bsp->brushes];
+        for (i = 0; i < 3; i++) {
+            b->mins[i] = min(b->mins[i], m1[i]);
+            b->maxs[i] = max(b->maxs[i], m2[i]);
+        }
+        b->brush = leaf->firstleafbrush[k];
+        b->contents |= leaf->contents;
+    }
+}
+
+// uses axial planes for bounds if brush has all of them, otherwise bounds
+// of leafs it is in. Both can't be combined, as brush planes pushed out
+// by box size can clip outside of the leafs.
+static void CM_BrushBounds(treebrush_t *b)
+{
+    mbrushside_t    *side;
+    cplane_t        *plane;
+    vec3_t          mins, maxs;
+    int             i, j, axial;
+
+    VectorSet(mins, -TREE_MAX_EXTENT, -TREE_MAX_EXTENT, -TREE_MAX_EXTENT);
+    VectorSet(maxs, TREE_MAX_EXTENT, TREE_MAX_EXTENT, TREE_MAX_EXTENT);
+    axial = 0;
+
+    // negative axial planes are not marked with axial type
+    side = b->brush->firstbrushside;
+    for (i = 0; i < b->brush->numsides; i++, side++) {
+        plane = side->plane;
+        for (j = 0; j < 3; j++) {
+            if (plane->normal[j] == 1) {
+                maxs[j] = min(maxs[j], plane->dist);
+                axial |= 1 << j;
+            } else if (plane->normal[j] == -1) {
+                mins[j] = max(mins[j], -plane->dist);
+                axial |= 8 << j;
+            }
+        }
+    }
+
+    if (axial == 63) {
+        VectorCopy(mins, b->mins);
+        VectorCopy(maxs, b->maxs);
+    }
+}
+
+static int CM_SortBrushes(const void *p1, const void *p2)
+{
+    const treesort_t *s1 = p1;
+    const treesort_t *s2 = p2;
+
+    if (s1->key < s2->key)
+        return -1;
+    if (s1->key > s2->key)
+        return 1;
+    return s1->index - s2->index;
+}
+
+static int CM_BuildBrushTree_r(treework_t *tw, brushtree_t *tree, int first, int count)
+{
+    treebrush_t *b = tree->brushes + first;
+    treenode_t  *node = tree->nodes + tree->numnodes;
+    vec3_t      mins, maxs, size;
+    int         i, index, axis, half;
+
+    index = tree->numnodes++;
+
+    ClearBounds(node->mins, node->maxs);
+    ClearBounds(mins, maxs);
+    for (i = 0; i < count; i++) {
+        AddPointToBounds(b[i].mins, node->mins, node->maxs);
+        AddPointToBounds(b[i].maxs, node->mins, node->maxs);
+        VectorAvg(b[i].mins, b[i].maxs, size);
+        AddPointToBounds(size, mins, maxs);
+    }
+
+    if (count <= TREE_LEAF_BRUSHES) {
+        node->index = first;
+        node->count = count;
+        node->axis = 0;
+        return index;
+    }
+
+    // split at median of centers along the longest axis
+    VectorSubtract(maxs, mins, size);
+    axis = 0;
+    if (size[1] > size[axis])
+        axis = 1;
+    if (size[2] > size[axis])
+        axis = 2;
+
+    for (i = 0; i < count; i++) {
+        tw->sort[i].key = b[i].mins[axis] + b[i].maxs[axis];
+        tw->sort[i].index = i;
+    }
+    qsort(tw->sort, count, sizeof(tw->sort[0]), CM_SortBrushes);
+
+    for (i = 0; i < count; i++)
+        tw->temp[i] = b[tw->sort[i].index];
+    memcpy(b, tw->temp, sizeof(b[0]) * count);
+
+    half = count / 2;
+    node->count = 0;
+    node->axis = axis;
+    CM_BuildBrushTree_r(tw, tree, first, half);
+    node->index = CM_BuildBrushTree_r(tw, tree, first + half, count - half);
+    return index;
+}
+
+static brushtree_t *CM_AllocBrushTree(bsp_t *bsp)
+{
+    mnode_t     *headnode = bsp->models[0].headnode;
+    brushtree_t *tree;
+    treework_t  tw;
+    vec3_t      mins, maxs;
+    int         i, slot, count;
+
+    tree = CM_FindBrushTree(headnode);
+    if (tree) {
+        tree->refcount++;
+        return tree;
+    }
+
+    for (slot = 0; slot < MAX_BRUSH_TREES; slot++)
+        if (!brushtrees[slot])
+            break;
+    if (slot == MAX_BRUSH_TREES || !bsp->numbrushes) {
+        return NULL;
+    }
+
+    tw.bsp = bsp;
+    tw.brushes = Z_TagMallocz(sizeof(tw.brushes[0]) * bsp->numbrushes, TAG_CMODEL);
+    for (i = 0; i < bsp->numbrushes; i++)
+        ClearBounds(tw.brushes[i].mins, tw.brushes[i].maxs);
+
+    VectorSet(mins, -TREE_MAX_EXTENT, -TREE_MAX_EXTENT, -TREE_MAX_EXTENT);
+    VectorSet(maxs, TREE_MAX_EXTENT, TREE_MAX_EXTENT, TREE_MAX_EXTENT);
+    CM_LeafBounds_r(&tw, headnode, mins, maxs);
+
+    // keep only brushes in world leafs
+    for (i = count = 0; i < bsp->numbrushes; i++) {
+        if (!tw.brushes[i].brush || !tw.brushes[i].brush->numsides)
+            continue;
+        CM_BrushBounds(&tw.brushes[i]);
+        tw.brushes[count++] = tw.brushes[i];
+    }
+
+    if (!count) {
+        Z_Free(tw.brushes);
+        return NULL;
+    }
+
+    tree = Z_TagMallocz(sizeof(*tree), TAG_CMODEL);
+    tree->headnode = headnode;
+    tree->refcount = 1;
+    tree->numbrushes = count;
+    tree->brushes = tw.brushes;
+    tree->nodes = Z_TagMalloc(sizeof(tree->nodes[0]) * (count * 2 + 1), TAG_CMODEL);
+
+    tw.temp = Z_TagMalloc(sizeof(tw.temp[0]) * (count + 1), TAG_CMODEL);
+    tw.sort = Z_TagMalloc(sizeof(tw.sort[0]) * (count + 1), TAG_CMODEL);
+    CM_BuildBrushTree_r(&tw, tree, 0, count);
+    Z_Free(tw.temp);
+    Z_Free(tw.sort);
+
+    brushtrees[slot] = tree;
+
+    Com_DPrintf("%s: %d brushes, %d nodes\n", __func__,
+                tree->numbrushes, tree->numnodes);
+    return tree;
+}
+
+static void CM_FreeBrushTree(brushtree_t *tree)
+{
+    int i;
+
+    if (!tree || --tree->refcount > 0)
+        return;
+
+    for (i = 0; i < MAX_BRUSH_TREES; i++)
+        if (brushtrees[i] == tree)
+            brushtrees[i] = NULL;
+
+    Z_Free(tree->nodes);
+    Z_Free(tree->brushes);
+    Z_Free(tree);
+}
+
+// returns true if box swept from start up to where the trace enters the
+// nearest brush so far can get within TREE_EPSILON of bounds
+static bool CM_SweepBounds(const tracework_t *tw, const vec3_t mins, const vec3_t maxs)
+{
+    float   t1 = 0, t2 = tw->exact;
+    float   a, b;
+    int     i;
+
+    for (i = 0; i < 3; i++) {
+        a = mins[i] - tw->offsets[7][i] - TREE_EPSILON - tw->start[i];
+        b = maxs[i] - tw->offsets[0][i] + TREE_EPSILON - tw->start[i];
+        if (!tw->invdir[i]) {
+            if (a > 0 || b < 0)
+                return false;
+            continue;
+        }
+        a *= tw->invdir[i];
+        b *= tw->invdir[i];
+        if (a > b) {
+            t1 = max(t1, b);
+            t2 = min(t2, a);
+        } else {
+            t1 = max(t1, a);
+            t2 = min(t2, b);
+        }
+        if (t1 > t2)
+            return false;
+    }
+
+    return true;
+}
+
+static void CM_ClipBoxToTreeBrush(tracework_t *tw, const treebrush_t *b)
+{
+    if (!(b->contents & tw->contents))
+        return;
+    if (!(b->brush->contents & tw->contents))
+        return;
+    if (!CM_SweepBounds(tw, b->mins, b->maxs))
+        return;
+    CM_ClipBoxToBrush(tw, tw->start, tw->end, tw->trace, b->brush);
+}
+
+static void CM_TraceBrushTree(tracework_t *tw, const brushtree_t *tree)
+{
+    const treenode_t    *node, *first, *second;
+    const treebrush_t   *b;
+    int                 stack[TREE_STACK];
+    int                 i, depth = 0;
+
+    node = tree->nodes;
+    while (1) {
+        if (CM_SweepBounds(tw, node->mins, node->maxs)) {
+            if (!node->count) {
+                // visit nearest child first
+                first = node + 1;
+                second = tree->nodes + node->index;
+                if (tw->end[node->axis] < tw->start[node->axis])
+                    SWAP(const treenode_t *, first, second);
+                Q_assert(depth < TREE_STACK);
+                stack[depth++] = second - tree->nodes;
+                node = first;
+                continue;
+            }
+
+            b = tree->brushes + node->index;
+            for (i = 0; i < node->count; i++, b++)
+                CM_ClipBoxToTreeBrush(tw, b);
+        }
+
+        if (!depth)
+            return;
+        node = tree->nodes + stack[--depth];
+    }
+}
+
+// collects brushes touching bounds, returns -1 if there are too many
+static int CM_GatherBrushTree(const brushtree_t *tree, const vec3_t mins, const vec3_t maxs,
+                              const treebrush_t **list, int maxbrushes)
+{
+    const treenode_t    *node;
+    int                 stack[TREE_STACK];
+    int                 i, depth = 0, count = 0;
+
+    node = tree->nodes;
+    while (1) {
+        for (i = 0; i < 3; i++)
+            if (node->mins[i] > maxs[i] || node->maxs[i] < mins[i])
+                break;
+
+        if (i == 3) {
+            if (!node->count) {
+                Q_assert(depth < TREE_STACK);
+                stack[depth++] = node->index;
+                node++;
+                continue;
+            }
+
+            if (count + node->count > maxbrushes)
+                return -1;
+            for (i = 0; i < node->count; i++)
+                list[count++] = tree->brushes + node->index + i;
+        }
+
+        if (!depth)
+            return count;
+        node = tree->nodes + stack[--depth];
+    }
 }
 
 //======================================================================
 
+static void CM_InitTrace(tracework_t *tw, trace_t *trace,
+                         const vec3_t start, const vec3_t end,
+                         const vec3_t mins, const vec3_t maxs, int brushmask)
+{
+    const vec_t *bounds[2] = { mins, maxs };
+    int i, j;
+
+    // fill in a default trace
+    memset(trace, 0, sizeof(*trace));
+    trace->fraction = 1;
+    trace->surface = &(nulltexinfo.c);
+
+    tw->trace = trace;
+    tw->tiebreak = false;
+    tw->brush = NULL;
+    tw->exact = 1;
+    tw->contents = brushmask;
+    VectorCopy(start, tw->start);
+    VectorCopy(end, tw->end);
+    for (i = 0; i < 8; i++)
+        for (j = 0; j < 3; j++)
+            tw->offsets[i][j] = bounds[(i >> j) & 1][j];
+
+    for (i = 0; i < 3; i++)
+        tw->invdir[i] = end[i] != start[i] ? 1.0f / (end[i] - start[i]) : 0;
+
+    //
+    // check for point special case
+    //
+    if (VectorEmpty(mins) && VectorEmpty(maxs)) {
+        tw->ispoint = true;
+        VectorClear(tw->extents);
+    } else {
+        tw->ispoint = false;
+        tw->extents[0] = max(-mins[0], maxs[0]);
+        tw->extents[1] = max(-mins[1], maxs[1]);
+        tw->extents[2] = max(-mins[2], maxs[2]);
+    }
+}
+
 /*
 ==================
 CM_BoxTrace
@@ -757,28 +1326,16 @@ void CM_BoxTrace(trace_t *trace,
                  const vec3_t mins, const vec3_t maxs,
                  mnode_t *headnode, int brushmask)
 {
-    const vec_t *bounds[2] = { mins, maxs };
-    int i, j;
+    tracework_t tw;
+    brushtree_t *tree;
+    int i;
 
-    checkcount++;       // for multi-check avoidance
-
-    // fill in a default trace
-    trace_trace = trace;
-    memset(trace_trace, 0, sizeof(*trace_trace));
-    trace_trace->fraction = 1;
-    trace_trace->surface = &(nulltexinfo.c);
+    CM_InitTrace(&tw, trace, start, end, mins, maxs, brushmask);
 
     if (!headnode) {
         return;
     }
 
-    trace_contents = brushmask;
-    VectorCopy(start, trace_start);
-    VectorCopy(end, trace_end);
-    for (i = 0; i < 8; i++)
-        for (j = 0; j < 3; j++)
-            trace_offsets[i][j] = bounds[(i >> j) & 1][j];
-
     //
     // check for position test special case
     //
@@ -787,6 +1344,8 @@ void CM_BoxTrace(trace_t *trace,
         int         numleafs;
         vec3_t      c1, c2;
 
+        tw.numchecked = 0;
+
         VectorAdd(start, mins, c1);
         VectorAdd(start, maxs, c2);
         for (i = 0; i < 3; i++) {
@@ -796,36 +1355,84 @@ void CM_BoxTrace(trace_t *trace,
 
         numleafs = CM_BoxLeafs_headnode(c1, c2, leafs, q_countof(leafs), headnode, NULL);
         for (i = 0; i < numleafs; i++) {
-            CM_TestInLeaf(leafs[i]);
-            if (trace_trace->allsolid)
+            CM_TestInLeaf(&tw, leafs[i]);
+            if (trace->allsolid)
                 break;
         }
-        VectorCopy(start, trace_trace->endpos);
+        VectorCopy(start, trace->endpos);
         return;
     }
 
     //
-    // check for point special case
+    // general sweeping through world
     //
-    if (VectorEmpty(mins) && VectorEmpty(maxs)) {
-        trace_ispoint = true;
-        VectorClear(trace_extents);
+    if (map_bvh->integer && (tree = CM_FindBrushTree(headnode))) {
+        tw.tiebreak = true;
+        CM_TraceBrushTree(&tw, tree);
     } else {
-        trace_ispoint = false;
-        trace_extents[0] = max(-mins[0], maxs[0]);
-        trace_extents[1] = max(-mins[1], maxs[1]);
-        trace_extents[2] = max(-mins[2], maxs[2]);
+        tw.numchecked = 0;
+        CM_RecursiveHullCheck(&tw, headnode, 0, 1, start, end);
     }
 
-    //
-    // general sweeping through world
-    //
-    CM_RecursiveHullCheck(headnode, 0, 1, start, end);
-
-    if (trace_trace->fraction == 1)
-        VectorCopy(end, trace_trace->endpos);
+    if (trace->fraction == 1)
+        VectorCopy(end, trace->endpos);
     else
-        LerpVector(start, end, trace_trace->fraction, trace_trace->endpos);
+        LerpVector(start, end, trace->fraction, trace->endpos);
+}
+
+/*
+==================
+CM_BoxTraceBundle
+
+Traces a number of boxes of the same size, like the ones issued by a single
+move. Brushes near all of them are collected from the brush tree only once.
+==================
+*/
+void CM_BoxTraceBundle(trace_t *traces,
+                       const vec3_t *starts, const vec3_t *ends, int count,
+                       const vec3_t mins, const vec3_t maxs,
+                       mnode_t *headnode, int brushmask)
+{
+    const treebrush_t   *list[256];
+    tracework_t tw;
+    brushtree_t *tree;
+    vec3_t      bmins, bmaxs;
+    int         i, j, numbrushes;
+
+    tree = NULL;
+    if (map_bvh->integer && count > 1)
+        tree = CM_FindBrushTree(headnode);
+
+    numbrushes = -1;
+    if (tree) {
+        ClearBounds(bmins, bmaxs);
+        for (i = 0; i < count; i++) {
+            AddPointToBounds(starts[i], bmins, bmaxs);
+            AddPointToBounds(ends[i], bmins, bmaxs);
+        }
+        for (i = 0; i < 3; i++) {
+            bmins[i] += mins[i] - TREE_EPSILON;
+            bmaxs[i] += maxs[i] + TREE_EPSILON;
+        }
+        numbrushes = CM_GatherBrushTree(tree, bmins, bmaxs, list, q_countof(list));
+    }
+
+    for (i = 0; i < count; i++) {
+        if (numbrushes < 0 || VectorCompare(starts[i], ends[i])) {
+            CM_BoxTrace(&traces[i], starts[i], ends[i], mins, maxs, headnode, brushmask);
+            continue;
+        }
+
+        CM_InitTrace(&tw, &traces[i], starts[i], ends[i], mins, maxs, brushmask);
+        tw.tiebreak = true;
+        for (j = 0; j < numbrushes; j++)
+            CM_ClipBoxToTreeBrush(&tw, list[j]);
+
+        if (traces[i].fraction == 1)
+            VectorCopy(ends[i], traces[i].endpos);
+        else
+            LerpVector(starts[i], ends[i], traces[i].fraction, traces[i].endpos);
+    }
 }
 
 /*
@@ -1150,12 +1757,14 @@ CM_Init
 */
 void CM_Init(void)
 {
-    CM_InitBoxHull();
+    CM_InitBoxHull(&box_hull);
+    box_headnode = &box_hull.nodes[0];
 
     nullleaf.cluster = -1;
 
     map_noareas = Cvar_Get("map_noareas", "0", 0);
     map_allsolid_bug = Cvar_Get("map_allsolid_bug", "1", 0);
     map_override_path = Cvar_Get("map_override_path", "", 0);
+    map_bvh = Cvar_Get("map_bvh", "0", 0);
 }
 
@@ -50,6 +50,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "server/server.h"
 #include "system/system.h"
 #include "system/hunk.h"
+#include "system/pthread.h"
 
 #include <setjmp.h>
 
@@ -69,6 +70,10 @@ static int      com_printEntered;
 
 static qhandle_t    com_logFile;
 static bool         com_logNewline;
+static char         com_logPath[MAX_OSPATH];
+static int64_t      com_logSize;
+static int64_t      com_logStart;   // size rotation limit counts from
+static time_t       com_logTime;
 static bool         com_conNewline;
 
 static char     **com_argv;
@@ -91,6 +96,9 @@ cvar_t  *logfile_enable;    // 1 = create new, 2 = append to existing
 cvar_t  *logfile_flush;     // 1 = flush after each print
 cvar_t  *logfile_name;
 cvar_t  *logfile_prefix;
+cvar_t  *logfile_async;     // 1 = write from background thread
+cvar_t  *logfile_rotate_size;   // in KiB
+cvar_t  *logfile_rotate_time;   // in minutes
 cvar_t  *console_prefix;
 
 #if USE_CLIENT
@@ -126,12 +134,25 @@ const char  com_version_string[] =
 unsigned    com_framenum;
 unsigned    com_eventTime;
 unsigned    com_localTime;
+
+static uint64_t     com_frameTime;  // microseconds, sub-millisecond part excluded
+
+// frame pacing statistics for host_speeds
+static struct {
+    uint64_t    last;       // start of previous frame
+    uint64_t    deadline;   // start time requested for current frame
+    uint64_t    start;      // start of current sampling period
+    unsigned    frames;
+    double      sum, sumsq, max;
+    double      late, maxlate;
+} com_jitter;
 bool        com_initialized;
 time_t      com_startTime;
 
-#if USE_CLIENT
 cvar_t  *host_speeds;
+cvar_t  *com_sleep_slack;
 
+#if USE_CLIENT
 // host_speeds times
 unsigned    time_before_game;
 unsigned    time_after_game;
@@ -207,6 +228,189 @@ static void Com_Redirect(const char *msg, size_t total)
     }
 }
 
+/*
+==============================================================================
+
+ASYNCHRONOUS CONSOLE LOG
+
+Main thread formats log lines into a ring buffer and never waits for disk
+I/O. Writer thread drains the buffer in as large chunks as possible. When
+the buffer is full, text is dropped and a note is inserted once there is
+free space again.
+
+==============================================================================
+*/
+
+#define LOGQ_SIZE   (1 << 20)   // must be power of two
+
+static struct {
+    bool            running;
+    bool            shutdown;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;       // signalled when data is queued
+    pthread_cond_t  idle;       // signalled when queue is drained
+    qhandle_t       file;
+    byte            *data;
+    size_t          head;       // advanced by main thread
+    size_t          tail;       // advanced by writer thread
+    int             error;      // set by writer thread
+    size_t          peak;
+    uint64_t        written;
+    uint64_t        batches;
+    uint64_t        dropped;    // main thread only
+    uint64_t        reported;   // main thread only
+    unsigned        rotations;  // main thread only
+} logq;
+
+static void *logfile_thread(void *arg)
+{
+    size_t pending, ofs, len;
+    int ret;
+
+    pthread_mutex_lock(&logq.lock);
+    while (1) {
+        pending = logq.head - logq.tail;
+        if (!pending) {
+            pthread_cond_signal(&logq.idle);
+            if (logq.shutdown)
+                break;
+            pthread_cond_wait(&logq.wake, &logq.lock);
+            continue;
+        }
+
+        // main thread never touches pending part of the buffer
+        ofs = logq.tail & (LOGQ_SIZE - 1);
+        len = min(pending, LOGQ_SIZE - ofs);
+        pthread_mutex_unlock(&logq.lock);
+
+        // discard everything after the first error
+        ret = logq.error ? len : FS_Write(logq.data + ofs, len, logq.file);
+
+        pthread_mutex_lock(&logq.lock);
+        if (ret != len)
+            logq.error = ret < 0 ? ret : Q_ERR_FAILURE;
+        logq.tail += len;
+        logq.written += len;
+        logq.batches++;
+    }
+    pthread_mutex_unlock(&logq.lock);
+
+    return NULL;
+}
+
+static void logfile_start_thread(void)
+{
+    if (!logfile_async->integer)
+        return;
+
+    logq.shutdown = false;
+    logq.file = com_logFile;
+    logq.data = Z_Malloc(LOGQ_SIZE);
+    logq.head = logq.tail = 0;
+    logq.error = 0;
+
+    pthread_mutex_init(&logq.lock, NULL);
+    pthread_cond_init(&logq.wake, NULL);
+    pthread_cond_init(&logq.idle, NULL);
+
+    if (pthread_create(&logq.thread, NULL, logfile_thread, NULL)) {
+        pthread_cond_destroy(&logq.idle);
+        pthread_cond_destroy(&logq.wake);
+        pthread_mutex_destroy(&logq.lock);
+        Z_Free(logq.data);
+        logq.data = NULL;
+        Com_WPrintf("Couldn't create console log thread\n");
+        return;
+    }
+
+    logq.running = true;
+}
+
+// drains the queue and stops writer thread, further writes are synchronous
+static void logfile_stop_thread(void)
+{
+    if (!logq.running)
+        return;
+
+    pthread_mutex_lock(&logq.lock);
+    logq.shutdown = true;
+    pthread_cond_signal(&logq.wake);
+    pthread_mutex_unlock(&logq.lock);
+
+    pthread_join(logq.thread, NULL);
+
+    pthread_cond_destroy(&logq.idle);
+    pthread_cond_destroy(&logq.wake);
+    pthread_mutex_destroy(&logq.lock);
+    Z_Free(logq.data);
+    logq.data = NULL;
+
+    logq.running = false;
+}
+
+// waits until writer thread has written everything queued so far
+static void logfile_sync(void)
+{
+    if (!logq.running)
+        return;
+
+    pthread_mutex_lock(&logq.lock);
+    while (logq.head != logq.tail)
+        pthread_cond_wait(&logq.idle, &logq.lock);
+    pthread_mutex_unlock(&logq.lock);
+}
+
+// returns false if there is not enough free space
+static bool logfile_enqueue(const char *text, size_t len, int *error)
+{
+    size_t head, ofs, n;
+
+    pthread_mutex_lock(&logq.lock);
+    *error = logq.error;
+    if (len > LOGQ_SIZE - (logq.head - logq.tail)) {
+        pthread_mutex_unlock(&logq.lock);
+        return false;
+    }
+    head = logq.head;
+    pthread_mutex_unlock(&logq.lock);
+
+    ofs = head & (LOGQ_SIZE - 1);
+    n = min(len, LOGQ_SIZE - ofs);
+    memcpy(logq.data + ofs, text, n);
+    memcpy(logq.data, text + n, len - n);
+
+    pthread_mutex_lock(&logq.lock);
+    logq.head = head + len;
+    logq.peak = max(logq.peak, logq.head - logq.tail);
+    pthread_cond_signal(&logq.wake);
+    pthread_mutex_unlock(&logq.lock);
+
+    return true;
+}
+
+static int logfile_queue(const char *text, size_t len)
+{
+    char note[MAX_QPATH];
+    size_t notelen;
+    int ret;
+
+    if (logq.dropped != logq.reported) {
+        notelen = Q_scnprintf(note, sizeof(note), "*** %"PRIu64" bytes of console log dropped ***\n",
+                              logq.dropped - logq.reported);
+        if (!logfile_enqueue(note, notelen, &ret)) {
+            logq.dropped += len;
+            return ret;
+        }
+        logq.reported = logq.dropped;
+    }
+
+    if (!logfile_enqueue(text, len, &ret))
+        logq.dropped += len;
+
+    return ret;
+}
+
 static void logfile_close(void)
 {
     if (!com_logFile) {
@@ -215,17 +419,15 @@ static void logfile_close(void)
 
     Com_Printf("Closing console log.\n");
 
+    logfile_stop_thread();
     FS_CloseFile(com_logFile);
     com_logFile = 0;
 }
 
-static void logfile_open(void)
+static void logfile_open(unsigned mode)
 {
-    char buffer[MAX_OSPATH];
-    unsigned mode;
     qhandle_t f;
 
-    mode = logfile_enable->integer > 1 ? FS_MODE_APPEND : FS_MODE_WRITE;
     if (logfile_flush->integer > 0) {
         if (logfile_flush->integer > 1) {
             mode |= FS_BUF_NONE;
@@ -234,7 +436,7 @@ static void logfile_open(void)
         }
     }
 
-    f = FS_EasyOpenFile(buffer, sizeof(buffer), mode | FS_FLAG_TEXT,
+    f = FS_EasyOpenFile(com_logPath, sizeof(com_logPath), mode | FS_FLAG_TEXT,
                         "logs/", logfile_name->string, ".log");
     if (!f) {
         Cvar_Set("logfile", "0");
@@ -243,23 +445,86 @@ static void logfile_open(void)
 
     com_logFile = f;
     com_logNewline = false;
-    Com_Printf("Logging console to %s\n", buffer);
+    com_logSize = max(FS_Tell(f), 0);
+    com_logStart = 0;
+    com_logTime = time(NULL);
+    logfile_start_thread();
+    Com_Printf("Logging console to %s\n", com_logPath);
 }
 
 static void logfile_enable_changed(cvar_t *self)
 {
     logfile_close();
     if (self->integer) {
-        logfile_open();
+        logfile_open(self->integer > 1 ? FS_MODE_APPEND : FS_MODE_WRITE);
     }
 }
 
 static void logfile_param_changed(cvar_t *self)
 {
     if (logfile_enable->integer) {
-        logfile_close();
-        logfile_open();
+        logfile_enable_changed(logfile_enable);
+    }
+}
+
+static bool logfile_need_rotate(void)
+{
+    if (com_logNewline) {
+        return false;   // don't split lines
+    }
+
+    if (logfile_rotate_size->integer > 0 &&
+        com_logSize - com_logStart >= logfile_rotate_size->integer * 1024LL) {
+        return true;
+    }
+
+    if (logfile_rotate_time->integer > 0 &&
+        time(NULL) - com_logTime >= logfile_rotate_time->integer * 60) {
+        return true;
+    }
+
+    return false;
+}
+
+// renames current log to timestamped name and starts a new one
+static void logfile_rotate(void)
+{
+    char path[MAX_OSPATH], date[MAX_QPATH];
+    char *ext = COM_FileExtension(com_logPath);
+    int i, ret;
+
+    logfile_stop_thread();
+    FS_CloseFile(com_logFile);
+    com_logFile = 0;
+
+    Com_FormatLocalTime(date, sizeof(date), "%Y%m%d-%H%M%S");
+    Q_snprintf(path, sizeof(path), "%.*s-%s%s",
+               (int)(ext - com_logPath), com_logPath, date, ext);
+
+    // may rotate more than once per second
+    for (i = 1; FS_FileExists(path); i++) {
+        if (i == 100) {
+            ret = Q_ERR(EEXIST);
+            goto fail;
+        }
+        Q_snprintf(path, sizeof(path), "%.*s-%s-%d%s",
+                   (int)(ext - com_logPath), com_logPath, date, i, ext);
     }
+
+    ret = FS_RenameFile(com_logPath, path);
+    if (ret)
+        goto fail;
+
+    logq.rotations++;
+    logfile_open(FS_MODE_WRITE);
+    return;
+
+fail:
+    // keep appending to current log, retry once limit is reached again
+    logfile_open(FS_MODE_APPEND);
+    com_logStart = com_logSize;
+    Com_WPrintf("Couldn't rename %s to %s: %s\n",
+                com_logPath, path, Q_ErrorString(ret));
 }
 
 static size_t prefix_lines(char *buf, size_t size, const char *text, const char *prefix, bool *state)
@@ -323,14 +588,31 @@ static void logfile_write(print_type_t type, const char *text)
     format_prefix(type, prefix, sizeof(prefix));
 
     size_t len = prefix_lines(buf, sizeof(buf), text, prefix, &com_logNewline);
-    int ret = FS_Write(buf, len, com_logFile);
-    if (ret == len) {
+    int ret;
+
+    if (logq.running) {
+        ret = logfile_queue(buf, len);
+    } else {
+        ret = FS_Write(buf, len, com_logFile);
+        if (ret == len) {
+            ret = Q_ERR_SUCCESS;
+        } else if (ret >= 0) {
+            ret = Q_ERR_FAILURE;
+        }
+    }
+
+    if (!ret) {
+        com_logSize += len;
+        if (logfile_need_rotate()) {
+            logfile_rotate();
+        }
         return;
     }
 
     // zero handle BEFORE doing anything else to avoid recursion
     qhandle_t tmp = com_logFile;
     com_logFile = 0;
+    logfile_stop_thread();
     FS_CloseFile(tmp);
     Com_EPrintf("Couldn't write console log: %s\n", Q_ErrorString(ret));
     Cvar_Set("logfile", "0");
@@ -556,6 +838,7 @@ void Com_Error(error_type_t code, const char *fmt, ...)
     }
 
     if (com_logFile) {
+        logfile_stop_thread();
         FS_FPrintf(com_logFile, "FATAL: %s\n", com_errorMsg);
     }
 
@@ -570,6 +853,7 @@ void Com_Error(error_type_t code, const char *fmt, ...)
 
 abort:
     if (com_logFile) {
+        logfile_sync();
         FS_Flush(com_logFile);
     }
     com_errorEntered = false;
@@ -690,6 +974,39 @@ static void Com_LastError_f(void)
     Com_Printf("%s\n", com_errorMsg);
 }
 
+static void Com_LogfileStats_f(void)
+{
+    char written[16], dropped[16], pending[16], peak[16];
+    uint64_t batches;
+
+    if (!com_logFile) {
+        Com_Printf("Console logging is disabled.\n");
+        return;
+    }
+
+    if (logq.running) {
+        pthread_mutex_lock(&logq.lock);
+        Com_FormatSizeLong(written, sizeof(written), logq.written);
+        Com_FormatSizeLong(pending, sizeof(pending), logq.head - logq.tail);
+        Com_FormatSizeLong(peak, sizeof(peak), logq.peak);
+        batches = logq.batches;
+        pthread_mutex_unlock(&logq.lock);
+    } else {
+        Com_FormatSizeLong(written, sizeof(written), com_logSize);
+        strcpy(pending, "0");
+        strcpy(peak, "0");
+        batches = 0;
+    }
+    Com_FormatSizeLong(dropped, sizeof(dropped), logq.dropped);
+
+    Com_Printf("Logging console to %s (%s)\n", com_logPath,
+               logq.running ? "asynchronous" : "synchronous");
+    Com_Printf("Written: %s in %"PRIu64" batches\n", written, batches);
+    Com_Printf("Pending: %s (peak %s)\n", pending, peak);
+    Com_Printf("Dropped: %s\n", dropped);
+    Com_Printf("Rotated: %u times\n", logq.rotations);
+}
+
 void Com_Address_g(genctx_t *ctx)
 {
     int i;
@@ -876,9 +1193,8 @@ void Qcommon_Init(int argc, char **argv)
 #if USE_TESTS
     z_perturb = Cvar_Get("z_perturb", "0", 0);
 #endif
-#if USE_CLIENT
     host_speeds = Cvar_Get("host_speeds", "0", 0);
-#endif
+    com_sleep_slack = Cvar_Get("com_sleep_slack", "1000", 0);
 #if USE_DEBUG
     developer = Cvar_Get("developer", "0", 0);
 #endif
@@ -888,6 +1204,9 @@ void Qcommon_Init(int argc, char **argv)
     logfile_flush = Cvar_Get("logfile_flush", "1", 0);
     logfile_name = Cvar_Get("logfile_name", "console", 0);
     logfile_prefix = Cvar_Get("logfile_prefix", "[%Y-%m-%d %H:%M] ", 0);
+    logfile_async = Cvar_Get("logfile_async", "1", 0);
+    logfile_rotate_size = Cvar_Get("logfile_rotate_size", "0", 0);
+    logfile_rotate_time = Cvar_Get("logfile_rotate_time", "0", 0);
     console_prefix = Cvar_Get("console_prefix", "", 0);
 #if USE_CLIENT
     dedicated = Cvar_Get("dedicated", "0", CVAR_NOSET);
@@ -958,6 +1277,7 @@ void Qcommon_Init(int argc, char **argv)
     logfile_enable->changed = logfile_enable_changed;
     logfile_flush->changed = logfile_param_changed;
     logfile_name->changed = logfile_param_changed;
+    logfile_async->changed = logfile_param_changed;
     logfile_enable_changed(logfile_enable);
 
     FS_AddConfigFiles(true);
@@ -965,6 +1285,7 @@ void Qcommon_Init(int argc, char **argv)
     Com_AddEarlyCommands(true);
 
     Cmd_AddCommand("lasterror", Com_LastError_f);
+    Cmd_AddCommand("logfile_stats", Com_LogfileStats_f);
 
     Cmd_AddCommand("quit", Com_Quit_f);
 #if !USE_CLIENT
@@ -975,6 +1296,11 @@ void Qcommon_Init(int argc, char **argv)
     // The log file is opened during the execution of one of the config files above.
     Com_LPrintf(PRINT_NOTICE, "\nEngine version: " APPLICATION " " LONG_VERSION_STRING ", built on " __DATE__ "\n\n");
 
+#if USE_CLIENT
+    // dedicated server starts worker threads on demand
+    Com_InitAsyncWork();
+#endif
+
     Netchan_Init();
     NET_Init();
     BSP_Init();
@@ -1023,6 +1349,104 @@ void Qcommon_Init(int argc, char **argv)
     time(&com_startTime);
 
     com_eventTime = Sys_Milliseconds();
+    com_frameTime = com_jitter.last = Sys_Microseconds();
+}
+
+/*
+=================
+Com_WaitFrame
+
+Sleeps on network sockets until `remaining' milliseconds past the last
+frame have elapsed. The last com_sleep_slack microseconds are spent
+spinning, since OS sleep granularity is too coarse to hit the deadline.
+Client keeps processing input events in between, so that packets that
+must be sent immediately are not delayed by more than a millisecond.
+=================
+*/
+static void Com_WaitFrame(unsigned remaining)
+{
+    uint64_t deadline, now;
+    unsigned slack, msec;
+
+    slack = Cvar_ClampInteger(com_sleep_slack, 0, 10000);
+    deadline = com_frameTime + remaining * 1000ULL;
+    com_jitter.deadline = deadline;
+
+    while (1) {
+        now = Sys_Microseconds();
+        if (now + slack >= deadline) {
+            break;
+        }
+        msec = min((deadline - now - slack) / 1000, INT_MAX);
+        if (!msec) {
+            break;
+        }
+#if USE_CLIENT
+        if (!dedicated->integer) {
+            msec = 1;
+        }
+#endif
+        if (NET_Sleep(msec) > 0) {
+            return;
+        }
+#if USE_CLIENT
+        if (!dedicated->integer && CL_ProcessEvents()) {
+            return;
+        }
+#endif
+    }
+
+    // always poll sockets at least once
+    do {
+        if (NET_Sleep(0) > 0) {
+            break;
+        }
+#if USE_CLIENT
+        if (!dedicated->integer && CL_ProcessEvents()) {
+            break;
+        }
+#endif
+    } while (Sys_Microseconds() < deadline);
+}
+
+static void Com_UpdateJitter(uint64_t now)
+{
+    double dt, late, mean, sdev;
+
+    dt = (now - com_jitter.last) * 0.001;
+    late = now > com_jitter.deadline ? (now - com_jitter.deadline) * 0.001 : 0;
+    com_jitter.last = now;
+
+    if (!host_speeds->integer) {
+        com_jitter.frames = 0;
+        return;
+    }
+
+    if (!com_jitter.frames) {
+        com_jitter.start = now;
+        com_jitter.sum = com_jitter.sumsq = com_jitter.max = 0;
+        com_jitter.late = com_jitter.maxlate = 0;
+    }
+
+    com_jitter.frames++;
+    com_jitter.sum += dt;
+    com_jitter.sumsq += dt * dt;
+    com_jitter.max = max(com_jitter.max, dt);
+    com_jitter.late += late;
+    com_jitter.maxlate = max(com_jitter.maxlate, late);
+
+    if (now - com_jitter.start < 1000000) {
+        return;
+    }
+
+    mean = com_jitter.sum / com_jitter.frames;
+    sdev = sqrt(max(com_jitter.sumsq / com_jitter.frames - mean * mean, 0));
+
+    Com_Printf("fps:%4u dt:%6.3f sdev:%6.3f max:%7.3f late:%6.3f max:%7.3f\n",
+               com_jitter.frames, mean, sdev, com_jitter.max,
+               com_jitter.late / com_jitter.frames, com_jitter.maxlate);
+
+    com_jitter.frames = 0;
 }
 
 /*
@@ -1036,7 +1460,8 @@ void Qcommon_Frame(void)
     unsigned time_before, time_event, time_between, time_after;
     unsigned clientrem;
 #endif
-    unsigned oldtime, msec;
+    uint64_t now;
+    unsigned msec;
     static unsigned remaining;
     static float frac;
 
@@ -1053,31 +1478,32 @@ void Qcommon_Frame(void)
         time_before = Sys_Milliseconds();
 #endif
 
-    // sleep on network sockets when running a dedicated server
-    // still do a select(), but don't sleep when running a client!
-    NET_Sleep(remaining);
+    // sleep on network sockets until the next frame is due
+    Com_WaitFrame(remaining);
 
     // calculate time spent running last frame and sleeping
-    oldtime = com_eventTime;
-    com_eventTime = Sys_Milliseconds();
-    if (oldtime > com_eventTime) {
-        oldtime = com_eventTime;
-    }
-    msec = com_eventTime - oldtime;
+    now = max(Sys_Microseconds(), com_frameTime);
+    msec = (now - com_frameTime) / 1000;
 
 #if USE_CLIENT
     // spin until msec is non-zero if running a client
     if (!dedicated->integer && !com_timedemo->integer) {
         while (msec < 1) {
             bool break_now = CL_ProcessEvents();
-            com_eventTime = Sys_Milliseconds();
-            msec = com_eventTime - oldtime;
+            now = Sys_Microseconds();
+            msec = (now - com_frameTime) / 1000;
             if (break_now)
                 break;
         }
     }
 #endif
 
+    // carry sub-millisecond part over to the next frame
+    com_frameTime += msec * 1000ULL;
+    com_eventTime = Sys_Milliseconds();
+
+    Com_UpdateJitter(now);
+
     if (msec > 250) {
         Com_DPrintf("Hitch warning: %u msec frame time\n", msec);
         msec = 100; // time was unreasonable,
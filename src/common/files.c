@@ -2000,8 +2000,6 @@ bool FS_EasyWriteFile(char *buf, size_t size, unsigned mode,
     return true;
 }
 
-#if USE_CLIENT
-
 static int build_absolute_path(char *buffer, const char *path)
 {
     char normalized[MAX_OSPATH];
@@ -2042,8 +2040,6 @@ int FS_RenameFile(const char *from, const char *to)
     return Q_ERR_SUCCESS;
 }
 
-#endif // USE_CLIENT
-
 /*
 ================
 FS_FPrintf
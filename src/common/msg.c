@@ -55,10 +55,18 @@ Reading buffer is reinitialized in many other places. Reinitializing will set
 the allow underflow flag as appropriate.
 =============
 */
+#if USE_CLIENT || USE_MVD_CLIENT
+static void MSG_InitEntitySizes(void);
+#endif
+
 void MSG_Init(void)
 {
     SZ_TagInit(&msg_read, msg_read_buffer, MAX_MSGLEN, "msg_read");
     SZ_TagInit(&msg_write, msg_write_buffer, MAX_MSGLEN, "msg_write");
+    msg_write.bits_left = 32;
+#if USE_CLIENT || USE_MVD_CLIENT
+    MSG_InitEntitySizes();
+#endif
 }
 
 
@@ -207,6 +215,55 @@ void MSG_WriteAngle(float f)
     MSG_WriteByte(ANGLE2BYTE(f));
 }
 
+/*
+=============
+MSG_WriteBits
+=============
+*/
+void MSG_WriteBits(int value, int bits)
+{
+    Q_assert(!(bits == 0 || bits < -31 || bits > 31));
+
+    if (bits < 0) {
+        bits = -bits;
+    }
+
+    uint32_t bits_buf  = msg_write.bits_buf;
+    uint32_t bits_left = msg_write.bits_left;
+    uint32_t v = value & ((1U << bits) - 1);
+
+    bits_buf |= v << (32 - bits_left);
+    if (bits >= bits_left) {
+        MSG_WriteLong(bits_buf);
+        bits_buf   = v >> bits_left;
+        bits_left += 32;
+    }
+    bits_left -= bits;
+
+    msg_write.bits_buf  = bits_buf;
+    msg_write.bits_left = bits_left;
+}
+
+/*
+=============
+MSG_FlushBits
+=============
+*/
+void MSG_FlushBits(void)
+{
+    uint32_t bits_buf  = msg_write.bits_buf;
+    uint32_t bits_left = msg_write.bits_left;
+
+    while (bits_left < 32) {
+        MSG_WriteByte(bits_buf & 255);
+        bits_buf >>= 8;
+        bits_left += 8;
+    }
+
+    msg_write.bits_buf  = 0;
+    msg_write.bits_left = 32;
+}
+
 #if USE_CLIENT
 
 /*
@@ -301,55 +358,6 @@ int MSG_WriteDeltaUsercmd(const usercmd_t *from, const usercmd_t *cmd, int versi
     return bits;
 }
 
-/*
-=============
-MSG_WriteBits
-=============
-*/
-void MSG_WriteBits(int value, int bits)
-{
-    Q_assert(!(bits == 0 || bits < -31 || bits > 31));
-
-    if (bits < 0) {
-        bits = -bits;
-    }
-
-    uint32_t bits_buf  = msg_write.bits_buf;
-    uint32_t bits_left = msg_write.bits_left;
-    uint32_t v = value & ((1U << bits) - 1);
-
-    bits_buf |= v << (32 - bits_left);
-    if (bits >= bits_left) {
-        MSG_WriteLong(bits_buf);
-        bits_buf   = v >> bits_left;
-        bits_left += 32;
-    }
-    bits_left -= bits;
-
-    msg_write.bits_buf  = bits_buf;
-    msg_write.bits_left = bits_left;
-}
-
-/*
-=============
-MSG_FlushBits
-=============
-*/
-void MSG_FlushBits(void)
-{
-    uint32_t bits_buf  = msg_write.bits_buf;
-    uint32_t bits_left = msg_write.bits_left;
-
-    while (bits_left < 32) {
-        MSG_WriteByte(bits_buf & 255);
-        bits_buf >>= 8;
-        bits_left += 8;
-    }
-
-    msg_write.bits_buf  = 0;
-    msg_write.bits_left = 32;
-}
-
 /*
 =============
 MSG_WriteDeltaUsercmd_Enhanced
@@ -477,6 +485,80 @@ void MSG_PackEntity(entity_packed_t *out, const entity_state_t *in)
     out->event = in->event;
 }
 
+// per component update bits, not contiguous in U_* mask
+static const uint32_t origin_bits[3] = { U_ORIGIN1, U_ORIGIN2, U_ORIGIN3 };
+static const uint32_t angle_bits[3] = { U_ANGLE1, U_ANGLE2, U_ANGLE3 };
+
+/*
+=============
+MSG_WriteDeltaBits
+
+Writes signed delta using as few bits as possible for small values.
+Full `width' bits are written for deltas that don't fit in 10 bits.
+=============
+*/
+static void MSG_WriteDeltaBits(int delta, int width)
+{
+    if (delta >= -32 && delta < 32) {
+        MSG_WriteBits(0, 1);
+        MSG_WriteBits(delta, -6);
+        return;
+    }
+
+    MSG_WriteBits(1, 1);
+    if (width > 10) {
+        if (delta >= -512 && delta < 512) {
+            MSG_WriteBits(0, 1);
+            MSG_WriteBits(delta, -10);
+            return;
+        }
+        MSG_WriteBits(1, 1);
+    }
+
+    MSG_WriteBits(delta, -width);
+}
+
+/*
+=============
+MSG_WritePackedCoords
+
+With MSG_ES_PACKED, origin and angles are sent as deltas from the previous
+state, and old_origin as delta from the new origin, all packed into a
+single byte aligned bit stream. 16-bit angles are sent as is, because
+client may only have 8-bit precision of the previous value if the entity
+has just switched to short angles.
+=============
+*/
+static void MSG_WritePackedCoords(const entity_packed_t *from,
+                                  const entity_packed_t *to,
+                                  uint32_t bits)
+{
+    int i;
+
+    if (!(bits & (U_ORIGIN1 | U_ORIGIN2 | U_ORIGIN3 |
+                  U_ANGLE1 | U_ANGLE2 | U_ANGLE3 | U_OLDORIGIN)))
+        return;
+
+    for (i = 0; i < 3; i++)
+        if (bits & origin_bits[i])
+            MSG_WriteDeltaBits((int16_t)(to->origin[i] - from->origin[i]), 16);
+
+    for (i = 0; i < 3; i++) {
+        if (!(bits & angle_bits[i]))
+            continue;
+        if (bits & U_ANGLE16)
+            MSG_WriteBits(to->angles[i], -16);
+        else
+            MSG_WriteDeltaBits((int8_t)((to->angles[i] >> 8) - (from->angles[i] >> 8)), 8);
+    }
+
+    if (bits & U_OLDORIGIN)
+        for (i = 0; i < 3; i++)
+            MSG_WriteDeltaBits((int16_t)(to->old_origin[i] - to->origin[i]), 16);
+
+    MSG_FlushBits();
+}
+
 void MSG_WriteDeltaEntity(const entity_packed_t *from,
                           const entity_packed_t *to,
                           msgEsFlags_t          flags)
@@ -681,33 +763,37 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
     else if (bits & U_RENDERFX16)
         MSG_WriteShort(to->renderfx);
 
-    if (bits & U_ORIGIN1)
-        MSG_WriteShort(to->origin[0]);
-    if (bits & U_ORIGIN2)
-        MSG_WriteShort(to->origin[1]);
-    if (bits & U_ORIGIN3)
-        MSG_WriteShort(to->origin[2]);
-
-    if (bits & U_ANGLE16) {
-        if (bits & U_ANGLE1)
-            MSG_WriteShort(to->angles[0]);
-        if (bits & U_ANGLE2)
-            MSG_WriteShort(to->angles[1]);
-        if (bits & U_ANGLE3)
-            MSG_WriteShort(to->angles[2]);
+    if (flags & MSG_ES_PACKED) {
+        MSG_WritePackedCoords(from, to, bits);
     } else {
-        if (bits & U_ANGLE1)
-            MSG_WriteChar(to->angles[0] >> 8);
-        if (bits & U_ANGLE2)
-            MSG_WriteChar(to->angles[1] >> 8);
-        if (bits & U_ANGLE3)
-            MSG_WriteChar(to->angles[2] >> 8);
-    }
+        if (bits & U_ORIGIN1)
+            MSG_WriteShort(to->origin[0]);
+        if (bits & U_ORIGIN2)
+            MSG_WriteShort(to->origin[1]);
+        if (bits & U_ORIGIN3)
+            MSG_WriteShort(to->origin[2]);
+
+        if (bits & U_ANGLE16) {
+            if (bits & U_ANGLE1)
+                MSG_WriteShort(to->angles[0]);
+            if (bits & U_ANGLE2)
+                MSG_WriteShort(to->angles[1]);
+            if (bits & U_ANGLE3)
+                MSG_WriteShort(to->angles[2]);
+        } else {
+            if (bits & U_ANGLE1)
+                MSG_WriteChar(to->angles[0] >> 8);
+            if (bits & U_ANGLE2)
+                MSG_WriteChar(to->angles[1] >> 8);
+            if (bits & U_ANGLE3)
+                MSG_WriteChar(to->angles[2] >> 8);
+        }
 
-    if (bits & U_OLDORIGIN) {
-        MSG_WriteShort(to->old_origin[0]);
-        MSG_WriteShort(to->old_origin[1]);
-        MSG_WriteShort(to->old_origin[2]);
+        if (bits & U_OLDORIGIN) {
+            MSG_WriteShort(to->old_origin[0]);
+            MSG_WriteShort(to->old_origin[1]);
+            MSG_WriteShort(to->old_origin[2]);
+        }
     }
 
     if (bits & U_SOUND)
@@ -1349,6 +1435,16 @@ byte *MSG_ReadData(size_t len)
     return SZ_ReadData(&msg_read, len);
 }
 
+// returns pointer to unread data if at least `len' bytes are available,
+// without advancing read position
+static inline byte *MSG_PeekData(size_t len)
+{
+    if (msg_read.readcount > msg_read.cursize || len > msg_read.cursize - msg_read.readcount)
+        return NULL;
+
+    return msg_read.data + msg_read.readcount;
+}
+
 // returns -1 if no more characters are available
 int MSG_ReadChar(void)
 {
@@ -1716,7 +1812,7 @@ void MSG_ReadDeltaUsercmd_Enhanced(const usercmd_t *from, usercmd_t *to)
     }
 }
 
-#if USE_CLIENT || USE_MVD_CLIENT
+#if USE_CLIENT || USE_MVD_CLIENT || USE_TESTS
 
 /*
 =================
@@ -1729,6 +1825,31 @@ int MSG_ParseEntityBits(int *bits)
 {
     unsigned    b, total;
     int         number;
+    byte        *p;
+
+    // fast path if the largest possible header fits
+    if ((p = MSG_PeekData(6))) {
+        byte *start = p;
+
+        total = *p++;
+        if (total & U_MOREBITS1)
+            total |= *p++ << 8;
+        if (total & U_MOREBITS2)
+            total |= *p++ << 16;
+        if (total & U_MOREBITS3)
+            total |= (unsigned)*p++ << 24;
+
+        if (total & U_NUMBER16) {
+            number = RL16(p);
+            p += 2;
+        } else {
+            number = *p++;
+        }
+
+        msg_read.readcount += p - start;
+        *bits = total;
+        return number;
+    }
 
     total = MSG_ReadByte();
     if (total & U_MOREBITS1) {
@@ -1754,6 +1875,221 @@ int MSG_ParseEntityBits(int *bits)
     return number;
 }
 
+static int MSG_ReadDeltaBits(int width)
+{
+    if (!MSG_ReadBits(1))
+        return MSG_ReadBits(-6);
+
+    if (width > 10 && !MSG_ReadBits(1))
+        return MSG_ReadBits(-10);
+
+    return MSG_ReadBits(-width);
+}
+
+// counterpart of MSG_WritePackedCoords, `to' holds the previous state
+static void MSG_ParsePackedCoords(entity_state_t *to, int bits)
+{
+    int i, v;
+
+    if (!(bits & (U_ORIGIN1 | U_ORIGIN2 | U_ORIGIN3 |
+                  U_ANGLE1 | U_ANGLE2 | U_ANGLE3 | U_OLDORIGIN)))
+        return;
+
+    // bit stream starts at byte boundary
+    msg_read.bits_buf  = 0;
+    msg_read.bits_left = 0;
+
+    for (i = 0; i < 3; i++) {
+        if (bits & origin_bits[i]) {
+            v = COORD2SHORT(to->origin[i]) + MSG_ReadDeltaBits(16);
+            to->origin[i] = SHORT2COORD((int16_t)v);
+        }
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (!(bits & angle_bits[i]))
+            continue;
+        if (bits & U_ANGLE16) {
+            to->angles[i] = SHORT2ANGLE(MSG_ReadBits(-16));
+        } else {
+            v = (ANGLE2SHORT(to->angles[i]) >> 8) + MSG_ReadDeltaBits(8);
+            to->angles[i] = BYTE2ANGLE((int8_t)v);
+        }
+    }
+
+    if (bits & U_OLDORIGIN) {
+        for (i = 0; i < 3; i++) {
+            v = COORD2SHORT(to->origin[i]) + MSG_ReadDeltaBits(16);
+            to->old_origin[i] = SHORT2COORD((int16_t)v);
+        }
+    }
+
+    // discard padding bits
+    msg_read.bits_buf  = 0;
+    msg_read.bits_left = 0;
+}
+
+/*
+==================
+MSG_EntityDataSize
+
+Upper bound of entity update payload size following the header, looked up
+per byte of header bits. Combined 32-bit fields are accounted by making the
+16-bit flag cover the extra bytes. Packed coordinates never take more bytes
+than accounted here (18 bits per coordinate, 16 bits per angle).
+==================
+*/
+static byte msg_es_sizes[4][256];
+
+static void MSG_InitEntitySizes(void)
+{
+    static const struct {
+        uint32_t    bit;
+        byte        size;
+    } fields[] = {
+        { U_ORIGIN1, 3 }, { U_ORIGIN2, 3 }, { U_ORIGIN3, 3 },
+        { U_ANGLE1, 2 }, { U_ANGLE2, 2 }, { U_ANGLE3, 2 },
+        { U_OLDORIGIN, 9 },
+        { U_MODEL, 1 }, { U_MODEL2, 1 }, { U_MODEL3, 1 }, { U_MODEL4, 1 },
+        { U_FRAME8, 1 }, { U_FRAME16, 2 },
+        { U_SKIN8, 1 }, { U_SKIN16, 3 },
+        { U_EFFECTS8, 1 }, { U_EFFECTS16, 3 },
+        { U_RENDERFX8, 1 }, { U_RENDERFX16, 3 },
+        { U_SOUND, 1 }, { U_EVENT, 1 }, { U_SOLID, 4 },
+    };
+    int i, j, k;
+
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < 256; j++) {
+            int size = 0;
+            for (k = 0; k < q_countof(fields); k++)
+                if ((fields[k].bit >> (i * 8)) & j)
+                    size += fields[k].size;
+            msg_es_sizes[i][j] = size;
+        }
+    }
+}
+
+static inline size_t MSG_EntityDataSize(uint32_t bits)
+{
+    return msg_es_sizes[0][bits & 255] +
+           msg_es_sizes[1][(bits >> 8) & 255] +
+           msg_es_sizes[2][(bits >> 16) & 255] +
+           msg_es_sizes[3][bits >> 24];
+}
+
+/*
+==================
+MSG_ParseDeltaEntityFast
+
+Unchecked version of entity update parsing. Caller must ensure that at least
+MSG_EntityDataSize(bits) bytes are available.
+==================
+*/
+static void MSG_ParseDeltaEntityFast(entity_state_t *to, uint32_t bits, msgEsFlags_t flags)
+{
+    byte *start = msg_read.data + msg_read.readcount;
+    byte *p = start;
+    int i;
+
+    if (bits & U_MODEL)
+        to->modelindex = *p++;
+    if (bits & U_MODEL2)
+        to->modelindex2 = *p++;
+    if (bits & U_MODEL3)
+        to->modelindex3 = *p++;
+    if (bits & U_MODEL4)
+        to->modelindex4 = *p++;
+
+    if (bits & U_FRAME8)
+        to->frame = *p++;
+    if (bits & U_FRAME16) {
+        to->frame = (int16_t)RL16(p);
+        p += 2;
+    }
+
+    if ((bits & U_SKIN32) == U_SKIN32) {
+        to->skinnum = (int32_t)RL32(p);
+        p += 4;
+    } else if (bits & U_SKIN8) {
+        to->skinnum = *p++;
+    } else if (bits & U_SKIN16) {
+        to->skinnum = RL16(p);
+        p += 2;
+    }
+
+    if ((bits & U_EFFECTS32) == U_EFFECTS32) {
+        to->effects = RL32(p);
+        p += 4;
+    } else if (bits & U_EFFECTS8) {
+        to->effects = *p++;
+    } else if (bits & U_EFFECTS16) {
+        to->effects = RL16(p);
+        p += 2;
+    }
+
+    if ((bits & U_RENDERFX32) == U_RENDERFX32) {
+        to->renderfx = RL32(p);
+        p += 4;
+    } else if (bits & U_RENDERFX8) {
+        to->renderfx = *p++;
+    } else if (bits & U_RENDERFX16) {
+        to->renderfx = RL16(p);
+        p += 2;
+    }
+
+    if (flags & MSG_ES_PACKED) {
+        msg_read.readcount += p - start;
+        if (!(flags & MSG_ES_SHORTANGLES))
+            bits &= ~U_ANGLE16;
+        MSG_ParsePackedCoords(to, bits);
+        start = p = msg_read.data + msg_read.readcount;
+    } else {
+        for (i = 0; i < 3; i++) {
+            if (bits & origin_bits[i]) {
+                to->origin[i] = SHORT2COORD((int16_t)RL16(p));
+                p += 2;
+            }
+        }
+
+        if ((flags & MSG_ES_SHORTANGLES) && (bits & U_ANGLE16)) {
+            for (i = 0; i < 3; i++) {
+                if (bits & angle_bits[i]) {
+                    to->angles[i] = SHORT2ANGLE((int16_t)RL16(p));
+                    p += 2;
+                }
+            }
+        } else {
+            for (i = 0; i < 3; i++)
+                if (bits & angle_bits[i])
+                    to->angles[i] = BYTE2ANGLE((int8_t)*p++);
+        }
+
+        if (bits & U_OLDORIGIN) {
+            for (i = 0; i < 3; i++, p += 2)
+                to->old_origin[i] = SHORT2COORD((int16_t)RL16(p));
+        }
+    }
+
+    if (bits & U_SOUND)
+        to->sound = *p++;
+
+    if (bits & U_EVENT)
+        to->event = *p++;
+
+    if (bits & U_SOLID) {
+        if (flags & MSG_ES_LONGSOLID) {
+            to->solid = RL32(p);
+            p += 4;
+        } else {
+            to->solid = RL16(p);
+            p += 2;
+        }
+    }
+
+    msg_read.readcount += p - start;
+}
+
 /*
 ==================
 MSG_ParseDeltaEntity
@@ -1784,6 +2120,12 @@ void MSG_ParseDeltaEntity(const entity_state_t *from,
         return;
     }
 
+    // validate length once and parse without bounds checks
+    if (MSG_PeekData(MSG_EntityDataSize(bits))) {
+        MSG_ParseDeltaEntityFast(to, bits, flags);
+        return;
+    }
+
     if (bits & U_MODEL) {
         to->modelindex = MSG_ReadByte();
     }
@@ -1823,34 +2165,40 @@ void MSG_ParseDeltaEntity(const entity_state_t *from,
     else if (bits & U_RENDERFX16)
         to->renderfx = MSG_ReadWord();
 
-    if (bits & U_ORIGIN1) {
-        to->origin[0] = MSG_ReadCoord();
-    }
-    if (bits & U_ORIGIN2) {
-        to->origin[1] = MSG_ReadCoord();
-    }
-    if (bits & U_ORIGIN3) {
-        to->origin[2] = MSG_ReadCoord();
-    }
-
-    if ((flags & MSG_ES_SHORTANGLES) && (bits & U_ANGLE16)) {
-        if (bits & U_ANGLE1)
-            to->angles[0] = MSG_ReadAngle16();
-        if (bits & U_ANGLE2)
-            to->angles[1] = MSG_ReadAngle16();
-        if (bits & U_ANGLE3)
-            to->angles[2] = MSG_ReadAngle16();
+    if (flags & MSG_ES_PACKED) {
+        if (!(flags & MSG_ES_SHORTANGLES))
+            bits &= ~U_ANGLE16;
+        MSG_ParsePackedCoords(to, bits);
     } else {
-        if (bits & U_ANGLE1)
-            to->angles[0] = MSG_ReadAngle();
-        if (bits & U_ANGLE2)
-            to->angles[1] = MSG_ReadAngle();
-        if (bits & U_ANGLE3)
-            to->angles[2] = MSG_ReadAngle();
-    }
+        if (bits & U_ORIGIN1) {
+            to->origin[0] = MSG_ReadCoord();
+        }
+        if (bits & U_ORIGIN2) {
+            to->origin[1] = MSG_ReadCoord();
+        }
+        if (bits & U_ORIGIN3) {
+            to->origin[2] = MSG_ReadCoord();
+        }
 
-    if (bits & U_OLDORIGIN) {
-        MSG_ReadPos(to->old_origin);
+        if ((flags & MSG_ES_SHORTANGLES) && (bits & U_ANGLE16)) {
+            if (bits & U_ANGLE1)
+                to->angles[0] = MSG_ReadAngle16();
+            if (bits & U_ANGLE2)
+                to->angles[1] = MSG_ReadAngle16();
+            if (bits & U_ANGLE3)
+                to->angles[2] = MSG_ReadAngle16();
+        } else {
+            if (bits & U_ANGLE1)
+                to->angles[0] = MSG_ReadAngle();
+            if (bits & U_ANGLE2)
+                to->angles[1] = MSG_ReadAngle();
+            if (bits & U_ANGLE3)
+                to->angles[2] = MSG_ReadAngle();
+        }
+
+        if (bits & U_OLDORIGIN) {
+            MSG_ReadPos(to->old_origin);
+        }
     }
 
     if (bits & U_SOUND) {
@@ -1870,7 +2218,7 @@ void MSG_ParseDeltaEntity(const entity_state_t *from,
     }
 }
 
-#endif // USE_CLIENT || USE_MVD_CLIENT
+#endif // USE_CLIENT || USE_MVD_CLIENT || USE_TESTS
 
 #if USE_CLIENT
 
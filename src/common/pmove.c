@@ -23,9 +23,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 // all of the locals will be zeroed before each
 // pmove, just to make damn sure we don't have
-// any differences when running on client or server
+// any differences when running on client or server.
+// passed explicitly so that Pmove is reentrant.
 
 typedef struct {
+    pmove_t     *pm;
+    const pmoveParams_t *pmp;
+    const pmoveWorld_t  *world;
+
     vec3_t      origin;         // full float precision
     vec3_t      velocity;       // full float precision
 
@@ -41,11 +46,6 @@ typedef struct {
     bool        ladder;
 } pml_t;
 
-static pmove_t      *pm;
-static pml_t        pml;
-
-static pmoveParams_t    *pmp;
-
 // movement parameters
 static const float  pm_stopspeed = 100;
 static const float  pm_duckspeed = 100;
@@ -53,6 +53,35 @@ static const float  pm_accelerate = 10;
 static const float  pm_wateraccelerate = 10;
 static const float  pm_waterspeed = 400;
 
+/*
+==================
+PM_Trace
+PM_PointContents
+
+Collision queries go through the world callbacks when given, otherwise
+through the ones in pmove_t.
+==================
+*/
+static inline trace_t PM_Trace(pml_t *pml, const vec3_t start, const vec3_t mins,
+                               const vec3_t maxs, const vec3_t end)
+{
+    trace_t trace;
+
+    if (!pml->world)
+        return pml->pm->trace(start, mins, maxs, end);
+
+    pml->world->trace(pml->world->arg, &trace, start, mins, maxs, end);
+    return trace;
+}
+
+static inline int PM_PointContents(pml_t *pml, const vec3_t point)
+{
+    if (!pml->world)
+        return pml->pm->pointcontents(point);
+
+    return pml->world->pointcontents(pml->world->arg, point);
+}
+
 /*
   walking up a step should kill some velocity
 */
@@ -97,8 +126,9 @@ Does not modify any world state?
 #define MIN_STEP_NORMAL 0.7f    // can't step up onto very steep slopes
 #define MAX_CLIP_PLANES 5
 
-static void PM_StepSlideMove_(void)
+static void PM_StepSlideMove_(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
     int         bumpcount, numbumps;
     vec3_t      dir;
     float       d;
@@ -112,26 +142,26 @@ static void PM_StepSlideMove_(void)
 
     numbumps = 4;
 
-    VectorCopy(pml.velocity, primal_velocity);
+    VectorCopy(pml->velocity, primal_velocity);
     numplanes = 0;
 
-    time_left = pml.frametime;
+    time_left = pml->frametime;
 
     for (bumpcount = 0; bumpcount < numbumps; bumpcount++) {
         for (i = 0; i < 3; i++)
-            end[i] = pml.origin[i] + time_left * pml.velocity[i];
+            end[i] = pml->origin[i] + time_left * pml->velocity[i];
 
-        trace = pm->trace(pml.origin, pm->mins, pm->maxs, end);
+        trace = PM_Trace(pml, pml->origin, pm->mins, pm->maxs, end);
 
         if (trace.allsolid) {
             // entity is trapped in another solid
-            pml.velocity[2] = 0;    // don't build up falling damage
+            pml->velocity[2] = 0;    // don't build up falling damage
             return;
         }
 
         if (trace.fraction > 0) {
             // actually covered some distance
-            VectorCopy(trace.endpos, pml.origin);
+            VectorCopy(trace.endpos, pml->origin);
             numplanes = 0;
         }
 
@@ -149,7 +179,7 @@ static void PM_StepSlideMove_(void)
         // slide along this plane
         if (numplanes >= MAX_CLIP_PLANES) {
             // this shouldn't really happen
-            VectorClear(pml.velocity);
+            VectorClear(pml->velocity);
             break;
         }
 
@@ -160,10 +190,10 @@ static void PM_StepSlideMove_(void)
 // modify original_velocity so it parallels all of the clip planes
 //
         for (i = 0; i < numplanes; i++) {
-            PM_ClipVelocity(pml.velocity, planes[i], pml.velocity, 1.01f);
+            PM_ClipVelocity(pml->velocity, planes[i], pml->velocity, 1.01f);
             for (j = 0; j < numplanes; j++)
                 if (j != i) {
-                    if (DotProduct(pml.velocity, planes[j]) < 0)
+                    if (DotProduct(pml->velocity, planes[j]) < 0)
                         break;  // not ok
                 }
             if (j == numplanes)
@@ -175,26 +205,26 @@ static void PM_StepSlideMove_(void)
         } else {
             // go along the crease
             if (numplanes != 2) {
-                VectorClear(pml.velocity);
+                VectorClear(pml->velocity);
                 break;
             }
             CrossProduct(planes[0], planes[1], dir);
-            d = DotProduct(dir, pml.velocity);
-            VectorScale(dir, d, pml.velocity);
+            d = DotProduct(dir, pml->velocity);
+            VectorScale(dir, d, pml->velocity);
         }
 
         //
         // if velocity is against the original velocity, stop dead
         // to avoid tiny occilations in sloping corners
         //
-        if (DotProduct(pml.velocity, primal_velocity) <= 0) {
-            VectorClear(pml.velocity);
+        if (DotProduct(pml->velocity, primal_velocity) <= 0) {
+            VectorClear(pml->velocity);
             break;
         }
     }
 
     if (pm->s.pm_time)
-        VectorCopy(primal_velocity, pml.velocity);
+        VectorCopy(primal_velocity, pml->velocity);
 }
 
 /*
@@ -203,43 +233,44 @@ PM_StepSlideMove
 
 ==================
 */
-static void PM_StepSlideMove(void)
+static void PM_StepSlideMove(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
     vec3_t      start_o, start_v;
     vec3_t      down_o, down_v;
     trace_t     trace;
     float       down_dist, up_dist;
     vec3_t      up, down;
 
-    VectorCopy(pml.origin, start_o);
-    VectorCopy(pml.velocity, start_v);
+    VectorCopy(pml->origin, start_o);
+    VectorCopy(pml->velocity, start_v);
 
-    PM_StepSlideMove_();
+    PM_StepSlideMove_(pml);
 
-    VectorCopy(pml.origin, down_o);
-    VectorCopy(pml.velocity, down_v);
+    VectorCopy(pml->origin, down_o);
+    VectorCopy(pml->velocity, down_v);
 
     VectorCopy(start_o, up);
     up[2] += STEPSIZE;
 
-    trace = pm->trace(up, pm->mins, pm->maxs, up);
+    trace = PM_Trace(pml, up, pm->mins, pm->maxs, up);
     if (trace.allsolid)
         return;     // can't step up
 
     // try sliding above
-    VectorCopy(up, pml.origin);
-    VectorCopy(start_v, pml.velocity);
+    VectorCopy(up, pml->origin);
+    VectorCopy(start_v, pml->velocity);
 
-    PM_StepSlideMove_();
+    PM_StepSlideMove_(pml);
 
     // push down the final amount
-    VectorCopy(pml.origin, down);
+    VectorCopy(pml->origin, down);
     down[2] -= STEPSIZE;
-    trace = pm->trace(pml.origin, pm->mins, pm->maxs, down);
+    trace = PM_Trace(pml, pml->origin, pm->mins, pm->maxs, down);
     if (!trace.allsolid)
-        VectorCopy(trace.endpos, pml.origin);
+        VectorCopy(trace.endpos, pml->origin);
 
-    VectorCopy(pml.origin, up);
+    VectorCopy(pml->origin, up);
 
     // decide which one went farther
     down_dist = (down_o[0] - start_o[0]) * (down_o[0] - start_o[0])
@@ -248,13 +279,13 @@ static void PM_StepSlideMove(void)
               + (up[1] - start_o[1]) * (up[1] - start_o[1]);
 
     if (down_dist > up_dist || trace.plane.normal[2] < MIN_STEP_NORMAL) {
-        VectorCopy(down_o, pml.origin);
-        VectorCopy(down_v, pml.velocity);
+        VectorCopy(down_o, pml->origin);
+        VectorCopy(down_v, pml->velocity);
         return;
     }
     //!! Special case
     // if we were walking along a plane, then we need to copy the Z over
-    pml.velocity[2] = down_v[2];
+    pml->velocity[2] = down_v[2];
 }
 
 /*
@@ -264,14 +295,16 @@ PM_Friction
 Handles both ground friction and water friction
 ==================
 */
-static void PM_Friction(void)
+static void PM_Friction(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
+    const pmoveParams_t *pmp = pml->pmp;
     float   *vel;
     float   speed, newspeed, control;
     float   friction;
     float   drop;
 
-    vel = pml.velocity;
+    vel = pml->velocity;
 
     speed = VectorLength(vel);
     if (speed < 1) {
@@ -283,15 +316,15 @@ static void PM_Friction(void)
     drop = 0;
 
 // apply ground friction
-    if ((pm->groundentity && pml.groundsurface && !(pml.groundsurface->flags & SURF_SLICK)) || (pml.ladder)) {
+    if ((pm->groundentity && pml->groundsurface && !(pml->groundsurface->flags & SURF_SLICK)) || (pml->ladder)) {
         friction = pmp->friction;
         control = speed < pm_stopspeed ? pm_stopspeed : speed;
-        drop += control * friction * pml.frametime;
+        drop += control * friction * pml->frametime;
     }
 
 // apply water friction
-    if (pm->waterlevel && !pml.ladder)
-        drop += speed * pmp->waterfriction * pm->waterlevel * pml.frametime;
+    if (pm->waterlevel && !pml->ladder)
+        drop += speed * pmp->waterfriction * pm->waterlevel * pml->frametime;
 
 // scale the velocity
     newspeed = speed - drop;
@@ -311,40 +344,40 @@ PM_Accelerate
 Handles user intended acceleration
 ==============
 */
-static void PM_Accelerate(const vec3_t wishdir, float wishspeed, float accel)
+static void PM_Accelerate(pml_t *pml, const vec3_t wishdir, float wishspeed, float accel)
 {
     int         i;
     float       addspeed, accelspeed, currentspeed;
 
-    currentspeed = DotProduct(pml.velocity, wishdir);
+    currentspeed = DotProduct(pml->velocity, wishdir);
     addspeed = wishspeed - currentspeed;
     if (addspeed <= 0)
         return;
-    accelspeed = accel * pml.frametime * wishspeed;
+    accelspeed = accel * pml->frametime * wishspeed;
     if (accelspeed > addspeed)
         accelspeed = addspeed;
 
     for (i = 0; i < 3; i++)
-        pml.velocity[i] += accelspeed * wishdir[i];
+        pml->velocity[i] += accelspeed * wishdir[i];
 }
 
-static void PM_AirAccelerate(const vec3_t wishdir, float wishspeed, float accel)
+static void PM_AirAccelerate(pml_t *pml, const vec3_t wishdir, float wishspeed, float accel)
 {
     int         i;
     float       addspeed, accelspeed, currentspeed, wishspd = wishspeed;
 
     if (wishspd > 30)
         wishspd = 30;
-    currentspeed = DotProduct(pml.velocity, wishdir);
+    currentspeed = DotProduct(pml->velocity, wishdir);
     addspeed = wishspd - currentspeed;
     if (addspeed <= 0)
         return;
-    accelspeed = accel * wishspeed * pml.frametime;
+    accelspeed = accel * wishspeed * pml->frametime;
     if (accelspeed > addspeed)
         accelspeed = addspeed;
 
     for (i = 0; i < 3; i++)
-        pml.velocity[i] += accelspeed * wishdir[i];
+        pml->velocity[i] += accelspeed * wishdir[i];
 }
 
 /*
@@ -352,8 +385,9 @@ static void PM_AirAccelerate(const vec3_t wishdir, float wishspeed, float accel)
 PM_AddCurrents
 =============
 */
-static void PM_AddCurrents(vec3_t wishvel)
+static void PM_AddCurrents(pml_t *pml, vec3_t wishvel)
 {
+    pmove_t *pm = pml->pm;
     vec3_t  v;
     float   s;
 
@@ -361,7 +395,7 @@ static void PM_AddCurrents(vec3_t wishvel)
     // account for ladders
     //
 
-    if (pml.ladder && fabsf(pml.velocity[2]) <= 200) {
+    if (pml->ladder && fabsf(pml->velocity[2]) <= 200) {
         if ((pm->viewangles[PITCH] <= -15) && (pm->cmd.forwardmove > 0))
             wishvel[2] = 200;
         else if ((pm->viewangles[PITCH] >= 15) && (pm->cmd.forwardmove > 0))
@@ -412,17 +446,17 @@ static void PM_AddCurrents(vec3_t wishvel)
     if (pm->groundentity) {
         VectorClear(v);
 
-        if (pml.groundcontents & CONTENTS_CURRENT_0)
+        if (pml->groundcontents & CONTENTS_CURRENT_0)
             v[0] += 1;
-        if (pml.groundcontents & CONTENTS_CURRENT_90)
+        if (pml->groundcontents & CONTENTS_CURRENT_90)
             v[1] += 1;
-        if (pml.groundcontents & CONTENTS_CURRENT_180)
+        if (pml->groundcontents & CONTENTS_CURRENT_180)
             v[0] -= 1;
-        if (pml.groundcontents & CONTENTS_CURRENT_270)
+        if (pml->groundcontents & CONTENTS_CURRENT_270)
             v[1] -= 1;
-        if (pml.groundcontents & CONTENTS_CURRENT_UP)
+        if (pml->groundcontents & CONTENTS_CURRENT_UP)
             v[2] += 1;
-        if (pml.groundcontents & CONTENTS_CURRENT_DOWN)
+        if (pml->groundcontents & CONTENTS_CURRENT_DOWN)
             v[2] -= 1;
 
         VectorMA(wishvel, 100 /* pm->groundentity->speed */, v, wishvel);
@@ -435,8 +469,10 @@ PM_WaterMove
 
 ===================
 */
-static void PM_WaterMove(void)
+static void PM_WaterMove(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
+    const pmoveParams_t *pmp = pml->pmp;
     int     i;
     vec3_t  wishvel;
     float   wishspeed;
@@ -446,14 +482,14 @@ static void PM_WaterMove(void)
 // user intentions
 //
     for (i = 0; i < 3; i++)
-        wishvel[i] = pml.forward[i] * pm->cmd.forwardmove + pml.right[i] * pm->cmd.sidemove;
+        wishvel[i] = pml->forward[i] * pm->cmd.forwardmove + pml->right[i] * pm->cmd.sidemove;
 
     if (!pm->cmd.forwardmove && !pm->cmd.sidemove && !pm->cmd.upmove)
         wishvel[2] -= 60;       // drift towards bottom
     else
         wishvel[2] += pm->cmd.upmove;
 
-    PM_AddCurrents(wishvel);
+    PM_AddCurrents(pml, wishvel);
 
     VectorCopy(wishvel, wishdir);
     wishspeed = VectorNormalize(wishdir);
@@ -464,9 +500,9 @@ static void PM_WaterMove(void)
     }
     wishspeed *= pmp->watermult;
 
-    PM_Accelerate(wishdir, wishspeed, pm_wateraccelerate);
+    PM_Accelerate(pml, wishdir, wishspeed, pm_wateraccelerate);
 
-    PM_StepSlideMove();
+    PM_StepSlideMove(pml);
 }
 
 /*
@@ -475,8 +511,10 @@ PM_AirMove
 
 ===================
 */
-static void PM_AirMove(void)
+static void PM_AirMove(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
+    const pmoveParams_t *pmp = pml->pmp;
     int         i;
     vec3_t      wishvel;
     float       fmove, smove;
@@ -488,10 +526,10 @@ static void PM_AirMove(void)
     smove = pm->cmd.sidemove;
 
     for (i = 0; i < 2; i++)
-        wishvel[i] = pml.forward[i] * fmove + pml.right[i] * smove;
+        wishvel[i] = pml->forward[i] * fmove + pml->right[i] * smove;
     wishvel[2] = 0;
 
-    PM_AddCurrents(wishvel);
+    PM_AddCurrents(pml, wishvel);
 
     VectorCopy(wishvel, wishdir);
     wishspeed = VectorNormalize(wishdir);
@@ -506,45 +544,45 @@ static void PM_AirMove(void)
         wishspeed = maxspeed;
     }
 
-    if (pml.ladder) {
-        PM_Accelerate(wishdir, wishspeed, pm_accelerate);
+    if (pml->ladder) {
+        PM_Accelerate(pml, wishdir, wishspeed, pm_accelerate);
         if (!wishvel[2]) {
-            if (pml.velocity[2] > 0) {
-                pml.velocity[2] -= pm->s.gravity * pml.frametime;
-                if (pml.velocity[2] < 0)
-                    pml.velocity[2] = 0;
+            if (pml->velocity[2] > 0) {
+                pml->velocity[2] -= pm->s.gravity * pml->frametime;
+                if (pml->velocity[2] < 0)
+                    pml->velocity[2] = 0;
             } else {
-                pml.velocity[2] += pm->s.gravity * pml.frametime;
-                if (pml.velocity[2] > 0)
-                    pml.velocity[2] = 0;
+                pml->velocity[2] += pm->s.gravity * pml->frametime;
+                if (pml->velocity[2] > 0)
+                    pml->velocity[2] = 0;
             }
         }
-        PM_StepSlideMove();
+        PM_StepSlideMove(pml);
     } else if (pm->groundentity) {
         // walking on ground
-        pml.velocity[2] = 0; //!!! this is before the accel
-        PM_Accelerate(wishdir, wishspeed, pm_accelerate);
+        pml->velocity[2] = 0; //!!! this is before the accel
+        PM_Accelerate(pml, wishdir, wishspeed, pm_accelerate);
 
 // PGM  -- fix for negative trigger_gravity fields
-//      pml.velocity[2] = 0;
+//      pml->velocity[2] = 0;
         if (pm->s.gravity > 0)
-            pml.velocity[2] = 0;
+            pml->velocity[2] = 0;
         else
-            pml.velocity[2] -= pm->s.gravity * pml.frametime;
+            pml->velocity[2] -= pm->s.gravity * pml->frametime;
 // PGM
 
-        if (!pml.velocity[0] && !pml.velocity[1])
+        if (!pml->velocity[0] && !pml->velocity[1])
             return;
-        PM_StepSlideMove();
+        PM_StepSlideMove(pml);
     } else {
         // not on ground, so little effect on velocity
         if (pmp->airaccelerate)
-            PM_AirAccelerate(wishdir, wishspeed, pm_accelerate);
+            PM_AirAccelerate(pml, wishdir, wishspeed, pm_accelerate);
         else
-            PM_Accelerate(wishdir, wishspeed, 1);
+            PM_Accelerate(pml, wishdir, wishspeed, 1);
         // add gravity
-        pml.velocity[2] -= pm->s.gravity * pml.frametime;
-        PM_StepSlideMove();
+        pml->velocity[2] -= pm->s.gravity * pml->frametime;
+        PM_StepSlideMove(pml);
     }
 }
 
@@ -553,8 +591,10 @@ static void PM_AirMove(void)
 PM_CategorizePosition
 =============
 */
-static void PM_CategorizePosition(void)
+static void PM_CategorizePosition(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
+    const pmoveParams_t *pmp = pml->pmp;
     vec3_t      point;
     int         cont;
     trace_t     trace;
@@ -565,17 +605,17 @@ static void PM_CategorizePosition(void)
 // is on ground
 
 // see if standing on something solid
-    point[0] = pml.origin[0];
-    point[1] = pml.origin[1];
-    point[2] = pml.origin[2] - 0.25f;
-    if (pml.velocity[2] > 180) { //!!ZOID changed from 100 to 180 (ramp accel)
+    point[0] = pml->origin[0];
+    point[1] = pml->origin[1];
+    point[2] = pml->origin[2] - 0.25f;
+    if (pml->velocity[2] > 180) { //!!ZOID changed from 100 to 180 (ramp accel)
         pm->s.pm_flags &= ~PMF_ON_GROUND;
         pm->groundentity = NULL;
     } else {
-        trace = pm->trace(pml.origin, pm->mins, pm->maxs, point);
-        pml.groundplane = trace.plane;
-        pml.groundsurface = trace.surface;
-        pml.groundcontents = trace.contents;
+        trace = PM_Trace(pml, pml->origin, pm->mins, pm->maxs, point);
+        pml->groundplane = trace.plane;
+        pml->groundsurface = trace.surface;
+        pml->groundcontents = trace.contents;
 
         if (!trace.ent || (trace.plane.normal[2] < 0.7f && !trace.startsolid)) {
             pm->groundentity = NULL;
@@ -593,10 +633,10 @@ static void PM_CategorizePosition(void)
                 // just hit the ground
                 pm->s.pm_flags |= PMF_ON_GROUND;
                 // don't do landing time if we were just going down a slope
-                if (pml.velocity[2] < -200 && !pmp->strafehack) {
+                if (pml->velocity[2] < -200 && !pmp->strafehack) {
                     pm->s.pm_flags |= PMF_TIME_LAND;
                     // don't allow another jump for a little while
-                    if (pml.velocity[2] < -400)
+                    if (pml->velocity[2] < -400)
                         pm->s.pm_time = 25;
                     else
                         pm->s.pm_time = 18;
@@ -619,18 +659,18 @@ static void PM_CategorizePosition(void)
     sample2 = pm->viewheight - pm->mins[2];
     sample1 = sample2 / 2;
 
-    point[2] = pml.origin[2] + pm->mins[2] + 1;
-    cont = pm->pointcontents(point);
+    point[2] = pml->origin[2] + pm->mins[2] + 1;
+    cont = PM_PointContents(pml, point);
 
     if (cont & MASK_WATER) {
         pm->watertype = cont;
         pm->waterlevel = 1;
-        point[2] = pml.origin[2] + pm->mins[2] + sample1;
-        cont = pm->pointcontents(point);
+        point[2] = pml->origin[2] + pm->mins[2] + sample1;
+        cont = PM_PointContents(pml, point);
         if (cont & MASK_WATER) {
             pm->waterlevel = 2;
-            point[2] = pml.origin[2] + pm->mins[2] + sample2;
-            cont = pm->pointcontents(point);
+            point[2] = pml->origin[2] + pm->mins[2] + sample2;
+            cont = PM_PointContents(pml, point);
             if (cont & MASK_WATER)
                 pm->waterlevel = 3;
         }
@@ -642,8 +682,11 @@ static void PM_CategorizePosition(void)
 PM_CheckJump
 =============
 */
-static void PM_CheckJump(void)
+static void PM_CheckJump(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
+    const pmoveParams_t *pmp = pml->pmp;
+
     if (pm->s.pm_flags & PMF_TIME_LAND) {
         // hasn't been long enough since landing to jump again
         return;
@@ -669,17 +712,17 @@ static void PM_CheckJump(void)
         if (pmp->waterhack)
             return;
 
-        if (pml.velocity[2] <= -300)
+        if (pml->velocity[2] <= -300)
             return;
 
         // FIXME: makes velocity dependent on client FPS,
         // even causes prediction misses
         if (pm->watertype == CONTENTS_WATER)
-            pml.velocity[2] = 100;
+            pml->velocity[2] = 100;
         else if (pm->watertype == CONTENTS_SLIME)
-            pml.velocity[2] = 80;
+            pml->velocity[2] = 80;
         else
-            pml.velocity[2] = 50;
+            pml->velocity[2] = 50;
         return;
     }
 
@@ -690,9 +733,9 @@ static void PM_CheckJump(void)
 
     pm->groundentity = NULL;
     pm->s.pm_flags &= ~PMF_ON_GROUND;
-    pml.velocity[2] += 270;
-    if (pml.velocity[2] < 270)
-        pml.velocity[2] = 270;
+    pml->velocity[2] += 270;
+    if (pml->velocity[2] < 270)
+        pml->velocity[2] = 270;
 }
 
 /*
@@ -700,8 +743,9 @@ static void PM_CheckJump(void)
 PM_CheckSpecialMovement
 =============
 */
-static void PM_CheckSpecialMovement(void)
+static void PM_CheckSpecialMovement(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
     vec3_t  spot;
     int     cont;
     vec3_t  flatforward;
@@ -710,36 +754,36 @@ static void PM_CheckSpecialMovement(void)
     if (pm->s.pm_time)
         return;
 
-    pml.ladder = false;
+    pml->ladder = false;
 
     // check for ladder
-    flatforward[0] = pml.forward[0];
-    flatforward[1] = pml.forward[1];
+    flatforward[0] = pml->forward[0];
+    flatforward[1] = pml->forward[1];
     flatforward[2] = 0;
     VectorNormalize(flatforward);
 
-    VectorMA(pml.origin, 1, flatforward, spot);
-    trace = pm->trace(pml.origin, pm->mins, pm->maxs, spot);
+    VectorMA(pml->origin, 1, flatforward, spot);
+    trace = PM_Trace(pml, pml->origin, pm->mins, pm->maxs, spot);
     if ((trace.fraction < 1) && (trace.contents & CONTENTS_LADDER))
-        pml.ladder = true;
+        pml->ladder = true;
 
     // check for water jump
     if (pm->waterlevel != 2)
         return;
 
-    VectorMA(pml.origin, 30, flatforward, spot);
+    VectorMA(pml->origin, 30, flatforward, spot);
     spot[2] += 4;
-    cont = pm->pointcontents(spot);
+    cont = PM_PointContents(pml, spot);
     if (!(cont & CONTENTS_SOLID))
         return;
 
     spot[2] += 16;
-    cont = pm->pointcontents(spot);
+    cont = PM_PointContents(pml, spot);
     if (cont)
         return;
     // jump out of water
-    VectorScale(flatforward, 50, pml.velocity);
-    pml.velocity[2] = 350;
+    VectorScale(flatforward, 50, pml->velocity);
+    pml->velocity[2] = 350;
 
     pm->s.pm_flags |= PMF_TIME_WATERJUMP;
     pm->s.pm_time = 255;
@@ -750,8 +794,10 @@ static void PM_CheckSpecialMovement(void)
 PM_FlyMove
 ===============
 */
-static void PM_FlyMove(void)
+static void PM_FlyMove(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
+    const pmoveParams_t *pmp = pml->pmp;
     float   speed, drop, friction, control, newspeed;
     float   currentspeed, addspeed, accelspeed;
     int         i;
@@ -763,15 +809,15 @@ static void PM_FlyMove(void)
     pm->viewheight = 22;
 
     // friction
-    speed = VectorLength(pml.velocity);
+    speed = VectorLength(pml->velocity);
     if (speed < 1) {
-        VectorClear(pml.velocity);
+        VectorClear(pml->velocity);
     } else {
         drop = 0;
 
         friction = pmp->flyfriction;
         control = speed < pm_stopspeed ? pm_stopspeed : speed;
-        drop += control * friction * pml.frametime;
+        drop += control * friction * pml->frametime;
 
         // scale the velocity
         newspeed = speed - drop;
@@ -779,18 +825,18 @@ static void PM_FlyMove(void)
             newspeed = 0;
         newspeed /= speed;
 
-        VectorScale(pml.velocity, newspeed, pml.velocity);
+        VectorScale(pml->velocity, newspeed, pml->velocity);
     }
 
     // accelerate
     fmove = pm->cmd.forwardmove;
     smove = pm->cmd.sidemove;
 
-    VectorNormalize(pml.forward);
-    VectorNormalize(pml.right);
+    VectorNormalize(pml->forward);
+    VectorNormalize(pml->right);
 
     for (i = 0; i < 3; i++)
-        wishvel[i] = pml.forward[i] * fmove + pml.right[i] * smove;
+        wishvel[i] = pml->forward[i] * fmove + pml->right[i] * smove;
     wishvel[2] += pm->cmd.upmove;
 
     VectorCopy(wishvel, wishdir);
@@ -804,23 +850,23 @@ static void PM_FlyMove(void)
         wishspeed = pmp->maxspeed;
     }
 
-    currentspeed = DotProduct(pml.velocity, wishdir);
+    currentspeed = DotProduct(pml->velocity, wishdir);
     addspeed = wishspeed - currentspeed;
     if (addspeed <= 0) {
         if (!pmp->flyhack) {
             return; // original buggy behaviour
         }
     } else {
-        accelspeed = pm_accelerate * pml.frametime * wishspeed;
+        accelspeed = pm_accelerate * pml->frametime * wishspeed;
         if (accelspeed > addspeed)
             accelspeed = addspeed;
 
         for (i = 0; i < 3; i++)
-            pml.velocity[i] += accelspeed * wishdir[i];
+            pml->velocity[i] += accelspeed * wishdir[i];
     }
 
     // move
-    VectorMA(pml.origin, pml.frametime, pml.velocity, pml.origin);
+    VectorMA(pml->origin, pml->frametime, pml->velocity, pml->origin);
 }
 
 /*
@@ -830,8 +876,9 @@ PM_CheckDuck
 Sets mins, maxs, and pm->viewheight
 ==============
 */
-static void PM_CheckDuck(void)
+static void PM_CheckDuck(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
     trace_t trace;
 
     pm->mins[0] = -16;
@@ -859,7 +906,7 @@ static void PM_CheckDuck(void)
         if (pm->s.pm_flags & PMF_DUCKED) {
             // try to stand up
             pm->maxs[2] = 32;
-            trace = pm->trace(pml.origin, pm->mins, pm->maxs, pml.origin);
+            trace = PM_Trace(pml, pml->origin, pm->mins, pm->maxs, pml->origin);
             if (!trace.allsolid)
                 pm->s.pm_flags &= ~PMF_DUCKED;
         }
@@ -879,26 +926,28 @@ static void PM_CheckDuck(void)
 PM_DeadMove
 ==============
 */
-static void PM_DeadMove(void)
+static void PM_DeadMove(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
     float   forward;
 
     if (!pm->groundentity)
         return;
 
     // extra friction
-    forward = VectorLength(pml.velocity);
+    forward = VectorLength(pml->velocity);
     forward -= 20;
     if (forward <= 0) {
-        VectorClear(pml.velocity);
+        VectorClear(pml->velocity);
     } else {
-        VectorNormalize(pml.velocity);
-        VectorScale(pml.velocity, forward, pml.velocity);
+        VectorNormalize(pml->velocity);
+        VectorScale(pml->velocity, forward, pml->velocity);
     }
 }
 
-static bool PM_GoodPosition(void)
+static bool PM_GoodPosition(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
     trace_t trace;
     vec3_t  origin, end;
     int     i;
@@ -908,7 +957,7 @@ static bool PM_GoodPosition(void)
 
     for (i = 0; i < 3; i++)
         origin[i] = end[i] = pm->s.origin[i] * 0.125f;
-    trace = pm->trace(origin, pm->mins, pm->maxs, end);
+    trace = PM_Trace(pml, origin, pm->mins, pm->maxs, end);
 
     return !trace.allsolid;
 }
@@ -921,8 +970,9 @@ On exit, the origin will have a value that is pre-quantized to the 0.125
 precision of the network channel and in a valid position.
 ================
 */
-static void PM_SnapPosition(void)
+static void PM_SnapPosition(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
     int     sign[3];
     int     i, j, bits;
     short   base[3];
@@ -931,15 +981,15 @@ static void PM_SnapPosition(void)
 
     // snap velocity to eigths
     for (i = 0; i < 3; i++)
-        pm->s.velocity[i] = (int)(pml.velocity[i] * 8);
+        pm->s.velocity[i] = (int)(pml->velocity[i] * 8);
 
     for (i = 0; i < 3; i++) {
-        if (pml.origin[i] >= 0)
+        if (pml->origin[i] >= 0)
             sign[i] = 1;
         else
             sign[i] = -1;
-        pm->s.origin[i] = (int)(pml.origin[i] * 8);
-        if (pm->s.origin[i] * 0.125f == pml.origin[i])
+        pm->s.origin[i] = (int)(pml->origin[i] * 8);
+        if (pm->s.origin[i] * 0.125f == pml->origin[i])
             sign[i] = 0;
     }
     VectorCopy(pm->s.origin, base);
@@ -952,12 +1002,12 @@ static void PM_SnapPosition(void)
             if (bits & (1 << i))
                 pm->s.origin[i] += sign[i];
 
-        if (PM_GoodPosition())
+        if (PM_GoodPosition(pml))
             return;
     }
 
     // go back to the last position
-    VectorCopy(pml.previous_origin, pm->s.origin);
+    VectorCopy(pml->previous_origin, pm->s.origin);
 }
 
 /*
@@ -966,8 +1016,9 @@ PM_InitialSnapPosition
 
 ================
 */
-static void PM_InitialSnapPosition(void)
+static void PM_InitialSnapPosition(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
     int        x, y, z;
     short      base[3];
     static const short offset[3] = { 0, -1, 1 };
@@ -980,11 +1031,11 @@ static void PM_InitialSnapPosition(void)
             pm->s.origin[1] = base[1] + offset[y];
             for (x = 0; x < 3; x++) {
                 pm->s.origin[0] = base[0] + offset[x];
-                if (PM_GoodPosition()) {
-                    pml.origin[0] = pm->s.origin[0] * 0.125f;
-                    pml.origin[1] = pm->s.origin[1] * 0.125f;
-                    pml.origin[2] = pm->s.origin[2] * 0.125f;
-                    VectorCopy(pm->s.origin, pml.previous_origin);
+                if (PM_GoodPosition(pml)) {
+                    pml->origin[0] = pm->s.origin[0] * 0.125f;
+                    pml->origin[1] = pm->s.origin[1] * 0.125f;
+                    pml->origin[2] = pm->s.origin[2] * 0.125f;
+                    VectorCopy(pm->s.origin, pml->previous_origin);
                     return;
                 }
             }
@@ -998,8 +1049,9 @@ PM_ClampAngles
 
 ================
 */
-static void PM_ClampAngles(void)
+static void PM_ClampAngles(pml_t *pml)
 {
+    pmove_t *pm = pml->pm;
     short   temp;
     int     i;
 
@@ -1017,20 +1069,18 @@ static void PM_ClampAngles(void)
         // don't let the player look up or down more than 90 degrees
         clamp(pm->viewangles[PITCH], -89, 89);
     }
-    AngleVectors(pm->viewangles, pml.forward, pml.right, pml.up);
+    AngleVectors(pm->viewangles, pml->forward, pml->right, pml->up);
 }
 
 /*
 ================
-Pmove
-
-Can be called by either the server or the client
+PM_Move
 ================
 */
-void Pmove(pmove_t *pmove, pmoveParams_t *params)
+static void PM_Move(pml_t *pml)
 {
-    pm = pmove;
-    pmp = params;
+    pmove_t *pm = pml->pm;
+    const pmoveParams_t *pmp = pml->pmp;
 
     // clear results
     pm->numtouch = 0;
@@ -1040,26 +1090,23 @@ void Pmove(pmove_t *pmove, pmoveParams_t *params)
     pm->watertype = 0;
     pm->waterlevel = 0;
 
-    // clear all pmove local vars
-    memset(&pml, 0, sizeof(pml));
-
     // convert origin and velocity to float values
-    VectorScale(pm->s.origin, 0.125f, pml.origin);
-    VectorScale(pm->s.velocity, 0.125f, pml.velocity);
+    VectorScale(pm->s.origin, 0.125f, pml->origin);
+    VectorScale(pm->s.velocity, 0.125f, pml->velocity);
 
     // save old org in case we get stuck
-    VectorCopy(pm->s.origin, pml.previous_origin);
+    VectorCopy(pm->s.origin, pml->previous_origin);
 
-    PM_ClampAngles();
+    PM_ClampAngles(pml);
 
     if (pm->s.pm_type == PM_SPECTATOR) {
-        pml.frametime = pmp->speedmult * pm->cmd.msec * 0.001f;
-        PM_FlyMove();
-        PM_SnapPosition();
+        pml->frametime = pmp->speedmult * pm->cmd.msec * 0.001f;
+        PM_FlyMove(pml);
+        PM_SnapPosition(pml);
         return;
     }
 
-    pml.frametime = pm->cmd.msec * 0.001f;
+    pml->frametime = pm->cmd.msec * 0.001f;
 
     if (pm->s.pm_type >= PM_DEAD) {
         pm->cmd.forwardmove = 0;
@@ -1071,18 +1118,18 @@ void Pmove(pmove_t *pmove, pmoveParams_t *params)
         return;     // no movement at all
 
     // set mins, maxs, and viewheight
-    PM_CheckDuck();
+    PM_CheckDuck(pml);
 
     if (pm->snapinitial)
-        PM_InitialSnapPosition();
+        PM_InitialSnapPosition(pml);
 
     // set groundentity, watertype, and waterlevel
-    PM_CategorizePosition();
+    PM_CategorizePosition(pml);
 
     if (pm->s.pm_type == PM_DEAD)
-        PM_DeadMove();
+        PM_DeadMove(pml);
 
-    PM_CheckSpecialMovement();
+    PM_CheckSpecialMovement(pml);
 
     // drop timing counter
     if (pm->s.pm_time) {
@@ -1102,21 +1149,21 @@ void Pmove(pmove_t *pmove, pmoveParams_t *params)
         // teleport pause stays exactly in place
     } else if (pm->s.pm_flags & PMF_TIME_WATERJUMP) {
         // waterjump has no control, but falls
-        pml.velocity[2] -= pm->s.gravity * pml.frametime;
-        if (pml.velocity[2] < 0) {
+        pml->velocity[2] -= pm->s.gravity * pml->frametime;
+        if (pml->velocity[2] < 0) {
             // cancel as soon as we are falling down again
             pm->s.pm_flags &= ~(PMF_TIME_WATERJUMP | PMF_TIME_LAND | PMF_TIME_TELEPORT);
             pm->s.pm_time = 0;
         }
 
-        PM_StepSlideMove();
+        PM_StepSlideMove(pml);
     } else {
-        PM_CheckJump();
+        PM_CheckJump(pml);
 
-        PM_Friction();
+        PM_Friction(pml);
 
         if (pm->waterlevel >= 2)
-            PM_WaterMove();
+            PM_WaterMove(pml);
         else {
             vec3_t  angles;
 
@@ -1125,16 +1172,41 @@ void Pmove(pmove_t *pmove, pmoveParams_t *params)
                 angles[PITCH] = angles[PITCH] - 360;
             angles[PITCH] /= 3;
 
-            AngleVectors(angles, pml.forward, pml.right, pml.up);
+            AngleVectors(angles, pml->forward, pml->right, pml->up);
 
-            PM_AirMove();
+            PM_AirMove(pml);
         }
     }
 
     // set groundentity, watertype, and waterlevel for final spot
-    PM_CategorizePosition();
+    PM_CategorizePosition(pml);
+
+    PM_SnapPosition(pml);
+}
+
+/*
+================
+Pmove
+
+Can be called by either the server or the client
+================
+*/
+void Pmove(pmove_t *pmove, pmoveParams_t *params)
+{
+    PmoveWorld(pmove, params, NULL);
+}
+
+void PmoveWorld(pmove_t *pmove, const pmoveParams_t *params, const pmoveWorld_t *world)
+{
+    pml_t   pml;
+
+    // clear all pmove local vars
+    memset(&pml, 0, sizeof(pml));
+    pml.pm = pmove;
+    pml.pmp = params;
+    pml.world = world;
 
-    PM_SnapPosition();
+    PM_Move(&pml);
 }
 
 void PmoveInit(pmoveParams_t *pmp)
@@ -19,14 +19,25 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "shared/shared.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
+#include "common/async.h"
+#include "common/cmodel.h"
 #include "common/common.h"
+#include "common/cvar.h"
 #include "common/files.h"
 #include "common/mdfour.h"
+#include "common/msg.h"
 #include "common/tests.h"
+#include "format/iqm.h"
 #include "refresh/refresh.h"
+#include "refresh/images.h"
+#include "refresh/models.h"
 #include "system/system.h"
 #include "client/sound/sound.h"
 
+#if USE_REF
+#include "stb_image.h"
+#endif
+
 // test error shutdown procedures
 static void Com_Error_f(void)
 {
@@ -519,6 +530,267 @@ static void Com_TestModels_f(void)
 }
 #endif
 
+#if USE_REF
+static const struct {
+    const char *name;
+    int flags;
+} image_filters[] = {
+    { "box",            0 },
+    { "box linear",     IMG_FILTER_LINEAR },
+    { "kaiser",         IMG_FILTER_KAISER },
+    { "kaiser linear",  IMG_FILTER_KAISER | IMG_FILTER_LINEAR },
+};
+
+static unsigned mipmap_chain(byte *pic, int width, int height, int flags)
+{
+    unsigned crc = 0;
+
+    while (width > 1 || height > 1) {
+        IMG_MipMapEx(pic, pic, width, height, flags);
+        width = max(width >> 1, 1);
+        height = max(height >> 1, 1);
+        crc = crc * 31 + pic[(width * height * 4) / 3];
+    }
+
+    return crc;
+}
+
+// mipmaps every image in directory with all filters
+static void test_image_dir(const char *dir)
+{
+    unsigned msec[q_countof(image_filters)] = { 0 };
+    unsigned crc[q_countof(image_filters)] = { 0 };
+    void **list;
+    byte *data, *src, *pic;
+    int i, j, len, count, errors, width, height;
+    unsigned start;
+
+    list = FS_ListFiles(dir, ".png;.tga", FS_SEARCH_SAVEPATH | FS_SEARCH_RECURSIVE, &count);
+    if (!list) {
+        Com_Printf("No images found in %s\n", dir);
+        return;
+    }
+
+    errors = 0;
+    for (i = 0; i < count; i++) {
+        len = FS_LoadFile(list[i], (void **)&data);
+        if (!data) {
+            Com_EPrintf("Couldn't load %s: %s\n", (char *)list[i], Q_ErrorString(len));
+            errors++;
+            continue;
+        }
+
+        src = stbi_load_from_memory(data, len, &width, &height, NULL, 4);
+        FS_FreeFile(data);
+        if (!src) {
+            Com_EPrintf("Couldn't decode %s: %s\n", (char *)list[i], stbi_failure_reason());
+            errors++;
+            continue;
+        }
+
+        pic = Z_Malloc(width * height * 4);
+        for (j = 0; j < q_countof(image_filters); j++) {
+            memcpy(pic, src, width * height * 4);
+            start = Sys_Milliseconds();
+            crc[j] = crc[j] * 31 + mipmap_chain(pic, width, height, image_filters[j].flags);
+            msec[j] += Sys_Milliseconds() - start;
+        }
+        Z_Free(pic);
+        stbi_image_free(src);
+    }
+
+    FS_FreeList(list);
+
+    for (j = 0; j < q_countof(image_filters); j++)
+        Com_Printf("%-14s %5u msec, checksum %08x\n", image_filters[j].name, msec[j], crc[j]);
+    Com_Printf("%d failures, %d images tested, %d threads\n",
+               errors, count, Com_ParallelThreads());
+}
+
+static void Com_TestImages_f(void)
+{
+    int i, j, size, passes;
+    byte *src, *pic;
+    unsigned start, end, crc;
+
+    IMG_InitProcessing();
+
+    if (Cmd_Argc() > 1 && !COM_IsUint(Cmd_Argv(1))) {
+        test_image_dir(Cmd_Argv(1));
+        return;
+    }
+
+    size = Cmd_Argc() > 1 ? Q_npot32(atoi(Cmd_Argv(1))) : 1024;
+    clamp(size, 16, MAX_TEXTURE_SIZE);
+    passes = max(0x1000000 / (size * size), 1);
+
+    src = Z_Malloc(size * size * 4);
+    pic = Z_Malloc(size * size * 4);
+
+    // fixed seed so that checksums are comparable between runs
+    for (i = 0, crc = 1; i < size * size * 4; i++) {
+        crc = crc * 1103515245 + 12345;
+        src[i] = crc >> 16;
+    }
+
+    for (i = 0; i < q_countof(image_filters); i++) {
+        start = Sys_Milliseconds();
+        for (j = 0, crc = 0; j < passes; j++) {
+            memcpy(pic, src, size * size * 4);
+            crc = mipmap_chain(pic, size, size, image_filters[i].flags);
+        }
+        end = Sys_Milliseconds();
+
+        Com_Printf("%-14s %5d msec, checksum %08x\n", image_filters[i].name, end - start, crc);
+    }
+
+    start = Sys_Milliseconds();
+    for (j = 0; j < passes; j++)
+        IMG_ResampleTexture(src, size, size, pic, size * 3 / 4, size * 3 / 4);
+    end = Sys_Milliseconds();
+
+    Com_Printf("%-14s %5d msec\n", "resample", end - start);
+    Com_Printf("%d passes over %dx%d image, %d threads\n",
+               passes, size, size, Com_ParallelThreads());
+
+    Z_Free(src);
+    Z_Free(pic);
+}
+
+#define BENCH_JOINTS    64
+#define BENCH_FRAMES    16
+
+// builds a random skeleton with parents preceding children, like IQM files
+static iqm_model_t *iqm_random_model(void)
+{
+    iqm_model_t *iqm;
+    iqm_transform_t *pose;
+    vec3_t angles, axis[3], origin;
+    float len;
+    int i, j;
+
+    iqm = Z_Mallocz(sizeof(*iqm));
+    iqm->num_joints = iqm->num_poses = BENCH_JOINTS;
+    iqm->num_frames = BENCH_FRAMES;
+    iqm->jointParents = Z_Malloc(sizeof(iqm->jointParents[0]) * BENCH_JOINTS);
+    iqm->bindJoints = Z_Malloc(sizeof(iqm->bindJoints[0]) * BENCH_JOINTS * 12);
+    iqm->invBindJoints = Z_Malloc(sizeof(iqm->invBindJoints[0]) * BENCH_JOINTS * 12);
+    iqm->poses = Z_Malloc(sizeof(iqm->poses[0]) * BENCH_JOINTS * BENCH_FRAMES);
+
+    for (i = 0; i < BENCH_JOINTS; i++) {
+        float *bind = &iqm->bindJoints[i * 12];
+        float *inv = &iqm->invBindJoints[i * 12];
+
+        iqm->jointParents[i] = i ? Q_rand_uniform(i) : -1;
+
+        // rigid transform and its inverse
+        for (j = 0; j < 3; j++) {
+            angles[j] = frand() * 360;
+            origin[j] = crand() * 16;
+        }
+        AnglesToAxis(angles, axis);
+        for (j = 0; j < 3; j++) {
+            bind[j * 4 + 0] = axis[0][j];
+            bind[j * 4 + 1] = axis[1][j];
+            bind[j * 4 + 2] = axis[2][j];
+            bind[j * 4 + 3] = origin[j];
+            inv[j * 4 + 0] = axis[j][0];
+            inv[j * 4 + 1] = axis[j][1];
+            inv[j * 4 + 2] = axis[j][2];
+            inv[j * 4 + 3] = -DotProduct(axis[j], origin);
+        }
+    }
+
+    // each frame rotates joints a bit further
+    for (i = 0, pose = iqm->poses; i < BENCH_JOINTS * BENCH_FRAMES; i++, pose++) {
+        if (i < BENCH_JOINTS) {
+            for (j = 0; j < 4; j++)
+                pose->rotate[j] = crand();
+        } else {
+            for (j = 0; j < 4; j++)
+                pose->rotate[j] = pose[-BENCH_JOINTS].rotate[j] + crand() * 0.25f;
+        }
+        len = sqrtf(DotProduct(pose->rotate, pose->rotate) + pose->rotate[3] * pose->rotate[3]);
+        for (j = 0; j < 4; j++)
+            pose->rotate[j] /= len;
+        for (j = 0; j < 3; j++) {
+            pose->translate[j] = crand() * 8;
+            pose->scale[j] = 1 + crand() * 0.1f;
+        }
+    }
+
+    return iqm;
+}
+
+static void iqm_free_model(iqm_model_t *iqm)
+{
+    Z_Free(iqm->jointParents);
+    Z_Free(iqm->bindJoints);
+    Z_Free(iqm->invBindJoints);
+    Z_Free(iqm->poses);
+    Z_Free(iqm);
+}
+
+// compares SIMD skeletal pose computation against scalar reference
+static void Com_IQMBench_f(void)
+{
+    static float pose[IQM_MAX_JOINTS * 12], ref[IQM_MAX_JOINTS * 12];
+    iqm_model_t *iqm, *temp = NULL;
+    int i, j, k, count, frame, oldframe;
+    uint64_t start, time[2];
+    float backlerp, error;
+
+    count = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100000;
+    if (count < 1) {
+        return;
+    }
+
+    Q_srand(1);
+
+    if (Cmd_Argc() > 2) {
+        model_t *model = MOD_ForHandle(R_RegisterModel(Cmd_Argv(2)));
+        if (!model || !model->iqmData || !model->iqmData->num_poses) {
+            Com_Printf("%s is not a skeletal model\n", Cmd_Argv(2));
+            return;
+        }
+        iqm = model->iqmData;
+    } else {
+        iqm = temp = iqm_random_model();
+    }
+
+    // all frame pairs, including unlerped ones
+    error = 0;
+    for (i = 0; i < 4096; i++) {
+        frame = Q_rand_uniform(iqm->num_frames + 1);
+        oldframe = (i & 7) ? frame + (i & 1) : frame;
+        backlerp = frand();
+        R_ComputeIQMPose(iqm, frame, oldframe, backlerp, pose);
+        R_ComputeIQMPoseScalar(iqm, frame, oldframe, backlerp, ref);
+        for (j = 0; j < iqm->num_poses * 12; j++)
+            error = max(error, fabsf(pose[j] - ref[j]));
+    }
+
+    for (k = 0; k < 2; k++) {
+        start = Sys_Microseconds();
+        for (i = 0; i < count; i++) {
+            backlerp = (i & 255) / 256.0f;
+            if (k)
+                R_ComputeIQMPoseScalar(iqm, i >> 8, (i >> 8) + 1, backlerp, ref);
+            else
+                R_ComputeIQMPose(iqm, i >> 8, (i >> 8) + 1, backlerp, pose);
+        }
+        time[k] = Sys_Microseconds() - start;
+    }
+
+    Com_Printf("%d joints, %d poses: %.1f ns/pose, scalar %.1f ns/pose, max error %g\n",
+               iqm->num_poses, count, time[0] * 1000.0f / count,
+               time[1] * 1000.0f / count, error);
+
+    if (temp)
+        iqm_free_model(temp);
+}
+#endif
+
 #if USE_CLIENT
 static void Com_TestSounds_f(void)
 {
@@ -679,6 +951,527 @@ static void Com_ExtCmpTest_f(void)
     Com_Printf("%d failures, %d strings tested\n", errors, numextcmptests);
 }
 
+static void delta_write(const entity_packed_t *from, const entity_packed_t *to, msgEsFlags_t flags)
+{
+    MSG_BeginWriting();
+    MSG_WriteDeltaEntity(from, to, flags);
+}
+
+// trailing padding makes parser take unchecked path
+static bool delta_parse(const entity_state_t *from, entity_state_t *to, msgEsFlags_t flags, size_t pad)
+{
+    int number, bits;
+
+    memcpy(msg_read_buffer, msg_write.data, msg_write.cursize);
+    memset(msg_read_buffer + msg_write.cursize, 0, pad);
+    msg_read.cursize = msg_write.cursize + pad;
+    MSG_BeginReading();
+
+    number = MSG_ParseEntityBits(&bits);
+    MSG_ParseDeltaEntity(from, to, number, bits, flags);
+
+    return msg_read.readcount == msg_write.cursize;
+}
+
+static int delta_random(int range)
+{
+    switch (Q_rand() & 3) {
+    case 0:
+        return 0;
+    case 1:
+        return Q_rand_uniform(64) - 32;
+    case 2:
+        return Q_rand_uniform(range * 2 + 1) - range;
+    default:
+        return (int16_t)Q_rand();
+    }
+}
+
+// checks that bit packed entity deltas and unchecked parsing path decode
+// to the same state as the byte oriented encoding, and reports relative size
+static void Com_TestDelta_f(void)
+{
+    entity_packed_t base, to;
+    entity_state_t from, s1, s2;
+    msgEsFlags_t flags;
+    size_t bytes1, bytes2;
+    int i, j, count, errors;
+
+    count = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100000;
+    Q_srand(Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 1);
+
+    errors = 0;
+    bytes1 = bytes2 = 0;
+    for (i = 0; i < count; i++) {
+        memset(&base, 0, sizeof(base));
+        base.number = 1 + Q_rand_uniform(MAX_EDICTS - 1);
+        for (j = 0; j < 3; j++) {
+            base.origin[j] = Q_rand();
+            base.angles[j] = Q_rand();
+            base.old_origin[j] = Q_rand();
+        }
+        base.modelindex = Q_rand();
+        base.frame = Q_rand_uniform(256);
+        base.renderfx = Q_rand() & (RF_FRAMELERP | RF_BEAM);
+
+        flags = MSG_ES_FORCE | MSG_ES_UMASK | MSG_ES_LONGSOLID | MSG_ES_BEAMORIGIN;
+        if (Q_rand() & 1)
+            flags |= MSG_ES_SHORTANGLES;
+
+        // what client has for the previous state
+        delta_write(NULL, &base, flags);
+        if (!delta_parse(NULL, &from, flags, 0)) {
+            Com_EPrintf("Entity %d: bad baseline\n", i);
+            errors++;
+            continue;
+        }
+
+        to = base;
+        for (j = 0; j < 3; j++) {
+            to.origin[j] += delta_random(512);
+            to.angles[j] += delta_random(4096);
+            to.old_origin[j] = to.origin[j] + delta_random(512);
+        }
+        if (Q_rand() & 1)
+            to.frame++;
+        if (Q_rand() & 1)
+            to.modelindex2 = Q_rand();
+        if (Q_rand() & 1)
+            to.skinnum = Q_rand() >> (Q_rand() & 31);
+        if (Q_rand() & 1)
+            to.effects = Q_rand() >> (Q_rand() & 31);
+        if (Q_rand() & 1)
+            to.solid = Q_rand() >> (Q_rand() & 31);
+        if (Q_rand() & 1)
+            to.sound = Q_rand();
+        if (Q_rand() & 1)
+            to.event = Q_rand();
+        if (Q_rand() & 1)
+            flags |= MSG_ES_NEWENTITY;
+
+        delta_write(&base, &to, flags);
+        bytes1 += msg_write.cursize;
+        if (!delta_parse(&from, &s1, flags, 0)) {
+            Com_EPrintf("Entity %d: bad size\n", i);
+            errors++;
+            continue;
+        }
+
+        if (!delta_parse(&from, &s2, flags, 64) || memcmp(&s1, &s2, sizeof(s1))) {
+            Com_EPrintf("Entity %d: fast path mismatch\n", i);
+            errors++;
+            continue;
+        }
+
+        delta_write(&base, &to, flags | MSG_ES_PACKED);
+        bytes2 += msg_write.cursize;
+        if (!delta_parse(&from, &s2, flags | MSG_ES_PACKED, Q_rand() & 64)) {
+            Com_EPrintf("Entity %d: bad packed size\n", i);
+            errors++;
+            continue;
+        }
+
+        if (memcmp(&s1, &s2, sizeof(s1))) {
+            Com_EPrintf("Entity %d: packed state mismatch\n", i);
+            errors++;
+        }
+    }
+
+    SZ_Clear(&msg_write);
+    msg_read.cursize = msg_read.readcount = 0;
+
+    Com_Printf("%d failures, %d entities tested\n", errors, count);
+    if (bytes1)
+        Com_Printf("%zu bytes, %zu bytes packed (%.1f%%)\n",
+                   bytes1, bytes2, bytes2 * 100.0 / bytes1);
+}
+
+// returns 0 if traces are identical, 1 if they stopped at the same position
+// but on another of equally near brushes, 2 otherwise
+static int trace_compare(const trace_t *t1, const trace_t *t2)
+{
+    if (t1->fraction != t2->fraction || !VectorCompare(t1->endpos, t2->endpos))
+        return 2;
+
+    if (t1->allsolid != t2->allsolid || t1->startsolid != t2->startsolid ||
+        t1->contents != t2->contents || t1->surface != t2->surface ||
+        !VectorCompare(t1->plane.normal, t2->plane.normal) || t1->plane.dist != t2->plane.dist)
+        return 1;
+
+    return 0;
+}
+
+static const vec3_t trace_sizes[][2] = {
+    { {   0,   0,   0 }, {  0,  0,  0 } },
+    { { -16, -16, -24 }, { 16, 16, 32 } },
+    { { -16, -16, -24 }, { 16, 16,  4 } },
+    { {  -4,  -4,  -4 }, {  4,  4,  4 } },
+};
+
+static const int trace_masks[] = {
+    MASK_PLAYERSOLID, MASK_SHOT, MASK_SOLID, MASK_WATER, MASK_ALL
+};
+
+static void point_random(vec3_t point, const mmodel_t *world)
+{
+    int i;
+
+    for (i = 0; i < 3; i++)
+        point[i] = world->mins[i] + frand() * (world->maxs[i] - world->mins[i]);
+}
+
+static void trace_random(vec3_t start, vec3_t end, const mmodel_t *world)
+{
+    float len;
+    int i;
+
+    point_random(start, world);
+
+    switch (Q_rand() & 3) {
+    case 0:
+        // anywhere in the world
+        point_random(end, world);
+        break;
+    case 1:
+        // along one axis
+        VectorCopy(start, end);
+        end[Q_rand_uniform(3)] += crand() * 1024;
+        break;
+    default:
+        // short moves, like pmove
+        len = Q_rand() & 1 ? 32 : 256;
+        for (i = 0; i < 3; i++)
+            end[i] = start[i] + crand() * len;
+        break;
+    }
+}
+
+// checks that tracing through brush tree gives the same results as
+// recursive hull check, both for single traces and bundles
+static void Com_TestTrace_f(void)
+{
+    trace_t tr1[8], tr2[8];
+    vec3_t starts[8], ends[8];
+    char buffer[MAX_QPATH];
+    const vec_t *mins, *maxs;
+    const mmodel_t *world;
+    mnode_t *headnode;
+    cvar_t *var;
+    cm_t cm;
+    int i, j, k, n, count, errors, ties, value, mask, ret;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <map> [count] [seed]\n", Cmd_Argv(0));
+        return;
+    }
+
+    count = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 100000;
+    Q_srand(Cmd_Argc() > 3 ? atoi(Cmd_Argv(3)) : 1);
+
+    var = Cvar_Get("map_bvh", "0", 0);
+    value = var->integer;
+    Cvar_SetInteger(var, 1, FROM_CODE);
+
+    memset(&cm, 0, sizeof(cm));
+    Q_snprintf(buffer, sizeof(buffer), "maps/%s.bsp", Cmd_Argv(1));
+    ret = CM_LoadMap(&cm, buffer);
+    if (!cm.cache) {
+        Com_EPrintf("Couldn't load %s: %s\n", buffer, BSP_ErrorString(ret));
+        goto done;
+    }
+    if (!cm.brushtree) {
+        Com_EPrintf("Couldn't build brush tree for %s\n", buffer);
+        goto done;
+    }
+
+    world = &cm.cache->models[0];
+    headnode = world->headnode;
+
+    errors = ties = 0;
+    for (i = 0; i < count; i++) {
+        k = Q_rand_uniform(q_countof(trace_sizes));
+        mins = trace_sizes[k][0];
+        maxs = trace_sizes[k][1];
+        mask = trace_masks[Q_rand_uniform(q_countof(trace_masks))];
+
+        // bundle of traces near the first one
+        n = Q_rand() & 1 ? 1 : 8;
+        trace_random(starts[0], ends[0], world);
+        for (j = 1; j < n; j++) {
+            for (k = 0; k < 3; k++) {
+                starts[j][k] = starts[0][k] + crand() * 16;
+                ends[j][k] = ends[0][k] + crand() * 16;
+            }
+        }
+
+        Cvar_SetInteger(var, 0, FROM_CODE);
+        for (j = 0; j < n; j++)
+            CM_BoxTrace(&tr1[j], starts[j], ends[j], mins, maxs, headnode, mask);
+
+        Cvar_SetInteger(var, 1, FROM_CODE);
+        for (j = 0; j < n; j++)
+            CM_BoxTrace(&tr2[j], starts[j], ends[j], mins, maxs, headnode, mask);
+
+        for (j = 0; j < n; j++) {
+            switch (trace_compare(&tr1[j], &tr2[j])) {
+            case 1:
+                ties++;
+                break;
+            case 2:
+                Com_EPrintf("Trace %d: (%s) -> (%s) fraction %f, tree %f\n", i,
+                            vtos(starts[j]), vtos(ends[j]), tr1[j].fraction, tr2[j].fraction);
+                errors++;
+                break;
+            }
+        }
+
+        if (n == 1)
+            continue;
+
+        CM_BoxTraceBundle(tr2, (const vec3_t *)starts, (const vec3_t *)ends, n, mins, maxs, headnode, mask);
+        for (j = 0; j < n; j++) {
+            switch (trace_compare(&tr1[j], &tr2[j])) {
+            case 1:
+                ties++;
+                break;
+            case 2:
+                Com_EPrintf("Bundle %d: (%s) -> (%s) fraction %f, tree %f\n", i,
+                            vtos(starts[j]), vtos(ends[j]), tr1[j].fraction, tr2[j].fraction);
+                errors++;
+                break;
+            }
+        }
+    }
+
+    Com_Printf("%d failures, %d ties, %d iterations tested\n", errors, ties, count);
+
+done:
+    CM_FreeMap(&cm);
+    Cvar_SetInteger(var, value, FROM_CODE);
+}
+
+#define BENCH_BATCH     64
+#define MAX_BENCH_LEAFS 64
+
+typedef enum {
+    BENCH_TRACE,
+    BENCH_TRANSFORMED,
+    BENCH_CONTENTS,
+    BENCH_LEAFS,
+
+    BENCH_TOTAL
+} benchtype_t;
+
+static const char *const bench_names[BENCH_TOTAL] = {
+    "boxtrace", "transformed", "contents", "boxleafs"
+};
+
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      mins, maxs;
+    vec3_t      origin, angles;
+    mnode_t     *headnode;      // NULL for box hull
+    int         mask;
+} benchquery_t;
+
+// results are hashed without pointers to be comparable across builds
+typedef struct {
+    float       fraction;
+    vec3_t      endpos;
+    vec3_t      normal;
+    float       dist;
+    int         contents;
+    int         flags;
+    char        surface[16];
+} benchtrace_t;
+
+typedef union {
+    benchtrace_t    trace;
+    int             contents;
+    int             leafs[MAX_BENCH_LEAFS + 2];
+} benchresult_t;
+
+static void bench_query(benchquery_t *q, benchtype_t type, const bsp_t *bsp)
+{
+    const mmodel_t *world = &bsp->models[0];
+    int i, k;
+
+    memset(q, 0, sizeof(*q));
+    q->headnode = world->headnode;
+    q->mask = trace_masks[Q_rand_uniform(q_countof(trace_masks))];
+    k = Q_rand_uniform(q_countof(trace_sizes));
+    VectorCopy(trace_sizes[k][0], q->mins);
+    VectorCopy(trace_sizes[k][1], q->maxs);
+
+    switch (type) {
+    case BENCH_TRACE:
+        trace_random(q->start, q->end, world);
+        break;
+    case BENCH_TRANSFORMED:
+        // moved inline model or box hull, like entity clipping does
+        if (bsp->nummodels > 1 && Q_rand() & 3) {
+            const mmodel_t *model = &bsp->models[1 + Q_rand_uniform(bsp->nummodels - 1)];
+
+            q->headnode = model->headnode;
+            for (i = 0; i < 3; i++)
+                q->origin[i] = crand() * 64;
+            if (Q_rand() & 1)
+                for (i = 0; i < 3; i++)
+                    q->angles[i] = frand() * 360;
+            VectorAvg(model->mins, model->maxs, q->start);
+            VectorAdd(q->start, q->origin, q->start);
+        } else {
+            q->headnode = NULL;
+            point_random(q->origin, world);
+            VectorCopy(q->origin, q->start);
+        }
+        for (i = 0; i < 3; i++) {
+            q->start[i] += crand() * 128;
+            q->end[i] = q->start[i] + crand() * 128;
+        }
+        break;
+    case BENCH_CONTENTS:
+        point_random(q->start, world);
+        break;
+    case BENCH_LEAFS:
+        point_random(q->start, world);
+        for (i = 0; i < 3; i++) {
+            q->mins[i] = q->start[i] - frand() * 256;
+            q->maxs[i] = q->start[i] + frand() * 256;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void bench_result(benchresult_t *r, const trace_t *tr)
+{
+    r->trace.fraction = tr->fraction;
+    VectorCopy(tr->endpos, r->trace.endpos);
+    VectorCopy(tr->plane.normal, r->trace.normal);
+    r->trace.dist = tr->plane.dist;
+    r->trace.contents = tr->contents;
+    r->trace.flags = tr->allsolid | tr->startsolid << 1;
+    memcpy(r->trace.surface, tr->surface->name, sizeof(r->trace.surface));
+}
+
+// runs a batch of queries, returns time spent in microseconds
+static uint64_t bench_batch(cm_t *cm, benchtype_t type, int count, uint32_t *checksum)
+{
+    static const vec3_t box_mins = { -16, -16, -16 };
+    static const vec3_t box_maxs = { 16, 16, 16 };
+    benchquery_t queries[BENCH_BATCH], *q;
+    benchresult_t results[BENCH_BATCH];
+    mleaf_t *leafs[MAX_BENCH_LEAFS];
+    trace_t tr;
+    mnode_t *headnode;
+    uint64_t start, end;
+    int i, j, n;
+
+    for (i = 0; i < count; i++)
+        bench_query(&queries[i], type, cm->cache);
+    memset(results, 0, sizeof(results[0]) * count);
+
+    start = Sys_Microseconds();
+    for (i = 0, q = queries; i < count; i++, q++) {
+        switch (type) {
+        case BENCH_TRACE:
+            CM_BoxTrace(&tr, q->start, q->end, q->mins, q->maxs, q->headnode, q->mask);
+            bench_result(&results[i], &tr);
+            break;
+        case BENCH_TRANSFORMED:
+            headnode = q->headnode ? q->headnode : CM_HeadnodeForBox(box_mins, box_maxs);
+            CM_TransformedBoxTrace(&tr, q->start, q->end, q->mins, q->maxs,
+                                   headnode, q->mask, q->origin, q->angles);
+            bench_result(&results[i], &tr);
+            break;
+        case BENCH_CONTENTS:
+            results[i].contents = CM_PointContents(q->start, q->headnode);
+            break;
+        case BENCH_LEAFS:
+            headnode = q->headnode;
+            n = CM_BoxLeafs(cm, q->mins, q->maxs, leafs, MAX_BENCH_LEAFS, &headnode);
+            results[i].leafs[0] = n;
+            results[i].leafs[1] = CM_NumNode(cm, headnode);
+            for (j = 0; j < n; j++)
+                results[i].leafs[j + 2] = leafs[j] - cm->cache->leafs;
+            break;
+        default:
+            break;
+        }
+    }
+    end = Sys_Microseconds();
+
+    *checksum = *checksum * 0x01000193 ^ Com_BlockChecksum(results, sizeof(results[0]) * count);
+    return end - start;
+}
+
+static int bench_cmp(const void *p1, const void *p2)
+{
+    float f1 = *(const float *)p1;
+    float f2 = *(const float *)p2;
+
+    return (f1 > f2) - (f1 < f2);
+}
+
+// fires randomized collision queries with fixed seed against a map,
+// reports throughput, latency percentiles and checksums of results
+static void Com_TraceBench_f(void)
+{
+    char buffer[MAX_QPATH];
+    uint64_t time, total;
+    uint32_t checksum;
+    float *latency;
+    int i, n, count, numbatches, seed, ret;
+    cm_t cm;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <map> [count] [seed]\n", Cmd_Argv(0));
+        return;
+    }
+
+    count = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 1000000;
+    seed = Cmd_Argc() > 3 ? atoi(Cmd_Argv(3)) : 1;
+    if (count < 1) {
+        return;
+    }
+
+    memset(&cm, 0, sizeof(cm));
+    Q_snprintf(buffer, sizeof(buffer), "maps/%s.bsp", Cmd_Argv(1));
+    ret = CM_LoadMap(&cm, buffer);
+    if (!cm.cache) {
+        Com_EPrintf("Couldn't load %s: %s\n", buffer, BSP_ErrorString(ret));
+        return;
+    }
+
+    numbatches = (count + BENCH_BATCH - 1) / BENCH_BATCH;
+    latency = Z_Malloc(sizeof(latency[0]) * numbatches);
+
+    Com_Printf("%d queries each, latency is per query averaged over %d\n", count, BENCH_BATCH);
+
+    for (i = 0; i < BENCH_TOTAL; i++) {
+        Q_srand(seed);
+        checksum = 0;
+        total = 0;
+        for (n = 0; n < numbatches; n++) {
+            int size = min(count - n * BENCH_BATCH, BENCH_BATCH);
+            time = bench_batch(&cm, i, size, &checksum);
+            latency[n] = time * 1000.0f / size;
+            total += time;
+        }
+
+        qsort(latency, numbatches, sizeof(latency[0]), bench_cmp);
+        Com_Printf("%-12s %7.3f Mq/s, %6.0f / %6.0f / %6.0f ns (p50/p90/p99), checksum %08x\n",
+                   bench_names[i], (float)count / max(total, 1),
+                   latency[numbatches / 2], latency[numbatches * 9 / 10],
+                   latency[numbatches * 99 / 100], checksum);
+    }
+
+    Z_Free(latency);
+    CM_FreeMap(&cm);
+}
+
 void TST_Init(void)
 {
     Cmd_AddCommand("error", Com_Error_f);
@@ -693,11 +1486,16 @@ void TST_Init(void)
     Cmd_AddCommand("snprintftest", Com_TestSnprintf_f);
 #if USE_REF
     Cmd_AddCommand("modeltest", Com_TestModels_f);
+    Cmd_AddCommand("imagetest", Com_TestImages_f);
+    Cmd_AddCommand("iqmbench", Com_IQMBench_f);
 #endif
 #if USE_CLIENT
     Cmd_AddCommand("soundtest", Com_TestSounds_f);
 #endif
     Cmd_AddCommand("mdfourtest", Com_MdfourTest_f);
     Cmd_AddCommand("extcmptest", Com_ExtCmpTest_f);
+    Cmd_AddCommand("deltatest", Com_TestDelta_f);
+    Cmd_AddCommand("tracetest", Com_TestTrace_f);
+    Cmd_AddCommand("tracebench", Com_TraceBench_f);
 }
 
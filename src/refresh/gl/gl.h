@@ -85,6 +85,9 @@ typedef struct {
         memhunk_t   hunk;
         vec_t       *vertices;
         GLuint      bufnum;
+        GLuint      ibonum;
+        struct glbatch_s    *batches;
+        int         numbatches;
         vec_t       size;
     } world;
     GLuint          warp_texture;
@@ -204,6 +207,7 @@ extern cvar_t *gl_test;
 #endif
 extern cvar_t *gl_cull_nodes;
 extern cvar_t *gl_hash_faces;
+extern cvar_t *gl_multidraw;
 extern cvar_t *gl_clear;
 extern cvar_t *gl_novis;
 extern cvar_t *gl_lockpvs;
@@ -280,6 +284,10 @@ typedef struct maliasmesh_s {
 #define LM_BLOCK_WIDTH      512
 #define LM_BLOCK_HEIGHT     512
 
+typedef struct {
+    int         x0, y0, x1, y1;
+} lmrect_t;
+
 typedef struct {
     int         inuse[LM_BLOCK_WIDTH];
     byte        buffer[LM_BLOCK_WIDTH * LM_BLOCK_HEIGHT * 4];
@@ -288,12 +296,16 @@ typedef struct {
     float       add, modulate, scale;
     int         nummaps;
     GLuint      texnums[LM_MAX_LIGHTMAPS];
+    byte        *pages[LM_MAX_LIGHTMAPS];
+    uint32_t    dirty_pages;
+    lmrect_t    dirty_rects[LM_MAX_LIGHTMAPS];
 } lightmap_builder_t;
 
 extern lightmap_builder_t lm;
 
 void GL_AdjustColor(vec3_t color);
 void GL_PushLights(mface_t *surf);
+void GL_UploadLightmaps(void);
 
 void GL_RebuildLighting(void);
 void GL_FreeWorld(void);
@@ -547,6 +559,18 @@ typedef struct {
 
 extern tesselator_t tess;
 
+// solid world faces sharing textures and state bits, stored contiguously in
+// the world index buffer so that visible ones can be drawn in one call
+typedef struct glbatch_s {
+    mtexinfo_t          *texinfo;
+    GLuint              lightmap;
+    int                 statebits;
+    unsigned            drawframe;
+    mface_t             *faces;
+    mface_t             **faces_next;
+    struct glbatch_s    *next;
+} glbatch_t;
+
 void GL_Flush2D(void);
 void GL_DrawParticles(void);
 void GL_DrawBeams(void);
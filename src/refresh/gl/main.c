@@ -70,6 +70,7 @@ cvar_t *gl_cull_models;
 cvar_t *gl_clear;
 cvar_t *gl_finish;
 cvar_t *gl_hash_faces;
+cvar_t *gl_multidraw;
 cvar_t *gl_novis;
 cvar_t *gl_lockpvs;
 cvar_t *gl_lightmap;
@@ -810,6 +811,7 @@ static void GL_Register(void)
     gl_cull_nodes = Cvar_Get("gl_cull_nodes", "1", 0);
     gl_cull_models = Cvar_Get("gl_cull_models", "1", 0);
     gl_hash_faces = Cvar_Get("gl_hash_faces", "1", 0);
+    gl_multidraw = Cvar_Get("gl_multidraw", "1", 0);
     gl_clear = Cvar_Get("gl_clear", "0", 0);
     gl_finish = Cvar_Get("gl_finish", "0", 0);
     gl_novis = Cvar_Get("gl_novis", "0", 0);
@@ -170,6 +170,17 @@ static const glsection_t sections[] = {
         .caps = QGL_CAP_TEXTURE_LOD_BIAS,
     },
 
+    // GL 1.4
+    // GL_EXT_multi_draw_arrays
+    {
+        .extension = "GL_EXT_multi_draw_arrays",
+        .ver_gl = QGL_VER(1, 4),
+        .functions = (const glfunction_t []) {
+            QGL_FN(MultiDrawElements),
+            { NULL }
+        }
+    },
+
     // GL 1.5
     // GL_ARB_vertex_buffer_object
     {
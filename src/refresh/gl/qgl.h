@@ -97,6 +97,9 @@ QGLAPI void (APIENTRYP qglActiveTexture)(GLenum texture);
 // GL 1.3, compat
 QGLAPI void (APIENTRYP qglClientActiveTexture)(GLenum texture);
 
+// GL 1.4
+QGLAPI void (APIENTRYP qglMultiDrawElements)(GLenum mode, const GLsizei *count, GLenum type, const void *const *indices, GLsizei drawcount);
+
 // GL 1.5
 QGLAPI void (APIENTRYP qglBindBuffer)(GLenum target, GLuint buffer);
 QGLAPI void (APIENTRYP qglBufferData)(GLenum target, GLsizeiptr size, const void *data, GLenum usage);
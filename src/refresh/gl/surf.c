@@ -216,8 +216,6 @@ static void add_light_styles(mface_t *surf, int size)
         }
     }
 
-    surf->stylecache[0] = style->white;
-
     // add remaining lightmaps
     for (i = 1; i < surf->numstyles; i++) {
         style = LIGHT_STYLE(surf, i);
@@ -228,15 +226,93 @@ static void add_light_styles(mface_t *surf, int size)
             bl[1] += src[1] * style->white;
             bl[2] += src[2] * style->white;
         }
+    }
+}
+
+static uint32_t hash_floats(uint32_t hash, const float *v, int count)
+{
+    uint32_t bits;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        memcpy(&bits, &v[i], sizeof(bits));
+        hash = (hash ^ bits) * 16777619;
+    }
+
+    return hash;
+}
+
+// identifies the set of light styles and dynamic lights affecting the
+// surface, lightmap doesn't need to be rebuilt while this stays the same
+static uint32_t light_signature(mface_t *surf)
+{
+    uint32_t hash = 2166136261U;
+    lightstyle_t *style;
+    dlight_t *light;
+    int i;
+
+    for (i = 0; i < surf->numstyles; i++) {
+        style = LIGHT_STYLE(surf, i);
+        hash = hash_floats(hash, &style->white, 1);
+    }
+
+    if (surf->dlightframe != glr.dlightframe) {
+        return hash;
+    }
+
+    for (i = 0; i < glr.fd.num_dlights; i++) {
+        if (!(surf->dlightbits & (1U << i)))
+            continue;
+
+        light = &glr.fd.dlights[i];
+        hash = hash_floats(hash, light->transformed, 3);
+        hash = hash_floats(hash, light->color, 3);
+        hash = hash_floats(hash, &light->intensity, 1);
+    }
+
+    return (hash ^ gl_dlight_falloff->integer) * 16777619;
+}
+
+static int LM_PageForTexnum(GLuint texnum)
+{
+    int i;
+
+    for (i = 0; i < lm.nummaps; i++) {
+        if (lm.texnums[i] == texnum) {
+            return i;
+        }
+    }
 
-        surf->stylecache[i] = style->white;
+    return -1;
+}
+
+static void LM_MarkDirty(int page, int s, int t, int w, int h)
+{
+    lmrect_t *r = &lm.dirty_rects[page];
+
+    if (!(lm.dirty_pages & BIT(page))) {
+        lm.dirty_pages |= BIT(page);
+        r->x0 = s;
+        r->y0 = t;
+        r->x1 = s + w;
+        r->y1 = t + h;
+        return;
     }
+
+    r->x0 = min(r->x0, s);
+    r->y0 = min(r->y0, t);
+    r->x1 = max(r->x1, s + w);
+    r->y1 = max(r->y1, t + h);
 }
 
 static void update_dynamic_lightmap(mface_t *surf)
 {
-    byte temp[MAX_BLOCKLIGHTS * 4];
-    int smax, tmax, size;
+    int smax, tmax, size, page;
+
+    page = LM_PageForTexnum(surf->texnum[1]);
+    if (page < 0) {
+        return;
+    }
 
     smax = surf->lm_width;
     tmax = surf->lm_height;
@@ -252,22 +328,16 @@ static void update_dynamic_lightmap(mface_t *surf)
         surf->dlightframe = 0;
     }
 
-    // put into texture format
-    put_blocklights(temp, smax, tmax, smax * 4);
-
-    // upload lightmap subimage
-    GL_ForceTexture(1, surf->texnum[1]);
-    qglTexSubImage2D(GL_TEXTURE_2D, 0,
-                     surf->light_s, surf->light_t, smax, tmax,
-                     GL_RGBA, GL_UNSIGNED_BYTE, temp);
+    // put into texture format, upload is deferred until the page is used
+    put_blocklights(lm.pages[page] + surf->light_t * LM_BLOCK_WIDTH * 4 + surf->light_s * 4,
+                    smax, tmax, LM_BLOCK_WIDTH * 4);
 
-    c.texUploads++;
+    LM_MarkDirty(page, surf->light_s, surf->light_t, smax, tmax);
 }
 
 void GL_PushLights(mface_t *surf)
 {
-    lightstyle_t *style;
-    int i;
+    uint32_t sig;
 
     if (!surf->lightmap) {
         return;
@@ -279,20 +349,54 @@ void GL_PushLights(mface_t *surf)
         return;
     }
 
-    // dynamic this frame or dynamic previously
-    if (surf->dlightframe) {
+    // check for light style or dynamic light updates
+    sig = light_signature(surf);
+    if (sig != surf->lightsig) {
+        surf->lightsig = sig;
         update_dynamic_lightmap(surf);
-        return;
     }
+}
 
-    // check for light style updates
-    for (i = 0; i < surf->numstyles; i++) {
-        style = LIGHT_STYLE(surf, i);
-        if (style->white != surf->stylecache[i]) {
-            update_dynamic_lightmap(surf);
-            return;
+/*
+=================
+GL_UploadLightmaps
+
+Uploads the bounding rectangle of modified texels of each lightmap page
+in a single call.
+=================
+*/
+void GL_UploadLightmaps(void)
+{
+    const lmrect_t *r;
+    const byte *src;
+    int i, j, w, h;
+
+    for (i = 0; i < lm.nummaps; i++) {
+        if (!(lm.dirty_pages & BIT(i))) {
+            continue;
+        }
+
+        r = &lm.dirty_rects[i];
+        w = r->x1 - r->x0;
+        h = r->y1 - r->y0;
+        src = lm.pages[i] + r->y0 * LM_BLOCK_WIDTH * 4 + r->x0 * 4;
+
+        // pack rows, GLES doesn't have GL_UNPACK_ROW_LENGTH
+        if (w < LM_BLOCK_WIDTH) {
+            for (j = 0; j < h; j++) {
+                memcpy(lm.buffer + j * w * 4, src + j * LM_BLOCK_WIDTH * 4, w * 4);
+            }
+            src = lm.buffer;
         }
+
+        GL_ForceTexture(1, lm.texnums[i]);
+        qglTexSubImage2D(GL_TEXTURE_2D, 0, r->x0, r->y0, w, h,
+                         GL_RGBA, GL_UNSIGNED_BYTE, src);
+
+        c.texUploads++;
     }
+
+    lm.dirty_pages = 0;
 }
 
 /*
@@ -323,6 +427,12 @@ static void LM_UploadBlock(void)
         return;
     }
 
+    // keep a copy for dynamic updates
+    if (!lm.pages[lm.nummaps]) {
+        lm.pages[lm.nummaps] = Z_Malloc(sizeof(lm.buffer));
+    }
+    memcpy(lm.pages[lm.nummaps], lm.buffer, sizeof(lm.buffer));
+
     GL_ForceTexture(1, lm.texnums[lm.nummaps++]);
     qglTexImage2D(GL_TEXTURE_2D, 0, lm.comp, LM_BLOCK_WIDTH, LM_BLOCK_HEIGHT, 0,
                   GL_RGBA, GL_UNSIGNED_BYTE, lm.buffer);
@@ -330,6 +440,18 @@ static void LM_UploadBlock(void)
     qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 }
 
+static void LM_FreePages(void)
+{
+    int i;
+
+    for (i = 0; i < LM_MAX_LIGHTMAPS; i++) {
+        Z_Free(lm.pages[i]);
+        lm.pages[i] = NULL;
+    }
+
+    lm.dirty_pages = 0;
+}
+
 static void build_style_map(int dynamic)
 {
     static lightstyle_t fake = { 1 };
@@ -359,6 +481,7 @@ static void LM_BeginBuilding(void)
     // lightmap textures are not deleted from memory when changing maps,
     // they are merely reused
     lm.nummaps = 0;
+    lm.dirty_pages = 0;
 
     LM_InitBlock();
 
@@ -382,7 +505,7 @@ static void LM_EndBuilding(void)
     Com_DPrintf("%s: %d lightmaps built\n", __func__, lm.nummaps);
 }
 
-static void build_primary_lightmap(mface_t *surf)
+static void build_primary_lightmap(mface_t *surf, byte *page)
 {
     int smax, tmax, size;
 
@@ -394,9 +517,10 @@ static void build_primary_lightmap(mface_t *surf)
     add_light_styles(surf, size);
 
     surf->dlightframe = 0;
+    surf->lightsig = light_signature(surf);
 
     // put into texture format
-    put_blocklights(lm.buffer + surf->light_t * LM_BLOCK_WIDTH * 4 + surf->light_s * 4,
+    put_blocklights(page + surf->light_t * LM_BLOCK_WIDTH * 4 + surf->light_s * 4,
                     smax, tmax, LM_BLOCK_WIDTH * 4);
 }
 
@@ -429,14 +553,14 @@ static void LM_BuildSurface(mface_t *surf, vec_t *vbo)
     surf->texnum[1] = lm.texnums[lm.nummaps];
 
     // build the primary lightmap
-    build_primary_lightmap(surf);
+    build_primary_lightmap(surf, lm.buffer);
 }
 
 static void LM_RebuildSurfaces(void)
 {
     bsp_t *bsp = gl_static.world.cache;
     mface_t *surf;
-    int i, texnum;
+    int i, page;
 
     build_style_map(gl_dynamic->integer);
 
@@ -444,9 +568,6 @@ static void LM_RebuildSurfaces(void)
         return;
     }
 
-    GL_ForceTexture(1, lm.texnums[0]);
-    texnum = lm.texnums[0];
-
     for (i = 0, surf = bsp->faces; i < bsp->numfaces; i++, surf++) {
         if (!surf->lightmap) {
             continue;
@@ -458,26 +579,23 @@ static void LM_RebuildSurfaces(void)
             continue;
         }
 
-        if (surf->texnum[1] != texnum) {
-            // done with previous lightmap
-            qglTexImage2D(GL_TEXTURE_2D, 0, lm.comp,
-                          LM_BLOCK_WIDTH, LM_BLOCK_HEIGHT, 0,
-                          GL_RGBA, GL_UNSIGNED_BYTE, lm.buffer);
-            GL_ForceTexture(1, surf->texnum[1]);
-            texnum = surf->texnum[1];
-
-            c.texUploads++;
+        page = LM_PageForTexnum(surf->texnum[1]);
+        if (page >= 0) {
+            build_primary_lightmap(surf, lm.pages[page]);
         }
-
-        build_primary_lightmap(surf);
     }
 
-    // upload the last lightmap
-    qglTexImage2D(GL_TEXTURE_2D, 0, lm.comp,
-                  LM_BLOCK_WIDTH, LM_BLOCK_HEIGHT, 0,
-                  GL_RGBA, GL_UNSIGNED_BYTE, lm.buffer);
+    // upload all pages, format may have changed
+    for (i = 0; i < lm.nummaps; i++) {
+        GL_ForceTexture(1, lm.texnums[i]);
+        qglTexImage2D(GL_TEXTURE_2D, 0, lm.comp,
+                      LM_BLOCK_WIDTH, LM_BLOCK_HEIGHT, 0,
+                      GL_RGBA, GL_UNSIGNED_BYTE, lm.pages[i]);
+
+        c.texUploads++;
+    }
 
-    c.texUploads++;
+    lm.dirty_pages = 0;
 }
 
 
@@ -787,6 +905,133 @@ static void upload_surface_vbo(int lastvert)
     tess.numverts = 0;
 }
 
+static int face_batch_keycmp(const mface_t *a, const mface_t *b)
+{
+    // animated textures can only be merged with the same texinfo
+    const mtexinfo_t *anim_a = a->texinfo->next ? a->texinfo : NULL;
+    const mtexinfo_t *anim_b = b->texinfo->next ? b->texinfo : NULL;
+
+    if (a->texnum[0] != b->texnum[0])
+        return a->texnum[0] < b->texnum[0] ? -1 : 1;
+    if (anim_a != anim_b)
+        return anim_a < anim_b ? -1 : 1;
+    if (a->texnum[1] != b->texnum[1])
+        return a->texnum[1] < b->texnum[1] ? -1 : 1;
+    if (a->statebits != b->statebits)
+        return a->statebits < b->statebits ? -1 : 1;
+    return 0;
+}
+
+static int face_batch_cmp(const void *p1, const void *p2)
+{
+    const mface_t *a = *(const mface_t **)p1;
+    const mface_t *b = *(const mface_t **)p2;
+    int ret = face_batch_keycmp(a, b);
+
+    // keep BSP order within batch so that visible ranges merge
+    if (ret)
+        return ret;
+    return a < b ? -1 : 1;
+}
+
+static void free_surface_batches(void)
+{
+    if (gl_static.world.ibonum && qglDeleteBuffers) {
+        qglDeleteBuffers(1, &gl_static.world.ibonum);
+        gl_static.world.ibonum = 0;
+    }
+
+    Z_Free(gl_static.world.batches);
+    gl_static.world.batches = NULL;
+    gl_static.world.numbatches = 0;
+}
+
+// sort solid faces into batches by texture, lightmap and state bits and
+// build static index buffer with triangle fans laid out in batch order
+static void create_surface_batches(void)
+{
+    bsp_t *bsp = gl_static.world.cache;
+    mface_t *surf, **sorted;
+    glbatch_t *batch;
+    QGL_INDEX_TYPE *indices, *dst;
+    int i, j, numfaces, numindices, numbatches;
+    GLuint buf = 0;
+
+    free_surface_batches();
+
+    for (i = 0, surf = bsp->faces; i < bsp->numfaces; i++, surf++)
+        surf->batchnum = -1;
+
+    if (gl_static.world.vertices || !qglMultiDrawElements)
+        return;
+
+    sorted = Z_Malloc(bsp->numfaces * sizeof(sorted[0]));
+    numfaces = numindices = 0;
+    for (i = 0, surf = bsp->faces; i < bsp->numfaces; i++, surf++) {
+        if (surf->drawflags & (SURF_SKY | SURF_NODRAW | SURF_TRANS_MASK))
+            continue;
+        sorted[numfaces++] = surf;
+        numindices += (surf->numsurfedges - 2) * 3;
+    }
+
+    if (!numindices) {
+        Z_Free(sorted);
+        return;
+    }
+
+    qsort(sorted, numfaces, sizeof(sorted[0]), face_batch_cmp);
+
+    indices = dst = Z_Malloc(numindices * sizeof(indices[0]));
+    numbatches = 0;
+    for (i = 0; i < numfaces; i++) {
+        surf = sorted[i];
+        if (!i || face_batch_keycmp(sorted[i - 1], surf))
+            numbatches++;
+
+        surf->batchnum = numbatches - 1;
+        surf->firstindex = dst - indices;
+        for (j = 0; j < surf->numsurfedges - 2; j++) {
+            dst[0] = surf->firstvert;
+            dst[1] = surf->firstvert + (j + 1);
+            dst[2] = surf->firstvert + (j + 2);
+            dst += 3;
+        }
+    }
+
+    QGL_ClearErrors();
+
+    qglGenBuffers(1, &buf);
+    qglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buf);
+    qglBufferData(GL_ELEMENT_ARRAY_BUFFER, numindices * sizeof(indices[0]), indices, GL_STATIC_DRAW);
+    qglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    Z_Free(indices);
+
+    if (GL_ShowErrors("Failed to create world model IBO")) {
+        qglDeleteBuffers(1, &buf);
+        Z_Free(sorted);
+        return;
+    }
+
+    gl_static.world.ibonum = buf;
+    gl_static.world.batches = Z_Mallocz(numbatches * sizeof(glbatch_t));
+    gl_static.world.numbatches = numbatches;
+
+    for (i = 0; i < numfaces; i++) {
+        surf = sorted[i];
+        batch = &gl_static.world.batches[surf->batchnum];
+        if (batch->texinfo)
+            continue;
+        batch->texinfo = surf->texinfo;
+        batch->lightmap = surf->texnum[1];
+        batch->statebits = surf->statebits;
+    }
+
+    Z_Free(sorted);
+
+    Com_DPrintf("%s: %d faces in %d batches\n", __func__, numfaces, numbatches);
+}
+
 static void upload_world_surfaces(void)
 {
     bsp_t *bsp = gl_static.world.cache;
@@ -840,6 +1085,8 @@ static void upload_world_surfaces(void)
         qglBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 
+    create_surface_batches();
+
     gl_fullbright->modified = false;
     gl_vertexlight->modified = false;
 }
@@ -896,6 +1143,10 @@ void GL_FreeWorld(void)
 
     BSP_Free(gl_static.world.cache);
 
+    free_surface_batches();
+
+    LM_FreePages();
+
     if (gl_static.world.vertices) {
         Hunk_Free(&gl_static.world.hunk);
     } else if (qglDeleteBuffers) {
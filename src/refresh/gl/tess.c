@@ -28,6 +28,13 @@ static mface_t  *faces_head[FACE_HASH_SIZE];
 static mface_t  **faces_next[FACE_HASH_SIZE];
 static mface_t  *faces_alpha;
 
+#define MAX_BATCH_RANGES    1024
+
+static glbatch_t    *batches_head;
+static glbatch_t    **batches_next = &batches_head;
+static unsigned     batches_frame;
+static bool         batches_enabled;
+
 void GL_Flush2D(void)
 {
     glStateBits_t bits;
@@ -270,16 +277,16 @@ void GL_BindArrays(void)
     }
 }
 
-void GL_Flush3D(void)
+static void GL_BindFaceState(const GLuint *texnum, glStateBits_t state)
 {
-    glStateBits_t state = tess.flags;
     glArrayBits_t array = GLA_VERTEX | GLA_TC;
 
-    if (!tess.numindices) {
-        return;
+    // dynamic lightmap updates are deferred until first use
+    if (q_unlikely(lm.dirty_pages)) {
+        GL_UploadLightmaps();
     }
 
-    if (q_likely(tess.texnum[1])) {
+    if (q_likely(texnum[1])) {
         state |= GLS_LIGHTMAP_ENABLE;
         array |= GLA_LMTC;
 
@@ -295,11 +302,20 @@ void GL_Flush3D(void)
     GL_StateBits(state);
     GL_ArrayBits(array);
 
-    GL_BindTexture(0, tess.texnum[0]);
-    if (q_likely(tess.texnum[1])) {
-        GL_BindTexture(1, tess.texnum[1]);
+    GL_BindTexture(0, texnum[0]);
+    if (q_likely(texnum[1])) {
+        GL_BindTexture(1, texnum[1]);
+    }
+}
+
+void GL_Flush3D(void)
+{
+    if (!tess.numindices) {
+        return;
     }
 
+    GL_BindFaceState(tess.texnum, tess.flags);
+
     if (gl_static.world.vertices) {
         GL_LockArrays(tess.numverts);
     }
@@ -354,6 +370,16 @@ static int GL_TextureAnimation(mtexinfo_t *tex)
     return tex->image->texnum;
 }
 
+static void GL_FaceTextures(GLuint *texnum, mtexinfo_t *texinfo, GLuint lightmap)
+{
+    if (q_unlikely(gl_lightmap->integer && lightmap)) {
+        texnum[0] = TEXNUM_WHITE;
+    } else {
+        texnum[0] = GL_TextureAnimation(texinfo);
+    }
+    texnum[1] = lightmap;
+}
+
 void GL_DrawFace(mface_t *surf)
 {
     int numtris = surf->numsurfedges - 2;
@@ -362,12 +388,7 @@ void GL_DrawFace(mface_t *surf)
     QGL_INDEX_TYPE *dst_indices;
     int i, j;
 
-    if (q_unlikely(gl_lightmap->integer && surf->texnum[1])) {
-        texnum[0] = TEXNUM_WHITE;
-    } else {
-        texnum[0] = GL_TextureAnimation(surf->texinfo);
-    }
-    texnum[1] = surf->texnum[1];
+    GL_FaceTextures(texnum, surf->texinfo, surf->texnum[1]);
 
     if (tess.texnum[0] != texnum[0] ||
         tess.texnum[1] != texnum[1] ||
@@ -400,6 +421,52 @@ void GL_DrawFace(mface_t *surf)
     c.facesDrawn++;
 }
 
+static void GL_DrawFaceBatch(const glbatch_t *batch)
+{
+    static GLsizei      counts[MAX_BATCH_RANGES];
+    static const void   *offsets[MAX_BATCH_RANGES];
+    GLuint texnum[2];
+    mface_t *face;
+    int numtris, numindices, numranges, end;
+
+    GL_FaceTextures(texnum, batch->texinfo, batch->lightmap);
+    GL_BindFaceState(texnum, batch->statebits);
+
+    // merge faces adjacent in index buffer into single ranges
+    numranges = 0;
+    end = -1;
+    for (face = batch->faces; face; face = face->next) {
+        numtris = face->numsurfedges - 2;
+        numindices = numtris * 3;
+
+        if (face->firstindex == end) {
+            counts[numranges - 1] += numindices;
+        } else {
+            if (numranges == MAX_BATCH_RANGES) {
+                qglMultiDrawElements(GL_TRIANGLES, counts, QGL_INDEX_ENUM, offsets, numranges);
+                c.batchesDrawn++;
+                numranges = 0;
+            }
+            counts[numranges] = numindices;
+            offsets[numranges] = (const void *)(face->firstindex * sizeof(QGL_INDEX_TYPE));
+            numranges++;
+        }
+        end = face->firstindex + numindices;
+
+        c.trisDrawn += numtris;
+        c.facesTris += numtris;
+        c.facesDrawn++;
+    }
+
+    if (numranges == 1) {
+        qglDrawElements(GL_TRIANGLES, counts[0], QGL_INDEX_ENUM, offsets[0]);
+    } else {
+        qglMultiDrawElements(GL_TRIANGLES, counts, QGL_INDEX_ENUM, offsets, numranges);
+    }
+
+    c.batchesDrawn++;
+}
+
 void GL_ClearSolidFaces(void)
 {
     int i;
@@ -407,13 +474,34 @@ void GL_ClearSolidFaces(void)
     for (i = 0; i < FACE_HASH_SIZE; i++) {
         faces_next[i] = &faces_head[i];
     }
+
+    // outlines need client side indices
+    batches_enabled = gl_static.world.numbatches &&
+        gl_multidraw->integer && !gl_showtris->integer;
+    batches_head = NULL;
+    batches_next = &batches_head;
+    batches_frame++;
 }
 
 void GL_DrawSolidFaces(void)
 {
+    glbatch_t *batch;
     mface_t *face;
     int i;
 
+    if (batches_head) {
+        GL_Flush3D();
+
+        qglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl_static.world.ibonum);
+        for (batch = batches_head; batch; batch = batch->next) {
+            GL_DrawFaceBatch(batch);
+        }
+        qglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        batches_head = NULL;
+        batches_next = &batches_head;
+    }
+
     for (i = 0; i < FACE_HASH_SIZE; i++) {
         for (face = faces_head[i]; face; face = face->next) {
             GL_DrawFace(face);
@@ -453,6 +541,24 @@ void GL_AddSolidFace(mface_t *face)
 {
     unsigned hash;
 
+    if (batches_enabled && face->batchnum >= 0) {
+        glbatch_t *batch = &gl_static.world.batches[face->batchnum];
+
+        if (batch->drawframe != batches_frame) {
+            batch->drawframe = batches_frame;
+            batch->faces_next = &batch->faces;
+            batch->next = NULL;
+            *batches_next = batch;
+            batches_next = &batch->next;
+        }
+
+        // preserve front-to-back ordering
+        face->next = NULL;
+        *batch->faces_next = face;
+        batch->faces_next = &face->next;
+        return;
+    }
+
     hash = face->texnum[0] ^ face->texnum[1] ^ face->statebits;
     hash ^= hash >> FACE_HASH_BITS;
     hash ^= hash >> (FACE_HASH_BITS * 2);
@@ -787,76 +787,6 @@ static void IMG_ScreenShotHDR_f(void)
 /*
 =========================================================
 
-IMAGE PROCESSING
-
-=========================================================
-*/
-
-void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
-                         byte *out, int outwidth, int outheight)
-{
-    int i, j;
-    const byte  *inrow1, *inrow2;
-    unsigned    frac, fracstep;
-    unsigned    p1[MAX_TEXTURE_SIZE], p2[MAX_TEXTURE_SIZE];
-    const byte  *pix1, *pix2, *pix3, *pix4;
-    float       heightScale;
-
-    if (outwidth > MAX_TEXTURE_SIZE) {
-        Com_Error(ERR_FATAL, "%s: outwidth > %d", __func__, MAX_TEXTURE_SIZE);
-    }
-
-    fracstep = inwidth * 0x10000 / outwidth;
-
-    frac = fracstep >> 2;
-    for (i = 0; i < outwidth; i++) {
-        p1[i] = 4 * (frac >> 16);
-        frac += fracstep;
-    }
-    frac = 3 * (fracstep >> 2);
-    for (i = 0; i < outwidth; i++) {
-        p2[i] = 4 * (frac >> 16);
-        frac += fracstep;
-    }
-
-    heightScale = (float)inheight / outheight;
-    inwidth <<= 2;
-    for (i = 0; i < outheight; i++) {
-        inrow1 = in + inwidth * (int)((i + 0.25f) * heightScale);
-        inrow2 = in + inwidth * (int)((i + 0.75f) * heightScale);
-        for (j = 0; j < outwidth; j++) {
-            pix1 = inrow1 + p1[j];
-            pix2 = inrow1 + p2[j];
-            pix3 = inrow2 + p1[j];
-            pix4 = inrow2 + p2[j];
-            out[0] = (pix1[0] + pix2[0] + pix3[0] + pix4[0]) >> 2;
-            out[1] = (pix1[1] + pix2[1] + pix3[1] + pix4[1]) >> 2;
-            out[2] = (pix1[2] + pix2[2] + pix3[2] + pix4[2]) >> 2;
-            out[3] = (pix1[3] + pix2[3] + pix3[3] + pix4[3]) >> 2;
-            out += 4;
-        }
-    }
-}
-
-void IMG_MipMap(byte *out, byte *in, int width, int height)
-{
-    int     i, j;
-
-    width <<= 2;
-    height >>= 1;
-    for (i = 0; i < height; i++, in += width) {
-        for (j = 0; j < width; j += 8, out += 4, in += 8) {
-            out[0] = (in[0] + in[4] + in[width + 0] + in[width + 4]) >> 2;
-            out[1] = (in[1] + in[5] + in[width + 1] + in[width + 5]) >> 2;
-            out[2] = (in[2] + in[6] + in[width + 2] + in[width + 6]) >> 2;
-            out[3] = (in[3] + in[7] + in[width + 3] + in[width + 7]) >> 2;
-        }
-    }
-}
-
-/*
-=========================================================
-
 IMAGE MANAGER
 
 =========================================================
@@ -864,7 +794,31 @@ IMAGE MANAGER
 
 #define RIMAGES_HASH    256
 
-static list_t   r_imageHash[RIMAGES_HASH];
+// Registered images are kept in an open addressing table keyed by image
+// type and base name (case insensitive). Removal shifts following entries
+// back into the hole, so there are no tombstones. Free image_t slots below
+// r_numImages are kept on a stack.
+typedef struct {
+    unsigned    hash;
+    int         index;      // into r_images, 0 = empty
+} image_slot_t;
+
+static image_slot_t *r_imageSlots;
+static unsigned     r_imageSlotsMask;
+static int          r_imageSlotsUsed;
+
+static int      r_freeImages[MAX_RIMAGES];
+static int      r_numFreeImages;
+
+static struct {
+    unsigned    lookups;
+    unsigned    hits;
+    unsigned    probes;
+    unsigned    allocs;
+    unsigned    reused;
+    unsigned    evicted;
+    unsigned    resizes;
+} r_imageStats;
 
 image_t     r_images[MAX_RIMAGES];
 int         r_numImages;
@@ -1011,35 +965,129 @@ static void IMG_List_f(void)
         FS_CloseFile(f);
         Com_Printf("Saved '%s'\n", path);
     } else {
-        Com_Printf("Total images: %d (out of %d slots)\n", count, r_numImages);
+        Com_Printf("Total images: %d (out of %d slots, %d free)\n", count, r_numImages, r_numFreeImages);
         Com_Printf("Total texels: %zu (not counting mipmaps)\n", texels);
+        Com_Printf("Registry: %d entries in %u buckets, %u resizes\n",
+                   r_imageSlotsUsed, r_imageSlotsMask + 1, r_imageStats.resizes);
+        Com_Printf("Lookups: %u (%u hits, %.2f probes each)\n", r_imageStats.lookups, r_imageStats.hits,
+                   r_imageStats.lookups ? (float)r_imageStats.probes / r_imageStats.lookups : 0.0f);
+        Com_Printf("Allocations: %u (%u reused, %u placeholders evicted)\n",
+                   r_imageStats.allocs, r_imageStats.reused, r_imageStats.evicted);
     }
 }
 
+static unsigned hash_image_name(const char *name, size_t baselen, imagetype_t type)
+{
+    unsigned hash = type;
+
+    while (*name && baselen--)
+        hash = 127 * hash + Q_tolower(*name++);
+
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static void init_image_slots(unsigned size)
+{
+    Z_Free(r_imageSlots);
+    r_imageSlots = Z_Mallocz(size * sizeof(r_imageSlots[0]));
+    r_imageSlotsMask = size - 1;
+    r_imageSlotsUsed = 0;
+}
+
+static void insert_image_slot(unsigned hash, int index)
+{
+    unsigned i;
+
+    for (i = hash & r_imageSlotsMask; r_imageSlots[i].index; i = (i + 1) & r_imageSlotsMask)
+        ;
+
+    r_imageSlots[i].hash = hash;
+    r_imageSlots[i].index = index;
+    r_imageSlotsUsed++;
+}
+
+// adds the image to the registry, growing it to stay at most half full
+static void hash_image(image_t *image, unsigned hash)
+{
+    if ((r_imageSlotsUsed + 1) * 2 > r_imageSlotsMask + 1) {
+        image_slot_t *old = r_imageSlots;
+        unsigned i, old_size = r_imageSlotsMask + 1;
+
+        r_imageSlots = NULL;
+        init_image_slots(old_size * 2);
+        for (i = 0; i < old_size; i++)
+            if (old[i].index)
+                insert_image_slot(old[i].hash, old[i].index);
+
+        Z_Free(old);
+        r_imageStats.resizes++;
+    }
+
+    image->hash = hash;
+    insert_image_slot(hash, image - r_images);
+}
+
+static void unhash_image(image_t *image)
+{
+    unsigned i, j, k, mask = r_imageSlotsMask;
+    int index = image - r_images;
+
+    for (i = image->hash & mask; r_imageSlots[i].index != index; i = (i + 1) & mask)
+        if (!r_imageSlots[i].index)
+            return;
+
+    // move back any following entry whose home slot doesn't lie between the hole and itself
+    for (j = (i + 1) & mask; r_imageSlots[j].index; j = (j + 1) & mask) {
+        k = r_imageSlots[j].hash & mask;
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        r_imageSlots[i] = r_imageSlots[j];
+        i = j;
+    }
+
+    r_imageSlots[i].index = 0;
+    r_imageSlotsUsed--;
+}
+
+// returns the image_t slot to the free list
+static void free_image(image_t *image)
+{
+    memset(image, 0, sizeof(*image));
+    r_freeImages[r_numFreeImages++] = image - r_images;
+}
+
 static image_t *alloc_image(void)
 {
     int i;
-    image_t *image, *placeholder = NULL;
+    image_t *image;
 
-    // find a free image_t slot
-    for (i = 1, image = r_images + 1; i < r_numImages; i++, image++) {
-        if (!image->registration_sequence)
+    r_imageStats.allocs++;
+
+    // take a free image_t slot
+    while (r_numFreeImages) {
+        image = &r_images[r_freeImages[--r_numFreeImages]];
+        if (!image->registration_sequence) {
+            r_imageStats.reused++;
             return image;
-        if (!image->upload_width && !image->upload_height && !placeholder)
-            placeholder = image;
+        }
     }
 
     // allocate new slot if possible
     if (r_numImages < MAX_RIMAGES) {
-        r_numImages++;
-        return image;
+        return &r_images[r_numImages++];
     }
 
     // reuse placeholder image if available
-    if (placeholder) {
-        List_Remove(&placeholder->entry);
-        memset(placeholder, 0, sizeof(*placeholder));
-        return placeholder;
+    for (i = 1, image = r_images + 1; i < r_numImages; i++, image++) {
+        if (!image->upload_width && !image->upload_height) {
+            unhash_image(image);
+            memset(image, 0, sizeof(*image));
+            r_imageStats.evicted++;
+            return image;
+        }
     }
 
     return NULL;
@@ -1051,9 +1099,17 @@ static image_t *lookup_image(const char *name,
                              imagetype_t type, unsigned hash, size_t baselen)
 {
     image_t *image;
+    unsigned i;
+
+    r_imageStats.lookups++;
 
     // look for it
-    LIST_FOR_EACH(image_t, image, &r_imageHash[hash], entry) {
+    for (i = hash & r_imageSlotsMask; r_imageSlots[i].index; i = (i + 1) & r_imageSlotsMask) {
+        r_imageStats.probes++;
+        if (r_imageSlots[i].hash != hash) {
+            continue;
+        }
+        image = &r_images[r_imageSlots[i].index];
         if (image->type != type) {
             continue;
         }
@@ -1061,6 +1117,7 @@ static image_t *lookup_image(const char *name,
             continue;
         }
         if (!FS_pathcmpn(image->name, name, baselen)) {
+            r_imageStats.hits++;
             return image;
         }
     }
@@ -1436,7 +1493,7 @@ static image_t *find_or_load_image(const char *name, size_t len,
         goto fail;
     }
 
-    hash = FS_HashPathLen(name, len - 4, RIMAGES_HASH);
+    hash = hash_image_name(name, len - 4, type);
 
     // look for it
     if ((image = lookup_image(name, type, hash, len - 4)) != NULL) {
@@ -1501,18 +1558,18 @@ static image_t *find_or_load_image(const char *name, size_t len,
     if (ret < 0) {
         print_error(image->name, flags, ret);
         if (flags & IF_PERMANENT) {
-            memset(image, 0, sizeof(*image));
+            free_image(image);
         } else {
             // don't reload temp pics every frame
             image->upload_width = image->upload_height = 0;
-            List_Append(&r_imageHash[hash], &image->entry);
+            hash_image(image, hash);
         }
         return NULL;
     }
 
     image->aspect = (float)image->upload_width / image->upload_height;
 
-    List_Append(&r_imageHash[hash], &image->entry);
+    hash_image(image, hash);
 
 	image->is_srgb = !!(flags & IF_SRGB);
 
@@ -1562,7 +1619,7 @@ image_t *IMG_FindExisting(const char *name, imagetype_t type)
         return R_NOTEXTURE;
     }
 
-    hash = FS_HashPathLen(name, len - 4, RIMAGES_HASH);
+    hash = hash_image_name(name, len - 4, type);
 
     // look for it
     if ((image = lookup_image(name, type, hash, len - 4)) != NULL) {
@@ -1613,8 +1670,7 @@ image_t *IMG_Clone(image_t *image, const char* new_name)
         new_image->baselen = strlen(new_image->name) - 4;
         assert(new_image->name[new_image->baselen] == '.');
     }
-    unsigned hash = FS_HashPathLen(new_image->name, new_image->baselen, RIMAGES_HASH);
-    List_Append(&r_imageHash[hash], &new_image->entry);
+    hash_image(new_image, hash_image_name(new_image->name, new_image->baselen, new_image->type));
     return new_image;
 }
 
@@ -1681,7 +1737,7 @@ qhandle_t R_RegisterRawImage(const char *name, int width, int height, byte* pic,
     unsigned        hash;
 
     int len = strlen(name);
-    hash = FS_HashPathLen(name, len, RIMAGES_HASH);
+    hash = hash_image_name(name, len, type);
 
     // look for it
     if ((image = lookup_image(name, type, hash, len)) != NULL) {
@@ -1707,7 +1763,7 @@ qhandle_t R_RegisterRawImage(const char *name, int width, int height, byte* pic,
     image->upload_width = width;
     image->upload_height = height;
 
-    List_Append(&r_imageHash[hash], &image->entry);
+    hash_image(image, hash);
 
     image->is_srgb = !!(flags & IF_SRGB);
 
@@ -1749,6 +1805,24 @@ bool R_GetPicSize(int *w, int *h, qhandle_t pic)
     return image->flags & IF_TRANSPARENT;
 }
 
+/*
+================
+IMG_Release
+
+Unloads the image and returns its slot for reuse.
+================
+*/
+void IMG_Release(image_t *image)
+{
+    // delete it from hash table
+    unhash_image(image);
+
+    // free it
+    IMG_Unload(image);
+
+    free_image(image);
+}
+
 /*
 ================
 IMG_FreeUnused
@@ -1771,13 +1845,7 @@ void IMG_FreeUnused(void)
         if (image->flags & (IF_PERMANENT | IF_SCRAP))
             continue;        // don't free pics
 
-        // delete it from hash table
-        List_Remove(&image->entry);
-
-        // free it
-        IMG_Unload(image);
-
-        memset(image, 0, sizeof(*image));
+        IMG_Release(image);
         count++;
     }
 
@@ -1805,9 +1873,8 @@ void IMG_FreeAll(void)
         Com_DPrintf("%s: %i images freed\n", __func__, count);
     }
 
-    for (i = 0; i < RIMAGES_HASH; i++) {
-        List_Init(&r_imageHash[i]);
-    }
+    init_image_slots(RIMAGES_HASH);
+    r_numFreeImages = 0;
 
     // &r_images[0] == R_NOTEXTURE
     r_numImages = 1;
@@ -1863,8 +1930,6 @@ static const cmdreg_t img_cmd[] = {
 
 void IMG_Init(void)
 {
-    int i;
-
     Q_assert(!r_numImages);
 
     r_override_textures = Cvar_Get("r_override_textures", "1", CVAR_FILES);
@@ -1880,11 +1945,13 @@ void IMG_Init(void)
     r_screenshot_message = Cvar_Get("gl_screenshot_message", "0", CVAR_ARCHIVE);
     r_screenshot_template = Cvar_Get("gl_screenshot_template", "quakeXXX", 0);
 
+    IMG_InitProcessing();
+
     Cmd_Register(img_cmd);
 
-    for (i = 0; i < RIMAGES_HASH; i++) {
-        List_Init(&r_imageHash[i]);
-    }
+    init_image_slots(RIMAGES_HASH);
+    r_numFreeImages = 0;
+    memset(&r_imageStats, 0, sizeof(r_imageStats));
 
     // &r_images[0] == R_NOTEXTURE
     r_numImages = 1;
@@ -1893,5 +1960,7 @@ void IMG_Init(void)
 void IMG_Shutdown(void)
 {
     Cmd_Deregister(img_cmd);
+    Z_Free(r_imageSlots);
+    r_imageSlots = NULL;
     r_numImages = 0;
 }
@@ -0,0 +1,719 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+Copyright (C) 2003-2008 Andrey Nazarov
+Copyright (C) 2019, NVIDIA CORPORATION. All rights reserved.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// imgproc.c -- image resampling, mipmapping and filtering kernels shared
+// by all renderers
+//
+
+#include "shared/shared.h"
+#include "common/async.h"
+#include "common/common.h"
+#include "common/cvar.h"
+#include "common/zone.h"
+#include "refresh/images.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2    1
+#include <emmintrin.h>
+#else
+#define USE_SSE2    0
+#endif
+
+// minimum number of output pixels per parallel chunk
+#define PARALLEL_PIXELS     0x10000
+
+#define ROW_GRAIN(width)    max(PARALLEL_PIXELS / max(width, 1), 1)
+
+#define KAISER_TAPS     8
+#define KAISER_ALPHA    4.0
+
+static cvar_t   *r_mipmap_filter;
+static cvar_t   *r_mipmap_linear;
+
+float           img_srgb_to_linear[256];
+static byte     linear_to_srgb[0x10000];
+
+static float    kaiser_weights[KAISER_TAPS];
+
+/*
+====================================================================
+
+COLOR SPACE
+
+====================================================================
+*/
+
+static float decode_srgb_exact(int pix)
+{
+    float x = pix / 255.0f;
+
+    if (x < 0.04045f)
+        return x / 12.92f;
+
+    return powf((x + 0.055f) / 1.055f, 2.4f);
+}
+
+static byte encode_srgb_exact(float x)
+{
+    if (x <= 0.0031308f)
+        x *= 12.92f;
+    else
+        x = 1.055f * powf(x, 1.0f / 2.4f) - 0.055f;
+
+    clamp(x, 0, 1);
+
+    return (byte)roundf(x * 255.0f);
+}
+
+byte IMG_LinearToSrgb(float x)
+{
+    if (x <= 0)
+        return 0;
+    if (x >= 1)
+        return 255;
+    return linear_to_srgb[(int)(x * 65535.0f + 0.5f)];
+}
+
+static inline byte float_to_byte(float x)
+{
+    int i = Q_rint(x);
+    clamp(i, 0, 255);
+    return i;
+}
+
+static double bessel_i0(double x)
+{
+    double sum = 1, term = 1;
+
+    for (int k = 1; k < 32; k++) {
+        term *= (x * x) / (4.0 * k * k);
+        sum += term;
+    }
+
+    return sum;
+}
+
+// Kaiser windowed sinc for 2:1 decimation, centered between two source pixels
+static void init_kaiser_weights(void)
+{
+    double sum = 0, w[KAISER_TAPS];
+    double radius = KAISER_TAPS / 2;
+
+    for (int i = 0; i < KAISER_TAPS; i++) {
+        double x = i - (KAISER_TAPS - 1) * 0.5;
+        double t = x / radius;
+        double s = x * 0.5 * M_PI;
+        w[i] = sin(s) / s;
+        w[i] *= bessel_i0(KAISER_ALPHA * sqrt(1 - t * t)) / bessel_i0(KAISER_ALPHA);
+        sum += w[i];
+    }
+
+    for (int i = 0; i < KAISER_TAPS; i++)
+        kaiser_weights[i] = w[i] / sum;
+}
+
+/*
+====================================================================
+
+RESAMPLING
+
+====================================================================
+*/
+
+typedef struct {
+    const byte  *in;
+    byte        *out;
+    int         inwidth, inheight;
+    int         outwidth, outheight;
+    const int   *p1, *p2;
+    bool        linear;
+} resample_t;
+
+static void resample_rows(void *arg, int begin, int end)
+{
+    const resample_t *r = arg;
+    float heightScale = (float)r->inheight / r->outheight;
+    int stride = r->inwidth * 4;
+
+    for (int i = begin; i < end; i++) {
+        const byte *inrow1 = r->in + stride * (int)((i + 0.25f) * heightScale);
+        const byte *inrow2 = r->in + stride * (int)((i + 0.75f) * heightScale);
+        byte *out = r->out + i * r->outwidth * 4;
+
+        for (int j = 0; j < r->outwidth; j++, out += 4) {
+            const byte *pix1 = inrow1 + r->p1[j];
+            const byte *pix2 = inrow1 + r->p2[j];
+            const byte *pix3 = inrow2 + r->p1[j];
+            const byte *pix4 = inrow2 + r->p2[j];
+
+            if (r->linear) {
+                for (int k = 0; k < 3; k++)
+                    out[k] = IMG_LinearToSrgb((img_srgb_to_linear[pix1[k]] + img_srgb_to_linear[pix2[k]] +
+                                               img_srgb_to_linear[pix3[k]] + img_srgb_to_linear[pix4[k]]) * 0.25f);
+            } else {
+                out[0] = (pix1[0] + pix2[0] + pix3[0] + pix4[0]) >> 2;
+                out[1] = (pix1[1] + pix2[1] + pix3[1] + pix4[1]) >> 2;
+                out[2] = (pix1[2] + pix2[2] + pix3[2] + pix4[2]) >> 2;
+            }
+            out[3] = (pix1[3] + pix2[3] + pix3[3] + pix4[3]) >> 2;
+        }
+    }
+}
+
+void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
+                         byte *out, int outwidth, int outheight)
+{
+    int         i;
+    unsigned    frac, fracstep;
+    int         p1[MAX_TEXTURE_SIZE], p2[MAX_TEXTURE_SIZE];
+
+    if (outwidth > MAX_TEXTURE_SIZE) {
+        Com_Error(ERR_FATAL, "%s: outwidth > %d", __func__, MAX_TEXTURE_SIZE);
+    }
+
+    fracstep = inwidth * 0x10000 / outwidth;
+
+    frac = fracstep >> 2;
+    for (i = 0; i < outwidth; i++) {
+        p1[i] = 4 * (frac >> 16);
+        frac += fracstep;
+    }
+    frac = 3 * (fracstep >> 2);
+    for (i = 0; i < outwidth; i++) {
+        p2[i] = 4 * (frac >> 16);
+        frac += fracstep;
+    }
+
+    resample_t r = {
+        .in = in,
+        .out = out,
+        .inwidth = inwidth,
+        .inheight = inheight,
+        .outwidth = outwidth,
+        .outheight = outheight,
+        .p1 = p1,
+        .p2 = p2,
+        .linear = r_mipmap_linear->integer,
+    };
+
+    Com_ParallelFor(outheight, ROW_GRAIN(outwidth), resample_rows, &r);
+}
+
+/*
+====================================================================
+
+MIPMAPPING
+
+====================================================================
+*/
+
+typedef struct {
+    const byte  *in;
+    byte        *out;
+    float       *temp;
+    int         width, height;
+    int         outwidth, outheight;
+    int         flags;
+} mipmap_t;
+
+// 2x2 box filter of one output row. dx is 0 for 1 pixel wide input.
+static void box_row(byte *out, const byte *row0, const byte *row1, int outwidth, int dx)
+{
+    int x = 0;
+
+#if USE_SSE2
+    if (dx == 4) {
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; x + 4 <= outwidth; x += 4) {
+            __m128i a0 = _mm_loadu_si128((const __m128i *)(row0 + x * 8));
+            __m128i a1 = _mm_loadu_si128((const __m128i *)(row0 + x * 8 + 16));
+            __m128i b0 = _mm_loadu_si128((const __m128i *)(row1 + x * 8));
+            __m128i b1 = _mm_loadu_si128((const __m128i *)(row1 + x * 8 + 16));
+
+            // vertical sums, two input pixels per register
+            __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+            __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+            __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+            __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+            // horizontal sums of adjacent pixels
+            s0 = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+            s1 = _mm_add_epi16(s1, _mm_srli_si128(s1, 8));
+            s2 = _mm_add_epi16(s2, _mm_srli_si128(s2, 8));
+            s3 = _mm_add_epi16(s3, _mm_srli_si128(s3, 8));
+
+            __m128i lo = _mm_srli_epi16(_mm_unpacklo_epi64(s0, s1), 2);
+            __m128i hi = _mm_srli_epi16(_mm_unpacklo_epi64(s2, s3), 2);
+            _mm_storeu_si128((__m128i *)(out + x * 4), _mm_packus_epi16(lo, hi));
+        }
+    }
+#endif
+
+    for (; x < outwidth; x++) {
+        const byte *a = row0 + x * dx * 2;
+        const byte *b = row1 + x * dx * 2;
+        byte *o = out + x * 4;
+        o[0] = (a[0] + a[dx + 0] + b[0] + b[dx + 0]) >> 2;
+        o[1] = (a[1] + a[dx + 1] + b[1] + b[dx + 1]) >> 2;
+        o[2] = (a[2] + a[dx + 2] + b[2] + b[dx + 2]) >> 2;
+        o[3] = (a[3] + a[dx + 3] + b[3] + b[dx + 3]) >> 2;
+    }
+}
+
+static void box_row_linear(byte *out, const byte *row0, const byte *row1, int outwidth, int dx)
+{
+    const float *lut = img_srgb_to_linear;
+
+    for (int x = 0; x < outwidth; x++, out += 4, row0 += dx * 2, row1 += dx * 2) {
+        for (int k = 0; k < 3; k++)
+            out[k] = IMG_LinearToSrgb((lut[row0[k]] + lut[row0[dx + k]] +
+                                       lut[row1[k]] + lut[row1[dx + k]]) * 0.25f);
+        out[3] = (row0[3] + row0[dx + 3] + row1[3] + row1[dx + 3]) >> 2;
+    }
+}
+
+static void box_rows(void *arg, int begin, int end)
+{
+    const mipmap_t *m = arg;
+    int stride = m->width * 4;
+    int dx = m->width > 1 ? 4 : 0;
+    int dy = m->height > 1 ? stride : 0;
+
+    for (int y = begin; y < end; y++) {
+        const byte *row0 = m->in + y * (dy * 2);
+        const byte *row1 = row0 + dy;
+        byte *out = m->out + y * m->outwidth * 4;
+
+        if (m->flags & IMG_FILTER_LINEAR)
+            box_row_linear(out, row0, row1, m->outwidth, dx);
+        else
+            box_row(out, row0, row1, m->outwidth, dx);
+    }
+}
+
+static inline int wrap_index(int i, int size)
+{
+    i %= size;
+    return i < 0 ? i + size : i;
+}
+
+// horizontal Kaiser pass: input rows -> outwidth x height floats
+static void kaiser_rows_h(void *arg, int begin, int end)
+{
+    const mipmap_t *m = arg;
+    const float *lut = img_srgb_to_linear;
+    bool linear = m->flags & IMG_FILTER_LINEAR;
+
+#if USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128 weights[KAISER_TAPS];
+
+    for (int k = 0; k < KAISER_TAPS; k++)
+        weights[k] = _mm_set1_ps(kaiser_weights[k]);
+#endif
+
+    for (int y = begin; y < end; y++) {
+        const byte *row = m->in + y * m->width * 4;
+        float *out = m->temp + y * m->outwidth * 4;
+
+        for (int x = 0; x < m->outwidth; x++, out += 4) {
+#if USE_SSE2
+            __m128 sum = _mm_setzero_ps();
+
+            for (int k = 0; k < KAISER_TAPS; k++) {
+                const byte *p = row + wrap_index(x * 2 - KAISER_TAPS / 2 + 1 + k, m->width) * 4;
+                __m128 v;
+                if (linear) {
+                    v = _mm_setr_ps(lut[p[0]], lut[p[1]], lut[p[2]], p[3]);
+                } else {
+                    uint32_t pix;
+                    memcpy(&pix, p, sizeof(pix));
+                    __m128i i = _mm_cvtsi32_si128(pix);
+                    i = _mm_unpacklo_epi16(_mm_unpacklo_epi8(i, zero), zero);
+                    v = _mm_cvtepi32_ps(i);
+                }
+                sum = _mm_add_ps(sum, _mm_mul_ps(v, weights[k]));
+            }
+
+            _mm_storeu_ps(out, sum);
+#else
+            float sum[4] = { 0, 0, 0, 0 };
+
+            for (int k = 0; k < KAISER_TAPS; k++) {
+                const byte *p = row + wrap_index(x * 2 - KAISER_TAPS / 2 + 1 + k, m->width) * 4;
+                float w = kaiser_weights[k];
+                if (linear) {
+                    sum[0] += lut[p[0]] * w;
+                    sum[1] += lut[p[1]] * w;
+                    sum[2] += lut[p[2]] * w;
+                } else {
+                    sum[0] += p[0] * w;
+                    sum[1] += p[1] * w;
+                    sum[2] += p[2] * w;
+                }
+                sum[3] += p[3] * w;
+            }
+
+            Vector4Copy(sum, out);
+#endif
+        }
+    }
+}
+
+// vertical Kaiser pass: temp -> output rows
+static void kaiser_rows_v(void *arg, int begin, int end)
+{
+    const mipmap_t *m = arg;
+    bool linear = m->flags & IMG_FILTER_LINEAR;
+    int stride = m->outwidth * 4;
+
+#if USE_SSE2
+    const __m128 half = _mm_set1_ps(0.5f);
+    __m128 weights[KAISER_TAPS];
+
+    for (int k = 0; k < KAISER_TAPS; k++)
+        weights[k] = _mm_set1_ps(kaiser_weights[k]);
+#endif
+
+    for (int y = begin; y < end; y++) {
+        byte *out = m->out + y * stride;
+        const float *rows[KAISER_TAPS];
+
+        for (int k = 0; k < KAISER_TAPS; k++)
+            rows[k] = m->temp + wrap_index(y * 2 - KAISER_TAPS / 2 + 1 + k, m->height) * stride;
+
+        for (int x = 0; x < stride; x += 4, out += 4) {
+            float sum[4];
+
+#if USE_SSE2
+            __m128 v = _mm_setzero_ps();
+
+            for (int k = 0; k < KAISER_TAPS; k++)
+                v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(rows[k] + x), weights[k]));
+
+            if (!linear) {
+                // same rounding as float_to_byte, negative values saturate to 0
+                __m128i i = _mm_cvttps_epi32(_mm_add_ps(v, half));
+                i = _mm_packs_epi32(i, i);
+                uint32_t pix = _mm_cvtsi128_si32(_mm_packus_epi16(i, i));
+                memcpy(out, &pix, sizeof(pix));
+                continue;
+            }
+
+            _mm_storeu_ps(sum, v);
+#else
+            Vector4Clear(sum);
+
+            for (int k = 0; k < KAISER_TAPS; k++) {
+                const float *p = rows[k] + x;
+                float w = kaiser_weights[k];
+                sum[0] += p[0] * w;
+                sum[1] += p[1] * w;
+                sum[2] += p[2] * w;
+                sum[3] += p[3] * w;
+            }
+#endif
+
+            if (linear) {
+                out[0] = IMG_LinearToSrgb(sum[0]);
+                out[1] = IMG_LinearToSrgb(sum[1]);
+                out[2] = IMG_LinearToSrgb(sum[2]);
+            } else {
+                out[0] = float_to_byte(sum[0]);
+                out[1] = float_to_byte(sum[1]);
+                out[2] = float_to_byte(sum[2]);
+            }
+            out[3] = float_to_byte(sum[3]);
+        }
+    }
+}
+
+/*
+================
+IMG_MipMapEx
+
+Generates the next mip level of a RGBA8 image. Input and output may point to
+the same buffer. Output size is half the input size, rounded down, but at
+least 1 pixel.
+================
+*/
+void IMG_MipMapEx(byte *out, byte *in, int width, int height, int flags)
+{
+    mipmap_t m = {
+        .in = in,
+        .out = out,
+        .width = width,
+        .height = height,
+        .outwidth = max(width >> 1, 1),
+        .outheight = max(height >> 1, 1),
+        .flags = flags,
+    };
+    int grain = ROW_GRAIN(m.outwidth);
+
+    if (flags & IMG_FILTER_KAISER) {
+        m.temp = IMG_AllocPixels(m.outwidth * height * 4 * sizeof(float));
+        Com_ParallelFor(height, ROW_GRAIN(m.outwidth), kaiser_rows_h, &m);
+        Com_ParallelFor(m.outheight, grain, kaiser_rows_v, &m);
+        IMG_FreePixels(m.temp);
+        return;
+    }
+
+    if (m.outheight <= grain) {
+        box_rows(&m, 0, m.outheight);
+        return;
+    }
+
+    if (out != in) {
+        Com_ParallelFor(m.outheight, grain, box_rows, &m);
+        return;
+    }
+
+    // in place, rows written by one worker may still be read by another
+    size_t size = m.outwidth * m.outheight * 4;
+    m.out = IMG_AllocPixels(size);
+    Com_ParallelFor(m.outheight, grain, box_rows, &m);
+    memcpy(out, m.out, size);
+    IMG_FreePixels(m.out);
+}
+
+void IMG_MipMap(byte *out, byte *in, int width, int height)
+{
+    int flags = 0;
+
+    if (r_mipmap_filter->integer == 1)
+        flags |= IMG_FILTER_KAISER;
+    if (r_mipmap_linear->integer)
+        flags |= IMG_FILTER_LINEAR;
+
+    IMG_MipMapEx(out, in, width, height, flags);
+}
+
+/*
+====================================================================
+
+FLOAT IMAGE FILTERING
+
+====================================================================
+*/
+
+typedef struct {
+    float       *pixels;
+    float       *scratch;       // one slice per worker thread
+    int         slice_size;
+    int         max_slices;
+    int         num_slices;
+    int         num_comps;
+    const float *kernel;
+    int         kernel_size;
+    int         num_stripes;
+    int         stripe_size;
+    int         stripe_stride;
+    int         element_stride;
+} filter_t;
+
+static void filter_stripe(const filter_t *f, float *scratch, int s)
+{
+    const int num_comps = f->num_comps;
+    const int pad_left = f->kernel_size / 2;
+    const int pad_right = f->kernel_size - pad_left - 1;
+    const int scratch_size = pad_left + f->stripe_size + pad_right;
+    float *stripe = f->pixels + s * f->stripe_stride * num_comps;
+
+    // back up stripe to scratch buffer
+    for (int i = 0; i < scratch_size; i++) {
+        int src = wrap_index(i - pad_left, f->stripe_size);
+        memcpy(scratch + i * num_comps, stripe + src * f->element_stride * num_comps,
+               num_comps * sizeof(float));
+    }
+
+    for (int i = 0; i < f->stripe_size; i++) {
+        float values[4] = { 0, 0, 0, 0 };
+
+        for (int j = 0; j < f->kernel_size; j++) {
+            const float *src = scratch + (i + j) * num_comps;
+            float w = f->kernel[j];
+            for (int c = 0; c < num_comps; c++)
+                values[c] += w * src[c];
+        }
+
+        memcpy(stripe + i * f->element_stride * num_comps, values, num_comps * sizeof(float));
+    }
+}
+
+// filter slices of stripes in place, wrapping around at the edges
+static void filter_slices(void *arg, int begin, int end)
+{
+    const filter_t *f = arg;
+
+    for (int n = begin; n < end; n++) {
+        float *scratch = f->scratch + n * f->slice_size;
+        int first = (int64_t)f->num_stripes * n / f->num_slices;
+        int last = (int64_t)f->num_stripes * (n + 1) / f->num_slices;
+
+        for (int s = first; s < last; s++)
+            filter_stripe(f, scratch, s);
+    }
+}
+
+static void filter_pass(filter_t *f, int num_stripes)
+{
+    int grain = ROW_GRAIN(f->stripe_size);
+
+    f->num_stripes = num_stripes;
+    f->num_slices = min(f->max_slices, (num_stripes + grain - 1) / grain);
+    Com_ParallelFor(f->num_slices, 1, filter_slices, f);
+}
+
+/*
+================
+IMG_FilterFloat
+
+Applies a separable filter kernel to a float image with up to 4 components.
+================
+*/
+void IMG_FilterFloat(float *pixels, int num_comps, const float *kernel,
+                     int kernel_size, int width, int height)
+{
+    Q_assert(num_comps >= 1 && num_comps <= 4);
+
+    filter_t f = {
+        .pixels = pixels,
+        .slice_size = (kernel_size - 1 + max(width, height)) * num_comps,
+        .max_slices = Com_ParallelThreads(),
+        .num_comps = num_comps,
+        .kernel = kernel,
+        .kernel_size = kernel_size,
+    };
+
+    f.scratch = Z_Malloc(f.max_slices * f.slice_size * sizeof(float));
+
+    // filter horizontally
+    f.stripe_size = width;
+    f.stripe_stride = width;
+    f.element_stride = 1;
+    filter_pass(&f, height);
+
+    // filter vertically
+    f.stripe_size = height;
+    f.stripe_stride = 1;
+    f.element_stride = width;
+    filter_pass(&f, width);
+
+    Z_Free(f.scratch);
+}
+
+typedef struct {
+    float       *out;
+    const float *in;
+    int         num_comps;
+    int         width, height;
+} upsample_t;
+
+static void upsample_rows(void *arg, int begin, int end)
+{
+    const upsample_t *u = arg;
+    const int nc = u->num_comps;
+    const int stride = u->width * nc;
+
+    for (int y = begin; y < end; y++) {
+        const float *row0 = u->in + (y >> 1) * stride;
+        const float *row1 = u->in + wrap_index((y >> 1) + 1, u->height) * stride;
+        float *out = u->out + y * stride * 2;
+        float cur[4], next[4], first[4];
+
+        for (int x = 0; x < u->width; x++) {
+            int x1 = x + 1 < u->width ? x + 1 : 0;
+
+            // odd rows interpolate between input rows
+            for (int c = 0; c < nc; c++) {
+                if (y & 1) {
+                    cur[c] = (row0[x * nc + c] + row1[x * nc + c]) * 0.5f;
+                    next[c] = (row0[x1 * nc + c] + row1[x1 * nc + c]) * 0.5f;
+                } else {
+                    cur[c] = row0[x * nc + c];
+                    next[c] = row0[x1 * nc + c];
+                }
+            }
+
+            if (x == 0)
+                memcpy(first, cur, sizeof(first));
+            if (x1 == 0)
+                memcpy(next, first, sizeof(next));
+
+            for (int c = 0; c < nc; c++) {
+                out[c] = cur[c];
+                out[nc + c] = (cur[c] + next[c]) * 0.5f;
+            }
+            out += nc * 2;
+        }
+    }
+}
+
+/*
+================
+IMG_Upsample2xFloat
+
+Bilinearly upsamples a float image to twice its size, wrapping around
+at the edges.
+================
+*/
+void IMG_Upsample2xFloat(float *out, const float *in, int num_comps, int width, int height)
+{
+    Q_assert(num_comps >= 1 && num_comps <= 4);
+
+    upsample_t u = {
+        .out = out,
+        .in = in,
+        .num_comps = num_comps,
+        .width = width,
+        .height = height,
+    };
+
+    Com_ParallelFor(height * 2, ROW_GRAIN(width * 2), upsample_rows, &u);
+}
+
+/*
+====================================================================
+
+INIT
+
+====================================================================
+*/
+
+void IMG_InitProcessing(void)
+{
+    int i;
+
+    r_mipmap_filter = Cvar_Get("r_mipmap_filter", "0", CVAR_FILES);
+    r_mipmap_linear = Cvar_Get("r_mipmap_linear", "0", CVAR_FILES);
+
+    if (kaiser_weights[0])
+        return;
+
+    for (i = 0; i < 256; i++)
+        img_srgb_to_linear[i] = decode_srgb_exact(i);
+
+    for (i = 0; i < 0x10000; i++)
+        linear_to_srgb[i] = encode_srgb_exact(i / 65535.0f);
+
+    init_kaiser_weights();
+}
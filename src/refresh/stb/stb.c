@@ -32,3 +32,5 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "stb_image_resize2.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
+#define STB_DXT_IMPLEMENTATION
+#include "stb_dxt.h"
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "material.h"
 #include "cameras.h"
 #include "conversion.h"
+#include "common/async.h"
 
 #include <assert.h>
 #include <float.h>
@@ -151,8 +152,7 @@ create_poly(
 	const bsp_t* bsp,
 	const mface_t* surf,
 	uint material_id,
-	uint32_t primitive_index,
-	uint32_t max_prim,
+	float emissive_factor,
 	VboPrimitive* primitives_out)
 {
 	static const int max_vertices = 32;
@@ -243,8 +243,6 @@ create_poly(
 	if (!primitives_out)
 		return num_triangles;
 
-	const float emissive_factor = compute_emissive(texinfo);
-
 	float alpha = 1.f;
 	if (MAT_IsKind(material_id, MATERIAL_KIND_TRANSPARENT))
 		alpha = (texinfo->c.flags & SURF_TRANS33) ? 0.33f : (texinfo->c.flags & SURF_TRANS66) ? 0.66f : 1.0f;
@@ -255,14 +253,6 @@ create_poly(
 	
 	for (uint32_t i = 0; i < num_triangles; i++)
 	{
-		// The prititive buffer is allocated based on the expected number of prims generated by the bsp,
-		// so just verify that here, mostly for debugging.
-		if (primitive_index + i >= max_prim)
-		{
-			assert(!"Primitive buffer overflow - there's a bug somewhere.");
-			return i;
-		}
-
 		memset(primitives_out, 0, sizeof(VboPrimitive));
 		
 		int i1 = (i + 2) % num_vertices;
@@ -323,6 +313,74 @@ create_poly(
 	return num_triangles;
 }
 
+// Computes the tangent basis for BSPs that don't provide it in the BSPX
+static void
+compute_prim_tangents(VboPrimitive* prims, uint32_t num_prims)
+{
+	for (uint32_t idx_tri = 0; idx_tri < num_prims; ++idx_tri)
+	{
+		VboPrimitive* prim = prims + idx_tri;
+		
+		float const * pA = prim->pos0;
+		float const * pB = prim->pos1;
+		float const * pC = prim->pos2;
+
+		float const * tA = prim->uv0;
+		float const * tB = prim->uv1;
+		float const * tC = prim->uv2;
+
+		vec3_t dP0, dP1;
+		VectorSubtract(pB, pA, dP0);
+		VectorSubtract(pC, pA, dP1);
+
+		vec2_t dt0, dt1;
+		Vector2Subtract(tB, tA, dt0);
+		Vector2Subtract(tC, tA, dt1);
+		
+		float r = 1.f / (dt0[0] * dt1[1] - dt1[0] * dt0[1]);
+
+		vec3_t sdir = {
+			(dt1[1] * dP0[0] - dt0[1] * dP1[0]) * r,
+			(dt1[1] * dP0[1] - dt0[1] * dP1[1]) * r,
+			(dt1[1] * dP0[2] - dt0[1] * dP1[2]) * r };
+
+		vec3_t tdir = {
+			(dt0[0] * dP1[0] - dt1[0] * dP0[0]) * r,
+			(dt0[0] * dP1[1] - dt1[0] * dP0[1]) * r,
+			(dt0[0] * dP1[2] - dt1[0] * dP0[2]) * r };
+
+		vec3_t normal;
+		CrossProduct(dP0, dP1, normal);
+		VectorNormalize(normal);
+
+		uint32_t encoded_normal = encode_normal(normal);
+		prim->normals[0] = encoded_normal;
+		prim->normals[1] = encoded_normal;
+		prim->normals[2] = encoded_normal;
+
+		vec3_t tangent;
+
+		vec3_t t;
+		VectorScale(normal, DotProduct(normal, sdir), t);
+		VectorSubtract(sdir, t, t);
+		VectorNormalize2(t, tangent); // Graham-Schmidt : t = normalize(t - n * (n.t))
+
+		uint32_t encoded_tangent = encode_normal(tangent);
+		prim->tangents[0] = encoded_tangent;
+		prim->tangents[1] = encoded_tangent;
+		prim->tangents[2] = encoded_tangent;
+
+		vec3_t cross;
+		CrossProduct(normal, t, cross);
+		float dot = DotProduct(cross, tdir);
+
+		if (dot < 0.0f)
+		{
+			prim->material_id |= MATERIAL_FLAG_HANDEDNESS;
+		}
+	}
+}
+
 static int
 belongs_to_model(bsp_t *bsp, mface_t *surf)
 {
@@ -616,162 +674,266 @@ static void build_pvs2(bsp_t* bsp)
 
 }
 
-// Provides an upper estimate (not counting the collinear edge removal, invisible materials etc.)
-// for the total number of triangles needed to represent the bsp and one instance of every model.
-static int count_triangles(const bsp_t* bsp)
+// Geometry buckets of the BSP mesh, in the order they are laid out in the primitive buffer.
+// Surfaces of inline models go into the model bucket, laid out per model after the world.
+enum {
+	SURF_BUCKET_OPAQUE,
+	SURF_BUCKET_TRANSPARENT,
+	SURF_BUCKET_MASKED,
+	SURF_BUCKET_SKY,
+	SURF_BUCKET_NODRAW_SKY_LIGHTS,
+	SURF_BUCKET_MODEL,
+	SURF_BUCKET_COUNT
+};
+
+// Material and set of buckets of one BSP face, from a single classification pass
+typedef struct {
+	uint32_t material_id;
+	uint32_t surf_flags;
+	int model_idx;
+	int buckets;
+} surface_class_t;
+
+// One face emitted into one bucket, with its precomputed range in the primitive buffer
+typedef struct {
+	mface_t *surf;
+	uint32_t material_id;
+	uint32_t surf_flags;
+	float emissive_factor;
+	bool is_world;
+	uint32_t first_prim;
+	uint32_t num_prims;
+} surface_entry_t;
+
+typedef struct {
+	bsp_mesh_t *wm;
+	bsp_t *bsp;
+	const surface_entry_t *entries;
+	int *anti_clusters;
+	int sky_lights;
+} surface_job_t;
+
+#define SURFACE_GRAIN 64
+
+static int
+get_surf_buckets(uint32_t material_id, uint32_t surf_flags, bool is_model)
 {
-	int num_tris = 0;
+	if (is_model)
+		return filter_all(material_id, surf_flags) ? BIT(SURF_BUCKET_MODEL) : 0;
+
+	int buckets = 0;
+
+	if (filter_static_opaque(material_id, surf_flags))
+		buckets |= BIT(SURF_BUCKET_OPAQUE);
+	if (filter_static_transparent(material_id, surf_flags))
+		buckets |= BIT(SURF_BUCKET_TRANSPARENT);
+	if (filter_static_masked(material_id, surf_flags))
+		buckets |= BIT(SURF_BUCKET_MASKED);
+	if (filter_static_sky(material_id, surf_flags))
+		buckets |= BIT(SURF_BUCKET_SKY);
+	if (cvar_pt_bsp_sky_lights->integer > 1 && filter_nodraw_sky_lights(material_id, surf_flags))
+		buckets |= BIT(SURF_BUCKET_NODRAW_SKY_LIGHTS);
+
+	return buckets;
+}
 
-	for (int i = 0; i < bsp->numfaces; i++)
+static void
+classify_surface(mface_t *surf, bool is_model, surface_class_t *out)
+{
+	uint32_t material_id = surf->texinfo->material ? surf->texinfo->material->flags : 0;
+	uint32_t surf_flags = surf->drawflags | surf->texinfo->c.flags;
+
+	// ugly hacks for situations when the same texture is used with different effects
+
+	if ((MAT_IsKind(material_id, MATERIAL_KIND_WATER) || MAT_IsKind(material_id, MATERIAL_KIND_SLIME)) && !(surf_flags & SURF_WARP))
+		material_id = MAT_SetKind(material_id, MATERIAL_KIND_REGULAR);
+
+	if (MAT_IsKind(material_id, MATERIAL_KIND_GLASS) && !(surf_flags & SURF_TRANS_MASK))
+		material_id = MAT_SetKind(material_id, MATERIAL_KIND_REGULAR);
+	
+	// custom transparent surfaces
+	if (surf_flags & SURF_SKY)
 	{
-		mface_t* surf = bsp->faces + i;
-		int num_vertices = surf->numsurfedges;
+		/* Sky: apply filtering _before_ changing the material kind, so we can detect
+		 * materials manually marked as SKY. */
+		out->buckets = get_surf_buckets(material_id, surf_flags, is_model);
 
-		if (num_vertices >= 3)
-			num_tris += (num_vertices - 2);
+		material_id = MAT_SetKind(material_id, MATERIAL_KIND_SKY);
 	}
+	else
+	{
+		if (MAT_IsKind(material_id, MATERIAL_KIND_REGULAR) && (surf_flags & SURF_TRANS_MASK) && !(material_id & MATERIAL_FLAG_LIGHT))
+			material_id = MAT_SetKind(material_id, MATERIAL_KIND_TRANSPARENT);
+
+		if (MAT_IsKind(material_id, MATERIAL_KIND_SCREEN) && (surf_flags & SURF_TRANS_MASK))
+			material_id = MAT_SetKind(material_id, MATERIAL_KIND_GLASS);
 
-	return num_tris;
+		if (surf_flags & SURF_WARP)
+			material_id |= MATERIAL_FLAG_WARP;
+
+		if (surf_flags & SURF_FLOWING)
+			material_id |= MATERIAL_FLAG_FLOWING;
+
+		out->buckets = get_surf_buckets(material_id, surf_flags, is_model);
+	}
+
+	if (out->buckets && (material_id & MATERIAL_FLAG_LIGHT) && surf->texinfo->material->light_styles)
+	{
+		int light_style = get_surf_light_style(surf);
+		material_id |= (light_style << MATERIAL_LIGHT_STYLE_SHIFT) & MATERIAL_LIGHT_STYLE_MASK;
+	}
+
+	out->material_id = material_id;
+	out->surf_flags = surf_flags;
 }
 
 static void
-collect_surfaces(uint32_t *prim_ctr, bsp_mesh_t *wm, bsp_t *bsp, int model_idx, int (*filter)(int, int))
+add_surface_entry(bsp_mesh_t *wm, const surface_class_t *surf_class, mface_t *surf,
+				  surface_entry_t *entry, uint32_t *prim_ctr)
 {
-	mface_t *surfaces = model_idx < 0 ? bsp->faces : bsp->models[model_idx].firstface;
-	int num_faces = model_idx < 0 ? bsp->numfaces : bsp->models[model_idx].numfaces;
-	bool any_pvs_patches = false;
+	uint32_t material_id = surf_class->material_id;
 
-	for (int i = 0; i < num_faces; i++) {
-		mface_t *surf = surfaces + i;
+	if (MAT_IsKind(material_id, MATERIAL_KIND_CAMERA) && wm->num_cameras > 0)
+	{
+		// Assign a random camera for this face
+		int camera_id = Q_rand() % (wm->num_cameras * 4);
+		material_id = (material_id & ~MATERIAL_LIGHT_STYLE_MASK) | ((camera_id << MATERIAL_LIGHT_STYLE_SHIFT) & MATERIAL_LIGHT_STYLE_MASK);
+	}
 
-		if (model_idx < 0 && belongs_to_model(bsp, surf)) {
-			continue;
+	entry->surf = surf;
+	entry->material_id = material_id;
+	entry->surf_flags = surf_class->surf_flags;
+	entry->emissive_factor = compute_emissive(surf->texinfo);
+	entry->is_world = surf_class->model_idx < 0;
+	entry->first_prim = *prim_ctr;
+
+	// Only sky surfaces lose vertices to the collinear edge removal in create_poly
+	int num_vertices = surf->numsurfedges;
+	if (MAT_IsKind(material_id, MATERIAL_KIND_SKY))
+	{
+		float positions[3 * /*max_vertices*/ 32];
+
+		for (int i = 0; i < surf->numsurfedges; i++)
+		{
+			msurfedge_t *src_surfedge = surf->firstsurfedge + i;
+			VectorCopy(src_surfedge->edge->v[src_surfedge->vert]->point, positions + i * 3);
 		}
 
-		uint32_t material_id = surf->texinfo->material ? surf->texinfo->material->flags : 0;
-		uint32_t surf_flags = surf->drawflags | surf->texinfo->c.flags;
+		remove_collinear_edges(positions, NULL, NULL, &num_vertices);
+	}
 
-		// ugly hacks for situations when the same texture is used with different effects
+	entry->num_prims = num_vertices >= 3 ? num_vertices - 2 : 0;
 
-		if ((MAT_IsKind(material_id, MATERIAL_KIND_WATER) || MAT_IsKind(material_id, MATERIAL_KIND_SLIME)) && !(surf_flags & SURF_WARP))
-			material_id = MAT_SetKind(material_id, MATERIAL_KIND_REGULAR);
+	*prim_ctr += entry->num_prims;
+}
 
-		if (MAT_IsKind(material_id, MATERIAL_KIND_GLASS) && !(surf_flags & SURF_TRANS_MASK))
-			material_id = MAT_SetKind(material_id, MATERIAL_KIND_REGULAR);
-		
-		// custom transparent surfaces
-		if (surf_flags & SURF_SKY)
-		{
-			/* Sky: apply filtering _before_ changing the material kind, so we can detect
-			 * materials manually marked as SKY. */
-			if (!filter(material_id, surf_flags))
-				continue;
+static void
+set_surface_prim_clusters(const surface_job_t *job, const surface_entry_t *entry)
+{
+	bsp_t *bsp = job->bsp;
+	VboPrimitive *prims = job->wm->primitives + entry->first_prim;
+	uint32_t material_id = entry->material_id;
 
-			material_id = MAT_SetKind(material_id, MATERIAL_KIND_SKY);
-		}
-		else
-		{
-			if (MAT_IsKind(material_id, MATERIAL_KIND_REGULAR) && (surf_flags & SURF_TRANS_MASK) && !(material_id & MATERIAL_FLAG_LIGHT))
-				material_id = MAT_SetKind(material_id, MATERIAL_KIND_TRANSPARENT);
+	bool needs_anti_cluster = job->anti_clusters && (MAT_IsKind(material_id, MATERIAL_KIND_SLIME) || MAT_IsKind(material_id, MATERIAL_KIND_WATER)
+		|| MAT_IsKind(material_id, MATERIAL_KIND_GLASS) || MAT_IsKind(material_id, MATERIAL_KIND_TRANSPARENT));
 
-			if (MAT_IsKind(material_id, MATERIAL_KIND_SCREEN) && (surf_flags & SURF_TRANS_MASK))
-				material_id = MAT_SetKind(material_id, MATERIAL_KIND_GLASS);
+	for (uint32_t k = 0; k < entry->num_prims; ++k) 
+	{
+		// Collect the positions into one array for compatibility with get_triangle_off_center(...)
+		float positions[9];
+		VectorCopy(prims[k].pos0, positions + 0);
+		VectorCopy(prims[k].pos1, positions + 3);
+		VectorCopy(prims[k].pos2, positions + 6);
+		
+		// Compute the BSP node for this specific triangle based on its center.
+		// The face lists in the BSP are slightly incorrect, or the original code 
+		// in q2vkpt that was extracting them was incorrect.
 
-			if (surf_flags & SURF_WARP)
-				material_id |= MATERIAL_FLAG_WARP;
+		vec3_t center, anti_center;
+		get_triangle_off_center(positions, center, anti_center, 0.01f);
 
-			if (surf_flags & SURF_FLOWING)
-				material_id |= MATERIAL_FLAG_FLOWING;
+		int cluster = BSP_PointLeaf(bsp->nodes, center)->cluster;
 
-			if (!filter(material_id, surf_flags))
-				continue;
+		// If the small offset for the off-center point was too small, and that point
+		// is not inside any cluster, try a larger offset.
+		if (cluster < 0) {
+			get_triangle_off_center(positions, center, anti_center, 1.f);
+			cluster = BSP_PointLeaf(bsp->nodes, center)->cluster;
 		}
 
-		if ((material_id & MATERIAL_FLAG_LIGHT) && surf->texinfo->material->light_styles)
-		{
-			int light_style = get_surf_light_style(surf);
-			material_id |= (light_style << MATERIAL_LIGHT_STYLE_SHIFT) & MATERIAL_LIGHT_STYLE_MASK;
-		}
+		prims[k].cluster = cluster;
 
-		if (MAT_IsKind(material_id, MATERIAL_KIND_CAMERA) && wm->num_cameras > 0)
+		if (cluster >= 0 && (MAT_IsKind(material_id, MATERIAL_KIND_SKY) || MAT_IsKind(material_id, MATERIAL_KIND_LAVA)))
 		{
-			// Assign a random camera for this face
-			int camera_id = Q_rand() % (wm->num_cameras * 4);
-			material_id = (material_id & ~MATERIAL_LIGHT_STYLE_MASK) | ((camera_id << MATERIAL_LIGHT_STYLE_SHIFT) & MATERIAL_LIGHT_STYLE_MASK);
+			bool is_bsp_sky_light = (entry->surf_flags & (SURF_LIGHT | SURF_SKY)) == (SURF_LIGHT | SURF_SKY);
+			if (is_sky_or_lava_cluster(job->wm, entry->surf, cluster, material_id) || (job->sky_lights && is_bsp_sky_light))
+			{
+				prims[k].material_id |= MATERIAL_FLAG_LIGHT;
+			}
 		}
-		
-		VboPrimitive* surface_prims = wm->primitives + *prim_ctr;
-		
-		uint32_t prims_in_surface = create_poly(bsp, surf, material_id, *prim_ctr, wm->num_primitives_allocated, surface_prims);
 
-		for (uint32_t k = 0; k < prims_in_surface; ++k) 
-		{
-			if (model_idx < 0)
-			{
-				// Collect the positions into one array for compatibility with get_triangle_off_center(...)
-				float positions[9];
-				VectorCopy(surface_prims[k].pos0, positions + 0);
-				VectorCopy(surface_prims[k].pos1, positions + 3);
-				VectorCopy(surface_prims[k].pos2, positions + 6);
-				
-				// Compute the BSP node for this specific triangle based on its center.
-				// The face lists in the BSP are slightly incorrect, or the original code 
-				// in q2vkpt that was extracting them was incorrect.
+		// The PVS is patched on the main thread afterwards, see patch_surface_pvs
+		if (job->anti_clusters)
+			job->anti_clusters[entry->first_prim + k] = needs_anti_cluster ? BSP_PointLeaf(bsp->nodes, anti_center)->cluster : -1;
+	}
+}
 
-				vec3_t center, anti_center;
-				get_triangle_off_center(positions, center, anti_center, 0.01f);
+static void
+emit_surface_range(void *arg, int begin, int end)
+{
+	const surface_job_t *job = arg;
 
-				int cluster = BSP_PointLeaf(bsp->nodes, center)->cluster;
+	for (int i = begin; i < end; i++)
+	{
+		const surface_entry_t *entry = job->entries + i;
+		VboPrimitive *prims = job->wm->primitives + entry->first_prim;
 
-				// If the small offset for the off-center point was too small, and that point
-				// is not inside any cluster, try a larger offset.
-				if (cluster < 0) {
-					get_triangle_off_center(positions, center, anti_center, 1.f);
-					cluster = BSP_PointLeaf(bsp->nodes, center)->cluster;
-				}
+		uint32_t prims_in_surface = create_poly(job->bsp, entry->surf, entry->material_id, entry->emissive_factor, prims);
+		assert(prims_in_surface == entry->num_prims);
+		(void)prims_in_surface;
 
-				surface_prims[k].cluster = cluster;
+		if (entry->is_world)
+			set_surface_prim_clusters(job, entry);
+		else
+		{
+			for (uint32_t k = 0; k < entry->num_prims; ++k)
+				prims[k].cluster = -1;
+		}
 
-				if (cluster >= 0 && (MAT_IsKind(material_id, MATERIAL_KIND_SKY) || MAT_IsKind(material_id, MATERIAL_KIND_LAVA)))
-				{
-					bool is_bsp_sky_light = (surf_flags & (SURF_LIGHT | SURF_SKY)) == (SURF_LIGHT | SURF_SKY);
-					if (is_sky_or_lava_cluster(wm, surf, cluster, material_id) || (cvar_pt_bsp_sky_lights->integer && is_bsp_sky_light))
-					{
-						surface_prims[k].material_id |= MATERIAL_FLAG_LIGHT;
-					}
-				}
+		if (!job->bsp->basisvectors)
+			compute_prim_tangents(prims, entry->num_prims);
+	}
+}
 
-				if (!bsp->pvs_patched)
-				{
-					if (MAT_IsKind(material_id, MATERIAL_KIND_SLIME) || MAT_IsKind(material_id, MATERIAL_KIND_WATER) || MAT_IsKind(material_id, MATERIAL_KIND_GLASS) || MAT_IsKind(material_id, MATERIAL_KIND_TRANSPARENT))
-					{
-						int anti_cluster = BSP_PointLeaf(bsp->nodes, anti_center)->cluster;
-
-						if (cluster >= 0 && anti_cluster >= 0 && cluster != anti_cluster)
-						{
-							byte* pvs_cluster = BSP_GetPvs(bsp, cluster);
-							byte* pvs_anti_cluster = BSP_GetPvs(bsp, anti_cluster);
-
-							if (!Q_IsBitSet(pvs_cluster, anti_cluster) || !Q_IsBitSet(pvs_anti_cluster, cluster))
-							{
-								connect_pvs(bsp, cluster, pvs_cluster, anti_cluster, pvs_anti_cluster);
-								any_pvs_patches = true;
-							}
-						}
-					}
-				}
+// Connects the PVS of clusters on both sides of see-through surfaces. Runs serially in the
+// original bucket order because every patch changes the outcome of the following checks.
+static bool
+patch_surface_pvs(bsp_t *bsp, const VboPrimitive *prims, const int *anti_clusters, const surface_entry_t *entry)
+{
+	bool any_pvs_patches = false;
+
+	for (uint32_t k = 0; k < entry->num_prims; ++k)
+	{
+		int cluster = prims[entry->first_prim + k].cluster;
+		int anti_cluster = anti_clusters[entry->first_prim + k];
+
+		if (cluster >= 0 && anti_cluster >= 0 && cluster != anti_cluster)
+		{
+			byte* pvs_cluster = BSP_GetPvs(bsp, cluster);
+			byte* pvs_anti_cluster = BSP_GetPvs(bsp, anti_cluster);
+
+			if (!Q_IsBitSet(pvs_cluster, anti_cluster) || !Q_IsBitSet(pvs_anti_cluster, cluster))
+			{
+				connect_pvs(bsp, cluster, pvs_cluster, anti_cluster, pvs_anti_cluster);
+				any_pvs_patches = true;
 			}
-			else
-				surface_prims[k].cluster = -1;
 		}
-
-		*prim_ctr += prims_in_surface;
 	}
 
-	if (any_pvs_patches)
-		make_pvs_symmetric(bsp);
+	return any_pvs_patches;
 }
 
+
 /*
   Sutherland-Hodgman polygon clipping algorithm, mostly copied from
   https://rosettacode.org/wiki/Sutherland-Hodgman_polygon_clipping#C
@@ -905,6 +1067,72 @@ clip_polygon(poly_t* input, poly_t* clipper, poly_t* output)
 		memcpy(output->v, p2->v, p2->len * sizeof(point2_t));
 }
 
+/*
+  Specialized version of poly_edge_clip for the axis-aligned edges of a texture
+  tile: keeps the points where sign * (v[axis] - value) >= 0, and emits vertices
+  in the same order as the generic clipper does for that edge.
+*/
+static void
+poly_axis_clip(poly_t* sub, int axis, float value, float sign, poly_t* res)
+{
+	int i;
+	float d0, d1;
+	point2_t tmp;
+	point2_t* v0 = sub->v + sub->len - 1;
+	point2_t* v1;
+	res->len = 0;
+
+	d0 = sign * ((axis ? v0->y : v0->x) - value);
+	if (d0 >= 0) poly_append(res, v0);
+
+	for (i = 0; i < sub->len; i++) {
+		v1 = sub->v + i;
+		d1 = sign * ((axis ? v1->y : v1->x) - value);
+		if ((d0 < 0 && d1 > 0) || (d0 > 0 && d1 < 0)) {
+			/* last point and current straddle the edge */
+			float t = d0 / (d0 - d1);
+			tmp.x = v0->x + t * (v1->x - v0->x);
+			tmp.y = v0->y + t * (v1->y - v0->y);
+			if (axis) tmp.y = value; else tmp.x = value;
+			poly_append(res, &tmp);
+		}
+		if (i == sub->len - 1) break;
+		if (d1 >= 0) poly_append(res, v1);
+		v0 = v1;
+		d0 = d1;
+	}
+}
+
+/*
+  Clips the polygon against the rectangle [x_min, x_max] x [y_min, y_max].
+  Equivalent to clip_polygon with a counter-clockwise rectangular clipper,
+  but without the cross products and the generic line intersection.
+*/
+static void
+clip_polygon_rect(poly_t* input, float x_min, float y_min, float x_max, float y_max, poly_t* output)
+{
+	poly_t tmp;
+
+	poly_axis_clip(input, 0, x_min, 1.f, output);
+	if (output->len == 0)
+		return;
+
+	poly_axis_clip(output, 1, y_min, 1.f, &tmp);
+	if (tmp.len == 0) {
+		output->len = 0;
+		return;
+	}
+
+	poly_axis_clip(&tmp, 0, x_max, -1.f, output);
+	if (output->len == 0)
+		return;
+
+	poly_axis_clip(output, 1, y_max, -1.f, &tmp);
+	output->len = tmp.len;
+	if (output->len)
+		memcpy(output->v, tmp.v, tmp.len * sizeof(point2_t));
+}
+
 static light_poly_t*
 append_light_poly(int* num_lights, int* allocated, light_poly_t** lights)
 {
@@ -916,18 +1144,61 @@ append_light_poly(int* num_lights, int* allocated, light_poly_t** lights)
 	return *lights + (*num_lights)++;
 }
 
+static void
+reserve_light_polys(int* num_lights, int* allocated, light_poly_t** lights, int count)
+{
+	if (*num_lights + count > *allocated)
+	{
+		*allocated = max(*num_lights + count, max(*allocated * 2, 128));
+		*lights = Z_Realloc(*lights, *allocated * sizeof(light_poly_t));
+	}
+}
+
 static inline bool
 is_light_material(uint32_t material)
 {
 	return (material & MATERIAL_FLAG_LIGHT) != 0;
 }
 
-static void
-collect_one_light_poly_entire_texture(bsp_t *bsp, mface_t *surf, mtexinfo_t *texinfo, int model_idx,
-									  const vec3_t light_color, float emissive_factor, int light_style,
-									  int *num_lights, int *allocated_lights, light_poly_t **lights)
+typedef enum {
+	LIGHT_FACE_ENTIRE_TEXTURE,
+	LIGHT_FACE_TEXTURE_GRID,
+	LIGHT_FACE_SKY,
+	LIGHT_FACE_LAVA
+} light_face_kind_t;
+
+// A light emitting face, classified on the main thread and converted into light polys by the workers
+typedef struct {
+	mface_t *surf;
+	light_face_kind_t kind;
+	int light_style;
+	float emissive_factor;
+	vec3_t light_color;
+	vec4_t plane;
+	float tex_scale[2];
+	vec2_t min_light_texcoord;
+	vec2_t max_light_texcoord;
+	bool skip_cluster_check; // sky light kept regardless of the sky clusters, see pt_bsp_sky_lights
+	int first_light; // index of the first light poly written for this face
+	int num_lights;  // upper bound before the fill pass, number of lights written after
+} light_face_t;
+
+typedef struct {
+	bsp_mesh_t *wm;
+	bsp_t *bsp;
+	int model_idx;
+	light_face_t *faces;
+	light_poly_t *lights;
+} light_face_job_t;
+
+#define LIGHT_FACE_GRAIN 16
+
+static int
+collect_one_light_poly_entire_texture(bsp_t *bsp, const light_face_t *face, int model_idx, light_poly_t *out)
 {
+	mface_t *surf = face->surf;
 	float positions[3 * /*max_vertices*/ 32];
+	int count = 0;
 
 	for (int i = 0; i < surf->numsurfedges; i++)
 	{
@@ -956,15 +1227,15 @@ collect_one_light_poly_entire_texture(bsp_t *bsp, mface_t *surf, mtexinfo_t *tex
 		VectorCopy(positions, light.positions + 0);
 		VectorCopy(positions + i1 * 3, light.positions + 3);
 		VectorCopy(positions + i2 * 3, light.positions + 6);
-		VectorScale(light_color, emissive_factor, light.color);
+		VectorScale(face->light_color, face->emissive_factor, light.color);
 
-		light.material = texinfo->material;
-		light.style = light_style;
+		light.material = surf->texinfo->material;
+		light.style = face->light_style;
 
 		if(!get_triangle_off_center(light.positions, light.off_center, NULL, 1.f))
 			continue;
 
-		light.emissive_factor = emissive_factor;
+		light.emissive_factor = face->emissive_factor;
 		
 		if (model_idx >= 0)
 			light.cluster = -1; // Cluster will be determined when the model is instanced
@@ -973,24 +1244,30 @@ collect_one_light_poly_entire_texture(bsp_t *bsp, mface_t *surf, mtexinfo_t *tex
 		
 		if (model_idx >= 0 || light.cluster >= 0)
 		{
-			light_poly_t* list_light = append_light_poly(num_lights, allocated_lights, lights);
-			memcpy(list_light, &light, sizeof(light_poly_t));
+			memcpy(out + count, &light, sizeof(light_poly_t));
+			count++;
 		}
 	}
+
+	return count;
 }
 
-static void
-collect_one_light_poly(bsp_t *bsp, mface_t *surf, mtexinfo_t *texinfo, int model_idx, const vec4_t plane,
-					   const float tex_scale[], const vec2_t min_light_texcoord, const vec2_t max_light_texcoord,
-					   const vec3_t light_color, float emissive_factor, int light_style,
-					   int* num_lights, int* allocated_lights, light_poly_t** lights)
+// Clips the surface against every repetition of the emissive texture region.
+// With out == NULL, only counts the triangles that would be produced.
+static int
+collect_one_light_poly(bsp_t *bsp, const light_face_t *face, int model_idx, light_poly_t *out)
 {
+	mface_t *surf = face->surf;
+	mtexinfo_t *texinfo = surf->texinfo;
+	const float *plane = face->plane;
+	int count = 0;
+
 	// Scale the texture axes according to the original resolution of the game's .wal textures
 	vec4_t tex_axis0, tex_axis1;
-	VectorScale(texinfo->axis[0], tex_scale[0], tex_axis0);
-	VectorScale(texinfo->axis[1], tex_scale[1], tex_axis1);
-	tex_axis0[3] = texinfo->offset[0] * tex_scale[0];
-	tex_axis1[3] = texinfo->offset[1] * tex_scale[1];
+	VectorScale(texinfo->axis[0], face->tex_scale[0], tex_axis0);
+	VectorScale(texinfo->axis[1], face->tex_scale[1], tex_axis1);
+	tex_axis0[3] = texinfo->offset[0] * face->tex_scale[0];
+	tex_axis1[3] = texinfo->offset[1] * face->tex_scale[1];
 
 	// The texture basis is not normalized, so we need the lengths of the axes to convert
 	// texture coordinates back into world space
@@ -1009,7 +1286,7 @@ collect_one_light_poly(bsp_t *bsp, mface_t *surf, mtexinfo_t *texinfo, int model
 		// Surface is perpendicular to texture plane, which means we can't un-project
 		// texture coordinates back onto the surface. This shouldn't happen though,
 		// so it should be safe to skip such lights.
-		return;
+		return 0;
 	}
 
 	// Construct the surface polygon in texture space, and find its texture extents
@@ -1038,6 +1315,10 @@ collect_one_light_poly(bsp_t *bsp, mface_t *surf, mtexinfo_t *texinfo, int model
 		tex_max.y = max(tex_max.y, t.y);
 	}
 
+	// The emissive region is normally a proper rectangle, use the axis-aligned clipper for it
+	const bool rect_clipper = face->min_light_texcoord[0] < face->max_light_texcoord[0]
+		&& face->min_light_texcoord[1] < face->max_light_texcoord[1];
+
 	// Instantiate a square polygon for every repetition of the texture in this surface,
 	// then clip the original surface against that square polygon.
 
@@ -1045,24 +1326,35 @@ collect_one_light_poly(bsp_t *bsp, mface_t *surf, mtexinfo_t *texinfo, int model
 	{
 		for (float x_tile = floorf(tex_min.x); x_tile <= ceilf(tex_max.x); x_tile++)
 		{
-			float x_min = x_tile + min_light_texcoord[0];
-			float x_max = x_tile + max_light_texcoord[0];
-			float y_min = y_tile + min_light_texcoord[1];
-			float y_max = y_tile + max_light_texcoord[1];
+			float x_min = x_tile + face->min_light_texcoord[0];
+			float x_max = x_tile + face->max_light_texcoord[0];
+			float y_min = y_tile + face->min_light_texcoord[1];
+			float y_max = y_tile + face->max_light_texcoord[1];
+
+			poly_t instance;
 
-			// The square polygon, for this repetition, according to the extents of emissive pixels
+			if (rect_clipper)
+			{
+				// Repetitions that don't overlap the surface extents can only produce empty
+				// or zero-area polygons
+				if (x_max <= tex_min.x || x_min >= tex_max.x || y_max <= tex_min.y || y_min >= tex_max.y)
+					continue;
 
-			poly_t clipper;
-			clipper.len = 4;
-			clipper.v[0].x = x_min; clipper.v[0].y = y_min;
-			clipper.v[1].x = x_max; clipper.v[1].y = y_min;
-			clipper.v[2].x = x_max; clipper.v[2].y = y_max;
-			clipper.v[3].x = x_min; clipper.v[3].y = y_max;
+				clip_polygon_rect(&tex_poly, x_min, y_min, x_max, y_max, &instance);
+			}
+			else
+			{
+				// The square polygon, for this repetition, according to the extents of emissive pixels
 
-			// Clip it
+				poly_t clipper;
+				clipper.len = 4;
+				clipper.v[0].x = x_min; clipper.v[0].y = y_min;
+				clipper.v[1].x = x_max; clipper.v[1].y = y_min;
+				clipper.v[2].x = x_max; clipper.v[2].y = y_max;
+				clipper.v[3].x = x_min; clipper.v[3].y = y_max;
 
-			poly_t instance;
-			clip_polygon(&tex_poly, &clipper, &instance);
+				clip_polygon(&tex_poly, &clipper, &instance);
+			}
 
 			if (instance.len < 3)
 			{
@@ -1070,6 +1362,14 @@ collect_one_light_poly(bsp_t *bsp, mface_t *surf, mtexinfo_t *texinfo, int model
 				continue;
 			}
 
+			const int num_triangles = instance.len - 2;
+
+			if (!out)
+			{
+				count += num_triangles;
+				continue;
+			}
+
 			// Map the clipped polygon back onto the surface plane
 
 			vec3_t instance_positions[MAX_POLY_VERTS];
@@ -1082,67 +1382,207 @@ collect_one_light_poly(bsp_t *bsp, mface_t *surf, mtexinfo_t *texinfo, int model
 				VectorScale(tex_axis1, (instance.v[vert].y - tex_axis1[3]) * tex_axis1_inv_square_length, p1);
 				VectorAdd(p0, p1, point_on_texture_plane);
 
-				// Shoot a ray from that point in the texture normal direction,
-				// and intersect it with the surface plane.
+				// Shoot a ray from that point in the texture normal direction,
+				// and intersect it with the surface plane.
+
+				// plane: P.N + d = 0
+				// ray: P = At + B
+				// (At + B).N + d = 0
+				// (A.N)t + B.N + d = 0
+				// t = -(B.N + d) / (A.N)
+
+				float bn = DotProduct(point_on_texture_plane, plane);
+
+				float ray_t = -(bn + plane[3]) / surf_normal_dot_tex_normal;
+
+				vec3_t p2;
+				VectorScale(tex_normal, ray_t, p2);
+				VectorAdd(p2, point_on_texture_plane, instance_positions[vert]);
+			}
+
+			// Create triangles for the polygon, using a triangle fan topology
+
+			for (int i = 0; i < num_triangles; i++)
+			{
+				const int e = instance.len;
+
+				int i1 = (i + 2) % e;
+				int i2 = (i + 1) % e;
+
+				light_poly_t* light = out + count;
+				light->material = texinfo->material;
+				light->style = face->light_style;
+				light->emissive_factor = face->emissive_factor;
+				VectorCopy(instance_positions[0], light->positions + 0);
+				VectorCopy(instance_positions[i1], light->positions + 3);
+				VectorCopy(instance_positions[i2], light->positions + 6);
+				VectorScale(face->light_color, face->emissive_factor, light->color);
+				
+				get_triangle_off_center(light->positions, light->off_center, NULL, 1.f);
+
+				if (model_idx < 0)
+				{
+					// Find the cluster for this triangle
+					light->cluster = BSP_PointLeaf(bsp->nodes, light->off_center)->cluster;
+
+					if (light->cluster < 0)
+					{
+						// Cluster not found - which happens sometimes.
+						// The lighting system can't work with lights that have no cluster, so remove the triangle.
+						continue;
+					}
+				}
+				else
+				{
+					// It's a model: cluster will be determined after model instantiation.
+					light->cluster = -1;
+				}
+
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+
+static int
+collect_one_sky_or_lava_light_poly(bsp_mesh_t *wm, bsp_t *bsp, const light_face_t *face, light_poly_t *out)
+{
+	mface_t *surf = face->surf;
+	float positions[3 * /*max_vertices*/ 32];
+	int count = 0;
+
+	for (int i = 0; i < surf->numsurfedges; i++)
+	{
+		msurfedge_t *src_surfedge = surf->firstsurfedge + i;
+		medge_t     *src_edge = src_surfedge->edge;
+		mvertex_t   *src_vert = src_edge->v[src_surfedge->vert];
+
+		float *p = positions + i * 3;
+
+		VectorCopy(src_vert->point, p);
+	}
+
+	int num_vertices = surf->numsurfedges;
+	remove_collinear_edges(positions, NULL, NULL, &num_vertices);
+
+	const int num_triangles = num_vertices - 2;
+
+	for (int i = 0; i < num_triangles; i++)
+	{
+		int i1 = (i + 2) % num_vertices;
+		int i2 = (i + 1) % num_vertices;
+
+		light_poly_t light;
+		VectorCopy(positions, light.positions + 0);
+		VectorCopy(positions + i1 * 3, light.positions + 3);
+		VectorCopy(positions + i2 * 3, light.positions + 6);
+
+		if (face->kind == LIGHT_FACE_SKY)
+		{
+			VectorSet(light.color, -1.f, -1.f, -1.f); // special value for the sky
+			light.material = 0;
+		}
+		else
+		{
+			VectorCopy(surf->texinfo->material->image_emissive->light_color, light.color);
+			light.material = surf->texinfo->material;
+		}
+
+		light.style = 0;
+
+		if (!get_triangle_off_center(light.positions, light.off_center, NULL, 1.f))
+			continue;
+
+		light.cluster = BSP_PointLeaf(bsp->nodes, light.off_center)->cluster;
+		
+		if (is_sky_or_lava_cluster(wm, surf, light.cluster, surf->texinfo->material->flags) || face->skip_cluster_check)
+		{
+			memcpy(out + count, &light, sizeof(light_poly_t));
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static void
+count_light_face_range(void *arg, int begin, int end)
+{
+	light_face_job_t *job = arg;
+
+	for (int i = begin; i < end; i++)
+	{
+		light_face_t *face = job->faces + i;
 
-				// plane: P.N + d = 0
-				// ray: P = At + B
-				// (At + B).N + d = 0
-				// (A.N)t + B.N + d = 0
-				// t = -(B.N + d) / (A.N)
+		// The other kinds produce at most one light per surface triangle, counted up front
+		if (face->kind == LIGHT_FACE_TEXTURE_GRID)
+			face->num_lights = collect_one_light_poly(job->bsp, face, job->model_idx, NULL);
+	}
+}
 
-				float bn = DotProduct(point_on_texture_plane, plane);
+static void
+fill_light_face_range(void *arg, int begin, int end)
+{
+	light_face_job_t *job = arg;
 
-				float ray_t = -(bn + plane[3]) / surf_normal_dot_tex_normal;
+	for (int i = begin; i < end; i++)
+	{
+		light_face_t *face = job->faces + i;
+		light_poly_t *out = job->lights + face->first_light;
+		int count = 0;
 
-				vec3_t p2;
-				VectorScale(tex_normal, ray_t, p2);
-				VectorAdd(p2, point_on_texture_plane, instance_positions[vert]);
-			}
+		switch (face->kind)
+		{
+		case LIGHT_FACE_ENTIRE_TEXTURE:
+			count = collect_one_light_poly_entire_texture(job->bsp, face, job->model_idx, out);
+			break;
+		case LIGHT_FACE_TEXTURE_GRID:
+			count = collect_one_light_poly(job->bsp, face, job->model_idx, out);
+			break;
+		case LIGHT_FACE_SKY:
+		case LIGHT_FACE_LAVA:
+			count = collect_one_sky_or_lava_light_poly(job->wm, job->bsp, face, out);
+			break;
+		}
 
-			// Create triangles for the polygon, using a triangle fan topology
+		assert(count <= face->num_lights);
+		face->num_lights = count;
+	}
+}
 
-			const int num_triangles = instance.len - 2;
+// Converts the classified faces into light polys on the worker threads, each face
+// writing into its own reserved range of the light array. The ranges are compacted
+// in face order afterwards, so the result doesn't depend on the number of threads.
+static void
+collect_light_faces(bsp_mesh_t *wm, bsp_t *bsp, int model_idx, light_face_t *faces, int num_faces,
+					int* num_lights, int* allocated_lights, light_poly_t** lights)
+{
+	light_face_job_t job = { wm, bsp, model_idx, faces, NULL };
 
-			for (int i = 0; i < num_triangles; i++)
-			{
-				const int e = instance.len;
+	Com_ParallelFor(num_faces, LIGHT_FACE_GRAIN, count_light_face_range, &job);
 
-				int i1 = (i + 2) % e;
-				int i2 = (i + 1) % e;
+	int total = 0;
+	for (int i = 0; i < num_faces; i++)
+	{
+		faces[i].first_light = *num_lights + total;
+		total += faces[i].num_lights;
+	}
 
-				light_poly_t* light = append_light_poly(num_lights, allocated_lights, lights);
-				light->material = texinfo->material;
-				light->style = light_style;
-				light->emissive_factor = emissive_factor;
-				VectorCopy(instance_positions[0], light->positions + 0);
-				VectorCopy(instance_positions[i1], light->positions + 3);
-				VectorCopy(instance_positions[i2], light->positions + 6);
-				VectorScale(light_color, emissive_factor, light->color);
-				
-				get_triangle_off_center(light->positions, light->off_center, NULL, 1.f);
+	reserve_light_polys(num_lights, allocated_lights, lights, total);
 
-				if (model_idx < 0)
-				{
-					// Find the cluster for this triangle
-					light->cluster = BSP_PointLeaf(bsp->nodes, light->off_center)->cluster;
+	job.lights = *lights;
+	Com_ParallelFor(num_faces, LIGHT_FACE_GRAIN, fill_light_face_range, &job);
 
-					if (light->cluster < 0)
-					{
-						// Cluster not found - which happens sometimes.
-						// The lighting system can't work with lights that have no cluster, so remove the triangle.
-						(*num_lights)--;
-					}
-				}
-				else
-				{
-					// It's a model: cluster will be determined after model instantiation.
-					light->cluster = -1;
-				}
-			}
-		}
+	int count = *num_lights;
+	for (int i = 0; i < num_faces; i++)
+	{
+		if (faces[i].num_lights && faces[i].first_light != count)
+			memmove(*lights + count, *lights + faces[i].first_light, faces[i].num_lights * sizeof(light_poly_t));
+		count += faces[i].num_lights;
 	}
-
+	*num_lights = count;
 }
 
 static bool
@@ -1186,6 +1626,12 @@ collect_light_polys(bsp_mesh_t *wm, bsp_t *bsp, int model_idx, int* num_lights,
 	mface_t *surfaces = model_idx < 0 ? bsp->faces : bsp->models[model_idx].firstface;
 	int num_faces = model_idx < 0 ? bsp->numfaces : bsp->models[model_idx].numfaces;
 
+	if (num_faces <= 0)
+		return;
+
+	light_face_t *faces = Z_Malloc(num_faces * sizeof(light_face_t));
+	int num_light_faces = 0;
+
 	for (int i = 0; i < num_faces; i++)
 	{
 		mface_t *surf = surfaces + i;
@@ -1220,13 +1666,12 @@ collect_light_polys(bsp_mesh_t *wm, bsp_t *bsp, int model_idx, int* num_lights,
 		if(!any_light_frame)
 			continue;
 
+		light_face_t *face = faces + num_light_faces;
+
 		// Collect emissive texture info from across frames
 		bool entire_texture_emissive;
-		vec2_t min_light_texcoord;
-		vec2_t max_light_texcoord;
-		vec3_t light_color;
 
-		if (!collect_frames_emissive_info(texinfo->material, &entire_texture_emissive, min_light_texcoord, max_light_texcoord, light_color))
+		if (!collect_frames_emissive_info(texinfo->material, &entire_texture_emissive, face->min_light_texcoord, face->max_light_texcoord, face->light_color))
 		{
 			// This algorithm relies on information from the emissive texture,
 			// specifically the extents of the emissive pixels in that texture.
@@ -1234,38 +1679,49 @@ collect_light_polys(bsp_mesh_t *wm, bsp_t *bsp, int model_idx, int* num_lights,
 			continue;
 		}
 
-		float emissive_factor = compute_emissive(texinfo);
-		if(emissive_factor == 0)
+		face->emissive_factor = compute_emissive(texinfo);
+		if(face->emissive_factor == 0)
 			continue;
 
-		int light_style = (texinfo->material->light_styles) ? get_surf_light_style(surf) : 0;
+		face->surf = surf;
+		face->light_style = (texinfo->material->light_styles) ? get_surf_light_style(surf) : 0;
+		face->skip_cluster_check = false;
 
 		if (entire_texture_emissive)
 		{
-			collect_one_light_poly_entire_texture(bsp, surf, texinfo, model_idx, light_color, emissive_factor, light_style,
-												  num_lights, allocated_lights, lights);
+			face->kind = LIGHT_FACE_ENTIRE_TEXTURE;
+			face->num_lights = max(surf->numsurfedges - 2, 0);
+			num_light_faces++;
 			continue;
 		}
 
-		vec4_t plane;
-		if (!get_surf_plane_equation(surf, plane))
+		if (!get_surf_plane_equation(surf, face->plane))
 		{
 			// It's possible that some polygons in the game are degenerate, ignore these.
 			continue;
 		}
 
-		float tex_scale[2] = { 1.0f / texinfo->material->original_width, 1.0f / texinfo->material->original_height };
-
-		collect_one_light_poly(bsp, surf, texinfo, model_idx, plane,
-							   tex_scale, min_light_texcoord, max_light_texcoord,
-							   light_color, emissive_factor, light_style,
-							   num_lights, allocated_lights, lights);
+		face->kind = LIGHT_FACE_TEXTURE_GRID;
+		face->tex_scale[0] = 1.0f / texinfo->material->original_width;
+		face->tex_scale[1] = 1.0f / texinfo->material->original_height;
+		face->num_lights = 0;
+		num_light_faces++;
 	}
+
+	collect_light_faces(wm, bsp, model_idx, faces, num_light_faces, num_lights, allocated_lights, lights);
+
+	Z_Free(faces);
 }
 
 static void
 collect_sky_and_lava_light_polys(bsp_mesh_t *wm, bsp_t* bsp)
 {
+	if (bsp->numfaces <= 0)
+		return;
+
+	light_face_t *faces = Z_Malloc(bsp->numfaces * sizeof(light_face_t));
+	int num_light_faces = 0;
+
 	for (int i = 0; i < bsp->numfaces; i++)
 	{
 		mface_t *surf = bsp->faces + i;
@@ -1289,60 +1745,16 @@ collect_sky_and_lava_light_polys(bsp_mesh_t *wm, bsp_t* bsp)
 		if (!is_sky && !is_lava)
 			continue;
 
-		float positions[3 * /*max_vertices*/ 32];
-
-		for (int i = 0; i < surf->numsurfedges; i++)
-		{
-			msurfedge_t *src_surfedge = surf->firstsurfedge + i;
-			medge_t     *src_edge = src_surfedge->edge;
-			mvertex_t   *src_vert = src_edge->v[src_surfedge->vert];
-
-			float *p = positions + i * 3;
-
-			VectorCopy(src_vert->point, p);
-		}
-
-		int num_vertices = surf->numsurfedges;
-		remove_collinear_edges(positions, NULL, NULL, &num_vertices);
-
-		const int num_triangles = num_vertices - 2;
-
-		for (int i = 0; i < num_triangles; i++)
-		{
-			int i1 = (i + 2) % num_vertices;
-			int i2 = (i + 1) % num_vertices;
-
-			light_poly_t light;
-			VectorCopy(positions, light.positions + 0);
-			VectorCopy(positions + i1 * 3, light.positions + 3);
-			VectorCopy(positions + i2 * 3, light.positions + 6);
-
-			if (is_sky)
-			{
-				VectorSet(light.color, -1.f, -1.f, -1.f); // special value for the sky
-				light.material = 0;
-			}
-			else
-			{
-				VectorCopy(surf->texinfo->material->image_emissive->light_color, light.color);
-				light.material = surf->texinfo->material;
-			}
-
-			light.style = 0;
+		light_face_t *face = faces + num_light_faces++;
+		face->surf = surf;
+		face->kind = is_sky ? LIGHT_FACE_SKY : LIGHT_FACE_LAVA;
+		face->skip_cluster_check = cvar_pt_bsp_sky_lights->integer && is_sky && is_light && (cvar_pt_bsp_sky_lights->integer > 1 || !is_nodraw);
+		face->num_lights = max(surf->numsurfedges - 2, 0);
+	}
 
-			if (!get_triangle_off_center(light.positions, light.off_center, NULL, 1.f))
-				continue;
+	collect_light_faces(wm, bsp, -1, faces, num_light_faces, &wm->num_light_polys, &wm->allocated_light_polys, &wm->light_polys);
 
-			light.cluster = BSP_PointLeaf(bsp->nodes, light.off_center)->cluster;
-			
-			if (is_sky_or_lava_cluster(wm, surf, light.cluster, surf->texinfo->material->flags) ||
-				(cvar_pt_bsp_sky_lights->integer && is_sky && is_light && (cvar_pt_bsp_sky_lights->integer > 1 || !is_nodraw)))
-			{
-				light_poly_t* list_light = append_light_poly(&wm->num_light_polys, &wm->allocated_light_polys, &wm->light_polys);
-				memcpy(list_light, &light, sizeof(light_poly_t));
-			}
-		}
-	}
+	Z_Free(faces);
 }
 
 static bool
@@ -1420,78 +1832,6 @@ compute_aabb(const VboPrimitive* primitives, uint32_t numprims, float* aabb_min,
 	append_aabb(primitives, numprims, aabb_min, aabb_max);
 }
 
-void
-compute_world_tangents(bsp_t* bsp, bsp_mesh_t* wm)
-{
-	if (bsp->basisvectors)
-		return;
-
-	// Compute the tangent basis if it's not provided by the BSPX
-
-	for (int idx_tri = 0; idx_tri < wm->num_primitives; ++idx_tri)
-	{
-		VboPrimitive* prim = wm->primitives + idx_tri;
-		
-		float const * pA = prim->pos0;
-		float const * pB = prim->pos1;
-		float const * pC = prim->pos2;
-
-		float const * tA = prim->uv0;
-		float const * tB = prim->uv1;
-		float const * tC = prim->uv2;
-
-		vec3_t dP0, dP1;
-		VectorSubtract(pB, pA, dP0);
-		VectorSubtract(pC, pA, dP1);
-
-		vec2_t dt0, dt1;
-		Vector2Subtract(tB, tA, dt0);
-		Vector2Subtract(tC, tA, dt1);
-		
-		float r = 1.f / (dt0[0] * dt1[1] - dt1[0] * dt0[1]);
-
-		vec3_t sdir = {
-			(dt1[1] * dP0[0] - dt0[1] * dP1[0]) * r,
-			(dt1[1] * dP0[1] - dt0[1] * dP1[1]) * r,
-			(dt1[1] * dP0[2] - dt0[1] * dP1[2]) * r };
-
-		vec3_t tdir = {
-			(dt0[0] * dP1[0] - dt1[0] * dP0[0]) * r,
-			(dt0[0] * dP1[1] - dt1[0] * dP0[1]) * r,
-			(dt0[0] * dP1[2] - dt1[0] * dP0[2]) * r };
-
-		vec3_t normal;
-		CrossProduct(dP0, dP1, normal);
-		VectorNormalize(normal);
-
-		uint32_t encoded_normal = encode_normal(normal);
-		prim->normals[0] = encoded_normal;
-		prim->normals[1] = encoded_normal;
-		prim->normals[2] = encoded_normal;
-
-		vec3_t tangent;
-
-		vec3_t t;
-		VectorScale(normal, DotProduct(normal, sdir), t);
-		VectorSubtract(sdir, t, t);
-		VectorNormalize2(t, tangent); // Graham-Schmidt : t = normalize(t - n * (n.t))
-
-		uint32_t encoded_tangent = encode_normal(tangent);
-		prim->tangents[0] = encoded_tangent;
-		prim->tangents[1] = encoded_tangent;
-		prim->tangents[2] = encoded_tangent;
-
-		vec3_t cross;
-		CrossProduct(normal, t, cross);
-		float dot = DotProduct(cross, tdir);
-
-		if (dot < 0.0f)
-		{
-			prim->material_id |= MATERIAL_FLAG_HANDEDNESS;
-		}
-	}
-}
-
 static void
 load_sky_and_lava_clusters(bsp_mesh_t* wm, const char* map_name)
 {
@@ -1833,6 +2173,143 @@ bsp_mesh_create_custom_sky_prims(uint32_t* prim_ctr, bsp_mesh_t* wm, const bsp_t
 	return custom_sky_attrib.num_face_num_verts;
 }
 
+// Builds the primitives of the world and of all inline models. Every face is classified once,
+// the entries are laid out by bucket, and the primitives are then emitted in parallel into
+// their precomputed ranges, along with the clusters and tangents.
+static void
+collect_surfaces(bsp_mesh_t *wm, bsp_t *bsp, uint32_t num_custom_sky_prims)
+{
+	surface_class_t *classes = Z_Malloc(max(bsp->numfaces, 1) * sizeof(surface_class_t));
+	int num_bucket_entries[SURF_BUCKET_COUNT] = { 0 };
+
+	for (int i = 0; i < bsp->numfaces; i++)
+		classes[i].model_idx = -1;
+
+	for (int k = 0; k < bsp->nummodels; k++)
+	{
+		for (int i = 0; i < bsp->models[k].numfaces; i++)
+			classes[bsp->models[k].firstface - bsp->faces + i].model_idx = k;
+	}
+
+	for (int i = 0; i < bsp->numfaces; i++)
+	{
+		surface_class_t *surf_class = classes + i;
+		classify_surface(bsp->faces + i, surf_class->model_idx >= 0, surf_class);
+
+		for (int b = 0; b < SURF_BUCKET_COUNT; b++)
+		{
+			if (surf_class->buckets & BIT(b))
+				num_bucket_entries[b]++;
+		}
+	}
+
+	int num_entries = 0;
+	for (int b = 0; b < SURF_BUCKET_COUNT; b++)
+		num_entries += num_bucket_entries[b];
+
+	surface_entry_t *entries = Z_Malloc(max(num_entries, 1) * sizeof(surface_entry_t));
+	int bucket_first_entry[SURF_BUCKET_MODEL + 1];
+	uint32_t bucket_first_prim[SURF_BUCKET_MODEL + 1];
+	uint32_t custom_sky_first_prim = 0;
+	uint32_t prim_ctr = 0;
+	int entry_ctr = 0;
+
+	// Lay out the world buckets in the order the renderer expects them,
+	// with the custom sky primitives between the sky and the nodraw sky lights.
+
+	for (int b = 0; b < SURF_BUCKET_MODEL; b++)
+	{
+		if (b == SURF_BUCKET_NODRAW_SKY_LIGHTS)
+		{
+			custom_sky_first_prim = prim_ctr;
+			prim_ctr += num_custom_sky_prims;
+		}
+
+		bucket_first_entry[b] = entry_ctr;
+		bucket_first_prim[b] = prim_ctr;
+
+		for (int i = 0; i < bsp->numfaces; i++)
+		{
+			if (classes[i].buckets & BIT(b))
+				add_surface_entry(wm, classes + i, bsp->faces + i, entries + entry_ctr++, &prim_ctr);
+		}
+	}
+
+	bucket_first_entry[SURF_BUCKET_MODEL] = entry_ctr;
+	bucket_first_prim[SURF_BUCKET_MODEL] = prim_ctr;
+
+	for (int k = 0; k < bsp->nummodels; k++)
+	{
+		bsp_model_t* model = wm->models + k;
+		uint32_t first_prim = prim_ctr;
+
+		for (int i = 0; i < bsp->models[k].numfaces; i++)
+		{
+			mface_t *surf = bsp->models[k].firstface + i;
+			surface_class_t *surf_class = classes + (surf - bsp->faces);
+
+			if (surf_class->model_idx == k && (surf_class->buckets & BIT(SURF_BUCKET_MODEL)))
+				add_surface_entry(wm, surf_class, surf, entries + entry_ctr++, &prim_ctr);
+		}
+
+		vkpt_init_model_geometry(&model->geometry, 1);
+		vkpt_append_model_geometry(&model->geometry, prim_ctr - first_prim, first_prim, "bsp_model");
+	}
+
+	Z_Free(classes);
+
+	wm->num_primitives_allocated = max(prim_ctr, 1);
+	wm->primitives = Z_Malloc(wm->num_primitives_allocated * sizeof(VboPrimitive));
+
+	if (num_custom_sky_prims > 0)
+	{
+		uint32_t custom_sky_ctr = custom_sky_first_prim;
+		bsp_mesh_create_custom_sky_prims(&custom_sky_ctr, wm, bsp);
+		assert(custom_sky_ctr == custom_sky_first_prim + num_custom_sky_prims);
+
+		if (!bsp->basisvectors)
+			compute_prim_tangents(wm->primitives + custom_sky_first_prim, num_custom_sky_prims);
+	}
+
+	surface_job_t job = {
+		.wm = wm,
+		.bsp = bsp,
+		.entries = entries,
+		.anti_clusters = bsp->pvs_patched ? NULL : Z_Malloc(wm->num_primitives_allocated * sizeof(int)),
+		.sky_lights = cvar_pt_bsp_sky_lights->integer
+	};
+
+	// The OBJ dump writes from create_poly, keep it on one thread
+	Com_ParallelFor(num_entries, DUMP_WORLD_MESH_TO_OBJ ? max(num_entries, 1) : SURFACE_GRAIN, emit_surface_range, &job);
+
+	if (job.anti_clusters)
+	{
+		for (int b = 0; b < SURF_BUCKET_MODEL; b++)
+		{
+			int last_entry = bucket_first_entry[b + 1];
+			bool any_pvs_patches = false;
+
+			for (int i = bucket_first_entry[b]; i < last_entry; i++)
+				any_pvs_patches |= patch_surface_pvs(bsp, wm->primitives, job.anti_clusters, entries + i);
+
+			if (any_pvs_patches)
+				make_pvs_symmetric(bsp);
+		}
+
+		Z_Free(job.anti_clusters);
+	}
+
+	Z_Free(entries);
+
+	vkpt_append_model_geometry(&wm->geom_opaque, bucket_first_prim[SURF_BUCKET_TRANSPARENT] - bucket_first_prim[SURF_BUCKET_OPAQUE], bucket_first_prim[SURF_BUCKET_OPAQUE], "bsp");
+	vkpt_append_model_geometry(&wm->geom_transparent, bucket_first_prim[SURF_BUCKET_MASKED] - bucket_first_prim[SURF_BUCKET_TRANSPARENT], bucket_first_prim[SURF_BUCKET_TRANSPARENT], "bsp");
+	vkpt_append_model_geometry(&wm->geom_masked, bucket_first_prim[SURF_BUCKET_SKY] - bucket_first_prim[SURF_BUCKET_MASKED], bucket_first_prim[SURF_BUCKET_MASKED], "bsp");
+	vkpt_append_model_geometry(&wm->geom_sky, custom_sky_first_prim - bucket_first_prim[SURF_BUCKET_SKY], bucket_first_prim[SURF_BUCKET_SKY], "bsp");
+	vkpt_append_model_geometry(&wm->geom_custom_sky, bucket_first_prim[SURF_BUCKET_MODEL] - custom_sky_first_prim, custom_sky_first_prim, "bsp");
+
+	wm->num_primitives = prim_ctr;
+}
+
 void
 bsp_mesh_create_from_bsp(bsp_mesh_t *wm, bsp_t *bsp, const char* map_name)
 {
@@ -1858,22 +2335,13 @@ bsp_mesh_create_from_bsp(bsp_mesh_t *wm, bsp_t *bsp, const char* map_name)
 		Com_Error(ERR_FATAL, "The BSP model has too many clusters (%d)", wm->num_clusters);
 	}
 	
-	wm->num_primitives_allocated = count_triangles(bsp);
-
 	uint32_t num_custom_sky_prims = bsp_mesh_load_custom_sky(full_game_map_name);
-	if (num_custom_sky_prims > 0)
-		wm->num_primitives_allocated += num_custom_sky_prims;
-
-	wm->primitives = Z_Malloc(wm->num_primitives_allocated * sizeof(VboPrimitive));
-	wm->num_primitives = 0;
 
 	// clear these here because `bsp_mesh_load_custom_sky` creates lights before `collect_light_polys`
 	wm->num_light_polys = 0;
 	wm->allocated_light_polys = 0;
 	wm->light_polys = NULL;
 
-    uint32_t prim_ctr = 0;
-
 #if DUMP_WORLD_MESH_TO_OBJ
 	{
 		char filename[MAX_QPATH];
@@ -1889,36 +2357,7 @@ bsp_mesh_create_from_bsp(bsp_mesh_t *wm, bsp_t *bsp, const char* map_name)
 	vkpt_init_model_geometry(&wm->geom_sky, 1);
 	vkpt_init_model_geometry(&wm->geom_custom_sky, 1);
 
-	uint32_t first_prim = prim_ctr;
-	collect_surfaces(&prim_ctr, wm, bsp, -1, filter_static_opaque);
-	vkpt_append_model_geometry(&wm->geom_opaque, prim_ctr - first_prim, first_prim, "bsp");
-
-	first_prim = prim_ctr;
-	collect_surfaces(&prim_ctr, wm, bsp, -1, filter_static_transparent);
-	vkpt_append_model_geometry(&wm->geom_transparent, prim_ctr - first_prim, first_prim, "bsp");
-
-	first_prim = prim_ctr;
-	collect_surfaces(&prim_ctr, wm, bsp, -1, filter_static_masked);
-	vkpt_append_model_geometry(&wm->geom_masked, prim_ctr - first_prim, first_prim, "bsp");
-
-	first_prim = prim_ctr;
-	collect_surfaces(&prim_ctr, wm, bsp, -1, filter_static_sky);
-	vkpt_append_model_geometry(&wm->geom_sky, prim_ctr - first_prim, first_prim, "bsp");
-	
-	first_prim = prim_ctr;
-	if (num_custom_sky_prims > 0)
-		bsp_mesh_create_custom_sky_prims(&prim_ctr, wm, bsp);
-	if (cvar_pt_bsp_sky_lights->integer > 1)
-		collect_surfaces(&prim_ctr, wm, bsp, -1, filter_nodraw_sky_lights);
-	vkpt_append_model_geometry(&wm->geom_custom_sky, prim_ctr - first_prim, first_prim, "bsp");
-
-    for (int k = 0; k < bsp->nummodels; k++) {
-		bsp_model_t* model = wm->models + k;
-		first_prim = prim_ctr;
-		collect_surfaces(&prim_ctr, wm, bsp, k, filter_all);
-		vkpt_init_model_geometry(&model->geometry, 1);
-		vkpt_append_model_geometry(&model->geometry, prim_ctr - first_prim, first_prim, "bsp_model");
-    }
+	collect_surfaces(wm, bsp, num_custom_sky_prims);
 
 #if DUMP_WORLD_MESH_TO_OBJ
 	fclose(obj_dump_file);
@@ -1935,10 +2374,6 @@ bsp_mesh_create_from_bsp(bsp_mesh_t *wm, bsp_t *bsp, const char* map_name)
 		}
 	}
 
-	wm->num_primitives = prim_ctr;
-	
-	compute_world_tangents(bsp, wm);
-	
 	for(int i = 0; i < wm->num_models; i++) 
 	{
 		bsp_model_t* model = wm->models + i;
@@ -2064,7 +2499,7 @@ bsp_mesh_register_textures(bsp_t *bsp)
 	}
 }
 
-static void animate_light_polys(int num_light_polys, light_poly_t *light_polys)
+static void animate_light_polys(int num_light_polys, light_poly_t *light_polys, byte *dirty)
 {
 	for (int i = 0; i < num_light_polys; i++)
 	{
@@ -2079,16 +2514,19 @@ static void animate_light_polys(int num_light_polys, light_poly_t *light_polys)
 			VectorScale(new_material->image_emissive->light_color, emissive_factor, light_polys[i].color);
 		else
 			VectorSet(light_polys[i].color, 0, 0, 0);
+
+		if (dirty && i < MAX_LIGHT_POLYS)
+			Q_SetBit(dirty, i);
 	}
 }
 
 void bsp_mesh_animate_light_polys(bsp_mesh_t *wm)
 {
-	animate_light_polys(wm->num_light_polys, wm->light_polys);
+	animate_light_polys(wm->num_light_polys, wm->light_polys, wm->light_polys_dirty);
 	for (int k = 0; k < wm->num_models; k++)
 	{
 		bsp_model_t* model = wm->models + k;
-		animate_light_polys(model->num_light_polys, model->light_polys);
+		animate_light_polys(model->num_light_polys, model->light_polys, NULL);
 	}
 }
 
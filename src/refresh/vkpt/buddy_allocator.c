@@ -39,6 +39,7 @@ typedef struct BuddyAllocator
 {
 	uint32_t block_size;
 	uint32_t level_num;
+	uint32_t num_allocations;
 	struct AllocatorFreeListItem** free_block_lists;
 	uint8_t* block_states;
 	struct AllocatorFreeListItem* free_items;
@@ -130,6 +131,7 @@ BAResult buddy_allocator_allocate(BuddyAllocator* allocator, uint64_t size, uint
 
 	*offset = item->block_index * block_size;
 	free_list_item(allocator, item);
+	allocator->num_allocations++;
 
 	return BA_SUCCESS;
 }
@@ -146,6 +148,31 @@ void buddy_allocator_free(BuddyAllocator* allocator, uint64_t offset, uint64_t s
 
 	if (!merge_blocks(allocator, level, block_index))
 		write_free_block_to_list(allocator, level, block_index);
+
+	assert(allocator->num_allocations > 0);
+	allocator->num_allocations--;
+}
+
+void buddy_allocator_get_stats(const BuddyAllocator* allocator, BuddyAllocatorStats* stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->capacity = (uint64_t)allocator->block_size << (allocator->level_num - 1);
+	stats->num_allocations = allocator->num_allocations;
+
+	uint64_t free_size = 0;
+	for (uint32_t level = 0; level < allocator->level_num; level++)
+	{
+		const uint64_t block_size = (uint64_t)allocator->block_size << level;
+
+		for (const AllocatorFreeListItem* item = allocator->free_block_lists[level]; item; item = item->next)
+		{
+			free_size += block_size;
+			stats->num_free_blocks++;
+			stats->largest_free = block_size;
+		}
+	}
+
+	stats->allocated = stats->capacity - free_size;
 }
 
 void destroy_buddy_allocator(BuddyAllocator* allocator)
@@ -294,3 +321,98 @@ static inline uint32_t get_next_level_offset(BuddyAllocator* allocator, uint32_t
 {
 	return offset + (1 << ((allocator->level_num - 1) - prev_level));
 }
+
+#if USE_TESTS
+// Random allocations and frees checked against a block ownership map:
+// no two allocations may overlap, and freeing everything has to merge
+// the blocks back into a single free block.
+void buddy_allocator_test(void)
+{
+	enum { BLOCK_SIZE = 256, LEVELS = 14, MAX_LIVE = 512, STEPS = 100000 };
+	const uint64_t capacity = (uint64_t)BLOCK_SIZE << (LEVELS - 1);
+	const uint32_t num_blocks = 1 << (LEVELS - 1);
+
+	BuddyAllocator* allocator = create_buddy_allocator(capacity, BLOCK_SIZE);
+	uint16_t* owners = Z_Mallocz(num_blocks * sizeof(uint16_t));
+	struct { uint64_t offset, size; } live[MAX_LIVE];
+	int num_live = 0, errors = 0, failures = 0;
+	uint64_t requested = 0;
+
+	Q_srand(1);
+	for (int step = 0; step < STEPS && !errors; step++)
+	{
+		if (num_live < MAX_LIVE && (num_live == 0 || Q_rand_uniform(3)))
+		{
+			// mostly small allocations with an occasional large one
+			uint64_t size = 1 + Q_rand_uniform(Q_rand_uniform(16) ? BLOCK_SIZE * 8 : capacity / 8);
+			uint64_t offset;
+
+			if (buddy_allocator_allocate(allocator, size, BLOCK_SIZE, &offset) != BA_SUCCESS)
+			{
+				failures++;
+				continue;
+			}
+
+			if (offset + size > capacity)
+				errors++;
+
+			for (uint64_t b = offset / BLOCK_SIZE; b < (offset + size + BLOCK_SIZE - 1) / BLOCK_SIZE && b < num_blocks; b++)
+			{
+				if (owners[b])
+					errors++;
+				owners[b] = num_live + 1;
+			}
+
+			live[num_live].offset = offset;
+			live[num_live].size = size;
+			requested += size;
+			num_live++;
+		}
+		else
+		{
+			int i = Q_rand_uniform(num_live);
+
+			for (uint64_t b = live[i].offset / BLOCK_SIZE; b < (live[i].offset + live[i].size + BLOCK_SIZE - 1) / BLOCK_SIZE; b++)
+				owners[b] = 0;
+
+			buddy_allocator_free(allocator, live[i].offset, live[i].size);
+			requested -= live[i].size;
+
+			// keep the owner tags in sync with the moved entry
+			if (i != num_live - 1)
+			{
+				live[i] = live[num_live - 1];
+				for (uint64_t b = live[i].offset / BLOCK_SIZE; b < (live[i].offset + live[i].size + BLOCK_SIZE - 1) / BLOCK_SIZE; b++)
+					owners[b] = i + 1;
+			}
+			num_live--;
+		}
+
+		BuddyAllocatorStats stats;
+		buddy_allocator_get_stats(allocator, &stats);
+		if (stats.num_allocations != (uint32_t)num_live || stats.allocated < requested || stats.allocated > capacity)
+			errors++;
+	}
+
+	BuddyAllocatorStats stats;
+	buddy_allocator_get_stats(allocator, &stats);
+	Com_Printf("%d allocations live, %"PRIu64" of %"PRIu64" bytes allocated for %"PRIu64" requested, "
+		"%u free blocks, largest %"PRIu64"\n", num_live, stats.allocated, stats.capacity, requested,
+		stats.num_free_blocks, stats.largest_free);
+
+	while (num_live > 0)
+	{
+		num_live--;
+		buddy_allocator_free(allocator, live[num_live].offset, live[num_live].size);
+	}
+
+	buddy_allocator_get_stats(allocator, &stats);
+	if (stats.num_allocations || stats.allocated || stats.num_free_blocks != 1 || stats.largest_free != capacity)
+		errors++;
+
+	Com_Printf("%d failed allocations, %s\n", failures, errors ? "ERRORS FOUND" : "all checks passed");
+
+	Z_Free(owners);
+	destroy_buddy_allocator(allocator);
+}
+#endif
@@ -28,7 +28,21 @@ typedef enum
 
 typedef struct BuddyAllocator BuddyAllocator;
 
+typedef struct BuddyAllocatorStats
+{
+	uint64_t capacity;
+	uint64_t allocated;     // in whole blocks, including the rounding to power-of-2 sizes
+	uint64_t largest_free;
+	uint32_t num_allocations;
+	uint32_t num_free_blocks;
+} BuddyAllocatorStats;
+
 BuddyAllocator* create_buddy_allocator(uint64_t capacity, uint64_t block_size);
 BAResult buddy_allocator_allocate(BuddyAllocator* allocator, uint64_t size, uint64_t alignment, uint64_t* offset);
 void buddy_allocator_free(BuddyAllocator* allocator, uint64_t offset, uint64_t size);
+void buddy_allocator_get_stats(const BuddyAllocator* allocator, BuddyAllocatorStats* stats);
 void destroy_buddy_allocator(BuddyAllocator* allocator);
+
+#if USE_TESTS
+void buddy_allocator_test(void);
+#endif
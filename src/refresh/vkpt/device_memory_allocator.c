@@ -45,6 +45,9 @@ typedef struct DeviceMemoryAllocator
 {
 	SubAllocator* sub_allocators[VK_MAX_MEMORY_TYPES];
     VkDevice device;
+    uint32_t block_size;
+    uint32_t capacity;
+    VkMemoryAllocateFlags flags;
     size_t total_memory_allocated;
     size_t total_memory_used;
 } DeviceMemoryAllocator;
@@ -52,17 +55,33 @@ typedef struct DeviceMemoryAllocator
 int create_sub_allocator(DeviceMemoryAllocator* allocator, uint32_t memory_type, uint32_t alignment);
 
 DeviceMemoryAllocator* create_device_memory_allocator(VkDevice device)
+{
+	return create_device_memory_allocator_ex(device, ALLOCATOR_BLOCK_SIZE, ALLOCATOR_CAPACITY, 0);
+}
+
+// Capacity must be a power-of-2 multiple of block_size. Flags are passed to vkAllocateMemory,
+// e.g. VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT for memory bound to acceleration structure inputs.
+DeviceMemoryAllocator* create_device_memory_allocator_ex(VkDevice device, uint32_t block_size, uint32_t capacity, VkMemoryAllocateFlags flags)
 {
 	char* memory = Z_Mallocz(sizeof(DeviceMemoryAllocator));
 
 	DeviceMemoryAllocator* allocator = (DeviceMemoryAllocator*)memory;
 	allocator->device = device;
+	allocator->block_size = block_size;
+	allocator->capacity = capacity;
+	allocator->flags = flags;
 
 	return allocator;
 }
 
 DMAResult allocate_device_memory(DeviceMemoryAllocator* allocator, DeviceMemory* device_memory)
 {
+	if (device_memory->size > allocator->capacity)
+	{
+		device_memory->memory = VK_NULL_HANDLE;
+		return DMA_NOT_ENOUGH_MEMORY;
+	}
+
 	const uint32_t memory_type = device_memory->memory_type;
 	if (allocator->sub_allocators[memory_type] == NULL)
 	{
@@ -70,8 +89,6 @@ DMAResult allocate_device_memory(DeviceMemoryAllocator* allocator, DeviceMemory*
 			return DMA_NOT_ENOUGH_MEMORY;
 	}
 
-	assert(device_memory->size <= ALLOCATOR_CAPACITY);
-
 	BAResult result = BA_NOT_ENOUGH_MEMORY;
 	SubAllocator* sub_allocator = allocator->sub_allocators[memory_type];
 
@@ -123,6 +140,36 @@ void free_device_memory(DeviceMemoryAllocator* allocator, const DeviceMemory* de
 	allocator->total_memory_used -= device_memory->size;
 }
 
+// Releases the device memory of sub-allocators that have no allocations left
+void trim_device_memory_allocator(DeviceMemoryAllocator* allocator)
+{
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+	{
+		SubAllocator** prev_next = &allocator->sub_allocators[i];
+
+		while (*prev_next != NULL)
+		{
+			SubAllocator* sub_allocator = *prev_next;
+
+			if (sub_allocator->memory_used == 0)
+			{
+				BuddyAllocatorStats stats;
+				buddy_allocator_get_stats(sub_allocator->buddy_allocator, &stats);
+
+				vkFreeMemory(allocator->device, sub_allocator->memory, NULL);
+				destroy_buddy_allocator(sub_allocator->buddy_allocator);
+				allocator->total_memory_allocated -= stats.capacity;
+
+				*prev_next = sub_allocator->next;
+				Z_Free(sub_allocator);
+				continue;
+			}
+
+			prev_next = &sub_allocator->next;
+		}
+	}
+}
+
 void destroy_device_memory_allocator(DeviceMemoryAllocator* allocator)
 {
 	assert(allocator->total_memory_used == 0);
@@ -146,15 +193,15 @@ int create_sub_allocator(DeviceMemoryAllocator* allocator, uint32_t memory_type,
 {
 	SubAllocator* sub_allocator = (SubAllocator*)Z_Mallocz(sizeof(SubAllocator));
 
-	uint32_t block_size = ALLOCATOR_BLOCK_SIZE;
-	uint32_t capacity = ALLOCATOR_CAPACITY;
+	uint32_t block_size = allocator->block_size;
+	uint32_t capacity = allocator->capacity;
 
 	if (alignment > block_size)
 	{
 		block_size = alignment;
 		capacity = 1;
 
-		while (capacity < ALLOCATOR_CAPACITY)
+		while (capacity < allocator->capacity)
 			capacity *= 2;
 	}
 
@@ -164,18 +211,23 @@ int create_sub_allocator(DeviceMemoryAllocator* allocator, uint32_t memory_type,
 		.memoryTypeIndex = memory_type
 	};
 
-#ifdef VKPT_DEVICE_GROUPS
 	VkMemoryAllocateFlagsInfo mem_alloc_flags = {
 		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
-		.flags = VK_MEMORY_ALLOCATE_DEVICE_MASK_BIT,
-		.deviceMask = (1 << qvk.device_count) - 1
+		.flags = allocator->flags,
+		.deviceMask = 0
 	};
 
+#ifdef VKPT_DEVICE_GROUPS
 	if (qvk.device_count > 1) {
-		memory_allocate_info.pNext = &mem_alloc_flags;
+		mem_alloc_flags.flags |= VK_MEMORY_ALLOCATE_DEVICE_MASK_BIT;
+		mem_alloc_flags.deviceMask = (1 << qvk.device_count) - 1;
 	}
 #endif
 
+	if (mem_alloc_flags.flags) {
+		memory_allocate_info.pNext = &mem_alloc_flags;
+	}
+
 	const VkResult result = vkAllocateMemory(allocator->device, &memory_allocate_info, NULL, &sub_allocator->memory);
 	if (result != VK_SUCCESS)
 		return 0;
@@ -194,3 +246,24 @@ void get_device_malloc_stats(DeviceMemoryAllocator* allocator, size_t* memory_al
     if (memory_allocated) *memory_allocated = allocator->total_memory_allocated;
     if (memory_used) *memory_used = allocator->total_memory_used;
 }
+
+// Sums the buddy allocator stats over all sub-allocators, largest_free is the largest of them
+void get_device_malloc_block_stats(DeviceMemoryAllocator* allocator, BuddyAllocatorStats* stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+	{
+		for (SubAllocator* sub_allocator = allocator->sub_allocators[i]; sub_allocator; sub_allocator = sub_allocator->next)
+		{
+			BuddyAllocatorStats sub_stats;
+			buddy_allocator_get_stats(sub_allocator->buddy_allocator, &sub_stats);
+
+			stats->capacity += sub_stats.capacity;
+			stats->allocated += sub_stats.allocated;
+			stats->largest_free = max(stats->largest_free, sub_stats.largest_free);
+			stats->num_allocations += sub_stats.num_allocations;
+			stats->num_free_blocks += sub_stats.num_free_blocks;
+		}
+	}
+}
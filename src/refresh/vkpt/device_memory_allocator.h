@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #pragma once
 #include <stdint.h>
+#include "buddy_allocator.h"
 
 typedef enum
 {
@@ -37,7 +38,10 @@ typedef struct DeviceMemory
 typedef struct DeviceMemoryAllocator DeviceMemoryAllocator;
 
 DeviceMemoryAllocator* create_device_memory_allocator(VkDevice device);
+DeviceMemoryAllocator* create_device_memory_allocator_ex(VkDevice device, uint32_t block_size, uint32_t capacity, VkMemoryAllocateFlags flags);
 DMAResult allocate_device_memory(DeviceMemoryAllocator* allocator, DeviceMemory* device_memory);
 void free_device_memory(DeviceMemoryAllocator* allocator, const DeviceMemory* device_memory);
+void trim_device_memory_allocator(DeviceMemoryAllocator* allocator);
 void destroy_device_memory_allocator(DeviceMemoryAllocator* allocator);
-void get_device_malloc_stats(DeviceMemoryAllocator* allocator, size_t* memory_allocated, size_t* memory_used);
\ No newline at end of file
+void get_device_malloc_stats(DeviceMemoryAllocator* allocator, size_t* memory_allocated, size_t* memory_used);
+void get_device_malloc_block_stats(DeviceMemoryAllocator* allocator, BuddyAllocatorStats* stats);
\ No newline at end of file
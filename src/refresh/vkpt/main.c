@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "shared/shared.h"
+#include "common/async.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
 #include "common/common.h"
@@ -34,6 +35,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "material.h"
 #include "fog.h"
 #include "cameras.h"
+#include "texture_cache.h"
 #include "physical_sky.h"
 #include "conversion.h"
 #include "../../client/client.h"
@@ -1169,8 +1171,10 @@ init_vulkan(void)
 		};
 		vkGetPhysicalDeviceFeatures2(qvk.physical_device, &device_features);
 		qvk.supports_fp16 = device_features_1_2.shaderFloat16 && features_16bit_storage.storageBuffer16BitAccess;
+		qvk.supports_bc = device_features.features.textureCompressionBC;
 	}
 	Com_Printf("FP16 support: %s\n", qvk.supports_fp16 ? "yes" : "no");
+	Com_Printf("BC texture support: %s\n", qvk.supports_bc ? "yes" : "no");
 
 	vkGetPhysicalDeviceMemoryProperties(qvk.physical_device, &qvk.mem_properties);
 
@@ -1295,7 +1299,7 @@ init_vulkan(void)
 			.samplerAnisotropy = VK_TRUE,
 			.textureCompressionETC2 = VK_FALSE,
 			.textureCompressionASTC_LDR = VK_FALSE,
-			.textureCompressionBC = VK_FALSE,
+			.textureCompressionBC = qvk.supports_bc,
 			.occlusionQueryPrecise = VK_FALSE,
 			.pipelineStatisticsQuery = VK_TRUE,
 			.vertexPipelineStoresAndAtomics = VK_FALSE,
@@ -1582,6 +1586,105 @@ static int model_entity_id_count[2];
 static int iqm_matrix_count[2];
 static ModelInstance model_instances_prev[MAX_MODEL_INSTANCES];
 
+// Entities sharing a model and animation pose share one block of IQM matrices.
+// Backlerp is quantized so that near-identical poses hit the same entry.
+// Poses are only allocated while walking the entities, and computed in
+// parallel once all of them are known.
+#define IQM_POSE_QUANT 256
+#define IQM_POSE_HASH_SIZE (MAX_ENTITIES * 2)
+
+typedef struct iqm_pose_s {
+	const iqm_model_t* model;
+	int frame;
+	int oldframe;
+	int backlerp;
+	int matrix_offset;
+} iqm_pose_t;
+
+static iqm_pose_t iqm_poses[MAX_ENTITIES];
+static int iqm_pose_count;
+static uint16_t iqm_pose_hash[IQM_POSE_HASH_SIZE]; // index + 1 into iqm_poses
+
+static void reset_iqm_poses(void)
+{
+	memset(iqm_pose_hash, 0, sizeof(iqm_pose_hash));
+	iqm_pose_count = 0;
+}
+
+static int get_iqm_pose_matrices(const iqm_model_t* iqm, const entity_t* entity, int* iqm_matrix_offset, float* iqm_matrix_data)
+{
+	int frame = iqm->num_frames ? entity->frame % (int)iqm->num_frames : 0;
+	int oldframe = iqm->num_frames ? entity->oldframe % (int)iqm->num_frames : 0;
+	int backlerp = (frame == oldframe) ? 0 : (int)(entity->backlerp * IQM_POSE_QUANT + 0.5f);
+
+	if (backlerp == 0)
+		oldframe = frame;
+	else if (backlerp == IQM_POSE_QUANT)
+	{
+		frame = oldframe;
+		backlerp = 0;
+	}
+
+	uint32_t hash = ((uint32_t)(uintptr_t)iqm >> 4) * 0x9E3779B1u;
+	hash ^= (uint32_t)frame * 0x85EBCA77u ^ (uint32_t)oldframe * 0xC2B2AE3Du ^ (uint32_t)backlerp * 0x27D4EB2Fu;
+	hash ^= hash >> 16;
+
+	uint16_t* slot = NULL;
+	for (uint32_t i = 0; i < IQM_POSE_HASH_SIZE; i++)
+	{
+		uint16_t* entry = &iqm_pose_hash[(hash + i) & (IQM_POSE_HASH_SIZE - 1)];
+		if (!*entry)
+		{
+			slot = entry;
+			break;
+		}
+
+		const iqm_pose_t* pose = &iqm_poses[*entry - 1];
+		if (pose->model == iqm && pose->frame == frame && pose->oldframe == oldframe && pose->backlerp == backlerp)
+			return pose->matrix_offset;
+	}
+
+	int matrix_offset = *iqm_matrix_offset;
+	if (matrix_offset + iqm->num_poses > MAX_IQM_MATRICES)
+	{
+		assert(!"IQM matrix buffer overflow");
+		return -1;
+	}
+
+	*iqm_matrix_offset += (int)iqm->num_poses;
+
+	if (!slot || iqm_pose_count >= MAX_ENTITIES)
+	{
+		// out of pose slots, compute right away
+		R_ComputeIQMPose(iqm, frame, oldframe, (float)backlerp / IQM_POSE_QUANT, iqm_matrix_data + (matrix_offset * 12));
+		return matrix_offset;
+	}
+
+	iqm_pose_t* pose = &iqm_poses[iqm_pose_count++];
+	pose->model = iqm;
+	pose->frame = frame;
+	pose->oldframe = oldframe;
+	pose->backlerp = backlerp;
+	pose->matrix_offset = matrix_offset;
+	*slot = (uint16_t)iqm_pose_count;
+
+	return matrix_offset;
+}
+
+#define IQM_POSE_GRAIN 4
+
+static void compute_iqm_poses(void* arg, int begin, int end)
+{
+	float* iqm_matrix_data = arg;
+
+	for (int i = begin; i < end; i++)
+	{
+		const iqm_pose_t* pose = &iqm_poses[i];
+		R_ComputeIQMPose(pose->model, pose->frame, pose->oldframe, (float)pose->backlerp / IQM_POSE_QUANT,
+			iqm_matrix_data + (pose->matrix_offset * 12));
+	}
+}
+
 #define MAX_MODEL_LIGHTS 16384
 static int num_model_lights = 0;
 static light_poly_t model_lights[MAX_MODEL_LIGHTS];
@@ -1673,12 +1776,8 @@ static material_and_shell_t compute_mesh_material_flags(const entity_t* entity,
 }
 
 static void fill_model_instance(ModelInstance* instance, const entity_t* entity, const model_t* model, const maliasmesh_t* mesh,
-	const float* transform, material_and_shell_t mat_shell, int instance_index, int iqm_matrix_index)
+	const float* transform, int cluster, material_and_shell_t mat_shell, int instance_index, int iqm_matrix_index)
 {
-	int cluster = -1;
-	if (bsp_world_model)
-		cluster = BSP_PointLeaf(bsp_world_model->nodes, entity->origin)->cluster;
-	
 	int frame = entity->frame;
 	int oldframe = entity->oldframe;
 	if (frame >= model->numframes) frame = 0;
@@ -1763,18 +1862,12 @@ static inline void transform_point(const float* p, const float* matrix, float* r
 	VectorCopy(transformed, result); // vec4 -> vec3
 }
 
-static void instance_model_lights(int num_light_polys, const light_poly_t* light_polys, const float* transform)
+static void transform_model_lights(int num_light_polys, const light_poly_t* light_polys, const float* transform, light_poly_t* dst_lights)
 {
 	for (int nlight = 0; nlight < num_light_polys; nlight++)
 	{
-		if (num_model_lights >= MAX_MODEL_LIGHTS)
-		{
-			assert(!"Model light count overflow");
-			break;
-		}
-
 		const light_poly_t* src_light = light_polys + nlight;
-		light_poly_t* dst_light = model_lights + num_model_lights;
+		light_poly_t* dst_light = dst_lights + nlight;
 
 		// Transform the light's positions and center
 		transform_point(src_light->positions + 0, transform, dst_light->positions + 0);
@@ -1783,42 +1876,51 @@ static void instance_model_lights(int num_light_polys, const light_poly_t* light
 		transform_point(src_light->off_center, transform, dst_light->off_center);
 
 		// Find the cluster based on the center. Maybe it's OK to use the model's cluster, need to test.
-		dst_light->cluster = BSP_PointLeaf(bsp_world_model->nodes, dst_light->off_center)->cluster;
-
-		// We really need to map these lights to a cluster
-		if (dst_light->cluster < 0)
-			continue;
+		dst_light->cluster = bsp_world_model ? BSP_PointLeaf(bsp_world_model->nodes, dst_light->off_center)->cluster : -1;
 
 		// Copy the other light properties
 		VectorCopy(src_light->color, dst_light->color);
 		dst_light->material = src_light->material;
 		dst_light->style = src_light->style;
-
-		num_model_lights++;
+		dst_light->emissive_factor = src_light->emissive_factor;
 	}
 }
-static const mat4 g_identity_transform = {
-	{ 1.f, 0.f, 0.f, 0.f },
-	{ 0.f, 1.f, 0.f, 0.f },
-	{ 0.f, 0.f, 1.f, 0.f },
-	{ 0.f, 0.f, 0.f, 1.f }
-};
 
-static void process_bsp_entity(const entity_t* entity, int* instance_count)
+static void instance_model_lights(int num_light_polys, const light_poly_t* lights)
 {
-	InstanceBuffer* uniform_instance_buffer = &vkpt_refdef.uniform_instance_buffer;
-
-	const int current_instance_idx = *instance_count;
-	if (current_instance_idx >= MAX_MODEL_INSTANCES)
+	for (int nlight = 0; nlight < num_light_polys; nlight++)
 	{
-		assert(!"Entity count overflow");
-		return;
+		// We really need to map these lights to a cluster
+		if (lights[nlight].cluster < 0)
+			continue;
+
+		if (num_model_lights >= MAX_MODEL_LIGHTS)
+		{
+			assert(!"Model light count overflow");
+			break;
+		}
+
+		model_lights[num_model_lights++] = lights[nlight];
 	}
-	
+}
+
+// Per-entity state that does not depend on other entities. It is computed for
+// all entities in parallel, then instances are assigned serially in entity order
+// so that the result does not depend on the number of threads.
+typedef struct entity_prep_s {
 	float transform[16];
-	create_entity_matrix(transform, (entity_t*)entity);
+	int cluster;
+	int first_light;
+	int num_lights;
+} entity_prep_t;
 
-	bsp_model_t* model = vkpt_refdef.bsp_mesh_world.models + (~entity->model);
+static entity_prep_t entity_preps[MAX_ENTITIES];
+static light_poly_t entity_lights[MAX_MODEL_LIGHTS];
+
+static int get_bsp_entity_cluster(const bsp_model_t* model, const float* transform)
+{
+	if (!bsp_world_model)
+		return -1;
 
 	vec3_t origin;
 	transform_point(model->center, transform, origin);
@@ -1848,6 +1950,113 @@ static void process_bsp_entity(const entity_t* entity, int* instance_count)
 		}
 	}
 
+	return cluster;
+}
+
+// Assigns light slots and computes the transforms that need the refdef,
+// returns false if the entity is not rendered.
+static bool setup_entity_prep(const entity_t* entity, entity_prep_t* prep, int* num_lights)
+{
+	int num_light_polys;
+
+	if (entity->model & 0x80000000)
+	{
+		const bsp_model_t* model = vkpt_refdef.bsp_mesh_world.models + (~entity->model);
+		num_light_polys = model->num_light_polys;
+	}
+	else
+	{
+		const model_t* model = MOD_ForHandle(entity->model);
+		if (model == NULL || model->meshes == NULL)
+			return false;
+
+		num_light_polys = model->num_light_polys;
+
+		if (entity->flags & RF_WEAPONMODEL)
+			create_viewweapon_matrix(prep->transform, (entity_t*)entity);
+	}
+
+	prep->first_light = *num_lights;
+	prep->num_lights = min(num_light_polys, MAX_MODEL_LIGHTS - *num_lights);
+	*num_lights += prep->num_lights;
+
+	return true;
+}
+
+static void prepare_entity_range(void* arg, int begin, int end)
+{
+	const entity_t* entities = arg;
+
+	for (int i = begin; i < end; i++)
+	{
+		const entity_t* entity = entities + i;
+		entity_prep_t* prep = entity_preps + i;
+		const light_poly_t* light_polys;
+
+		if (entity->model & 0x80000000)
+		{
+			const bsp_model_t* model = vkpt_refdef.bsp_mesh_world.models + (~entity->model);
+
+			create_entity_matrix(prep->transform, (entity_t*)entity);
+			prep->cluster = get_bsp_entity_cluster(model, prep->transform);
+			light_polys = model->light_polys;
+		}
+		else
+		{
+			const model_t* model = MOD_ForHandle(entity->model);
+			if (model == NULL || model->meshes == NULL)
+				continue;
+
+			// view weapon matrix depends on cvars, it is set up before
+			if (!(entity->flags & RF_WEAPONMODEL))
+				create_entity_matrix(prep->transform, (entity_t*)entity);
+
+			prep->cluster = bsp_world_model ? BSP_PointLeaf(bsp_world_model->nodes, entity->origin)->cluster : -1;
+			light_polys = model->light_polys;
+		}
+
+		transform_model_lights(prep->num_lights, light_polys, prep->transform, entity_lights + prep->first_light);
+	}
+}
+
+#define ENTITY_PREP_GRAIN 16
+
+// Precomputes entity_preps[] for the given entities, in parallel.
+static void prepare_entity_preps(const entity_t* entities, int num_entities, int grain)
+{
+	int num_lights = 0;
+
+	for (int i = 0; i < num_entities; i++)
+	{
+		if (!setup_entity_prep(entities + i, entity_preps + i, &num_lights))
+			entity_preps[i].num_lights = 0;
+	}
+
+	Com_ParallelFor(num_entities, grain, prepare_entity_range, (void*)entities);
+}
+
+static const mat4 g_identity_transform = {
+	{ 1.f, 0.f, 0.f, 0.f },
+	{ 0.f, 1.f, 0.f, 0.f },
+	{ 0.f, 0.f, 1.f, 0.f },
+	{ 0.f, 0.f, 0.f, 1.f }
+};
+
+static void process_bsp_entity(const entity_t* entity, const entity_prep_t* prep, int* instance_count)
+{
+	InstanceBuffer* uniform_instance_buffer = &vkpt_refdef.uniform_instance_buffer;
+
+	const int current_instance_idx = *instance_count;
+	if (current_instance_idx >= MAX_MODEL_INSTANCES)
+	{
+		assert(!"Entity count overflow");
+		return;
+	}
+	
+	const float* transform = prep->transform;
+
+	bsp_model_t* model = vkpt_refdef.bsp_mesh_world.models + (~entity->model);
+
 	entity_hash_t hash;
 	hash.entity = entity->id;
 	hash.model = ~entity->model;
@@ -1858,10 +2067,10 @@ static void process_bsp_entity(const entity_t* entity, int* instance_count)
 
 	float model_alpha = (entity->flags & RF_TRANSLUCENT) ? entity->alpha : 1.f;
 	ModelInstance* mi = uniform_instance_buffer->model_instances + current_instance_idx;
-	memcpy(&mi->transform, transform, sizeof(transform));
-	memcpy(&mi->transform_prev, transform, sizeof(transform));
+	memcpy(&mi->transform, transform, sizeof(mi->transform));
+	memcpy(&mi->transform_prev, transform, sizeof(mi->transform_prev));
 	mi->material = 0;
-	mi->cluster = cluster;
+	mi->cluster = prep->cluster;
 	mi->source_buffer_idx = VERTEX_BUFFER_WORLD;
 	mi->prim_count = model->geometry.prim_counts[0];
 	mi->prim_offset_curr_pose_curr_frame = 0; // bsp models are not processed by the instancing shader
@@ -1876,7 +2085,7 @@ static void process_bsp_entity(const entity_t* entity, int* instance_count)
 	mi->render_buffer_idx = VERTEX_BUFFER_WORLD;
 	mi->render_prim_offset = model->geometry.prim_offsets[0];
 	
-	instance_model_lights(model->num_light_polys, model->light_polys, transform);
+	instance_model_lights(prep->num_lights, entity_lights + prep->first_light);
 
 	if (model->geometry.accel)
 	{
@@ -1899,6 +2108,7 @@ static void process_bsp_entity(const entity_t* entity, int* instance_count)
 
 static void process_regular_entity(
 	const entity_t* entity, 
+	const entity_prep_t* prep, 
 	const model_t* model, 
 	bool is_viewer_weapon, 
 	bool is_double_sided, 
@@ -1913,11 +2123,7 @@ static void process_regular_entity(
 {
 	InstanceBuffer* uniform_instance_buffer = &vkpt_refdef.uniform_instance_buffer;
 
-	float transform[16];
-	if (is_viewer_weapon)
-		create_viewweapon_matrix(transform, (entity_t *)entity);
-	else
-		create_entity_matrix(transform, (entity_t*)entity);
+	const float* transform = prep->transform;
 	
 	int current_instance_index = *instance_count;
 	int current_animated_index = *animated_count;
@@ -1929,17 +2135,10 @@ static void process_regular_entity(
 	int iqm_matrix_index = -1;
 	if (model->iqmData && model->iqmData->num_poses)
 	{
-		iqm_matrix_index = *iqm_matrix_offset;
-		
-		if (iqm_matrix_index + model->iqmData->num_poses > MAX_IQM_MATRICES)
-		{
-			assert(!"IQM matrix buffer overflow");
+		iqm_matrix_index = get_iqm_pose_matrices(model->iqmData, entity, iqm_matrix_offset, iqm_matrix_data);
+
+		if (iqm_matrix_index < 0)
 			return;
-		}
-		
-		R_ComputeIQMTransforms(model->iqmData, entity, iqm_matrix_data + (iqm_matrix_index * 12));
-		
-		*iqm_matrix_offset += (int)model->iqmData->num_poses;
 	}
 
 	float alpha = (entity->flags & RF_TRANSLUCENT) ? entity->alpha : 1.f;
@@ -2030,7 +2229,7 @@ static void process_regular_entity(
 		
 		ModelInstance* mi = uniform_instance_buffer->model_instances + current_instance_index;
 
-		fill_model_instance(mi, entity, model, mesh, transform, mat_shell,
+		fill_model_instance(mi, entity, model, mesh, transform, prep->cluster, mat_shell,
 			current_instance_index, iqm_matrix_index);
 
 		if (use_static_blas)
@@ -2100,6 +2299,10 @@ prepare_entities(EntityUploadInfo* upload_info)
 	int instance_idx = 0;
 	int iqm_matrix_offset = 0;
 
+	reset_iqm_poses();
+
+	prepare_entity_preps(vkpt_refdef.fd->entities, vkpt_refdef.fd->num_entities, ENTITY_PREP_GRAIN);
+
 	const bool first_person_model = (cl_player_model->integer == CL_PLAYER_MODEL_FIRST_PERSON) && cl.baseclientinfo.model;
 
 	for (int i = 0; i < vkpt_refdef.fd->num_entities; i++)
@@ -2108,7 +2311,7 @@ prepare_entities(EntityUploadInfo* upload_info)
 
 		if (entity->model & 0x80000000)
 		{
-			process_bsp_entity(entity, &model_instance_idx); /* embedded in bsp */
+			process_bsp_entity(entity, &entity_preps[i], &model_instance_idx); /* embedded in bsp */
 		}
 		else
 		{
@@ -2126,7 +2329,7 @@ prepare_entities(EntityUploadInfo* upload_info)
 			{
 				bool contains_transparent = false;
 				bool contains_masked = false;
-				process_regular_entity(entity, model, false, false, &model_instance_idx, &instance_idx, &num_instanced_prim,
+				process_regular_entity(entity, &entity_preps[i], model, false, false, &model_instance_idx, &instance_idx, &num_instanced_prim,
 					MESH_FILTER_OPAQUE, &contains_transparent, &contains_masked, &iqm_matrix_offset, qvk.iqm_matrices_shadow);
 
 				if (contains_transparent)
@@ -2135,17 +2338,7 @@ prepare_entities(EntityUploadInfo* upload_info)
 					masked_model_indices[masked_model_num++] = i;
 			}
 
-			if (model->num_light_polys > 0)
-			{
-				float transform[16];
-				const bool is_viewer_weapon = (entity->flags & RF_WEAPONMODEL) != 0;
-				if (is_viewer_weapon)
-					create_viewweapon_matrix(transform, (entity_t*)entity);
-				else
-					create_entity_matrix(transform, (entity_t*)entity);
-
-				instance_model_lights(model->num_light_polys, model->light_polys, transform);
-			}
+			instance_model_lights(entity_preps[i].num_lights, entity_lights + entity_preps[i].first_light);
 		}
 	}
 
@@ -2154,10 +2347,11 @@ prepare_entities(EntityUploadInfo* upload_info)
 	
 	for (int i = 0; i < transparent_model_num; i++)
 	{
-		const entity_t* entity = vkpt_refdef.fd->entities + transparent_model_indices[i];
+		const int entity_index = transparent_model_indices[i];
+		const entity_t* entity = vkpt_refdef.fd->entities + entity_index;
 
 		const model_t* model = MOD_ForHandle(entity->model);
-		process_regular_entity(entity, model, false, false, &model_instance_idx, &instance_idx, &num_instanced_prim,
+		process_regular_entity(entity, &entity_preps[entity_index], model, false, false, &model_instance_idx, &instance_idx, &num_instanced_prim,
 			MESH_FILTER_TRANSPARENT, NULL, NULL, &iqm_matrix_offset, qvk.iqm_matrices_shadow);
 	}
 
@@ -2166,10 +2360,11 @@ prepare_entities(EntityUploadInfo* upload_info)
 
 	for (int i = 0; i < masked_model_num; i++)
 	{
-		const entity_t* entity = vkpt_refdef.fd->entities + masked_model_indices[i];
+		const int entity_index = masked_model_indices[i];
+		const entity_t* entity = vkpt_refdef.fd->entities + entity_index;
 		
 		const model_t* model = MOD_ForHandle(entity->model);
-		process_regular_entity(entity, model, false, true, &model_instance_idx, &instance_idx, &num_instanced_prim,
+		process_regular_entity(entity, &entity_preps[entity_index], model, false, true, &model_instance_idx, &instance_idx, &num_instanced_prim,
 			MESH_FILTER_MASKED, NULL, NULL, &iqm_matrix_offset, qvk.iqm_matrices_shadow);
 	}
 
@@ -2180,9 +2375,10 @@ prepare_entities(EntityUploadInfo* upload_info)
 	{
 		for (int i = 0; i < viewer_model_num; i++)
 		{
-			const entity_t* entity = vkpt_refdef.fd->entities + viewer_model_indices[i];
+			const int entity_index = viewer_model_indices[i];
+			const entity_t* entity = vkpt_refdef.fd->entities + entity_index;
 			const model_t* model = MOD_ForHandle(entity->model);
-			process_regular_entity(entity, model, false, true, &model_instance_idx, &instance_idx, &num_instanced_prim,
+			process_regular_entity(entity, &entity_preps[entity_index], model, false, true, &model_instance_idx, &instance_idx, &num_instanced_prim,
 				MESH_FILTER_ALL, NULL, NULL, &iqm_matrix_offset, qvk.iqm_matrices_shadow);
 		}
 	}
@@ -2194,9 +2390,10 @@ prepare_entities(EntityUploadInfo* upload_info)
 	
 	for (int i = 0; i < viewer_weapon_num; i++)
 	{
-		const entity_t* entity = vkpt_refdef.fd->entities + viewer_weapon_indices[i];
+		const int entity_index = viewer_weapon_indices[i];
+		const entity_t* entity = vkpt_refdef.fd->entities + entity_index;
 		const model_t* model = MOD_ForHandle(entity->model);
-		process_regular_entity(entity, model, true, false, &model_instance_idx, &instance_idx, &num_instanced_prim,
+		process_regular_entity(entity, &entity_preps[entity_index], model, true, false, &model_instance_idx, &instance_idx, &num_instanced_prim,
 			MESH_FILTER_ALL, NULL, NULL, &iqm_matrix_offset, qvk.iqm_matrices_shadow);
 
 		if (info_hand->integer == 1)
@@ -2208,9 +2405,10 @@ prepare_entities(EntityUploadInfo* upload_info)
 	
 	for (int i = 0; i < explosion_num; i++)
 	{
-		const entity_t* entity = vkpt_refdef.fd->entities + explosion_indices[i];
+		const int entity_index = explosion_indices[i];
+		const entity_t* entity = vkpt_refdef.fd->entities + entity_index;
 		const model_t* model = MOD_ForHandle(entity->model);
-		process_regular_entity(entity, model, false, false, &model_instance_idx, &instance_idx, &num_instanced_prim,
+		process_regular_entity(entity, &entity_preps[entity_index], model, false, false, &model_instance_idx, &instance_idx, &num_instanced_prim,
 			MESH_FILTER_ALL, NULL, NULL, &iqm_matrix_offset, qvk.iqm_matrices_shadow);
 	}
 
@@ -2218,6 +2416,8 @@ prepare_entities(EntityUploadInfo* upload_info)
 
 	upload_info->num_instances = instance_idx;
 	upload_info->num_prims  = num_instanced_prim;
+
+	Com_ParallelFor(iqm_pose_count, IQM_POSE_GRAIN, compute_iqm_poses, qvk.iqm_matrices_shadow);
 	
 	memset(instance_buffer->model_current_to_prev, -1, sizeof(instance_buffer->model_current_to_prev));
 	memset(instance_buffer->model_prev_to_current, -1, sizeof(instance_buffer->model_prev_to_current));
@@ -3600,6 +3800,119 @@ vkpt_show_pvs(void)
 	cluster_debug_index = vkpt_refdef.fd->feedback.lookatcluster;
 }
 
+#if USE_TESTS
+// Feeds a synthetic scene of random models placed in the current map through
+// the parallel entity preparation and checks the result against a serial run.
+static void
+vkpt_entity_bench(void)
+{
+	static entity_t entities[MAX_ENTITIES];
+	static entity_prep_t preps[MAX_ENTITIES];
+	static light_poly_t lights[MAX_MODEL_LIGHTS];
+	qhandle_t handles[256];
+	int num_handles = 0;
+
+	if (!bsp_world_model)
+	{
+		Com_Printf("No map loaded\n");
+		return;
+	}
+
+	for (int i = 0; i < r_numModels && num_handles < q_countof(handles); i++)
+	{
+		if (r_models[i].type && r_models[i].meshes)
+			handles[num_handles++] = i + 1;
+	}
+
+	if (!num_handles)
+	{
+		Com_Printf("No models loaded\n");
+		return;
+	}
+
+	int num_entities = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : MAX_ENTITIES;
+	int passes = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 100;
+	clamp(num_entities, 1, MAX_ENTITIES);
+	passes = max(passes, 1);
+
+	const mmodel_t* world = &bsp_world_model->models[0];
+	const int num_bsp_models = vkpt_refdef.bsp_mesh_world.num_models;
+
+	Q_srand(1);
+	memset(entities, 0, sizeof(entities));
+	for (int i = 0; i < num_entities; i++)
+	{
+		entity_t* entity = entities + i;
+
+		// some inline models, the rest random alias and IQM models
+		if (num_bsp_models > 1 && !Q_rand_uniform(8))
+			entity->model = ~(1 + Q_rand_uniform(num_bsp_models - 1));
+		else
+			entity->model = handles[Q_rand_uniform(num_handles)];
+
+		for (int j = 0; j < 3; j++)
+		{
+			entity->origin[j] = world->mins[j] + frand() * (world->maxs[j] - world->mins[j]);
+			entity->oldorigin[j] = entity->origin[j] + crand() * 8;
+			entity->angles[j] = frand() * 360;
+		}
+		entity->frame = Q_rand_uniform(64);
+		entity->oldframe = Q_rand_uniform(64);
+		entity->backlerp = frand();
+		entity->id = i + 1;
+	}
+
+	float* matrices = Z_Mallocz(MAX_IQM_MATRICES * 12 * sizeof(float) * 2);
+	float* matrices_parallel = matrices + MAX_IQM_MATRICES * 12;
+	int num_poses = 0;
+	int matrix_offset = 0;
+
+	reset_iqm_poses();
+	for (int i = 0; i < num_entities; i++)
+	{
+		const model_t* model = (entities[i].model & 0x80000000) ? NULL : MOD_ForHandle(entities[i].model);
+		if (model && model->iqmData && model->iqmData->num_poses)
+			get_iqm_pose_matrices(model->iqmData, entities + i, &matrix_offset, matrices);
+	}
+	num_poses = iqm_pose_count;
+
+	uint64_t time[2];
+	for (int k = 0; k < 2; k++)
+	{
+		const int grain = k ? MAX_ENTITIES : ENTITY_PREP_GRAIN;
+		uint64_t start = Sys_Microseconds();
+		for (int pass = 0; pass < passes; pass++)
+		{
+			prepare_entity_preps(entities, num_entities, grain);
+			Com_ParallelFor(num_poses, k ? MAX_ENTITIES : IQM_POSE_GRAIN, compute_iqm_poses, matrices);
+		}
+		time[k] = Sys_Microseconds() - start;
+
+		if (!k)
+		{
+			memcpy(preps, entity_preps, sizeof(preps[0]) * num_entities);
+			memcpy(lights, entity_lights, sizeof(lights));
+			memcpy(matrices_parallel, matrices, matrix_offset * 12 * sizeof(float));
+		}
+	}
+
+	int num_lights = 0;
+	for (int i = 0; i < num_entities; i++)
+		num_lights += entity_preps[i].num_lights;
+
+	bool match = !memcmp(preps, entity_preps, sizeof(preps[0]) * num_entities)
+		&& !memcmp(lights, entity_lights, sizeof(lights[0]) * num_lights)
+		&& !memcmp(matrices_parallel, matrices, matrix_offset * 12 * sizeof(float));
+
+	Com_Printf("%d entities, %d lights, %d poses: %.1f us parallel, %.1f us serial, %d threads, %s\n",
+		num_entities, num_lights, num_poses, (float)time[0] / passes, (float)time[1] / passes,
+		Com_ParallelThreads(), match ? "results match" : "RESULTS DIFFER");
+
+	Z_Free(matrices);
+	reset_iqm_poses();
+}
+#endif
+
 static float halton(int base, int index) {
 	float f = 1.f;
 	float r = 0.f;
@@ -3796,9 +4109,15 @@ R_Init_RTX(bool total)
 	Cmd_AddCommand("reload_textures", (xcommand_t)&vkpt_reload_textures);
 	Cmd_AddCommand("show_pvs", (xcommand_t)&vkpt_show_pvs);
 	Cmd_AddCommand("next_sun", (xcommand_t)&vkpt_next_sun_preset);
+#if USE_TESTS
+	Cmd_AddCommand("entitybench", &vkpt_entity_bench);
+	Cmd_AddCommand("particlebench", &vkpt_particle_bench);
+	Cmd_AddCommand("buddytest", &buddy_allocator_test);
+#endif
 
 	vkpt_fog_init();
 	vkpt_cameras_init();
+	vkpt_texcache_init();
 
 	for (int i = 0; i < 256; i++) {
 		qvk.sintab[i] = sinf(i * (2 * M_PI / 255));
@@ -3829,6 +4148,11 @@ R_Shutdown_RTX(bool total)
 	Cmd_RemoveCommand("reload_textures");
 	Cmd_RemoveCommand("show_pvs");
 	Cmd_RemoveCommand("next_sun");
+#if USE_TESTS
+	Cmd_RemoveCommand("entitybench");
+	Cmd_RemoveCommand("particlebench");
+	Cmd_RemoveCommand("buddytest");
+#endif
 
 	if (vkpt_refdef.bsp_mesh_world_loaded)
 	{
@@ -3838,6 +4162,7 @@ R_Shutdown_RTX(bool total)
 
 	vkpt_fog_shutdown();
 	vkpt_cameras_shutdown();
+	vkpt_texcache_shutdown();
 	MAT_Shutdown();
 	IMG_FreeAll();
 	vkpt_textures_destroy_unused();
@@ -4141,11 +4466,7 @@ R_SetSky_RTX(const char *name, float rotate, int autorotate, const vec3_t axis)
 		assert(w_prev == img->upload_width);
 		assert(h_prev == img->upload_height);
 
-		List_Remove(&img->entry);
-
-		IMG_Unload(img);
-
-		memset(img, 0, sizeof(*img));
+		IMG_Release(img);
 	}
 
 	float inv_num_pixels = 1.0f / (w_prev * h_prev * 6);
@@ -31,14 +31,82 @@ extern cvar_t* cvar_pt_surface_lights_threshold;
 extern void CL_PrepRefresh(void);
 
 pbr_material_t r_materials[MAX_PBR_MATERIALS];
-static pbr_material_t r_global_materials[MAX_PBR_MATERIALS];
-static pbr_material_t r_map_materials[MAX_PBR_MATERIALS];
-static uint32_t num_global_materials = 0;
-static uint32_t num_map_materials = 0;
 
 #define RMATERIALS_HASH 256
 static list_t r_materialsHash[RMATERIALS_HASH];
 
+#define MATDB_DIR		"matcache"
+#define MATDB_IDENT		MakeLittleLong('M','A','T','D')
+#define MATDB_VERSION	1
+#define MATDB_EMPTY		UINT32_MAX
+#define MATDB_MAX_SEED	65536
+
+static cvar_t *cvar_pt_material_cache;
+
+// Material database files are a local cache written by this build,
+// so they use native byte order and are used in place after loading.
+typedef struct
+{
+	uint32_t ident;
+	uint32_t version;
+	uint32_t record_size;
+	int32_t emissive_threshold;
+	uint32_t num_sources;
+	uint32_t num_materials;
+	uint32_t num_buckets;
+	uint32_t table_size;
+} matdb_header_t;
+
+// A .mat file the database was compiled from. The database is rebuilt
+// whenever any of these change, or the list of files itself changes.
+typedef struct
+{
+	char name[MAX_QPATH];
+	uint32_t source;
+	int32_t length;
+	uint64_t last_modified;
+} matdb_source_t;
+
+// Material definition as parsed from a .mat file
+typedef struct
+{
+	char name[MAX_QPATH];
+	char filename_base[MAX_QPATH];
+	char filename_normals[MAX_QPATH];
+	char filename_emissive[MAX_QPATH];
+	char filename_mask[MAX_QPATH];
+	char source_matfile[MAX_QPATH];
+	uint32_t source_line;
+	uint32_t flags;
+	uint32_t image_flags;
+	int32_t num_frames;
+	int32_t emissive_threshold;
+	float bump_scale;
+	float roughness_override;
+	float metalness_factor;
+	float emissive_factor;
+	float specular_factor;
+	float base_factor;
+	float default_radiance;
+	uint8_t light_styles;
+	uint8_t bsp_radiance;
+	uint8_t synth_emissive;
+	uint8_t pad;
+} matdb_record_t;
+
+typedef struct
+{
+	void *buffer;
+	const matdb_header_t *header;
+	const matdb_source_t *sources;
+	const matdb_record_t *records;
+	const uint32_t *seeds;
+	const uint32_t *slots;
+} matdb_t;
+
+static matdb_t global_materials;
+static matdb_t map_materials;
+
 #define RELOAD_MAP		1
 #define RELOAD_EMISSIVE	2
 
@@ -102,6 +170,384 @@ static qboolean is_game_custom(void)
 	return fs_game->string[0] && strcmp(fs_game->string, BASEGAME) != 0;
 }
 
+/*
+=================================================================
+
+Compiled material database
+
+Global and per-map material definitions are parsed once, then stored
+in the cache directory together with a perfect hash index over the
+material names. Later runs load the database with a single file read
+as long as none of the source .mat files have changed.
+
+=================================================================
+*/
+
+static uint64_t matdb_hash(const char *name)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+
+	while (*name) {
+		h ^= (byte)*name++;
+		h *= 0x100000001b3ull;
+	}
+
+	return h;
+}
+
+static inline uint32_t matdb_bucket(uint64_t h, uint32_t num_buckets)
+{
+	return (uint32_t)(h >> 32) % num_buckets;
+}
+
+static inline uint32_t matdb_slot(uint64_t h, uint32_t seed, uint32_t table_size)
+{
+	h += seed * 0x9e3779b97f4a7c15ull;
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ull;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebull;
+	h ^= h >> 31;
+
+	return (uint32_t)h & (table_size - 1);
+}
+
+static size_t matdb_size(uint32_t num_sources, uint32_t num_materials, uint32_t num_buckets, uint32_t table_size)
+{
+	return sizeof(matdb_header_t) +
+		num_sources * sizeof(matdb_source_t) +
+		num_materials * sizeof(matdb_record_t) +
+		num_buckets * sizeof(uint32_t) +
+		table_size * sizeof(uint32_t);
+}
+
+static void matdb_attach(matdb_t *db, void *buffer)
+{
+	const matdb_header_t *header = buffer;
+
+	db->buffer = buffer;
+	db->header = header;
+	db->sources = (const matdb_source_t *)(header + 1);
+	db->records = (const matdb_record_t *)(db->sources + header->num_sources);
+	db->seeds = (const uint32_t *)(db->records + header->num_materials);
+	db->slots = db->seeds + header->num_buckets;
+}
+
+static void matdb_free(matdb_t *db)
+{
+	Z_Free(db->buffer);
+	memset(db, 0, sizeof(*db));
+}
+
+static uint32_t matdb_count(const matdb_t *db)
+{
+	return db->header ? db->header->num_materials : 0;
+}
+
+static const matdb_record_t *matdb_find(const matdb_t *db, const char *name)
+{
+	const matdb_header_t *header = db->header;
+
+	if (!header || !header->num_materials)
+		return NULL;
+
+	uint64_t h = matdb_hash(name);
+	uint32_t seed = db->seeds[matdb_bucket(h, header->num_buckets)];
+	uint32_t index = db->slots[matdb_slot(h, seed, header->table_size)];
+
+	if (index >= header->num_materials)
+		return NULL;
+
+	const matdb_record_t *rec = db->records + index;
+	return strcmp(rec->name, name) ? NULL : rec;
+}
+
+// Hash and displace: keys are split into small buckets by the upper half
+// of their hash, then buckets are placed largest first, each searching for
+// a seed that sends all of its keys to free slots.
+static bool matdb_place_buckets(const uint64_t *hashes, uint32_t count,
+	uint32_t *seeds, uint32_t num_buckets, uint32_t *slots, uint32_t table_size)
+{
+	uint32_t *bucket_start = Z_Mallocz((num_buckets + 1) * sizeof(uint32_t));
+	uint32_t *cursor = Z_Malloc(num_buckets * sizeof(uint32_t));
+	uint32_t *keys = Z_Malloc(max(count, 1) * sizeof(uint32_t));
+	uint32_t *trial = Z_Malloc(max(count, 1) * sizeof(uint32_t));
+	uint32_t max_bucket_size = 0;
+	bool result = true;
+
+	for (uint32_t i = 0; i < count; i++)
+		bucket_start[matdb_bucket(hashes[i], num_buckets) + 1]++;
+
+	for (uint32_t b = 0; b < num_buckets; b++) {
+		max_bucket_size = max(max_bucket_size, bucket_start[b + 1]);
+		bucket_start[b + 1] += bucket_start[b];
+	}
+
+	memcpy(cursor, bucket_start, num_buckets * sizeof(uint32_t));
+	for (uint32_t i = 0; i < count; i++)
+		keys[cursor[matdb_bucket(hashes[i], num_buckets)]++] = i;
+
+	for (uint32_t i = 0; i < table_size; i++)
+		slots[i] = MATDB_EMPTY;
+	memset(seeds, 0, num_buckets * sizeof(uint32_t));
+
+	for (uint32_t size = max_bucket_size; size > 0 && result; size--) {
+		for (uint32_t b = 0; b < num_buckets && result; b++) {
+			const uint32_t *bucket = keys + bucket_start[b];
+
+			if (bucket_start[b + 1] - bucket_start[b] != size)
+				continue;
+
+			uint32_t seed;
+			for (seed = 0; seed < MATDB_MAX_SEED; seed++) {
+				uint32_t k;
+				for (k = 0; k < size; k++) {
+					trial[k] = matdb_slot(hashes[bucket[k]], seed, table_size);
+					if (slots[trial[k]] != MATDB_EMPTY)
+						break;
+
+					uint32_t j;
+					for (j = 0; j < k && trial[j] != trial[k]; j++)
+						;
+					if (j < k)
+						break;
+				}
+				if (k == size)
+					break;
+			}
+
+			if (seed == MATDB_MAX_SEED) {
+				result = false;
+				break;
+			}
+
+			seeds[b] = seed;
+			for (uint32_t k = 0; k < size; k++)
+				slots[trial[k]] = bucket[k];
+		}
+	}
+
+	Z_Free(bucket_start);
+	Z_Free(cursor);
+	Z_Free(keys);
+	Z_Free(trial);
+
+	return result;
+}
+
+static void record_from_material(matdb_record_t *rec, const pbr_material_t *mat)
+{
+	memset(rec, 0, sizeof(*rec));
+	Q_strlcpy(rec->name, mat->name, sizeof(rec->name));
+	Q_strlcpy(rec->filename_base, mat->filename_base, sizeof(rec->filename_base));
+	Q_strlcpy(rec->filename_normals, mat->filename_normals, sizeof(rec->filename_normals));
+	Q_strlcpy(rec->filename_emissive, mat->filename_emissive, sizeof(rec->filename_emissive));
+	Q_strlcpy(rec->filename_mask, mat->filename_mask, sizeof(rec->filename_mask));
+	Q_strlcpy(rec->source_matfile, mat->source_matfile, sizeof(rec->source_matfile));
+	rec->source_line = mat->source_line;
+	rec->flags = mat->flags;
+	rec->image_flags = mat->image_flags;
+	rec->num_frames = mat->num_frames;
+	rec->emissive_threshold = mat->emissive_threshold;
+	rec->bump_scale = mat->bump_scale;
+	rec->roughness_override = mat->roughness_override;
+	rec->metalness_factor = mat->metalness_factor;
+	rec->emissive_factor = mat->emissive_factor;
+	rec->specular_factor = mat->specular_factor;
+	rec->base_factor = mat->base_factor;
+	rec->default_radiance = mat->default_radiance;
+	rec->light_styles = mat->light_styles;
+	rec->bsp_radiance = mat->bsp_radiance;
+	rec->synth_emissive = mat->synth_emissive;
+}
+
+static void material_from_record(pbr_material_t *mat, const matdb_record_t *rec)
+{
+	memset(mat, 0, sizeof(*mat));
+	Q_strlcpy(mat->name, rec->name, sizeof(mat->name));
+	Q_strlcpy(mat->filename_base, rec->filename_base, sizeof(mat->filename_base));
+	Q_strlcpy(mat->filename_normals, rec->filename_normals, sizeof(mat->filename_normals));
+	Q_strlcpy(mat->filename_emissive, rec->filename_emissive, sizeof(mat->filename_emissive));
+	Q_strlcpy(mat->filename_mask, rec->filename_mask, sizeof(mat->filename_mask));
+	Q_strlcpy(mat->source_matfile, rec->source_matfile, sizeof(mat->source_matfile));
+	mat->source_line = rec->source_line;
+	mat->flags = rec->flags;
+	mat->image_flags = rec->image_flags;
+	mat->num_frames = rec->num_frames;
+	mat->emissive_threshold = rec->emissive_threshold;
+	mat->bump_scale = rec->bump_scale;
+	mat->roughness_override = rec->roughness_override;
+	mat->metalness_factor = rec->metalness_factor;
+	mat->emissive_factor = rec->emissive_factor;
+	mat->specular_factor = rec->specular_factor;
+	mat->base_factor = rec->base_factor;
+	mat->default_radiance = rec->default_radiance;
+	mat->light_styles = rec->light_styles;
+	mat->bsp_radiance = rec->bsp_radiance;
+	mat->synth_emissive = rec->synth_emissive;
+	mat->registration_sequence = registration_sequence;
+}
+
+// Compiles sorted and deduplicated materials into a database
+static void matdb_build(matdb_t *db, const pbr_material_t *materials, uint32_t count,
+	const matdb_source_t *sources, uint32_t num_sources)
+{
+	uint32_t num_buckets = max(1, (count + 3) / 4);
+	uint32_t table_size = Q_npot32(count + count / 4 + 1);
+	uint64_t *hashes = Z_Malloc(max(count, 1) * sizeof(uint64_t));
+
+	for (uint32_t i = 0; i < count; i++)
+		hashes[i] = matdb_hash(materials[i].name);
+
+	while (1) {
+		matdb_header_t *header = Z_Mallocz(matdb_size(num_sources, count, num_buckets, table_size));
+		header->ident = MATDB_IDENT;
+		header->version = MATDB_VERSION;
+		header->record_size = sizeof(matdb_record_t);
+		header->emissive_threshold = cvar_pt_surface_lights_threshold->integer;
+		header->num_sources = num_sources;
+		header->num_materials = count;
+		header->num_buckets = num_buckets;
+		header->table_size = table_size;
+
+		matdb_attach(db, header);
+
+		if (matdb_place_buckets(hashes, count, (uint32_t *)db->seeds, num_buckets, (uint32_t *)db->slots, table_size))
+			break;
+
+		// practically never happens, unless two names have the same 64-bit hash
+		matdb_free(db);
+		if (table_size >= (1u << 24)) {
+			Com_EPrintf("Couldn't build material index\n");
+			break;
+		}
+		table_size <<= 1;
+	}
+
+	Z_Free(hashes);
+
+	if (!db->header)
+		return;
+
+	memcpy((matdb_source_t *)db->sources, sources, num_sources * sizeof(matdb_source_t));
+
+	for (uint32_t i = 0; i < count; i++)
+		record_from_material((matdb_record_t *)db->records + i, materials + i);
+}
+
+// Fills in the stamp used to detect changes of a material file, picking
+// the same copy that load_material_file would read. Returns false if
+// the file doesn't exist.
+static bool matdb_stat_source(const char *file_name, matdb_source_t *src)
+{
+	int len = Q_ERR(ENOENT);
+	unsigned source = IF_SRC_GAME;
+
+	memset(src, 0, sizeof(*src));
+	Q_strlcpy(src->name, file_name, sizeof(src->name));
+	src->length = -1;
+
+	if (is_game_custom())
+		len = FS_LoadFileEx(file_name, NULL, FS_PATH_GAME, TAG_FREE);
+
+	if (len < 0) {
+		source = IF_SRC_BASE;
+		len = FS_LoadFileEx(file_name, NULL, FS_PATH_BASE, TAG_FREE);
+	}
+
+	if (len < 0)
+		return false;
+
+	src->source = source;
+	src->length = len;
+
+	// files inside packs don't have a modification time, only length is checked for them
+	FS_LastModified(file_name, &src->last_modified);
+
+	return true;
+}
+
+static bool matdb_read(matdb_t *db, const char *path, const matdb_source_t *sources, uint32_t num_sources)
+{
+	matdb_header_t *header;
+
+	int len = FS_LoadFile(path, (void **)&header);
+	if (!header)
+		return false;
+
+	if (len < (int)sizeof(*header) ||
+		header->ident != MATDB_IDENT ||
+		header->version != MATDB_VERSION ||
+		header->record_size != sizeof(matdb_record_t) ||
+		header->emissive_threshold != cvar_pt_surface_lights_threshold->integer ||
+		header->num_sources != num_sources ||
+		header->num_materials > MAX_PBR_MATERIALS ||
+		header->num_buckets == 0 || header->num_buckets > MAX_PBR_MATERIALS ||
+		header->table_size == 0 || header->table_size > (1u << 24) ||
+		(header->table_size & (header->table_size - 1)) ||
+		(size_t)len != matdb_size(num_sources, header->num_materials, header->num_buckets, header->table_size) ||
+		memcmp(header + 1, sources, num_sources * sizeof(matdb_source_t)))
+	{
+		FS_FreeFile(header);
+		return false;
+	}
+
+	matdb_attach(db, header);
+	return true;
+}
+
+static void matdb_write(const matdb_t *db, const char *path)
+{
+	const matdb_header_t *header = db->header;
+	size_t len = matdb_size(header->num_sources, header->num_materials, header->num_buckets, header->table_size);
+
+	int ret = FS_WriteFile(path, header, len);
+	if (ret < 0)
+		Com_WPrintf("Couldn't write %s: %s\n", path, Q_ErrorString(ret));
+}
+
+// Loads the database compiled from the given sources from the cache,
+// or parses the sources and compiles it.
+static void load_material_db(matdb_t *db, const char *cache_name, const matdb_source_t *sources, uint32_t num_sources)
+{
+	char path[MAX_QPATH];
+	bool use_cache = cvar_pt_material_cache->integer &&
+		Q_concat(path, sizeof(path), MATDB_DIR "/", cache_name, ".bin") < sizeof(path);
+
+	matdb_free(db);
+
+	if (use_cache && matdb_read(db, path, sources, num_sources)) {
+		Com_Printf("Loaded %d materials from %s\n", db->header->num_materials, path);
+		return;
+	}
+
+	pbr_material_t *parsed = Z_Malloc(sizeof(pbr_material_t) * MAX_PBR_MATERIALS);
+	uint32_t count = 0;
+
+	for (uint32_t i = 0; i < num_sources; i++) {
+		if (sources[i].length < 0)
+			continue;
+
+		int mat_slots_available = MAX_PBR_MATERIALS - count;
+		if (mat_slots_available > 0) {
+			uint32_t file_count = load_material_file(sources[i].name, parsed + count, mat_slots_available);
+			count += file_count;
+
+			Com_Printf("Loaded %d materials from %s\n", file_count, sources[i].name);
+		}
+		else {
+			Com_WPrintf("Coundn't load materials from %s: no free slots.\n", sources[i].name);
+		}
+	}
+
+	sort_and_deduplicate_materials(parsed, &count);
+	matdb_build(db, parsed, count, sources, num_sources);
+	Z_Free(parsed);
+
+	if (use_cache && db->header)
+		matdb_write(db, path);
+}
+
 void MAT_Init()
 {
 	cmdreg_t commands[2];
@@ -112,10 +558,10 @@ void MAT_Init()
 	Cmd_Register(commands);
 	
 	memset(r_materials, 0, sizeof(r_materials));
-	memset(r_global_materials, 0, sizeof(r_global_materials));
-	memset(r_map_materials, 0, sizeof(r_map_materials));
-	num_global_materials = 0;
-	num_map_materials = 0;
+	matdb_free(&global_materials);
+	matdb_free(&map_materials);
+
+	cvar_pt_material_cache = Cvar_Get("pt_material_cache", "1", CVAR_ARCHIVE);
 
 	// initialize the hash table
 	for (int i = 0; i < RMATERIALS_HASH; i++)
@@ -126,34 +572,26 @@ void MAT_Init()
 	// find all *.mat files in the root
 	int num_files;
 	void** list = FS_ListFiles("materials", ".mat", 0, &num_files);
+	matdb_source_t* sources = Z_Malloc(max(num_files, 1) * sizeof(matdb_source_t));
 	
 	for (int i = 0; i < num_files; i++) {
 		char* file_name = list[i];
 		char buffer[MAX_QPATH];
 		Q_concat(buffer, sizeof(buffer), "materials/", file_name);
-		
-		int mat_slots_available = MAX_PBR_MATERIALS - num_global_materials;
-		if (mat_slots_available > 0) {
-			uint32_t count = load_material_file(buffer, r_global_materials + num_global_materials,
-				mat_slots_available);
-			num_global_materials += count;
-			
-			Com_Printf("Loaded %d materials from %s\n", count, buffer);
-		}
-		else {
-			Com_WPrintf("Coundn't load materials from %s: no free slots.\n", buffer);
-		}
-		
+		matdb_stat_source(buffer, sources + i);
 		Z_Free(file_name);
 	}
 	Z_Free(list);
 
-	sort_and_deduplicate_materials(r_global_materials, &num_global_materials);
+	load_material_db(&global_materials, "global", sources, num_files);
+	Z_Free(sources);
 }
 
 void MAT_Shutdown()
 {
 	Cmd_RemoveCommand("mat");
+	matdb_free(&global_materials);
+	matdb_free(&map_materials);
 }
 
 static void MAT_SetIndex(pbr_material_t* mat)
@@ -264,29 +702,6 @@ static pbr_material_t* find_material(const char* name, uint32_t hash, pbr_materi
 	return NULL;
 }
 
-static pbr_material_t* find_material_sorted(const char* name, pbr_material_t* first, uint32_t count)
-{
-	// binary search in a sorted table: global and per-map material dictionaries
-	int left = 0, right = (int)count - 1;
-
-	while (left <= right)
-	{
-		int middle = (left + right) / 2;
-		pbr_material_t* mat = first + middle;
-
-		int cmp = strcmp(name, mat->name);
-
-		if (cmp < 0)
-			right = middle - 1;
-		else if (cmp > 0)
-			left = middle + 1;
-		else
-			return mat;
-	}
-
-	return NULL;
-}
-
 enum AttributeIndex
 {
 	MAT_BUMP_SCALE,
@@ -728,20 +1143,20 @@ static void save_materials(const char* file_name, bool save_all, bool force)
 void MAT_ChangeMap(const char* map_name)
 {
 	// clear the old map-specific materials
-	uint32_t old_map_materails = num_map_materials;
-	if (num_map_materials > 0) {
-		memset(r_map_materials, 0, sizeof(pbr_material_t) * num_map_materials);
-	}
+	uint32_t old_map_materails = matdb_count(&map_materials);
+	matdb_free(&map_materials);
 
 	// load the new materials
 	char map_name_no_ext[MAX_QPATH];
 	truncate_extension(map_name, map_name_no_ext);
 	char file_name[MAX_QPATH];
 	Q_snprintf(file_name, sizeof(file_name), "%s.mat", map_name_no_ext);
-	num_map_materials = load_material_file(file_name, r_map_materials, MAX_PBR_MATERIALS);
-	if (num_map_materials > 0) {	
-		Com_Printf("Loaded %d materials from %s\n", num_map_materials, file_name);
-	}
+
+	matdb_source_t source;
+	if (matdb_stat_source(file_name, &source))
+		load_material_db(&map_materials, map_name_no_ext, &source, 1);
+
+	uint32_t num_map_materials = matdb_count(&map_materials);
 
 	// if there are any overrides now or there were some overrides before,
 	// unload all wall materials to re-initialize them with the overrides
@@ -830,11 +1245,11 @@ pbr_material_t* MAT_Find(const char* name, imagetype_t type, imageflags_t flags)
 
 	mat = allocate_material();
 
-	pbr_material_t* matdef = find_material_sorted(mat_name_no_ext, r_global_materials, num_global_materials);
+	const matdb_record_t* matdef = matdb_find(&global_materials, mat_name_no_ext);
 	
 	if (type == IT_WALL)
 	{
-		pbr_material_t* map_mat = find_material_sorted(mat_name_no_ext, r_map_materials, num_map_materials);
+		const matdb_record_t* map_mat = matdb_find(&map_materials, mat_name_no_ext);
 
 		if (map_mat)
 			matdef = map_mat;
@@ -864,7 +1279,7 @@ pbr_material_t* MAT_Find(const char* name, imagetype_t type, imageflags_t flags)
 	}
 	if (matdef)
 	{
-		memcpy(mat, matdef, sizeof(pbr_material_t));
+		material_from_record(mat, matdef);
 		uint32_t index = (uint32_t)(mat - r_materials);
 		mat->flags = (mat->flags & ~MATERIAL_INDEX_MASK) | index;
 		mat->next_frame = index;
@@ -1296,7 +1711,7 @@ void MAT_SynthesizeEmissive(pbr_material_t * mat)
 		mat->image_emissive = get_fake_emissive_image(mat->image_base, mat->emissive_threshold);
 		mat->synth_emissive = true;
 
-		if (mat->image_emissive) {
+		if (mat->image_emissive && !mat->image_emissive->processing_complete) {
 			vkpt_extract_emissive_texture_info(mat->image_emissive);
 		}
 	}
@@ -0,0 +1,666 @@
+/*
+Copyright (C) 2019, NVIDIA CORPORATION. All rights reserved.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+	Block compressed texture cache.
+
+	Color textures are transcoded into BC1 (opaque) or BC3 (with alpha) along
+	with their full mip chain, and stored in the write directory as DDS files
+	named after a hash of the source pixels. Changing a texture produces a new
+	hash, so stale entries are never used; they can simply be deleted.
+
+	Normal maps and other linear textures are left uncompressed because they
+	are written by the normalization shader, which needs a storage image.
+
+	Fake emissive textures are cached the same way, together with their light
+	info, keyed by the source pixels and brightness threshold. They are mostly
+	black, so runs of black pixels are stored as counts.
+*/
+
+#include "vkpt.h"
+#include "dds.h"
+#include "texture_cache.h"
+#include "refresh/images.h"
+#include "common/async.h"
+#include "common/mdfour.h"
+#include "system/system.h"
+
+#include "../stb/stb_dxt.h"
+
+#define TEXCACHE_DIR        "texcache"
+
+// bump this to invalidate all cache entries when the encoder changes
+#define TEXCACHE_VERSION    1
+
+#define EMISSIVE_IDENT      MakeLittleLong('E','M','I','S')
+#define EMISSIVE_VERSION    1
+
+static cvar_t *cvar_pt_texture_compression;
+static cvar_t *cvar_pt_emissive_cache;
+
+static struct
+{
+	int hits;
+	int encoded;
+	int failures;
+	int emissive_hits;
+	int emissive_written;
+} texcache_stats;
+
+static int num_levels_for_size(int w, int h)
+{
+	int levels = 1;
+	for (int size = max(w, h); size > 1; size >>= 1)
+		levels++;
+	return levels;
+}
+
+static uint32_t level_size(int w, int h, int level, int block_size)
+{
+	int lw = max(w >> level, 1);
+	int lh = max(h >> level, 1);
+	return ((lw + 3) / 4) * ((lh + 3) / 4) * block_size;
+}
+
+// Checks whether the pixel data can be block compressed, regardless of how the image is used
+static bool can_compress(const image_t *image)
+{
+	if (!image->pix_data || image->pixel_format != PF_R8G8B8A8_UNORM || !image->is_srgb)
+		return false;
+
+	if (image->flags & IF_NORMAL_MAP)
+		return false;
+
+	// partial blocks are only allowed in the smaller mip levels
+	if ((image->upload_width & 3) || (image->upload_height & 3))
+		return false;
+
+	if (num_levels_for_size(image->upload_width, image->upload_height) > MAX_TEXCACHE_LEVELS)
+		return false;
+
+	return true;
+}
+
+static bool has_alpha(const image_t *image)
+{
+	const byte *p = image->pix_data;
+
+	for (int i = 0; i < image->upload_width * image->upload_height; i++, p += 4)
+		if (p[3] != 255)
+			return true;
+
+	return false;
+}
+
+static void get_cache_path(const image_t *image, const uint32_t *header, size_t header_size,
+	const char *ext, char *path, size_t size)
+{
+	struct mdfour md;
+	byte hash[16];
+
+	mdfour_begin(&md);
+	mdfour_update(&md, (const byte *)header, header_size);
+	mdfour_update(&md, image->pix_data, image->upload_width * image->upload_height * 4);
+	mdfour_result(&md, hash);
+
+	Q_snprintf(path, size, TEXCACHE_DIR "/%02x%02x%02x%02x%02x%02x%02x%02x%s",
+		hash[0], hash[1], hash[2], hash[3], hash[4], hash[5], hash[6], hash[7], ext);
+}
+
+/*
+=================
+DDS parsing
+=================
+*/
+
+static bool parse_dds(const image_t *image, void *data, size_t len, texcache_image_t *tc)
+{
+	const DDS_HEADER *dds = data;
+	const DDS_HEADER_DXT10 *dxt10 = (const DDS_HEADER_DXT10 *)(dds + 1);
+	size_t offset = sizeof(*dds) + sizeof(*dxt10);
+	int block_size;
+
+	if (len < offset)
+		return false;
+
+	if (dds->magic != DDS_MAGIC || dds->size != sizeof(DDS_HEADER) - 4 || dds->ddspf.fourCC != MAKEFOURCC('D', 'X', '1', '0'))
+		return false;
+
+	switch (dxt10->dxgiFormat)
+	{
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+		tc->format = VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+		block_size = 8;
+		break;
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+		tc->format = VK_FORMAT_BC3_SRGB_BLOCK;
+		block_size = 16;
+		break;
+	default:
+		return false;
+	}
+
+	if (dds->mipMapCount > MAX_TEXCACHE_LEVELS)
+		return false;
+
+	int w = image->upload_width;
+	int h = image->upload_height;
+	tc->num_levels = num_levels_for_size(w, h);
+
+	if (dds->width != w || dds->height != h || dds->mipMapCount != tc->num_levels)
+		return false;
+
+	for (int level = 0; level < tc->num_levels; level++)
+	{
+		uint32_t size = level_size(w, h, level, block_size);
+		if (offset + size > len)
+			return false;
+
+		tc->levels[level] = (const byte *)data + offset;
+		tc->level_sizes[level] = size;
+		offset += size;
+	}
+
+	tc->file_data = data;
+	return true;
+}
+
+/*
+=================
+Encoding
+=================
+*/
+
+typedef struct
+{
+	const byte *pixels;
+	byte *out;
+	int width;
+	int height;
+	int block_size;
+	bool alpha;
+} encode_job_t;
+
+static void encode_block_rows(void *arg, int begin, int end)
+{
+	const encode_job_t *job = arg;
+	int blocks_x = (job->width + 3) / 4;
+	byte block[64];
+
+	for (int by = begin; by < end; by++)
+	{
+		byte *out = job->out + by * blocks_x * job->block_size;
+
+		for (int bx = 0; bx < blocks_x; bx++)
+		{
+			// replicate edge pixels into partial blocks
+			for (int y = 0; y < 4; y++)
+			{
+				int sy = min(by * 4 + y, job->height - 1);
+				for (int x = 0; x < 4; x++)
+				{
+					int sx = min(bx * 4 + x, job->width - 1);
+					memcpy(block + (y * 4 + x) * 4, job->pixels + (sy * job->width + sx) * 4, 4);
+				}
+			}
+
+			stb_compress_dxt_block(out, block, job->alpha, STB_DXT_NORMAL);
+			out += job->block_size;
+		}
+	}
+}
+
+static void *encode_dds(const image_t *image, size_t *len_p)
+{
+	int w = image->upload_width;
+	int h = image->upload_height;
+	int num_levels = num_levels_for_size(w, h);
+	bool alpha = has_alpha(image);
+	int block_size = alpha ? 16 : 8;
+
+	size_t len = sizeof(DDS_HEADER) + sizeof(DDS_HEADER_DXT10);
+	for (int level = 0; level < num_levels; level++)
+		len += level_size(w, h, level, block_size);
+
+	byte *data = Z_Mallocz(len);
+
+	DDS_HEADER *dds = (DDS_HEADER *)data;
+	dds->magic = DDS_MAGIC;
+	dds->size = sizeof(DDS_HEADER) - 4;
+	dds->flags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_MIPMAP | DDS_HEADER_FLAGS_LINEARSIZE;
+	dds->width = w;
+	dds->height = h;
+	dds->pitchOrLinearSize = level_size(w, h, 0, block_size);
+	dds->mipMapCount = num_levels;
+	dds->ddspf.size = sizeof(DDS_PIXELFORMAT);
+	dds->ddspf.flags = DDS_FOURCC;
+	dds->ddspf.fourCC = MAKEFOURCC('D', 'X', '1', '0');
+	dds->caps = DDS_SURFACE_FLAGS_TEXTURE | DDS_SURFACE_FLAGS_MIPMAP;
+
+	DDS_HEADER_DXT10 *dxt10 = (DDS_HEADER_DXT10 *)(dds + 1);
+	dxt10->dxgiFormat = alpha ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM_SRGB;
+	dxt10->resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	dxt10->arraySize = 1;
+
+	// mips are filtered in linear space, like the GPU blits for sRGB formats
+	byte *pixels = IMG_AllocPixels(w * h * 4);
+	memcpy(pixels, image->pix_data, w * h * 4);
+
+	encode_job_t job = {
+		.pixels = pixels,
+		.out = (byte *)(dxt10 + 1),
+		.width = w,
+		.height = h,
+		.block_size = block_size,
+		.alpha = alpha,
+	};
+
+	for (int level = 0; level < num_levels; level++)
+	{
+		int blocks_y = (job.height + 3) / 4;
+		int blocks_x = (job.width + 3) / 4;
+		Com_ParallelFor(blocks_y, max(1024 / blocks_x, 1), encode_block_rows, &job);
+
+		if (level + 1 < num_levels)
+			IMG_MipMapEx(pixels, pixels, job.width, job.height, IMG_FILTER_LINEAR);
+
+		job.out += level_size(w, h, level, block_size);
+		job.width = max(job.width >> 1, 1);
+		job.height = max(job.height >> 1, 1);
+	}
+
+	IMG_FreePixels(pixels);
+
+	*len_p = len;
+	return data;
+}
+
+// Finds or creates the cache entry for an image
+static bool lookup_image(const image_t *image, texcache_image_t *tc, bool *encoded)
+{
+	char path[MAX_OSPATH];
+	void *data;
+	int ret;
+
+	uint32_t header[3] = { TEXCACHE_VERSION, image->upload_width, image->upload_height };
+
+	*encoded = false;
+	get_cache_path(image, header, sizeof(header), ".dds", path, sizeof(path));
+
+	ret = FS_LoadFile(path, &data);
+	if (ret >= 0)
+	{
+		if (parse_dds(image, data, ret, tc))
+			return true;
+
+		Com_WPrintf("Ignoring invalid texture cache file %s for %s\n", path, image->name);
+		FS_FreeFile(data);
+	}
+
+	size_t len;
+	data = encode_dds(image, &len);
+
+	ret = FS_WriteFile(path, data, len);
+	if (ret < 0)
+		Com_WPrintf("Couldn't write %s: %s\n", path, Q_ErrorString(ret));
+
+	if (!parse_dds(image, data, len, tc))
+	{
+		Z_Free(data);
+		return false;
+	}
+
+	*encoded = true;
+	return true;
+}
+
+bool vkpt_texcache_get(const image_t *image, texcache_image_t *tc)
+{
+	bool encoded;
+
+	memset(tc, 0, sizeof(*tc));
+
+	if (!cvar_pt_texture_compression->integer || !qvk.supports_bc)
+		return false;
+
+	// keep UI images sharp
+	if (image->type == IT_PIC || image->type == IT_FONT)
+		return false;
+
+	if (!can_compress(image))
+		return false;
+
+	if (!lookup_image(image, tc, &encoded))
+	{
+		texcache_stats.failures++;
+		return false;
+	}
+
+	if (encoded)
+		texcache_stats.encoded++;
+	else
+		texcache_stats.hits++;
+
+	return true;
+}
+
+void vkpt_texcache_release(texcache_image_t *tc)
+{
+	if (tc->file_data)
+		FS_FreeFile(tc->file_data);
+
+	memset(tc, 0, sizeof(*tc));
+}
+
+/*
+=================
+Fake emissive textures
+=================
+*/
+
+typedef struct
+{
+	uint32_t ident;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	float light_color[3];
+	float min_light_texcoord[2];
+	float max_light_texcoord[2];
+	uint32_t entire_texture_emissive;
+	uint32_t num_words;
+} emissive_header_t;
+
+#define BLACK_PIXEL LittleLong(MakeLittleLong(0, 0, 0, 255))
+
+bool vkpt_texcache_emissive_path(const image_t *image, int threshold, char *path, size_t size)
+{
+	if (!cvar_pt_emissive_cache->integer || !image->pix_data || image->pixel_format != PF_R8G8B8A8_UNORM)
+		return false;
+
+	uint32_t header[4] = { EMISSIVE_VERSION, image->upload_width, image->upload_height, threshold };
+	get_cache_path(image, header, sizeof(header), ".emissive", path, size);
+	return true;
+}
+
+// Decodes pairs of (black pixel count, literal pixel count) followed by literal pixels
+static bool decode_emissive(const uint32_t *words, uint32_t num_words, uint32_t *out, uint32_t num_pixels)
+{
+	const uint32_t *end = words + num_words;
+	uint32_t pos = 0;
+
+	while (words < end)
+	{
+		if (end - words < 2)
+			return false;
+
+		uint32_t black = LittleLong(words[0]);
+		uint32_t literal = LittleLong(words[1]);
+		words += 2;
+
+		if (black > num_pixels - pos || literal > num_pixels - pos - black || literal > (uint32_t)(end - words))
+			return false;
+
+		for (uint32_t i = 0; i < black; i++)
+			out[pos++] = BLACK_PIXEL;
+
+		memcpy(out + pos, words, literal * sizeof(uint32_t));
+		pos += literal;
+		words += literal;
+	}
+
+	return pos == num_pixels;
+}
+
+bool vkpt_texcache_load_emissive(const char *path, image_t *image)
+{
+	emissive_header_t *header;
+	int len = FS_LoadFile(path, (void **)&header);
+
+	if (len < 0)
+		return false;
+
+	uint32_t width = 0, height = 0, num_words = 0;
+	uint32_t *pixels = NULL;
+
+	if (len < sizeof(*header) || LittleLong(header->ident) != EMISSIVE_IDENT || LittleLong(header->version) != EMISSIVE_VERSION)
+		goto fail;
+
+	width = LittleLong(header->width);
+	height = LittleLong(header->height);
+	num_words = LittleLong(header->num_words);
+	if (width < 1 || width > MAX_TEXTURE_SIZE * 2 || height < 1 || height > MAX_TEXTURE_SIZE * 2)
+		goto fail;
+	if (num_words > (len - sizeof(*header)) / sizeof(uint32_t))
+		goto fail;
+
+	pixels = IMG_AllocPixels(width * height * 4);
+	if (!decode_emissive((const uint32_t *)(header + 1), num_words, pixels, width * height))
+		goto fail;
+
+	Z_Free(image->pix_data);
+	image->pix_data = (byte *)pixels;
+	image->upload_width = width;
+	image->upload_height = height;
+	for (int i = 0; i < 3; i++)
+		image->light_color[i] = LittleFloat(header->light_color[i]);
+	for (int i = 0; i < 2; i++)
+	{
+		image->min_light_texcoord[i] = LittleFloat(header->min_light_texcoord[i]);
+		image->max_light_texcoord[i] = LittleFloat(header->max_light_texcoord[i]);
+	}
+	image->entire_texture_emissive = LittleLong(header->entire_texture_emissive) != 0;
+	image->processing_complete = true;
+
+	FS_FreeFile(header);
+	texcache_stats.emissive_hits++;
+	return true;
+
+fail:
+	Com_WPrintf("Ignoring invalid emissive cache file %s for %s\n", path, image->name);
+	if (pixels)
+		Z_Free(pixels);
+	FS_FreeFile(header);
+	return false;
+}
+
+void vkpt_texcache_save_emissive(const char *path, const image_t *image)
+{
+	const uint32_t *pixels = (const uint32_t *)image->pix_data;
+	uint32_t num_pixels = image->upload_width * image->upload_height;
+
+	// worst case is a pair of counts for every literal pixel
+	emissive_header_t *header = Z_Malloc(sizeof(*header) + num_pixels * 3 * sizeof(uint32_t));
+	uint32_t *words = (uint32_t *)(header + 1);
+	uint32_t num_words = 0;
+
+	for (uint32_t pos = 0; pos < num_pixels; )
+	{
+		uint32_t black = 0, literal = 0;
+
+		while (pos + black < num_pixels && pixels[pos + black] == BLACK_PIXEL)
+			black++;
+		pos += black;
+
+		// short black runs are cheaper to store as literals
+		while (pos + literal < num_pixels)
+		{
+			if (pixels[pos + literal] == BLACK_PIXEL)
+			{
+				uint32_t run = 1;
+				while (run < 3 && pos + literal + run < num_pixels && pixels[pos + literal + run] == BLACK_PIXEL)
+					run++;
+				if (run >= 3 || pos + literal + run == num_pixels)
+					break;
+			}
+			literal++;
+		}
+
+		words[num_words++] = LittleLong(black);
+		words[num_words++] = LittleLong(literal);
+		memcpy(words + num_words, pixels + pos, literal * sizeof(uint32_t));
+		num_words += literal;
+		pos += literal;
+	}
+
+	header->ident = LittleLong(EMISSIVE_IDENT);
+	header->version = LittleLong(EMISSIVE_VERSION);
+	header->width = LittleLong(image->upload_width);
+	header->height = LittleLong(image->upload_height);
+	for (int i = 0; i < 3; i++)
+		header->light_color[i] = LittleFloat(image->light_color[i]);
+	for (int i = 0; i < 2; i++)
+	{
+		header->min_light_texcoord[i] = LittleFloat(image->min_light_texcoord[i]);
+		header->max_light_texcoord[i] = LittleFloat(image->max_light_texcoord[i]);
+	}
+	header->entire_texture_emissive = LittleLong(image->entire_texture_emissive);
+	header->num_words = LittleLong(num_words);
+
+	int ret = FS_WriteFile(path, header, sizeof(*header) + num_words * sizeof(uint32_t));
+	if (ret < 0)
+		Com_WPrintf("Couldn't write %s: %s\n", path, Q_ErrorString(ret));
+	else
+		texcache_stats.emissive_written++;
+
+	Z_Free(header);
+}
+
+/*
+=================
+Console commands
+=================
+*/
+
+static bool build_image(const image_t *image, int *built, int *cached)
+{
+	texcache_image_t tc;
+	bool encoded;
+
+	if (!can_compress(image))
+		return false;
+
+	if (!lookup_image(image, &tc, &encoded))
+		return false;
+
+	vkpt_texcache_release(&tc);
+
+	if (encoded)
+		(*built)++;
+	else
+		(*cached)++;
+
+	return true;
+}
+
+static void texcache_build_f(void)
+{
+	int built = 0, cached = 0, skipped = 0;
+	unsigned start = Sys_Milliseconds();
+
+	if (Cmd_Argc() < 2)
+	{
+		// all currently loaded textures
+		for (int i = 0; i < r_numImages; i++)
+		{
+			const image_t *image = r_images + i;
+
+			if (!image->registration_sequence || image->type == IT_PIC || image->type == IT_FONT)
+				continue;
+
+			if (!build_image(image, &built, &cached))
+				skipped++;
+		}
+	}
+	else
+	{
+		int count;
+		void **list = FS_ListFiles(Cmd_Argv(1), ".png;.tga;.jpg", FS_SEARCH_SAVEPATH | FS_SEARCH_RECURSIVE, &count);
+
+		if (!list)
+		{
+			Com_Printf("No textures found in %s\n", Cmd_Argv(1));
+			return;
+		}
+
+		for (int i = 0; i < count; i++)
+		{
+			const char *name = list[i];
+			image_t image;
+
+			// normal maps are not compressed
+			if (strstr(name, "_n."))
+			{
+				skipped++;
+				continue;
+			}
+
+			memset(&image, 0, sizeof(image));
+			if (load_img(name, &image) < 0)
+			{
+				skipped++;
+				continue;
+			}
+
+			image.is_srgb = 1;
+
+			if (!build_image(&image, &built, &cached))
+				skipped++;
+
+			Z_Free(image.pix_data);
+		}
+
+		FS_FreeList(list);
+	}
+
+	Com_Printf("%d textures compressed, %d already cached, %d skipped, %u msec\n",
+		built, cached, skipped, Sys_Milliseconds() - start);
+}
+
+static void texcache_stats_f(void)
+{
+	Com_Printf("Texture cache: %d hits, %d encoded, %d failures\n",
+		texcache_stats.hits, texcache_stats.encoded, texcache_stats.failures);
+	Com_Printf("Emissive cache: %d hits, %d written\n",
+		texcache_stats.emissive_hits, texcache_stats.emissive_written);
+}
+
+static const cmdreg_t cmds[] = {
+	{ "texcache_build", texcache_build_f, NULL },
+	{ "texcache_stats", texcache_stats_f, NULL },
+	{ NULL, NULL, NULL }
+};
+
+void vkpt_texcache_init(void)
+{
+	cvar_pt_texture_compression = Cvar_Get("pt_texture_compression", "0", CVAR_ARCHIVE | CVAR_FILES);
+	cvar_pt_emissive_cache = Cvar_Get("pt_emissive_cache", "1", CVAR_ARCHIVE);
+
+	// older versions of the encoder initialize their tables on first use,
+	// make sure that doesn't happen on worker threads
+	byte block[64] = { 0 }, out[16];
+	stb_compress_dxt_block(out, block, 1, STB_DXT_NORMAL);
+
+	Cmd_Register(cmds);
+}
+
+void vkpt_texcache_shutdown(void)
+{
+	Cmd_RemoveCommand("texcache_build");
+	Cmd_RemoveCommand("texcache_stats");
+}
@@ -0,0 +1,52 @@
+/*
+Copyright (C) 2019, NVIDIA CORPORATION. All rights reserved.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef __TEXTURE_CACHE_H_
+#define __TEXTURE_CACHE_H_
+
+#include "vkpt.h"
+
+// log2(MAX_TEXTURE_SIZE) + 1, vkpt doesn't cap image sizes, so larger
+// images are left uncompressed
+#define MAX_TEXCACHE_LEVELS 13
+
+// Block compressed mip chain of a texture, stored in a cached DDS file
+typedef struct
+{
+	VkFormat format;
+	int num_levels;
+	void *file_data;
+	const byte *levels[MAX_TEXCACHE_LEVELS];
+	uint32_t level_sizes[MAX_TEXCACHE_LEVELS];
+} texcache_image_t;
+
+void vkpt_texcache_init(void);
+void vkpt_texcache_shutdown(void);
+
+// Returns the compressed version of the image if texture compression is enabled
+// and the image is suitable for it, encoding and caching it if needed.
+bool vkpt_texcache_get(const image_t *image, texcache_image_t *tc);
+void vkpt_texcache_release(texcache_image_t *tc);
+
+// Fake emissive textures and their light info, cached by source pixels and threshold.
+// Path is only valid if caching is enabled.
+bool vkpt_texcache_emissive_path(const image_t *image, int threshold, char *path, size_t size);
+bool vkpt_texcache_load_emissive(const char *path, image_t *image);
+void vkpt_texcache_save_emissive(const char *path, const image_t *image);
+
+#endif // __TEXTURE_CACHE_H_
@@ -20,12 +20,20 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "vkpt.h"
 #include "vk_util.h"
 #include "refresh/images.h"
+#include "common/async.h"
 #include "device_memory_allocator.h"
 
 #include <assert.h>
 
-#include "color.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2	1
+#include <emmintrin.h>
+#else
+#define USE_SSE2	0
+#endif
+
 #include "material.h"
+#include "texture_cache.h"
 #include "../stb/stb_image.h"
 #include "../stb/stb_image_resize2.h"
 #include "../stb/stb_image_write.h"
@@ -54,6 +62,7 @@ typedef struct TextureSystem
 static TextureSystem texture_system = { 0 };
 
 static VkImage          tex_images     [MAX_RIMAGES] = { 0 };
+static texcache_image_t tex_compressed [MAX_RIMAGES] = { 0 };
 static VkImageView      tex_image_views[MAX_RIMAGES] = { 0 };
 static VkImageView      tex_image_views_mip0[MAX_RIMAGES] = { 0 };
 static VkDeviceMemory   mem_blue_noise, mem_envmap;
@@ -518,274 +527,171 @@ IMG_Load
 ================
 */
 
-struct filterscratch_s
-{
-	int num_comps;
-	int pad_left, pad_right;
-	float *ptr;
-};
+/*
+================
+Emissive texture analysis
 
-static void filterscratch_init(struct filterscratch_s* scratch, unsigned kernel_size, int stripe_size, int num_comps)
-{
-	scratch->num_comps = num_comps;
-	scratch->pad_left = kernel_size / 2;
-	scratch->pad_right = kernel_size - scratch->pad_left - 1;
-	int num_scratch_pixels = scratch->pad_left + stripe_size + scratch->pad_right;
-	scratch->ptr = Z_Malloc(num_scratch_pixels * num_comps * sizeof(float));
-}
+Pixel passes run on horizontal stripes of the image in parallel. Reductions
+keep one partial result per stripe and combine them in stripe order, so
+results don't depend on the number of threads.
+================
+*/
 
-static void filterscratch_free(struct filterscratch_s* scratch)
+#define EMISSIVE_MAX_STRIPES	64
+#define EMISSIVE_STRIPE_PIXELS	16384
+
+static int num_emissive_stripes(int w, int h)
 {
-	Z_Free(scratch->ptr);
+	int count = (w * h) / EMISSIVE_STRIPE_PIXELS;
+	return clamp(count, 1, min(h, EMISSIVE_MAX_STRIPES));
 }
 
-static void filterscratch_fill_from_float_image(struct filterscratch_s *scratch, float *current_stripe, int stripe_size, int element_stride)
+static inline void stripe_rows(int stripe, int num_stripes, int h, int *y0, int *y1)
 {
-	const int num_comps = scratch->num_comps;
-	int src = -scratch->pad_left;
-	float *dest_ptr = scratch->ptr;
-	if ((stripe_size >= scratch->pad_left) && (stripe_size >= scratch->pad_right))
-	{
-		for (; src < 0; src++)
-		{
-			const float *src_data = current_stripe + (src + stripe_size) * element_stride * num_comps;
-			memcpy(dest_ptr, src_data, num_comps * sizeof(float));
-			dest_ptr += num_comps;
-		}
-		for (; src < stripe_size; src++)
-		{
-			const float *src_data = current_stripe + src * element_stride * num_comps;
-			memcpy(dest_ptr, src_data, num_comps * sizeof(float));
-			dest_ptr += num_comps;
-		}
-		for (; src < stripe_size + scratch->pad_right; src++)
-		{
-			const float *src_data = current_stripe + (src - stripe_size) * element_stride * num_comps;
-			memcpy(dest_ptr, src_data, num_comps * sizeof(float));
-			dest_ptr += num_comps;
-		}
-	}
-	else
-	{
-		// The (probably) rarer case - filter kernel is larger than image
-		while(src < 0)
-			src += stripe_size;
-		for (int i = 0; i < scratch->pad_left + stripe_size + scratch->pad_right; i++)
-		{
-			const float *src_data = current_stripe + src * element_stride * num_comps;
-			memcpy(dest_ptr, src_data, num_comps * sizeof(float));
-			dest_ptr += scratch->num_comps;
-			src = (src + 1) % stripe_size;
-		}
-	}
+	*y0 = (int)((int64_t)h * stripe / num_stripes);
+	*y1 = (int)((int64_t)h * (stripe + 1) / num_stripes);
 }
 
-/* Apply a (separable) filter along one dimension of an image.
- * Whether this is done along the X or Y dimension depends on the "stripe size"
- * and "stripe stride" options. See filter_image() for how to use it practically. */
-static void filter_one_dimension_float(float* pixels, int num_comps,
-									   const float kernel[], unsigned kernel_size,
-									   int stripe_size, int num_stripes,
-									   int stripe_stride, int element_stride)
+#if USE_SSE2
+// luminance of 4 pixels, with sRGB decoded through a table
+static inline __m128 luminance_sse2(const byte *p)
 {
-	struct filterscratch_s scratch;
-	filterscratch_init(&scratch, kernel_size, stripe_size, num_comps);
-	float *current_stripe = pixels;
-	float* values = alloca(num_comps * sizeof(float));
-	for (int s = 0; s < num_stripes; s++)
-	{
-		// back up image data to scratch buffer
-		filterscratch_fill_from_float_image(&scratch, current_stripe, stripe_size, element_stride);
-		// filter the stripe
-		for (int i = 0; i < stripe_size; i++)
-		{
-			memset(values, 0, num_comps * sizeof(float));
-			for (int j = 0; j < kernel_size; j++)
-			{
-				float f = kernel[j];
-				float *src_p = scratch.ptr + (i + j) * num_comps;
-				for (int c = 0; c < num_comps; c++)
-				{
-					values[c] += f * src_p[c];
-				}
-			}
-			memcpy(current_stripe + i * element_stride * num_comps, values, num_comps * sizeof(float));
-		}
-		current_stripe += stripe_stride * num_comps;
-	}
-	filterscratch_free(&scratch);
+	const float *lut = img_srgb_to_linear;
+	__m128 r = _mm_setr_ps(lut[p[0]], lut[p[4]], lut[p[8]], lut[p[12]]);
+	__m128 g = _mm_setr_ps(lut[p[1]], lut[p[5]], lut[p[9]], lut[p[13]]);
+	__m128 b = _mm_setr_ps(lut[p[2]], lut[p[6]], lut[p[10]], lut[p[14]]);
+
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.2126f)), _mm_mul_ps(g, _mm_set1_ps(0.7152f))),
+		_mm_mul_ps(b, _mm_set1_ps(0.0722f)));
 }
 
-// Apply a (separable) filter to an image.
-static void filter_float_image(float* pixels, int num_comps, const float kernel[], unsigned kernel_size, int width, int height)
+static inline float hmax_sse2(__m128 v)
 {
-	// Filter horizontally
-	filter_one_dimension_float(pixels, num_comps, kernel, kernel_size, width, height, width, 1);
-	// Filter vertically
-	filter_one_dimension_float(pixels, num_comps, kernel, kernel_size, height, width, 1, width);
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(v);
 }
+#endif
 
-struct bilerp_s
+static float max_float_row(const float *row, int count)
 {
-	int current_output_row;
-	float *current_input_data;
-	float *next_input_data;
-	float *output_data;
-};
+	float max_value = 0;
+	int x = 0;
+
+#if USE_SSE2
+	__m128 vmax = _mm_setzero_ps();
+	for (; x + 4 <= count; x += 4)
+		vmax = _mm_max_ps(vmax, _mm_loadu_ps(row + x));
+	max_value = hmax_sse2(vmax);
+#endif
 
-static void bilerp_init(struct bilerp_s* bilerp, int input_w)
-{
-	bilerp->current_output_row = -1;
-	bilerp->current_input_data = IMG_AllocPixels(input_w * sizeof(float) * 3);
-	bilerp->next_input_data = IMG_AllocPixels(input_w * sizeof(float) * 3);
-	bilerp->output_data = IMG_AllocPixels(input_w * 2 * sizeof(float) * 3);
-}
+	for (; x < count; x++)
+		max_value = max(max_value, row[x]);
 
-static void bilerp_free(struct bilerp_s* bilerp)
-{
-	Z_Free(bilerp->current_input_data);
-	Z_Free(bilerp->next_input_data);
-	Z_Free(bilerp->output_data);
+	return max_value;
 }
 
-static inline void _bilerp_get_next_output_line(struct bilerp_s *bilerp, const float** output_line, const float* next_input, int input_w)
+typedef struct
 {
-	if(bilerp->current_output_row == -1) {
-		memcpy(bilerp->next_input_data, next_input, input_w * sizeof(float) * 3);
-		bilerp->current_output_row = 0;
-	}
+	const byte *pixels;
+	float *bright_mask;
+	float *final;
+	byte *out;
+	int width;
+	int height;
+	int num_stripes;
+	byte bright_threshold;
+	float src_lum_scale;
+	float lum_scale;
+	float stripe_max[EMISSIVE_MAX_STRIPES];
+} fake_emissive_job_t;
+
+/* Extract "bright" pixels by choosing all those that have one component
+   larger than some threshold. */
+static void bright_mask_stripes(void *arg, int begin, int end)
+{
+	fake_emissive_job_t *job = arg;
 
-	if((bilerp->current_output_row & 1) == 0) {
-		// Even output line: use input lines
-		// Swap next_input_data into current_input_data
-		float *tmp = bilerp->next_input_data;
-		bilerp->next_input_data = bilerp->current_input_data;
-		bilerp->current_input_data = tmp;
-	} else {
-		// Odd output line: interpolate between input lines
-		memcpy(bilerp->next_input_data, next_input, input_w * sizeof(float) * 3);
-
-		float *color_ptr = bilerp->current_input_data;
-		float *next_color_ptr = bilerp->next_input_data;
-		for (int x = 0; x < input_w; x++) {
-			color_ptr[0] = (color_ptr[0] + next_color_ptr[0]) * 0.5f;
-			color_ptr[1] = (color_ptr[1] + next_color_ptr[1]) * 0.5f;
-			color_ptr[2] = (color_ptr[2] + next_color_ptr[2]) * 0.5f;
-			color_ptr += 3;
-			next_color_ptr += 3;
-		}
-	}
+	for (int stripe = begin; stripe < end; stripe++)
+	{
+		int y0, y1;
+		stripe_rows(stripe, job->num_stripes, job->height, &y0, &y1);
 
-	float *out_ptr = bilerp->output_data;
-	float color[3];
-	const float* color_ptr = bilerp->current_input_data;
-	for (int out_x = 0; out_x < input_w * 2 - 1; out_x++) {
-		if((out_x & 1) == 0) {
-			// Even output row: direct value
-			memcpy(color, color_ptr, 3 * sizeof(float));
-		} else {
-			// Odd output row: interpolate between colors
-			color_ptr += 3;
-			color[0] = (color[0] + color_ptr[0]) * 0.5f;
-			color[1] = (color[1] + color_ptr[1]) * 0.5f;
-			color[2] = (color[2] + color_ptr[2]) * 0.5f;
-		}
-		memcpy(out_ptr, color, 3 * sizeof(float));
-		out_ptr += 3;
-	}
+		const byte *src_pixel = job->pixels + y0 * job->width * 4;
+		float *current_bright_mask = job->bright_mask + y0 * job->width;
+		int count = (y1 - y0) * job->width;
+		float max_src_lum = 0;
+		int i = 0;
 
-	// Last row: interpolate between last and first pixel
-	color[0] = (color_ptr[0] + bilerp->current_input_data[0]) * 0.5f;
-	color[1] = (color_ptr[1] + bilerp->current_input_data[1]) * 0.5f;
-	color[2] = (color_ptr[2] + bilerp->current_input_data[2]) * 0.5f;
-	memcpy(out_ptr, color, 3 * sizeof(float));
+#if USE_SSE2
+		const __m128i threshold = _mm_set1_epi32(job->bright_threshold - 1);
+		const __m128i comp_mask = _mm_set1_epi32(0xff);
+		__m128 vmax = _mm_setzero_ps();
 
-	*output_line = bilerp->output_data;
+		for (; i + 4 <= count; i += 4, src_pixel += 16, current_bright_mask += 4)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *)src_pixel);
+			__m128i max_comp = _mm_max_epu8(v, _mm_srli_epi32(v, 8));
+			max_comp = _mm_and_si128(_mm_max_epu8(max_comp, _mm_srli_epi32(v, 16)), comp_mask);
+			__m128 bright = _mm_castsi128_ps(_mm_cmpgt_epi32(max_comp, threshold));
+
+			__m128 src_lum = luminance_sse2(src_pixel);
+			_mm_storeu_ps(current_bright_mask, _mm_and_ps(src_lum, bright));
+			vmax = _mm_max_ps(vmax, src_lum);
+		}
+		max_src_lum = hmax_sse2(vmax);
+#endif
 
-	bilerp->current_output_row++;
-}
+		for (; i < count; i++, src_pixel += 4, current_bright_mask++)
+		{
+			const float *lut = img_srgb_to_linear;
+			float src_lum = LUMINANCE(lut[src_pixel[0]], lut[src_pixel[1]], lut[src_pixel[2]]);
+			byte max_comp = max(src_pixel[0], src_pixel[1]);
+			max_comp = max(src_pixel[2], max_comp);
+			*current_bright_mask = (max_comp < job->bright_threshold) ? 0 : src_lum;
+			max_src_lum = max(max_src_lum, src_lum);
+		}
 
-static inline void bilerp_get_next_output_line_from_rgb_f32(struct bilerp_s *bilerp, const float** output_line, const float* input_data, int input_w, int input_h)
-{
-	const float *next_input = NULL;
-	if (bilerp->current_output_row == -1) {
-		next_input = input_data;
-	} else if ((bilerp->current_output_row & 1) != 0) {
-		int in_y = (bilerp->current_output_row + 1) >> 1;
-		// Wraparound last line
-		if(in_y >= input_h)
-			in_y = 0;
-		next_input = input_data + in_y * input_w * 3;
+		job->stripe_max[stripe] = max_src_lum;
 	}
-	_bilerp_get_next_output_line(bilerp, output_line, next_input, input_w);
 }
 
-// Fake an emissive texture from a diffuse texture by using pixels brighter than a certain amount
-static void apply_fake_emissive_threshold(image_t *image, int bright_threshold_int)
+static void max_mask_stripes(void *arg, int begin, int end)
 {
-	int w = image->upload_width;
-	int h = image->upload_height;
+	fake_emissive_job_t *job = arg;
 
-	float *bright_mask = IMG_AllocPixels(w * h * sizeof(float));
+	for (int stripe = begin; stripe < end; stripe++)
+	{
+		int y0, y1;
+		stripe_rows(stripe, job->num_stripes, job->height, &y0, &y1);
 
-	/* Extract "bright" pixels by choosing all those that have one component
-	   larger than some threshold. */
-	clamp(bright_threshold_int, 0, 255);
-	byte bright_threshold = (byte)bright_threshold_int;
-
-	float *current_bright_mask = bright_mask;
-	byte *src_pixel = image->pix_data;
-	float max_src_lum = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			float src_lum = LUMINANCE(decode_srgb(src_pixel[0]), decode_srgb(src_pixel[1]), decode_srgb(src_pixel[2]));
-			byte max_comp = max(src_pixel[0], src_pixel[1]);
-			max_comp = max(src_pixel[2], max_comp);
-			if (max_comp < bright_threshold) {
-				*current_bright_mask = 0;
-			} else {
-				*current_bright_mask = src_lum;
-			}
-			if (src_lum > max_src_lum)
-				max_src_lum = src_lum;
-			current_bright_mask++;
-			src_pixel += 4;
-		}
+		job->stripe_max[stripe] = max_float_row(job->bright_mask + y0 * job->width, (y1 - y0) * job->width);
 	}
-	float src_lum_scale = max_src_lum > 0 ? 1.0f / max_src_lum : 1.0f;
-
-	// Blur those "bright" pixels
-	const float filter[] = { 0.0093f, 0.028002f, 0.065984f, 0.121703f, 0.175713f, 0.198596f, 0.175713f, 0.121703f, 0.065984f, 0.028002f, 0.0093f };
-	filter_float_image(bright_mask, 1, filter, sizeof(filter) / sizeof(filter[0]), w, h);
+}
 
-	// Do a pass to find max luminance of bright_mask...
-	current_bright_mask = bright_mask;
-	float max_lum = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			float lum = *current_bright_mask;
-			if (lum > max_lum)
-				max_lum = lum;
+/* Combine blurred "bright" mask with original image (to retain some colorization).
+   Produce float output for upsampling pass */
+static void combine_stripes(void *arg, int begin, int end)
+{
+	const fake_emissive_job_t *job = arg;
+	const float *lut = img_srgb_to_linear;
 
-			current_bright_mask++;
-		}
-	}
-	// ...and use it to normalize max luminance to 1
-	float lum_scale = max_lum > 0 ? 1.0f / max_lum : 1.0f;
+	for (int stripe = begin; stripe < end; stripe++)
+	{
+		int y0, y1;
+		stripe_rows(stripe, job->num_stripes, job->height, &y0, &y1);
 
-	/* Combine blurred "bright" mask with original image (to retain some colorization).
-	   Produce float output for upsampling pass */
-	float *final = IMG_AllocPixels(w * h * 3 * sizeof(float));
+		const byte *current_img_pixel = job->pixels + y0 * job->width * 4;
+		const float *current_bright_mask = job->bright_mask + y0 * job->width;
+		float *out_final = job->final + y0 * job->width * 3;
+		int count = (y1 - y0) * job->width;
 
-	float *out_final = final;
-	current_bright_mask = bright_mask;
-	byte *current_img_pixel = image->pix_data;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
+		for (int i = 0; i < count; i++)
+		{
 			vec3_t color_img;
-			color_img[0] = decode_srgb(current_img_pixel[0]);
-			color_img[1] = decode_srgb(current_img_pixel[1]);
-			color_img[2] = decode_srgb(current_img_pixel[2]);
+			color_img[0] = lut[current_img_pixel[0]];
+			color_img[1] = lut[current_img_pixel[1]];
+			color_img[2] = lut[current_img_pixel[2]];
 
 			/* The formula for the "emissive" color is objectively weird,
 			   but is subjectively suitable for typical "light" textures...
@@ -794,9 +700,9 @@ static void apply_fake_emissive_threshold(image_t *image, int bright_threshold_i
 			float src_lum = LUMINANCE(color_img[0], color_img[1], color_img[2]);
 			/* Normalize source luminance to increase resulting emissive intensity
 			 * on textures that are relatively dark */
-			src_lum *= src_lum_scale;
+			src_lum *= job->src_lum_scale;
 			src_lum *= src_lum;
-			float scale = *current_bright_mask * src_lum * lum_scale;
+			float scale = *current_bright_mask * src_lum * job->lum_scale;
 			out_final[0] = color_img[0] * scale;
 			out_final[1] = color_img[1] * scale;
 			out_final[2] = color_img[2] * scale;
@@ -806,50 +712,121 @@ static void apply_fake_emissive_threshold(image_t *image, int bright_threshold_i
 			current_img_pixel += 4;
 		}
 	}
-	Z_Free(bright_mask);
+}
+
+// Final -> SRGB
+static void encode_stripes(void *arg, int begin, int end)
+{
+	const fake_emissive_job_t *job = arg;
+
+	for (int stripe = begin; stripe < end; stripe++)
+	{
+		int y0, y1;
+		stripe_rows(stripe, job->num_stripes, job->height, &y0, &y1);
+
+		const float *current_pixel = job->final + y0 * job->width * 3;
+		byte *out_pixel = job->out + y0 * job->width * 4;
+		int count = (y1 - y0) * job->width;
+
+		for (int i = 0; i < count; i++)
+		{
+			out_pixel[0] = IMG_LinearToSrgb(current_pixel[0]);
+			out_pixel[1] = IMG_LinearToSrgb(current_pixel[1]);
+			out_pixel[2] = IMG_LinearToSrgb(current_pixel[2]);
+			out_pixel[3] = 255;
+
+			current_pixel += 3;
+			out_pixel += 4;
+		}
+	}
+}
+
+static float reduce_stripe_max(const fake_emissive_job_t *job)
+{
+	float max_value = 0;
+
+	for (int i = 0; i < job->num_stripes; i++)
+		max_value = max(max_value, job->stripe_max[i]);
+
+	return max_value;
+}
+
+// Fake an emissive texture from a diffuse texture by using pixels brighter than a certain amount
+static void apply_fake_emissive_threshold(image_t *image, int bright_threshold_int)
+{
+	int w = image->upload_width;
+	int h = image->upload_height;
+	fake_emissive_job_t job;
+
+	clamp(bright_threshold_int, 0, 255);
+
+	char cache_path[MAX_OSPATH];
+	bool use_cache = vkpt_texcache_emissive_path(image, bright_threshold_int, cache_path, sizeof(cache_path));
+	if (use_cache && vkpt_texcache_load_emissive(cache_path, image))
+		return;
+
+	memset(&job, 0, sizeof(job));
+	job.pixels = image->pix_data;
+	job.width = w;
+	job.height = h;
+	job.num_stripes = num_emissive_stripes(w, h);
+	job.bright_threshold = (byte)bright_threshold_int;
+	job.bright_mask = IMG_AllocPixels(w * h * sizeof(float));
+
+	Com_ParallelFor(job.num_stripes, 1, bright_mask_stripes, &job);
+
+	float max_src_lum = reduce_stripe_max(&job);
+	job.src_lum_scale = max_src_lum > 0 ? 1.0f / max_src_lum : 1.0f;
+
+	// Blur those "bright" pixels
+	const float filter[] = { 0.0093f, 0.028002f, 0.065984f, 0.121703f, 0.175713f, 0.198596f, 0.175713f, 0.121703f, 0.065984f, 0.028002f, 0.0093f };
+	IMG_FilterFloat(job.bright_mask, 1, filter, sizeof(filter) / sizeof(filter[0]), w, h);
+
+	// Find max luminance of bright_mask and use it to normalize max luminance to 1
+	Com_ParallelFor(job.num_stripes, 1, max_mask_stripes, &job);
+
+	float max_lum = reduce_stripe_max(&job);
+	job.lum_scale = max_lum > 0 ? 1.0f / max_lum : 1.0f;
+
+	float *final = IMG_AllocPixels(w * h * 3 * sizeof(float));
+	job.final = final;
+
+	Com_ParallelFor(job.num_stripes, 1, combine_stripes, &job);
+
+	Z_Free(job.bright_mask);
 
 	// Interpolate final image to 2x size, apply a mild filter, to have it look less blocky
 	int width_2x = w * 2;
 	int height_2x = h * 2;
 	float *final_2x = IMG_AllocPixels(width_2x * height_2x * 3 * sizeof(float));
 
-	struct bilerp_s bilerp_final;
-	bilerp_init(&bilerp_final, w);
-	float *out_final_2x = final_2x;
-	for (int out_y = 0; out_y < height_2x; out_y++) {
-		float *img_line;
-		bilerp_get_next_output_line_from_rgb_f32(&bilerp_final, (const float**)&img_line, final, w, h);
-		memcpy(out_final_2x, img_line, width_2x * 3 * sizeof(float));
-		out_final_2x += width_2x * 3;
-	}
-	bilerp_free(&bilerp_final);
+	IMG_Upsample2xFloat(final_2x, final, 3, w, h);
 	Z_Free(final);
 
 	const float filter_final[] = { 0.157731f, 0.684538f, 0.157731f };
-	filter_float_image(final_2x, 3, filter_final, sizeof(filter_final) / sizeof(filter_final[0]), width_2x, height_2x);
+	IMG_FilterFloat(final_2x, 3, filter_final, sizeof(filter_final) / sizeof(filter_final[0]), width_2x, height_2x);
 
-	// Final -> SRGB
 	int new_size = width_2x * height_2x * 4;
 	Z_Free(image->pix_data);
 	image->pix_data = IMG_AllocPixels(new_size);
 	image->upload_width = width_2x;
 	image->upload_height = height_2x;
 
-	float* current_pixel = final_2x;
-	byte *out_pixel = image->pix_data;
-	for (int y = 0; y < height_2x; y++) {
-		for (int x = 0; x < width_2x; x++) {
-			out_pixel[0] = encode_srgb(current_pixel[0]);
-			out_pixel[1] = encode_srgb(current_pixel[1]);
-			out_pixel[2] = encode_srgb(current_pixel[2]);
-			out_pixel[3] = 255;
+	job.final = final_2x;
+	job.out = image->pix_data;
+	job.width = width_2x;
+	job.height = height_2x;
+	job.num_stripes = num_emissive_stripes(width_2x, height_2x);
 
-			current_pixel += 3;
-			out_pixel += 4;
-		}
-	}
+	Com_ParallelFor(job.num_stripes, 1, encode_stripes, &job);
 
 	Z_Free(final_2x);
+
+	if (use_cache)
+	{
+		vkpt_extract_emissive_texture_info(image);
+		vkpt_texcache_save_emissive(cache_path, image);
+	}
 }
 
 image_t *vkpt_fake_emissive_texture(image_t *image, int bright_threshold_int)
@@ -885,18 +862,140 @@ image_t *vkpt_fake_emissive_texture(image_t *image, int bright_threshold_int)
 		return image;
 
 	new_image->flags |= IF_FAKE_EMISSIVE | (clamp(bright_threshold_int, 0, 255) << IF_FAKE_EMISSIVE_THRESH_SHIFT);
+	new_image->processing_complete = false;
 	apply_fake_emissive_threshold(new_image, bright_threshold_int);
 
 	return new_image;
 }
 
+typedef struct
+{
+	const byte *pixels;
+	int width;
+	int height;
+	int num_stripes;
+	float lut[256];
+	struct {
+		vec3_t color;
+		int min_x, max_x;
+		int min_y, max_y;
+	} stripes[EMISSIVE_MAX_STRIPES];
+} emissive_info_job_t;
+
+// returns index of the first pixel with nonzero color in a row, or count
+static int first_lit_pixel(const byte *row, int count)
+{
+	int x = 0;
+
+#if USE_SSE2
+	const __m128i color_mask = _mm_set1_epi32(0x00ffffff);
+	for (; x + 4 <= count; x += 4)
+	{
+		__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(row + x * 4)), color_mask);
+		int zero = _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128()));
+		if (zero != 0xffff)
+			break;
+	}
+#endif
+
+	for (; x < count; x++)
+		if (row[x * 4 + 0] | row[x * 4 + 1] | row[x * 4 + 2])
+			break;
+
+	return x;
+}
+
+// returns index of the last pixel with nonzero color in a row, or -1
+static int last_lit_pixel(const byte *row, int count)
+{
+	int x = count;
+
+#if USE_SSE2
+	const __m128i color_mask = _mm_set1_epi32(0x00ffffff);
+	for (; x >= 4; x -= 4)
+	{
+		__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(row + (x - 4) * 4)), color_mask);
+		int zero = _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128()));
+		if (zero != 0xffff)
+			break;
+	}
+#endif
+
+	for (x--; x >= 0; x--)
+		if (row[x * 4 + 0] | row[x * 4 + 1] | row[x * 4 + 2])
+			break;
+
+	return x;
+}
+
+static void emissive_info_stripes(void *arg, int begin, int end)
+{
+	emissive_info_job_t *job = arg;
+
+	for (int stripe = begin; stripe < end; stripe++)
+	{
+		int y0, y1;
+		stripe_rows(stripe, job->num_stripes, job->height, &y0, &y1);
+
+		vec3_t emissive_color;
+		VectorClear(emissive_color);
+
+		int min_x = job->width;
+		int max_x = -1;
+		int min_y = job->height;
+		int max_y = -1;
+
+		for (int y = y0; y < y1; y++)
+		{
+			const byte *row = job->pixels + y * job->width * 4;
+
+			int first = first_lit_pixel(row, job->width);
+			if (first == job->width)
+				continue;
+
+			int last = last_lit_pixel(row, job->width);
+
+			// black pixels in between contribute nothing, see emissive_lut
+			const byte *current_pixel = row + first * 4;
+			for (int x = first; x <= last; x++, current_pixel += 4)
+			{
+				emissive_color[0] += job->lut[current_pixel[0]];
+				emissive_color[1] += job->lut[current_pixel[1]];
+				emissive_color[2] += job->lut[current_pixel[2]];
+			}
+
+			min_x = min(min_x, first);
+			max_x = max(max_x, last);
+			min_y = min(min_y, y);
+			max_y = y;
+		}
+
+		VectorCopy(emissive_color, job->stripes[stripe].color);
+		job->stripes[stripe].min_x = min_x;
+		job->stripes[stripe].max_x = max_x;
+		job->stripes[stripe].min_y = min_y;
+		job->stripes[stripe].max_y = max_y;
+	}
+}
+
 void
 vkpt_extract_emissive_texture_info(image_t *image)
 {
 	int w = image->upload_width;
 	int h = image->upload_height;
+	emissive_info_job_t job_data, *job = &job_data;
+
+	job->pixels = image->pix_data;
+	job->width = w;
+	job->height = h;
+	job->num_stripes = num_emissive_stripes(w, h);
+
+	// decoded color with bias, black maps to exactly 0
+	for (int i = 0; i < 256; i++)
+		job->lut[i] = max(0.f, img_srgb_to_linear[i] + EMISSIVE_TRANSFORM_BIAS);
+
+	Com_ParallelFor(job->num_stripes, 1, emissive_info_stripes, job);
 
-	byte* current_pixel = image->pix_data;
 	vec3_t emissive_color;
 	VectorClear(emissive_color);
 
@@ -904,30 +1003,14 @@ vkpt_extract_emissive_texture_info(image_t *image)
 	int max_x = -1;
 	int min_y = h;
 	int max_y = -1;
-	
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			if(current_pixel[0] + current_pixel[1] + current_pixel[2] > 0)
-			{
-				vec3_t color;
-				color[0] = decode_srgb(current_pixel[0]);
-				color[1] = decode_srgb(current_pixel[1]);
-				color[2] = decode_srgb(current_pixel[2]);
-
-				color[0] = max(0.f, color[0] + EMISSIVE_TRANSFORM_BIAS);
-				color[1] = max(0.f, color[1] + EMISSIVE_TRANSFORM_BIAS);
-				color[2] = max(0.f, color[2] + EMISSIVE_TRANSFORM_BIAS);
-
-				VectorAdd(emissive_color, color, emissive_color);
 
-				min_x = min(min_x, x);
-				min_y = min(min_y, y);
-				max_x = max(max_x, x);
-				max_y = max(max_y, y);
-			}
-			
-			current_pixel += 4;
-		}
+	for (int i = 0; i < job->num_stripes; i++)
+	{
+		VectorAdd(emissive_color, job->stripes[i].color, emissive_color);
+		min_x = min(min_x, job->stripes[i].min_x);
+		max_x = max(max_x, job->stripes[i].max_x);
+		min_y = min(min_y, job->stripes[i].min_y);
+		max_y = max(max_y, job->stripes[i].max_y);
 	}
 
 	if (min_x <= max_x && min_y <= max_y)
@@ -1545,6 +1628,14 @@ static VkFormat get_image_format(image_t *q_img)
 	return VK_FORMAT_R8G8B8A8_UNORM;
 }
 
+static VkFormat get_texture_format(int index)
+{
+	if (tex_compressed[index].file_data)
+		return tex_compressed[index].format;
+
+	return get_image_format(r_images + index);
+}
+
 VkResult
 vkpt_textures_end_registration()
 {
@@ -1616,10 +1707,13 @@ vkpt_textures_end_registration()
 		if (tex_images[i] != VK_NULL_HANDLE || !q_img->registration_sequence || q_img->pix_data == NULL)
 			continue;
 
+		// use the precompressed mip chain if there is one
+		vkpt_texcache_get(q_img, tex_compressed + i);
+
 		img_info.extent.width = q_img->upload_width;
 		img_info.extent.height = q_img->upload_height;
 		img_info.mipLevels = get_num_miplevels(q_img->upload_width, q_img->upload_height);
-		img_info.format = get_image_format(q_img);
+		img_info.format = get_texture_format(i);
 		if (!q_img->is_srgb)
 			img_info.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
 		else
@@ -1677,7 +1771,7 @@ vkpt_textures_end_registration()
 
 		img_view_info.image = tex_images[i];
 		img_view_info.subresourceRange.levelCount = num_mip_levels;
-		img_view_info.format = get_image_format(q_img);
+		img_view_info.format = get_texture_format(i);
 		_VK(vkCreateImageView(qvk.device, &img_view_info, NULL, tex_image_views + i));
 		ATTACH_LABEL_VARIABLE(tex_image_views[i], IMAGE_VIEW);
 
@@ -1738,6 +1832,50 @@ vkpt_textures_end_registration()
 			.newLayout        = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
 		);
 
+		texcache_image_t *tc = tex_compressed + i;
+		if (tc->file_data)
+		{
+			// Copy all mip levels, they don't need to be generated later
+			VkBufferImageCopy cpy_info[MAX_TEXCACHE_LEVELS];
+			size_t level_offset = offset;
+
+			for (int level = 0; level < tc->num_levels; level++)
+			{
+				memcpy(staging_buffer + level_offset, tc->levels[level], tc->level_sizes[level]);
+
+				cpy_info[level] = (VkBufferImageCopy) {
+					.bufferOffset = level_offset,
+					.imageSubresource = {
+						.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+						.mipLevel       = level,
+						.baseArrayLayer = 0,
+						.layerCount     = 1,
+					},
+					.imageOffset    = { 0, 0, 0 },
+					.imageExtent    = { max(wd >> level, 1), max(ht >> level, 1), 1 }
+				};
+
+				level_offset += tc->level_sizes[level];
+			}
+
+			assert(level_offset - offset <= mem_req.size);
+
+			vkCmdCopyBufferToImage(cmd_buf, buf_img_upload.buffer, tex_images[i],
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, tc->num_levels, cpy_info);
+
+			IMAGE_BARRIER(cmd_buf,
+				.image = tex_images[i],
+				.subresourceRange = subresource_range,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				.newLayout = VK_IMAGE_LAYOUT_GENERAL
+			);
+
+			offset += mem_req.size;
+			continue;
+		}
+
 		int bytes_per_pixel = q_img->pixel_format == PF_R16_UNORM ? 2 : 4;
 		memcpy(staging_buffer + offset, q_img->pix_data, wd * ht * bytes_per_pixel);
 
@@ -1793,6 +1931,12 @@ vkpt_textures_end_registration()
 		if (tex_upload_frames[i] != qvk.current_frame_index + 1)
 			continue;
 
+		if (tex_compressed[i].file_data)
+		{
+			vkpt_texcache_release(tex_compressed + i);
+			continue;
+		}
+
 		VkImageSubresourceRange subresource_range = {
 			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
 			.baseMipLevel = 0,
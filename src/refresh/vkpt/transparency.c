@@ -18,11 +18,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <assert.h>
 #include "shared/shared.h"
+#include "common/async.h"
 #include "vkpt.h"
 #include "vk_util.h"
-#include "color.h"
 #include "conversion.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2	1
+#include <emmintrin.h>
+#else
+#define USE_SSE2	0
+#endif
+
 #define TR_PARTICLE_MAX_NUM    MAX_PARTICLES
 #define TR_BEAM_MAX_NUM        MAX_ENTITIES
 #define TR_SPRITE_MAX_NUM      MAX_ENTITIES
@@ -33,6 +40,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define TR_COLOR_SIZE          (4 * sizeof(float))
 #define TR_BEAM_INTERSECT_SIZE (12 * sizeof(float))
 #define TR_SPRITE_INFO_SIZE    (2 * sizeof(float))
+#define TR_PARTICLE_GRAIN      1024
 
 struct
 {
@@ -55,7 +63,7 @@ struct
 	unsigned int host_frame_index;
 	unsigned int host_buffered_frame_num;
 	char* mapped_host_buffer;
-	char* host_buffer_shadow;
+	char* host_frame_data;
 	BufferResource_t vertex_buffer;
 	BufferResource_t index_buffer;
 	BufferResource_t beam_aabb_buffer;
@@ -79,6 +87,16 @@ static void create_buffer_views(void);
 static void fill_index_buffer(void);
 
 // update
+typedef struct
+{
+	const particle_t* particles;
+	vec3_t* vertex_positions;
+	float* colors;
+	vec3_t view_origin;
+	vec3_t view_y;
+	float particle_size;
+} particle_job_t;
+
 static void write_particle_geometry(const float* view_matrix, const particle_t* particles, int particle_num);
 static void write_beam_geometry(const entity_t* entities, int entity_num);
 static void write_sprite_geometry(const float* view_matrix, const entity_t* entities, int entity_num);
@@ -100,7 +118,7 @@ void cast_u32_to_f32_color(int color_index, const color_t* pcolor, float* color_
 		color.u32 = d_8to24table[color_index & 0xff];
 
 	for (int i = 0; i < 3; i++)
-		color_f32[i] = hdr_factor * decode_srgb(color.u8[i]);
+		color_f32[i] = hdr_factor * img_srgb_to_linear[color.u8[i]];
 }
 
 bool initialize_transparency()
@@ -155,17 +173,13 @@ void destroy_transparency()
 
 	vkDestroyBuffer(qvk.device, transparency.host_buffer, NULL);
 	vkFreeMemory(qvk.device, transparency.host_buffer_memory, NULL);
-
-	if (transparency.host_buffer_shadow)
-	{
-		Z_Freep((void**)&transparency.host_buffer_shadow);
-	}
 }
 
 void update_transparency(VkCommandBuffer command_buffer, const float* view_matrix,
 	const particle_t* particles, int particle_num, const entity_t* entities, int entity_num)
 {
 	transparency.host_frame_index = (transparency.host_frame_index + 1) % transparency.host_buffered_frame_num;
+	transparency.host_frame_data = transparency.mapped_host_buffer + transparency.host_frame_index * transparency.host_frame_size;
 	particle_num = min(particle_num, TR_PARTICLE_MAX_NUM);
 
 	uint32_t beam_num = 0;
@@ -284,22 +298,14 @@ void get_transparency_counts(int* particle_num, int* beam_num, int* sprite_num)
 	*sprite_num = transparency.sprite_num;
 }
 
-static void write_particle_geometry(const float* view_matrix, const particle_t* particles, int particle_num)
+static void write_particles_scalar(const particle_job_t* job, int begin, int end)
 {
-	const float particle_size = cvar_pt_particle_size->value;
-
-	const vec3_t view_y = { view_matrix[1], view_matrix[5], view_matrix[9] };
+	vec3_t* vertex_positions = job->vertex_positions + begin * 4;
+	float* particle_colors = job->colors + begin * 4;
 
-	// TODO: remove vkpt_refdef.fd, it's better to calculate it from the view matrix
-	const vec3_t view_origin = { vkpt_refdef.fd->vieworg[0], vkpt_refdef.fd->vieworg[1], vkpt_refdef.fd->vieworg[2] };
-
-	// TODO: use better alignment?
-	vec3_t* vertex_positions = (vec3_t*)(transparency.host_buffer_shadow + transparency.vertex_position_host_offset);
-	float* particle_colors = (float*)(transparency.host_buffer_shadow + transparency.particle_color_host_offset);
-
-	for (int i = 0; i < particle_num; i++)
+	for (int i = begin; i < end; i++)
 	{
-		const particle_t* particle = particles + i;
+		const particle_t* particle = job->particles + i;
 
 		cast_u32_to_f32_color(particle->color, &particle->rgba, particle_colors, particle->brightness);
 		particle_colors[3] = particle->alpha;
@@ -309,19 +315,19 @@ static void write_particle_geometry(const float* view_matrix, const particle_t*
 		VectorCopy(particle->origin, origin);
 
 		vec3_t z_axis;
-		VectorSubtract(view_origin, origin, z_axis);
+		VectorSubtract(job->view_origin, origin, z_axis);
 		VectorNormalize(z_axis);
 
 		vec3_t x_axis;
 		vec3_t y_axis;
-		CrossProduct(z_axis, view_y, x_axis);
+		CrossProduct(z_axis, job->view_y, x_axis);
 		CrossProduct(x_axis, z_axis, y_axis);
 
 		const float size_factor = pow(particle->alpha, 0.05f);
 		if (particle->radius == 0.f)
 		{
-			VectorScale(y_axis, particle_size * size_factor, y_axis);
-			VectorScale(x_axis, particle_size * size_factor, x_axis);
+			VectorScale(y_axis, job->particle_size * size_factor, y_axis);
+			VectorScale(x_axis, job->particle_size * size_factor, x_axis);
 		}
 		else
 		{
@@ -346,6 +352,262 @@ static void write_particle_geometry(const float* view_matrix, const particle_t*
 	}
 }
 
+#if USE_SSE2
+// exp and log after the Cephes single precision versions, good to a few ulp
+static inline __m128 exp_sse2(__m128 x)
+{
+	x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-87.3f)), _mm_set1_ps(88.3f));
+
+	__m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f));
+	__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+	fx = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, fx), _mm_set1_ps(1.f)));
+
+	x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(0.693359375f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(-2.12194440e-4f)));
+
+	__m128 z = _mm_mul_ps(x, x);
+	__m128 y = _mm_set1_ps(1.9875691500e-4f);
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+	y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, z), x), _mm_set1_ps(1.f));
+
+	__m128i e = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(fx), _mm_set1_epi32(0x7f)), 23);
+	return _mm_mul_ps(y, _mm_castsi128_ps(e));
+}
+
+// only valid for positive normal x
+static inline __m128 log_sse2(__m128 x)
+{
+	__m128i bits = _mm_castps_si128(x);
+	__m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(0x7e)));
+
+	// mantissa in [0.5, 1)
+	x = _mm_or_ps(_mm_castsi128_ps(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff))), _mm_set1_ps(0.5f));
+
+	__m128 mask = _mm_cmplt_ps(x, _mm_set1_ps(0.707106781186547524f));
+	__m128 t = _mm_and_ps(x, mask);
+	x = _mm_sub_ps(x, _mm_set1_ps(1.f));
+	e = _mm_sub_ps(e, _mm_and_ps(mask, _mm_set1_ps(1.f)));
+	x = _mm_add_ps(x, t);
+
+	__m128 z = _mm_mul_ps(x, x);
+	__m128 y = _mm_set1_ps(7.0376836292e-2f);
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.1514610310e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.1676998740e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.2420140846e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.4249322787e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.6668057665e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(2.0000714765e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-2.4999993993e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(3.3333331174e-1f));
+	y = _mm_mul_ps(_mm_mul_ps(y, x), z);
+
+	y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(-2.12194440e-4f)));
+	y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+	x = _mm_add_ps(x, y);
+	return _mm_add_ps(x, _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+}
+
+#define CROSS_SSE2(ax, ay, az, bx, by, bz, cx, cy, cz) \
+	cx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)); \
+	cy = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz)); \
+	cz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx))
+
+// Expands 4 particles at a time, with the same math as write_particles_scalar
+// on SoA registers, then transposes the 4 quads back to vertex order.
+static void write_particles_sse2(const particle_job_t* job, int begin, int end)
+{
+	const __m128 view_ox = _mm_set1_ps(job->view_origin[0]);
+	const __m128 view_oy = _mm_set1_ps(job->view_origin[1]);
+	const __m128 view_oz = _mm_set1_ps(job->view_origin[2]);
+	const __m128 view_yx = _mm_set1_ps(job->view_y[0]);
+	const __m128 view_yy = _mm_set1_ps(job->view_y[1]);
+	const __m128 view_yz = _mm_set1_ps(job->view_y[2]);
+	const __m128 zero = _mm_setzero_ps();
+
+	float* out = job->vertex_positions[begin * 4];
+	float* particle_colors = job->colors + begin * 4;
+	int i;
+
+	for (i = begin; i + 4 <= end; i += 4)
+	{
+		const particle_t* p = job->particles + i;
+
+		for (int k = 0; k < 4; k++)
+		{
+			cast_u32_to_f32_color(p[k].color, &p[k].rgba, particle_colors, p[k].brightness);
+			particle_colors[3] = p[k].alpha;
+			particle_colors += 4;
+		}
+
+		__m128 ox = _mm_setr_ps(p[0].origin[0], p[1].origin[0], p[2].origin[0], p[3].origin[0]);
+		__m128 oy = _mm_setr_ps(p[0].origin[1], p[1].origin[1], p[2].origin[1], p[3].origin[1]);
+		__m128 oz = _mm_setr_ps(p[0].origin[2], p[1].origin[2], p[2].origin[2], p[3].origin[2]);
+		__m128 alpha = _mm_setr_ps(p[0].alpha, p[1].alpha, p[2].alpha, p[3].alpha);
+		__m128 radius = _mm_setr_ps(p[0].radius, p[1].radius, p[2].radius, p[3].radius);
+
+		__m128 zx = _mm_sub_ps(view_ox, ox);
+		__m128 zy = _mm_sub_ps(view_oy, oy);
+		__m128 zz = _mm_sub_ps(view_oz, oz);
+		__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(zx, zx), _mm_mul_ps(zy, zy)), _mm_mul_ps(zz, zz)));
+		__m128 inv_len = _mm_and_ps(_mm_cmpgt_ps(len, zero), _mm_div_ps(_mm_set1_ps(1.f), len));
+		zx = _mm_mul_ps(zx, inv_len);
+		zy = _mm_mul_ps(zy, inv_len);
+		zz = _mm_mul_ps(zz, inv_len);
+
+		__m128 xx, xy, xz, yx, yy, yz;
+		CROSS_SSE2(zx, zy, zz, view_yx, view_yy, view_yz, xx, xy, xz);
+		CROSS_SSE2(xx, xy, xz, zx, zy, zz, yx, yy, yz);
+
+		// pow(alpha, 0.05), which is 0 for alpha <= 0
+		__m128 size_factor = exp_sse2(_mm_mul_ps(log_sse2(_mm_max_ps(alpha, _mm_set1_ps(1e-30f))), _mm_set1_ps(0.05f)));
+		size_factor = _mm_and_ps(size_factor, _mm_cmpgt_ps(alpha, zero));
+		__m128 use_radius = _mm_cmpneq_ps(radius, zero);
+		__m128 size = _mm_or_ps(_mm_and_ps(use_radius, radius),
+			_mm_andnot_ps(use_radius, _mm_mul_ps(size_factor, _mm_set1_ps(job->particle_size))));
+
+		xx = _mm_mul_ps(xx, size); xy = _mm_mul_ps(xy, size); xz = _mm_mul_ps(xz, size);
+		yx = _mm_mul_ps(yx, size); yy = _mm_mul_ps(yy, size); yz = _mm_mul_ps(yz, size);
+
+		// quad corners: origin - x + y, origin + x + y, origin + x - y, origin - x - y
+		__m128 v[12];
+		v[0] = _mm_add_ps(_mm_sub_ps(ox, xx), yx);
+		v[1] = _mm_add_ps(_mm_sub_ps(oy, xy), yy);
+		v[2] = _mm_add_ps(_mm_sub_ps(oz, xz), yz);
+		v[3] = _mm_add_ps(_mm_add_ps(ox, xx), yx);
+		v[4] = _mm_add_ps(_mm_add_ps(oy, xy), yy);
+		v[5] = _mm_add_ps(_mm_add_ps(oz, xz), yz);
+		v[6] = _mm_sub_ps(_mm_add_ps(ox, xx), yx);
+		v[7] = _mm_sub_ps(_mm_add_ps(oy, xy), yy);
+		v[8] = _mm_sub_ps(_mm_add_ps(oz, xz), yz);
+		v[9] = _mm_sub_ps(_mm_sub_ps(ox, xx), yx);
+		v[10] = _mm_sub_ps(_mm_sub_ps(oy, xy), yy);
+		v[11] = _mm_sub_ps(_mm_sub_ps(oz, xz), yz);
+
+		_MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+		_MM_TRANSPOSE4_PS(v[4], v[5], v[6], v[7]);
+		_MM_TRANSPOSE4_PS(v[8], v[9], v[10], v[11]);
+
+		for (int k = 0; k < 4; k++)
+		{
+			_mm_storeu_ps(out + 0, v[k]);
+			_mm_storeu_ps(out + 4, v[k + 4]);
+			_mm_storeu_ps(out + 8, v[k + 8]);
+			out += 12;
+		}
+	}
+
+	write_particles_scalar(job, i, end);
+}
+
+#undef CROSS_SSE2
+#endif
+
+static void write_particle_range(void* arg, int begin, int end)
+{
+#if USE_SSE2
+	write_particles_sse2(arg, begin, end);
+#else
+	write_particles_scalar(arg, begin, end);
+#endif
+}
+
+static void setup_particle_job(particle_job_t* job, const float* view_matrix, const particle_t* particles, char* frame_data)
+{
+	job->particles = particles;
+	job->vertex_positions = (vec3_t*)(frame_data + transparency.vertex_position_host_offset);
+	job->colors = (float*)(frame_data + transparency.particle_color_host_offset);
+	job->particle_size = cvar_pt_particle_size->value;
+
+	VectorSet(job->view_y, view_matrix[1], view_matrix[5], view_matrix[9]);
+
+	// TODO: remove vkpt_refdef.fd, it's better to calculate it from the view matrix
+	VectorCopy(vkpt_refdef.fd->vieworg, job->view_origin);
+}
+
+// Billboards are written straight into this frame's slice of the mapped upload buffer,
+// split across worker threads.
+static void write_particle_geometry(const float* view_matrix, const particle_t* particles, int particle_num)
+{
+	particle_job_t job;
+	setup_particle_job(&job, view_matrix, particles, transparency.host_frame_data);
+	Com_ParallelFor(particle_num, TR_PARTICLE_GRAIN, write_particle_range, &job);
+}
+
+#if USE_TESTS
+// Expands a synthetic particle array with the scalar, SIMD and parallel writers
+// and compares the results. Does not touch the GPU buffers or the current view.
+void vkpt_particle_bench(void)
+{
+	int particle_num = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : TR_PARTICLE_MAX_NUM;
+	int passes = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 100;
+	clamp(particle_num, 1, TR_PARTICLE_MAX_NUM);
+	passes = max(passes, 1);
+
+	particle_t* particles = Z_Mallocz(particle_num * sizeof(particle_t));
+	const size_t vertex_size = particle_num * 4 * TR_POSITION_SIZE;
+	const size_t color_size = particle_num * TR_COLOR_SIZE;
+	char* buffers = Z_Malloc((vertex_size + color_size) * 2);
+
+	Q_srand(1);
+	for (int i = 0; i < particle_num; i++)
+	{
+		particle_t* particle = particles + i;
+		for (int j = 0; j < 3; j++)
+			particle->origin[j] = crand() * 1024;
+		particle->color = (i & 1) ? Q_rand_uniform(256) : -1;
+		particle->rgba.u32 = Q_rand();
+		particle->alpha = frand();
+		particle->brightness = 1.f + frand();
+		particle->radius = (i % 3) ? 0.f : frand() * 4;
+	}
+
+	particle_job_t job = {
+		.particles = particles,
+		.view_origin = { 16, -32, 64 },
+		.view_y = { 0, 0, 1 },
+		.particle_size = 0.5f
+	};
+
+	static const char* const names[] = { "scalar", "simd", "parallel" };
+	uint64_t time[3];
+	for (int k = 0; k < 3; k++)
+	{
+		char* data = buffers + (k ? vertex_size + color_size : 0);
+		job.vertex_positions = (vec3_t*)data;
+		job.colors = (float*)(data + vertex_size);
+
+		uint64_t start = Sys_Microseconds();
+		for (int pass = 0; pass < passes; pass++)
+		{
+			if (k == 0)
+				write_particles_scalar(&job, 0, particle_num);
+			else
+				Com_ParallelFor(particle_num, k == 1 ? TR_PARTICLE_MAX_NUM : TR_PARTICLE_GRAIN, write_particle_range, &job);
+		}
+		time[k] = Sys_Microseconds() - start;
+	}
+
+	// the SIMD pow() approximation is not bit exact
+	const float* ref = (const float*)buffers;
+	const float* test = (const float*)(buffers + vertex_size + color_size);
+	float max_error = 0.f;
+	for (size_t i = 0; i < (vertex_size + color_size) / sizeof(float); i++)
+		max_error = max(max_error, fabsf(ref[i] - test[i]));
+
+	for (int k = 0; k < 3; k++)
+		Com_Printf("%s: %.1f us\n", names[k], (float)time[k] / passes);
+	Com_Printf("%d particles, %d threads, max error %g, %s\n", particle_num, Com_ParallelThreads(),
+		max_error, max_error < 1e-3f ? "results match" : "RESULTS DIFFER");
+
+	Z_Free(buffers);
+	Z_Free(particles);
+}
+#endif
+
 static void write_beam_geometry(const entity_t* entities, int entity_num)
 {
 	const float hdr_factor = cvar_pt_particle_emissive->value;
@@ -356,9 +618,9 @@ static void write_beam_geometry(const entity_t* entities, int entity_num)
 	const size_t beam_aabb_offset = transparency.beam_aabb_host_offset;
 
 	// TODO: use better alignment?
-	VkAabbPositionsKHR* aabb_positions = (VkAabbPositionsKHR*)(transparency.host_buffer_shadow + beam_aabb_offset);
-	uint32_t* beam_infos = (uint32_t*)(transparency.host_buffer_shadow + transparency.beam_intersect_host_offset);
-	float* beam_colors = (float*)(transparency.host_buffer_shadow + transparency.beam_color_host_offset);
+	VkAabbPositionsKHR* aabb_positions = (VkAabbPositionsKHR*)(transparency.host_frame_data + beam_aabb_offset);
+	uint32_t* beam_infos = (uint32_t*)(transparency.host_frame_data + transparency.beam_intersect_host_offset);
+	float* beam_colors = (float*)(transparency.host_frame_data + transparency.beam_color_host_offset);
 
 	for (int i = 0; i < entity_num; i++)
 	{
@@ -626,8 +888,8 @@ static void write_sprite_geometry(const float* view_matrix, const entity_t* enti
 	const size_t sprite_vertex_offset = transparency.vertex_position_host_offset + particle_vertex_data_size;
 
 	// TODO: use better alignment?
-	vec3_t* vertex_positions = (vec3_t*)(transparency.host_buffer_shadow + sprite_vertex_offset);
-	uint32_t* sprite_info = (uint32_t*)(transparency.host_buffer_shadow + transparency.sprite_info_host_offset);
+	vec3_t* vertex_positions = (vec3_t*)(transparency.host_frame_data + sprite_vertex_offset);
+	uint32_t* sprite_info = (uint32_t*)(transparency.host_frame_data + transparency.sprite_info_host_offset);
 
 	int sprite_count = 0;
 	for (int i = 0; i < entity_num; i++)
@@ -704,8 +966,8 @@ static void upload_geometry(VkCommandBuffer command_buffer)
 
     const size_t host_buffer_offset = transparency.host_frame_index * transparency.host_frame_size;
 
+	// geometry has already been written to the mapped buffer at host_buffer_offset
 	assert(transparency.current_upload_size > 0);
-	memcpy(transparency.mapped_host_buffer + host_buffer_offset, transparency.host_buffer_shadow, transparency.current_upload_size);
 	transparency.current_upload_size = 0;
 
 	const VkBufferCopy vertices = {
@@ -876,8 +1138,6 @@ static bool allocate_and_bind_memory_to_buffers(void)
 	_VK(vkMapMemory(qvk.device, transparency.host_buffer_memory, 0, host_buffer_size, 0,
 		(void**)&transparency.mapped_host_buffer));
 
-	transparency.host_buffer_shadow = Z_Mallocz(transparency.host_frame_size);
-	
 	return true;
 }
 
@@ -926,7 +1186,7 @@ static void create_buffer_views(void)
 
 static void fill_index_buffer(void)
 {
-	uint16_t* indices = (uint16_t*)transparency.host_buffer_shadow;
+	uint16_t* indices = (uint16_t*)transparency.mapped_host_buffer;
 
 	for (size_t i = 0; i < TR_INDEX_MAX_NUM / 6; i++)
 	{
@@ -941,8 +1201,6 @@ static void fill_index_buffer(void)
 		quad[5] = base_vertex + 0;
 	}
 
-	memcpy(transparency.mapped_host_buffer, transparency.host_buffer_shadow, sizeof(uint16_t) * TR_INDEX_MAX_NUM);
-
 	VkCommandBuffer cmd_buf = vkpt_begin_command_buffer(&qvk.cmd_buffers_transfer);
 
 	const VkBufferMemoryBarrier pre_barrier = {
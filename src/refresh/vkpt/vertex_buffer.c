@@ -34,6 +34,27 @@ static VkPipelineLayout pipeline_layout_instance_geometry;
 model_vbo_t model_vertex_data[MAX_MODELS];
 static BufferResource_t null_buffer;
 
+// Model VBOs are suballocated from a buddy allocator arena. The VBOs of unloaded models
+// are kept in a small pool and adopted again when a model with the same data is loaded,
+// so going back and forth between maps doesn't re-upload and rebuild their BLAS.
+#define MODEL_ARENA_BLOCK_SIZE  (4 * 1024)
+#define MODEL_ARENA_CAPACITY    (MODEL_ARENA_BLOCK_SIZE * 16384)
+#define MAX_RETIRED_MODEL_VBOS  64
+
+static DeviceMemoryAllocator* model_memory_allocator;
+static model_vbo_t retired_vbos[MAX_RETIRED_MODEL_VBOS];
+static int num_retired_vbos;
+
+static struct
+{
+	int uploaded;
+	int adopted;
+	int kept;
+	int retired;
+	int evicted;
+	int dedicated;
+} model_vbo_stats;
+
 // Cvar that controls the initial animated primitive buffer size at startup.
 // The buffer can grow later if necessary, but that causes stutter.
 static cvar_t* cvar_pt_primbuf = NULL;
@@ -425,6 +446,82 @@ void vkpt_vertex_buffer_cleanup_bsp_mesh(bsp_mesh_t* bsp_mesh)
 	}
 }
 
+#define MAX_LIGHT_UPLOAD_RANGES 64
+#define LIGHT_POLY_SIZE         (LIGHT_POLY_VEC4S * sizeof(vec4_t))
+#define LIGHT_POLY_OFFSET(n)    (q_offsetof(LightBuffer, light_polys) + (n) * LIGHT_POLY_SIZE)
+
+// BSP light polys are only rewritten in the light buffer when one of their inputs
+// changes: the light style values, sky radiance, material emissive factor or the
+// animation frame. Model lights are rewritten every frame.
+static struct
+{
+	bool valid;
+	float styles[MAX_LIGHTSTYLES];
+	float prev_styles[MAX_LIGHTSTYLES];
+	vec3_t sky_radiance;
+	float emissive_factors[MAX_LIGHT_POLYS];
+	VkBufferCopy ranges[MAX_LIGHT_UPLOAD_RANGES];
+	int num_ranges;
+} light_upload;
+
+static struct
+{
+	int frames;
+	int bsp_lights;
+	int model_lights;
+	int ranges;
+	uint64_t total_bsp_lights;
+	uint64_t total_model_lights;
+} light_upload_stats;
+
+// Adds a light to the upload ranges, returns false when that would need more than max_ranges.
+static bool add_light_upload_range(int nlight, int max_ranges)
+{
+	const VkDeviceSize offset = LIGHT_POLY_OFFSET(nlight);
+
+	if (light_upload.num_ranges)
+	{
+		VkBufferCopy* last = light_upload.ranges + light_upload.num_ranges - 1;
+		if (last->srcOffset + last->size == offset)
+		{
+			last->size += LIGHT_POLY_SIZE;
+			return true;
+		}
+	}
+
+	if (light_upload.num_ranges >= max_ranges)
+		return false;
+
+	light_upload.ranges[light_upload.num_ranges++] = (VkBufferCopy) {
+		.srcOffset = offset,
+		.dstOffset = offset,
+		.size = LIGHT_POLY_SIZE
+	};
+	return true;
+}
+
+// First light after the last upload range
+static int light_upload_ranges_end(void)
+{
+	const VkBufferCopy* last = light_upload.ranges + light_upload.num_ranges - 1;
+	return (last->srcOffset + last->size - LIGHT_POLY_OFFSET(0)) / LIGHT_POLY_SIZE;
+}
+
+void vkpt_light_buffer_invalidate(void)
+{
+	light_upload.valid = false;
+}
+
+static void lightbuffer_stats_f(void)
+{
+	int frames = max(light_upload_stats.frames, 1);
+
+	Com_Printf("Last frame: %d BSP lights and %d model lights written in %d ranges\n",
+		light_upload_stats.bsp_lights, light_upload_stats.model_lights, light_upload_stats.ranges);
+	Com_Printf("Average over %d frames: %.1f BSP lights, %.1f model lights\n", light_upload_stats.frames,
+		(double)light_upload_stats.total_bsp_lights / frames, (double)light_upload_stats.total_model_lights / frames);
+}
+
 VkResult
 vkpt_light_buffer_upload_staging(VkCommandBuffer cmd_buf)
 {
@@ -432,10 +529,21 @@ vkpt_light_buffer_upload_staging(VkCommandBuffer cmd_buf)
 
 	assert(!staging->is_mapped);
 
-	VkBufferCopy copyRegion = {
-		.size = sizeof(LightBuffer),
+	// everything around the light polys is rebuilt every frame,
+	// the light polys themselves only where they were written this frame
+	VkBufferCopy regions[MAX_LIGHT_UPLOAD_RANGES + 2] = {
+		{
+			.size = q_offsetof(LightBuffer, light_polys),
+		},
+		{
+			.srcOffset = LIGHT_POLY_OFFSET(MAX_LIGHT_POLYS),
+			.dstOffset = LIGHT_POLY_OFFSET(MAX_LIGHT_POLYS),
+			.size = sizeof(LightBuffer) - LIGHT_POLY_OFFSET(MAX_LIGHT_POLYS),
+		}
 	};
-	vkCmdCopyBuffer(cmd_buf, staging->buffer, qvk.buf_light.buffer, 1, &copyRegion);
+	memcpy(regions + 2, light_upload.ranges, light_upload.num_ranges * sizeof(VkBufferCopy));
+	vkCmdCopyBuffer(cmd_buf, staging->buffer, qvk.buf_light.buffer, 2 + light_upload.num_ranges, regions);
+	light_upload.num_ranges = 0;
 
 	int buffer_idx = qvk.frame_counter % 3;
 	if (qvk.buf_light_stats[buffer_idx].buffer)
@@ -469,6 +577,7 @@ static int max_model_lights;
 void vkpt_light_buffer_reset_counts()
 {
 	max_model_lights = 0;
+	vkpt_light_buffer_invalidate();
 }
 
 static void copy_bsp_lights(bsp_mesh_t* bsp_mesh, LightBuffer *lbo)
@@ -601,21 +710,40 @@ inject_model_lights(bsp_mesh_t* bsp_mesh, bsp_t* bsp, int num_model_lights, ligh
 #endif
 }
 
-static inline void
-copy_light(const light_poly_t* light, float* vblight, const float* sky_radiance)
+static void
+get_light_style_scales(float* styles, float* prev_styles)
 {
-	float style_scale = 1.f;
-	float prev_style = 1.f;
-	if (light->style != 0 && vkpt_refdef.fd->lightstyles)
+	styles[0] = prev_styles[0] = 1.f;
+
+	for (int nstyle = 1; nstyle < MAX_LIGHTSTYLES; nstyle++)
 	{
-		style_scale = vkpt_refdef.fd->lightstyles[light->style].white;
-		style_scale = max(0.f, min(2.f, style_scale));
+		float style_scale = 1.f;
+		float prev_style = 1.f;
+		if (vkpt_refdef.fd->lightstyles)
+		{
+			style_scale = vkpt_refdef.fd->lightstyles[nstyle].white;
+			style_scale = max(0.f, min(2.f, style_scale));
 
-		prev_style = vkpt_refdef.prev_lightstyles[light->style].white;
-		prev_style = max(0.f, min(2.f, prev_style));
+			prev_style = vkpt_refdef.prev_lightstyles[nstyle].white;
+			prev_style = max(0.f, min(2.f, prev_style));
+		}
+		styles[nstyle] = style_scale;
+		prev_styles[nstyle] = prev_style;
 	}
+}
+
+static inline float
+get_light_emissive_factor(const light_poly_t* light)
+{
+	return light->material ? light->material->emissive_factor : 1.f;
+}
 
-	float mat_scale = light->material ? light->material->emissive_factor : 1.f;
+static inline void
+copy_light(const light_poly_t* light, float* vblight, const float* sky_radiance, const float* styles, const float* prev_styles)
+{
+	float style_scale = styles[light->style];
+	float prev_style = prev_styles[light->style];
+	float mat_scale = get_light_emissive_factor(light);
 
 	VectorCopy(light->positions + 0, vblight + 0);
 	VectorCopy(light->positions + 3, vblight + 4);
@@ -689,19 +817,71 @@ vkpt_light_buffer_upload_to_staging(bool render_world, bsp_mesh_t *bsp_mesh, bsp
 			copy_bsp_lights(bsp_mesh, lbo);
 		}
 
+		float styles[MAX_LIGHTSTYLES];
+		float prev_styles[MAX_LIGHTSTYLES];
+		bool style_changed[MAX_LIGHTSTYLES];
+		get_light_style_scales(styles, prev_styles);
+
+		for (int nstyle = 0; nstyle < MAX_LIGHTSTYLES; nstyle++)
+		{
+			style_changed[nstyle] = styles[nstyle] != light_upload.styles[nstyle]
+				|| prev_styles[nstyle] != light_upload.prev_styles[nstyle];
+		}
+		const bool sky_changed = !VectorCompare(sky_radiance, light_upload.sky_radiance);
+
+		memcpy(light_upload.styles, styles, sizeof(styles));
+		memcpy(light_upload.prev_styles, prev_styles, sizeof(prev_styles));
+		VectorCopy(sky_radiance, light_upload.sky_radiance);
+
+		// once the upload ranges run out, all lights after the last range are written,
+		// one range is kept for the model lights
+		bool write_all = !light_upload.valid;
+		int num_written = 0;
+
 		for (int nlight = 0; nlight < bsp_mesh->num_light_polys && nlight < MAX_LIGHT_POLYS; nlight++)
 		{
 			light_poly_t* light = bsp_mesh->light_polys + nlight;
+			float emissive_factor = get_light_emissive_factor(light);
+
+			if (!write_all
+				&& !style_changed[light->style]
+				&& !(sky_changed && light->color[0] < 0.f)
+				&& !Q_IsBitSet(bsp_mesh->light_polys_dirty, nlight)
+				&& emissive_factor == light_upload.emissive_factors[nlight])
+				continue;
+
+			if (!add_light_upload_range(nlight, MAX_LIGHT_UPLOAD_RANGES - 1))
+			{
+				write_all = true;
+				nlight = light_upload_ranges_end() - 1;
+				continue;
+			}
+
 			float* vblight = *(lbo->light_polys + nlight * LIGHT_POLY_VEC4S);
-			copy_light(light, vblight, sky_radiance);
+			copy_light(light, vblight, sky_radiance, styles, prev_styles);
+			light_upload.emissive_factors[nlight] = emissive_factor;
+			num_written++;
 		}
 
+		memset(bsp_mesh->light_polys_dirty, 0, sizeof(bsp_mesh->light_polys_dirty));
+		light_upload.valid = true;
+
+		int num_model_written = 0;
 		for (int nlight = 0; nlight < num_model_lights && nlight + model_light_offset < MAX_LIGHT_POLYS; nlight++)
 		{
 			light_poly_t* light = transformed_model_lights + nlight;
 			float* vblight = *(lbo->light_polys + (nlight + model_light_offset) * LIGHT_POLY_VEC4S);
-			copy_light(light, vblight, sky_radiance);
+			copy_light(light, vblight, sky_radiance, styles, prev_styles);
+			add_light_upload_range(nlight + model_light_offset, MAX_LIGHT_UPLOAD_RANGES);
+			num_model_written++;
 		}
+
+		light_upload_stats.frames++;
+		light_upload_stats.bsp_lights = num_written;
+		light_upload_stats.model_lights = num_model_written;
+		light_upload_stats.ranges = light_upload.num_ranges;
+		light_upload_stats.total_bsp_lights += num_written;
+		light_upload_stats.total_model_lights += num_model_written;
 	}
 	else
 	{
@@ -792,10 +972,202 @@ static void destroy_model_vbo(model_vbo_t* vbo)
 	vkpt_destroy_model_geometry(&vbo->geom_masked);
 
 	buffer_destroy(&vbo->buffer);
+
+	if (vbo->memory.memory != VK_NULL_HANDLE)
+		free_device_memory(model_memory_allocator, &vbo->memory);
 	
 	memset(vbo, 0, sizeof(model_vbo_t));
 }
 
+static void evict_retired_model_vbos(void)
+{
+	for (int i = 0; i < num_retired_vbos; i++)
+		destroy_model_vbo(retired_vbos + i);
+
+	model_vbo_stats.evicted += num_retired_vbos;
+	num_retired_vbos = 0;
+
+	trim_device_memory_allocator(model_memory_allocator);
+}
+
+// Moves the VBO into the retired pool, dropping the one that has been unused the longest if it is full
+static void retire_model_vbo(model_vbo_t* vbo)
+{
+	if (!vbo->buffer.buffer)
+		return;
+
+	if (num_retired_vbos == MAX_RETIRED_MODEL_VBOS)
+	{
+		int oldest = 0;
+		for (int i = 1; i < num_retired_vbos; i++)
+		{
+			if (retired_vbos[i].registration_sequence < retired_vbos[oldest].registration_sequence)
+				oldest = i;
+		}
+
+		destroy_model_vbo(retired_vbos + oldest);
+		retired_vbos[oldest] = retired_vbos[--num_retired_vbos];
+		model_vbo_stats.evicted++;
+	}
+
+	retired_vbos[num_retired_vbos++] = *vbo;
+	memset(vbo, 0, sizeof(model_vbo_t));
+	model_vbo_stats.retired++;
+}
+
+static bool adopt_retired_model_vbo(model_vbo_t* vbo, uint64_t key)
+{
+	for (int i = 0; i < num_retired_vbos; i++)
+	{
+		if (retired_vbos[i].key == key)
+		{
+			*vbo = retired_vbos[i];
+			retired_vbos[i] = retired_vbos[--num_retired_vbos];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static uint32_t get_model_material_categories(const model_t* model)
+{
+	uint32_t hash = 2166136261u;
+
+	for (int nmesh = 0; nmesh < model->nummeshes; nmesh++)
+	{
+		uint32_t flags = model->meshes[nmesh].materials[0]->flags;
+		uint32_t category = MAT_IsTransparent(flags) ? 1 : MAT_IsMasked(flags) ? 2 : 0;
+		hash = (hash ^ category) * 16777619u;
+	}
+
+	return hash;
+}
+
+static inline uint64_t hash_model_words(uint64_t hash, const void* data, size_t size)
+{
+	const uint32_t* words = data;
+
+	if (!data)
+		return hash;
+
+	for (size_t i = 0; i < size / sizeof(uint32_t); i++)
+		hash = (hash ^ words[i]) * 0x100000001b3ull;
+
+	return hash;
+}
+
+// Hashes everything stage_mesh_primitives reads, plus the material categories
+// that decide the BLAS layout of static models.
+static uint64_t get_model_vbo_key(const model_t* model, uint32_t material_categories)
+{
+	int header[3] = { model->numframes, model->nummeshes, material_categories };
+	uint64_t hash = hash_model_words(0xcbf29ce484222325ull, header, sizeof(header));
+
+	for (int nmesh = 0; nmesh < model->nummeshes; nmesh++)
+	{
+		const maliasmesh_t* m = model->meshes + nmesh;
+		const size_t num_verts = (size_t)m->numverts * model->numframes;
+
+		int counts[2] = { m->numtris, m->numverts };
+		hash = hash_model_words(hash, counts, sizeof(counts));
+		hash = hash_model_words(hash, m->indices, m->numtris * 3 * sizeof(int));
+		hash = hash_model_words(hash, m->positions, num_verts * sizeof(vec3_t));
+		hash = hash_model_words(hash, m->normals, num_verts * sizeof(vec3_t));
+		hash = hash_model_words(hash, m->tangents, num_verts * sizeof(vec3_t));
+		hash = hash_model_words(hash, m->tex_coords, num_verts * sizeof(vec2_t));
+		if (m->blend_indices && m->blend_weights)
+		{
+			hash = hash_model_words(hash, m->blend_indices, num_verts * sizeof(uint32_t));
+			hash = hash_model_words(hash, m->blend_weights, num_verts * sizeof(uint32_t));
+		}
+	}
+
+	return hash;
+}
+
+static void set_model_tri_offsets(const model_t* model)
+{
+	int write_ptr = 0;
+
+	for (int nmesh = 0; nmesh < model->nummeshes; nmesh++)
+	{
+		maliasmesh_t* m = model->meshes + nmesh;
+		m->tri_offset = write_ptr;
+		write_ptr += m->numtris * model->numframes;
+	}
+}
+
+// Creates the VBO buffer with its memory taken from the model arena.
+// Falls back to a dedicated allocation if that fails, even after dropping the retired VBOs.
+static VkResult create_model_vbo_buffer(model_vbo_t* vbo, VkDeviceSize size, VkBufferUsageFlags usage)
+{
+	VkBufferCreateInfo buf_create_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size  = size,
+		.usage = usage,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+
+	memset(&vbo->buffer, 0, sizeof(vbo->buffer));
+	memset(&vbo->memory, 0, sizeof(vbo->memory));
+
+	_VK(vkCreateBuffer(qvk.device, &buf_create_info, NULL, &vbo->buffer.buffer));
+
+	VkMemoryRequirements mem_reqs;
+	vkGetBufferMemoryRequirements(qvk.device, vbo->buffer.buffer, &mem_reqs);
+
+	vbo->memory.size = mem_reqs.size;
+	vbo->memory.alignment = mem_reqs.alignment;
+	vbo->memory.memory_type = get_memory_type(mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	DMAResult result = allocate_device_memory(model_memory_allocator, &vbo->memory);
+	if (result != DMA_SUCCESS && num_retired_vbos > 0 && vbo->memory.size <= MODEL_ARENA_CAPACITY)
+	{
+		evict_retired_model_vbos();
+		result = allocate_device_memory(model_memory_allocator, &vbo->memory);
+	}
+
+	if (result != DMA_SUCCESS)
+	{
+		vkDestroyBuffer(qvk.device, vbo->buffer.buffer, NULL);
+		memset(&vbo->buffer, 0, sizeof(vbo->buffer));
+		memset(&vbo->memory, 0, sizeof(vbo->memory));
+		model_vbo_stats.dedicated++;
+
+		return buffer_create(&vbo->buffer, size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+
+	_VK(vkBindBufferMemory(qvk.device, vbo->buffer.buffer, vbo->memory.memory, vbo->memory.memory_offset));
+
+	vbo->buffer.size = size;
+	if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+		vbo->buffer.address = get_buffer_device_address(vbo->buffer.buffer);
+
+	return VK_SUCCESS;
+}
+
+static void modelvbo_stats_f(void)
+{
+	size_t memory_allocated, memory_used;
+	BuddyAllocatorStats blocks;
+	get_device_malloc_stats(model_memory_allocator, &memory_allocated, &memory_used);
+	get_device_malloc_block_stats(model_memory_allocator, &blocks);
+
+	const uint64_t free_size = blocks.capacity - blocks.allocated;
+	const double mb = 1.0 / (1024 * 1024);
+
+	Com_Printf("Model VBOs: %d uploaded, %d reused from earlier maps, %d kept after material changes\n",
+		model_vbo_stats.uploaded, model_vbo_stats.adopted, model_vbo_stats.kept);
+	Com_Printf("Retired pool: %d of %d, %d retired, %d evicted, %d dedicated allocations\n",
+		num_retired_vbos, MAX_RETIRED_MODEL_VBOS, model_vbo_stats.retired, model_vbo_stats.evicted, model_vbo_stats.dedicated);
+	Com_Printf("Arena: %.1f MB reserved, %.1f MB used by %u VBOs, %.1f MB in blocks\n",
+		memory_allocated * mb, memory_used * mb, blocks.num_allocations, blocks.allocated * mb);
+	Com_Printf("Free: %.1f MB in %u blocks, largest %.1f MB, %.0f%% fragmented\n",
+		free_size * mb, blocks.num_free_blocks, blocks.largest_free * mb,
+		free_size ? 100.0 * (1.0 - (double)blocks.largest_free / free_size) : 0.0);
+}
+
 static void
 stage_mesh_primitives(uint8_t* staging_data, int* p_write_ptr, float** p_vertex_write_ptr, const model_t* model, const maliasmesh_t* m)
 {
@@ -926,12 +1298,19 @@ void vkpt_vertex_buffer_invalidate_static_model_vbos(int material_index)
 				}
 			}
 
-			// Invalidate and later re-upload the VBO if the material is used
-			if (found)
+			if (!found)
+				continue;
+
+			// Only the split into opaque, transparent and masked geometries is baked into the VBO
+			if (get_model_material_categories(model) == vbo->material_categories)
 			{
-				write_model_vbo_descriptor(i, null_buffer.buffer, null_buffer.size);
-				destroy_model_vbo(vbo);
+				model_vbo_stats.kept++;
+				continue;
 			}
+
+			// Invalidate and later re-upload the VBO
+			write_model_vbo_descriptor(i, null_buffer.buffer, null_buffer.size);
+			destroy_model_vbo(vbo);
 		}
 	}
 }
@@ -940,6 +1319,8 @@ VkResult
 vkpt_vertex_buffer_upload_models()
 {
 	bool any_models_to_upload = false;
+	bool any_models_retired = false;
+	byte adopted[(MAX_MODELS + 7) / 8] = { 0 };
 
 	for(int i = 0; i < MAX_MODELS; i++)
 	{
@@ -947,9 +1328,10 @@ vkpt_vertex_buffer_upload_models()
 		model_vbo_t* vbo = model_vertex_data + i;
 
 		if (!model->meshes && vbo->buffer.buffer) {
-			// model unloaded, destroy the VBO
+			// model unloaded, keep the VBO in case the model is loaded again
 			write_model_vbo_descriptor(i, null_buffer.buffer, null_buffer.size);
-			destroy_model_vbo(vbo);
+			retire_model_vbo(vbo);
+			any_models_retired = true;
 			//Com_Printf("Unloaded model[%d]\n", i);
 			continue;
 		}
@@ -964,18 +1346,38 @@ vkpt_vertex_buffer_upload_models()
 			continue;
 		}
 
-		// Destroy the old buffers if they exist.
+		// Retire the old buffers if they exist.
 		// This may happen when a model is unloaded and then another model
 		// is loaded in the same slot when changing a map.
-		destroy_model_vbo(vbo);
+		if (vbo->buffer.buffer)
+		{
+			retire_model_vbo(vbo);
+			any_models_retired = true;
+		}
 
 		memset(vbo, 0, sizeof(model_vbo_t));
 
         assert(model->numframes > 0);
 
+		const uint32_t material_categories = get_model_material_categories(model);
+		const uint64_t key = get_model_vbo_key(model, material_categories);
+
+		if (adopt_retired_model_vbo(vbo, key))
+		{
+			// Same data as a model that was unloaded earlier, the VBO and BLAS are still valid
+			set_model_tri_offsets(model);
+			vbo->registration_sequence = model->registration_sequence;
+			Q_SetBit(adopted, i);
+			model_vbo_stats.adopted++;
+			any_models_to_upload = true;
+			continue;
+		}
+
 		bool model_is_static = model->numframes == 1 && (!model->iqmData || !model->iqmData->blend_indices);
 		vbo->is_static = model_is_static;
 		vbo->total_tris = 0;
+		vbo->key = key;
+		vbo->material_categories = material_categories;
 
 		if (model_is_static)
 		{
@@ -1054,12 +1456,11 @@ vkpt_vertex_buffer_upload_models()
 			VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
 			VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
 
-		buffer_create(&vbo->buffer, vbo_size, 
+		create_model_vbo_buffer(vbo, vbo_size,
 			VK_BUFFER_USAGE_TRANSFER_DST_BIT |
 			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
 			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-			(model_is_static ? accel_usage : 0),
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			(model_is_static ? accel_usage : 0));
 		
 		buffer_create(&vbo->staging_buffer, staging_size,
 			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -1067,7 +1468,8 @@ vkpt_vertex_buffer_upload_models()
 			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
 		ATTACH_LABEL_VARIABLE_NAME(vbo->buffer.buffer, BUFFER, model->name);
-		ATTACH_LABEL_VARIABLE_NAME(vbo->buffer.memory, DEVICE_MEMORY, model->name);
+		if (vbo->buffer.memory)
+			ATTACH_LABEL_VARIABLE_NAME(vbo->buffer.memory, DEVICE_MEMORY, model->name);
 
 		if (model_is_static)
 		{
@@ -1100,9 +1502,13 @@ vkpt_vertex_buffer_upload_models()
 		buffer_unmap(&vbo->staging_buffer);
 
 		vbo->registration_sequence = model->registration_sequence;
+		model_vbo_stats.uploaded++;
 		any_models_to_upload = true;
 	}
 
+	if (any_models_retired)
+		trim_device_memory_allocator(model_memory_allocator);
+
 	if (any_models_to_upload)
 	{
 		VkCommandBuffer cmd_buf = vkpt_begin_command_buffer(&qvk.cmd_buffers_graphics);
@@ -1163,6 +1569,10 @@ vkpt_vertex_buffer_upload_models()
 				// otherwise, the descriptor set might be still in use by in-flight shaders.
 				write_model_vbo_descriptor(i, vbo->buffer.buffer, vbo->buffer.size);
 			}
+			else if (Q_IsBitSet(adopted, i))
+			{
+				write_model_vbo_descriptor(i, vbo->buffer.buffer, vbo->buffer.size);
+			}
 		}
 	}
 
@@ -1310,6 +1720,9 @@ vkpt_vertex_buffer_create()
 	buffer_create(&qvk.buf_light, sizeof(LightBuffer),
 		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	vkpt_light_buffer_invalidate();
+	memset(&light_upload_stats, 0, sizeof(light_upload_stats));
+	Cmd_AddCommand("lightbuffer_stats", lightbuffer_stats_f);
 
 	for (int frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
 	{
@@ -1429,6 +1842,13 @@ vkpt_vertex_buffer_create()
 	create_primbuf();
 	
 	memset(model_vertex_data, 0, sizeof(model_vertex_data));
+	memset(retired_vbos, 0, sizeof(retired_vbos));
+	num_retired_vbos = 0;
+	memset(&model_vbo_stats, 0, sizeof(model_vbo_stats));
+
+	model_memory_allocator = create_device_memory_allocator_ex(qvk.device,
+		MODEL_ARENA_BLOCK_SIZE, MODEL_ARENA_CAPACITY, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+	Cmd_AddCommand("modelvbo_stats", modelvbo_stats_f);
 
 	for (int i = 0; i < MAX_MODELS; i++)
 	{
@@ -1469,10 +1889,16 @@ vkpt_vertex_buffer_destroy()
 		destroy_model_vbo(&model_vertex_data[model]);
 	}
 
+	evict_retired_model_vbos();
+	destroy_device_memory_allocator(model_memory_allocator);
+	model_memory_allocator = NULL;
+	Cmd_RemoveCommand("modelvbo_stats");
+
 	buffer_destroy(&null_buffer);
 
 	buffer_destroy(&qvk.buf_world);
 	buffer_destroy(&qvk.buf_light);
+	Cmd_RemoveCommand("lightbuffer_stats");
 	buffer_destroy(&qvk.buf_iqm_matrices);
 	buffer_destroy(&qvk.buf_readback);
 	for (int frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
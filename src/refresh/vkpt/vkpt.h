@@ -29,6 +29,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #endif // !defined(HAVE_M_PI)
 
 #include "vk_util.h"
+#include "device_memory_allocator.h"
 
 #include "shared/shared.h"
 #include "common/bsp.h"
@@ -202,6 +203,7 @@ typedef struct QVK_s {
 	bool                        use_ray_query;
 	bool                        enable_validation;
 	bool                        supports_fp16;
+	bool                        supports_bc;
 
 	cmd_buf_group_t             cmd_buffers_graphics;
 	cmd_buf_group_t             cmd_buffers_transfer;
@@ -359,6 +361,9 @@ typedef struct {
 	size_t vertex_data_offset;
 	uint32_t total_tris;
 	bool is_static;
+	DeviceMemory memory; // suballocated from the model arena, null memory for a dedicated buffer
+	uint64_t key; // hash of the model data and material categories the VBO was built from
+	uint32_t material_categories;
 } model_vbo_t;
 
 typedef struct
@@ -408,6 +413,7 @@ typedef struct bsp_mesh_s {
 	int num_light_polys;
 	int allocated_light_polys;
 	light_poly_t *light_polys;
+	byte light_polys_dirty[MAX_LIGHT_POLYS / 8]; // animated since the last light buffer upload
 
 	uint32_t sky_clusters[MAX_SKY_CLUSTERS];
 	int num_sky_clusters;
@@ -629,6 +635,7 @@ VkResult vkpt_instance_geometry(VkCommandBuffer cmd_buf, uint32_t num_instances,
 void vkpt_vertex_buffer_invalidate_static_model_vbos(int material_index);
 VkResult vkpt_vertex_buffer_upload_models(void);
 void vkpt_light_buffer_reset_counts(void);
+void vkpt_light_buffer_invalidate(void);
 VkResult vkpt_light_buffer_upload_to_staging(bool render_world, bsp_mesh_t *bsp_mesh, bsp_t* bsp, int num_model_lights, light_poly_t* transformed_model_lights, const float* sky_radiance);
 VkResult vkpt_light_buffer_upload_staging(VkCommandBuffer cmd_buf);
 VkResult vkpt_light_buffers_create(bsp_mesh_t *bsp_mesh);
@@ -718,6 +725,9 @@ void destroy_transparency(void);
 
 void update_transparency(VkCommandBuffer command_buffer, const float* view_matrix,
 	const particle_t* particles, int particle_num, const entity_t* entities, int entity_num);
+#if USE_TESTS
+void vkpt_particle_bench(void);
+#endif
 
 typedef enum {
 	VKPT_TRANSPARENCY_PARTICLES,
@@ -666,13 +666,514 @@ static void PF_StartSound(edict_t *entity, int channel,
     SV_StartSound(NULL, entity, channel, soundindex, volume, attenuation, timeofs);
 }
 
+/*
+===============================================================================
+
+PLAYER MOVEMENT
+
+With sv_parallel_pmove, moves are queued while reading packets and run
+once all packets of the frame are in: client by client in slot order, each
+client's moves in the order they arrived. This differs from the serial path,
+which runs moves in packet arrival order across clients, but doesn't depend
+on network timing. Results are exactly those of running the moves serially
+in slot order.
+
+Before that, Pmove is run for the queued moves on worker threads, against
+the world as it is before any of them, with the input the game is expected
+to pass in. A prediction is only used when the game's gi.Pmove input
+matches it and nothing the move looked at has changed since. Anything else,
+such as players running into each other, runs serially as usual.
+
+Predicting requires the game's pmove callbacks to be gi.pointcontents and
+a function that passes its arguments to gi.trace along with a fixed entity
+and mask, which is checked on every move that runs serially.
+
+===============================================================================
+*/
+
+#define MAX_PREDICTED_MOVES     8   // per client, longer bursts run serially
+#define MAX_PREDICTED_EDICTS    64  // edicts near one move
+
+typedef struct {
+    pmove_t         in;             // expected game input
+    pmove_t         out;
+    worldquery_t    query;
+    edict_t         *passowner;
+    int             numedicts;
+    edict_t         *edicts[MAX_PREDICTED_EDICTS];
+    bool            valid;
+} predmove_t;
+
+// what clipping reads from an edict
+typedef struct {
+    unsigned        stamp;
+    solid_t         solid;
+    int             svflags;
+    int             modelindex;
+    edict_t         *owner;
+    vec3_t          origin, angles;
+    vec3_t          mins, maxs;
+    vec3_t          absmin, absmax;
+} edictsnap_t;
+
+static predmove_t   *pred_moves;
+static int          pred_maxmoves;
+static client_t     *pred_clients[MAX_CLIENTS];
+static int          pred_numclients;
+
+static edictsnap_t  *pred_snaps;
+static int          pred_maxsnaps;
+static unsigned     pred_stamp;
+
+static int          pred_curmove = -1;  // queued move being run
+
+static bool SV_PmoveStateEqual(const pmove_state_t *a, const pmove_state_t *b)
+{
+    return a->pm_type == b->pm_type
+        && a->origin[0] == b->origin[0]
+        && a->origin[1] == b->origin[1]
+        && a->origin[2] == b->origin[2]
+        && a->velocity[0] == b->velocity[0]
+        && a->velocity[1] == b->velocity[1]
+        && a->velocity[2] == b->velocity[2]
+        && a->pm_flags == b->pm_flags
+        && a->pm_time == b->pm_time
+        && a->gravity == b->gravity
+        && a->delta_angles[0] == b->delta_angles[0]
+        && a->delta_angles[1] == b->delta_angles[1]
+        && a->delta_angles[2] == b->delta_angles[2];
+}
+
+// compares everything Pmove reads from pmove_t, except callbacks
+static bool SV_PmoveInputEqual(const pmove_t *a, const pmove_t *b)
+{
+    return SV_PmoveStateEqual(&a->s, &b->s)
+        && !memcmp(&a->cmd, &b->cmd, sizeof(a->cmd))
+        && !a->snapinitial == !b->snapinitial
+        && VectorCompare(a->mins, b->mins)
+        && VectorCompare(a->maxs, b->maxs);
+}
+
+static bool SV_TraceEqual(const trace_t *a, const trace_t *b)
+{
+    return a->allsolid == b->allsolid
+        && a->startsolid == b->startsolid
+        && a->fraction == b->fraction
+        && VectorCompare(a->endpos, b->endpos)
+        && VectorCompare(a->plane.normal, b->plane.normal)
+        && a->plane.dist == b->plane.dist
+        && a->plane.type == b->plane.type
+        && a->plane.signbits == b->plane.signbits
+        && a->surface == b->surface
+        && a->contents == b->contents
+        && a->ent == b->ent;
+}
+
+static void SV_SnapEdict(edictsnap_t *snap, const edict_t *ent)
+{
+    snap->stamp = pred_stamp;
+    snap->solid = ent->solid;
+    snap->svflags = ent->svflags;
+    snap->modelindex = ent->s.modelindex;
+    snap->owner = ent->owner;
+    VectorCopy(ent->s.origin, snap->origin);
+    VectorCopy(ent->s.angles, snap->angles);
+    VectorCopy(ent->mins, snap->mins);
+    VectorCopy(ent->maxs, snap->maxs);
+    VectorCopy(ent->absmin, snap->absmin);
+    VectorCopy(ent->absmax, snap->absmax);
+}
+
+static bool SV_EdictUnchanged(const edict_t *ent)
+{
+    const edictsnap_t *snap = &pred_snaps[NUM_FOR_EDICT(ent)];
+
+    return snap->stamp == pred_stamp
+        && snap->solid == ent->solid
+        && snap->svflags == ent->svflags
+        && snap->modelindex == ent->s.modelindex
+        && snap->owner == ent->owner
+        && VectorCompare(snap->origin, ent->s.origin)
+        && VectorCompare(snap->angles, ent->s.angles)
+        && VectorCompare(snap->mins, ent->mins)
+        && VectorCompare(snap->maxs, ent->maxs)
+        && VectorCompare(snap->absmin, ent->absmin)
+        && VectorCompare(snap->absmax, ent->absmax);
+}
+
+/*
+===============
+SV_SetupPredictedMoves
+
+Guesses what the game will pass to gi.Pmove for the first queued move,
+the same way the game builds it. Later moves start where the previous
+one ended.
+===============
+*/
+static bool SV_SetupPredictedMoves(client_t *client)
+{
+    pmpredict_t *pred = &client->pred;
+    edict_t     *ent = client->edict;
+    predmove_t  *m;
+    int         i, count;
+
+    if (!pred->known || pred->spawncount != sv.spawncount)
+        return false;
+    if (!ent->inuse || !ent->client || pred->passedict != ent)
+        return false;
+    if (ent->solid == SOLID_BSP)
+        return false;
+
+    count = min(client->nummoves, MAX_PREDICTED_MOVES);
+    m = &pred_moves[pred->firstmove];
+    memset(&m->in, 0, sizeof(m->in));
+    m->in.s = ent->client->ps.pmove;
+    for (i = 0; i < 3; i++)
+        m->in.s.origin[i] = COORD2SHORT(ent->s.origin[i]);
+    m->in.cmd = client->moves[0];
+    m->in.snapinitial = !SV_PmoveStateEqual(&pred->old_state, &m->in.s);
+    VectorCopy(pred->mins, m->in.mins);
+    VectorCopy(pred->maxs, m->in.maxs);
+
+    SV_InitWorldQuery(&m->query, ent, pred->contentmask);
+    if (ent->area.prev && ent->solid == SOLID_BBOX)
+        SV_LinkQueryPass(&m->query, ent->s.origin, ent->mins, ent->maxs);
+    if (!SV_QueryPassMatches(&m->query))
+        return false;
+
+    pred->nummoves = count;
+    pred->pmp = client->pmp;
+    return true;
+}
+
+static void predict_moves(void *arg, int begin, int end)
+{
+    pmoveWorld_t world = {
+        .trace = SV_QueryTrace,
+        .pointcontents = SV_QueryPointContents
+    };
+    client_t    *client;
+    pmpredict_t *pred;
+    predmove_t  *m, *prev;
+    vec3_t      origin;
+    int         i, j;
+
+    for (i = begin; i < end; i++) {
+        client = pred_clients[i];
+        pred = &client->pred;
+
+        for (j = 0; j < pred->nummoves; j++) {
+            m = &pred_moves[pred->firstmove + j];
+
+            if (j) {
+                // the game copies the result into the player and relinks it
+                prev = m - 1;
+                memset(&m->in, 0, sizeof(m->in));
+                m->in.s = prev->out.s;
+                m->in.cmd = client->moves[j];
+                VectorCopy(prev->in.mins, m->in.mins);
+                VectorCopy(prev->in.maxs, m->in.maxs);
+
+                SV_InitWorldQuery(&m->query, pred->passedict, pred->contentmask);
+                if (prev->query.passlinked) {
+                    VectorScale(prev->out.s.origin, 0.125f, origin);
+                    SV_LinkQueryPass(&m->query, origin, prev->out.mins, prev->out.maxs);
+                }
+            }
+
+            m->passowner = pred->passedict->owner;
+            m->out = m->in;
+            world.arg = &m->query;
+            PmoveWorld(&m->out, &pred->pmp, &world);
+
+            m->numedicts = SV_QueryEdicts(&m->query, m->edicts, MAX_PREDICTED_EDICTS);
+            m->valid = !m->query.error && m->numedicts >= 0;
+            if (!m->valid) {
+                // the rest would start from a bad result
+                pred->nummoves = j + 1;
+                break;
+            }
+        }
+    }
+}
+
+/*
+===============
+SV_PredictMoves
+
+Runs queued moves of all clients on worker threads.
+===============
+*/
+static void SV_PredictMoves(void)
+{
+    client_t    *client;
+    predmove_t  *m;
+    int         i, j, total;
+
+    pred_numclients = 0;
+    total = 0;
+
+    for (i = 0; i < sv_maxclients->integer; i++) {
+        client = &svs.client_pool[i];
+        client->pred.nummoves = 0;
+        if (client->state != cs_spawned || !client->nummoves)
+            continue;
+        if (client->movespawncount != sv.spawncount)
+            continue;
+        total += min(client->nummoves, MAX_PREDICTED_MOVES);
+    }
+
+    if (!total)
+        return;
+
+    if (total > pred_maxmoves) {
+        pred_maxmoves = ALIGN(total, 64);
+        Z_Free(pred_moves);
+        pred_moves = SV_Malloc(pred_maxmoves * sizeof(pred_moves[0]));
+    }
+
+    total = 0;
+    for (i = 0; i < sv_maxclients->integer; i++) {
+        client = &svs.client_pool[i];
+        if (client->state != cs_spawned || !client->nummoves)
+            continue;
+        if (client->movespawncount != sv.spawncount)
+            continue;
+        client->pred.firstmove = total;
+        if (!SV_SetupPredictedMoves(client))
+            continue;
+        pred_clients[pred_numclients++] = client;
+        total += client->pred.nummoves;
+    }
+
+    Com_ParallelFor(pred_numclients, 1, predict_moves, NULL);
+
+    // remember what predictions looked at, the world is still unchanged
+    if (ge->max_edicts > pred_maxsnaps) {
+        pred_maxsnaps = ge->max_edicts;
+        Z_Free(pred_snaps);
+        pred_snaps = SV_Mallocz(pred_maxsnaps * sizeof(pred_snaps[0]));
+    }
+
+    pred_stamp++;
+    for (i = 0; i < pred_numclients; i++) {
+        client = pred_clients[i];
+        for (j = 0; j < client->pred.nummoves; j++) {
+            m = &pred_moves[client->pred.firstmove + j];
+            for (int k = 0; k < m->numedicts; k++)
+                SV_SnapEdict(&pred_snaps[NUM_FOR_EDICT(m->edicts[k])], m->edicts[k]);
+        }
+    }
+}
+
+/*
+===============
+SV_UsePredictedMove
+
+Fills in the results of a predicted move if it is exactly what the game
+asks for and nothing it depends on has changed.
+===============
+*/
+static bool SV_UsePredictedMove(pmove_t *pm)
+{
+    pmpredict_t *pred = &sv_client->pred;
+    edict_t     *list[MAX_PREDICTED_EDICTS];
+    tracewatch_t probe = { .probe = true };
+    predmove_t  *m;
+    int         i, num;
+
+    if (pred_curmove >= pred->nummoves)
+        return false;
+
+    m = &pred_moves[pred->firstmove + pred_curmove];
+    if (!m->valid)
+        return false;
+
+    if (pm->trace != pred->trace || pm->pointcontents != SV_PointContents)
+        return false;
+    if (!SV_PmoveInputEqual(pm, &m->in))
+        return false;
+    if (memcmp(&sv_client->pmp, &pred->pmp, sizeof(pred->pmp)))
+        return false;
+
+    // find out what the trace callback is going to use this time
+    sv_tracewatch = &probe;
+    pm->trace(vec3_origin, vec3_origin, vec3_origin, vec3_origin);
+    sv_tracewatch = NULL;
+
+    if (probe.count != 1 || probe.passedict != m->query.passedict
+        || probe.contentmask != m->query.contentmask)
+        return false;
+    if (m->query.passedict->owner != m->passowner)
+        return false;
+    if (!SV_QueryPassMatches(&m->query))
+        return false;
+
+    // everything the move could have run into must be the same
+    num = SV_QueryEdicts(&m->query, list, MAX_PREDICTED_EDICTS);
+    if (num != m->numedicts)
+        return false;
+    for (i = 0; i < num; i++)
+        if (list[i] != m->edicts[i] || !SV_EdictUnchanged(list[i]))
+            return false;
+
+    return true;
+}
+
+// checks that the game's trace callback is a plain wrapper for SV_Trace
+typedef struct {
+    pmove_t         *pm;
+    tracewatch_t    watch;
+    int             numtraces;
+    bool            plain;
+} pmwatch_t;
+
+static void watch_trace(void *arg, trace_t *tr, const vec3_t start, const vec3_t mins,
+                        const vec3_t maxs, const vec3_t end)
+{
+    pmwatch_t *w = arg;
+    int count = w->watch.count;
+    edict_t *passedict = w->watch.passedict;
+    int contentmask = w->watch.contentmask;
+
+    *tr = w->pm->trace(start, mins, maxs, end);
+
+    if (w->watch.count != count + 1 || !SV_TraceEqual(tr, &w->watch.trace))
+        w->plain = false;
+    else if (w->numtraces && (passedict != w->watch.passedict ||
+                              contentmask != w->watch.contentmask))
+        w->plain = false;
+
+    w->numtraces++;
+}
+
+static int watch_pointcontents(void *arg, const vec3_t point)
+{
+    pmwatch_t *w = arg;
+
+    return w->pm->pointcontents(point);
+}
+
+/*
+===============
+SV_WatchPmove
+
+Runs Pmove normally, learning how to predict the client's next moves.
+===============
+*/
+static void SV_WatchPmove(pmove_t *pm)
+{
+    pmpredict_t *pred = &sv_client->pred;
+    pmwatch_t   w = { .pm = pm, .plain = true };
+    pmoveWorld_t world = {
+        .trace = watch_trace,
+        .pointcontents = watch_pointcontents,
+        .arg = &w
+    };
+
+    VectorCopy(pm->mins, pred->mins);
+    VectorCopy(pm->maxs, pred->maxs);
+
+    sv_tracewatch = &w.watch;
+    PmoveWorld(pm, &sv_client->pmp, &world);
+    sv_tracewatch = NULL;
+
+    pred->old_state = pm->s;
+    if (pred->spawncount != sv.spawncount) {
+        pred->spawncount = sv.spawncount;
+        pred->known = false;
+    }
+
+    if (!w.numtraces)
+        return;     // didn't learn anything
+
+    pred->known = w.plain && pm->pointcontents == SV_PointContents;
+    pred->trace = pm->trace;
+    pred->passedict = w.watch.passedict;
+    pred->contentmask = w.watch.contentmask;
+}
+
 void PF_Pmove(pmove_t *pm)
 {
-    if (sv_client) {
-        Pmove(pm, &sv_client->pmp);
-    } else {
+    trace_t (* q_gameabi trace)(const vec3_t, const vec3_t, const vec3_t, const vec3_t);
+    int (*pointcontents)(const vec3_t);
+
+    if (!sv_client) {
         Pmove(pm, &sv_pmp);
+        return;
     }
+
+    if (pred_curmove < 0) {
+        Pmove(pm, &sv_client->pmp);
+        return;
+    }
+
+    if (!SV_UsePredictedMove(pm)) {
+        SV_WatchPmove(pm);
+        return;
+    }
+
+    trace = pm->trace;
+    pointcontents = pm->pointcontents;
+    *pm = pred_moves[sv_client->pred.firstmove + pred_curmove].out;
+    pm->trace = trace;
+    pm->pointcontents = pointcontents;
+
+    sv_client->pred.old_state = pm->s;
+}
+
+/*
+===============
+SV_RunMoves
+
+Runs moves queued for the client.
+===============
+*/
+void SV_RunMoves(client_t *client)
+{
+    client_t    *oldclient = sv_client;
+    edict_t     *oldplayer = sv_player;
+    int         i;
+
+    if (!client->nummoves)
+        return;
+
+    sv_client = client;
+    sv_player = client->edict;
+
+    for (i = 0; i < client->nummoves; i++) {
+        // may have been dropped, or the map changed
+        if (client->state != cs_spawned || client->movespawncount != sv.spawncount)
+            break;
+        pred_curmove = i;
+        ge->ClientThink(sv_player, &client->moves[i]);
+    }
+
+    pred_curmove = -1;
+    client->nummoves = 0;
+    client->pred.nummoves = 0;
+
+    sv_client = oldclient;
+    sv_player = oldplayer;
+}
+
+/*
+===============
+SV_RunQueuedMoves
+
+Predicts queued moves of all clients in parallel, then runs them in
+client slot order.
+===============
+*/
+void SV_RunQueuedMoves(void)
+{
+    int i;
+
+    if (sv_parallel_pmove->integer)
+        SV_PredictMoves();
+
+    for (i = 0; i < sv_maxclients->integer; i++)
+        SV_RunMoves(&svs.client_pool[i]);
 }
 
 static cvar_t *PF_cvar(const char *name, const char *value, int flags)
@@ -744,6 +1245,10 @@ it is changing to a different game directory.
 */
 void SV_ShutdownGameProgs(void)
 {
+    Z_Freep((void **)&pred_moves);
+    Z_Freep((void **)&pred_snaps);
+    pred_maxmoves = pred_maxsnaps = 0;
+
     if (ge) {
         ge->Shutdown();
         ge = NULL;
@@ -82,6 +82,8 @@ cvar_t  *sv_calcpings_method;
 cvar_t  *sv_changemapcmd;
 cvar_t  *sv_max_download_size;
 cvar_t  *sv_max_packet_entities;
+cvar_t  *sv_packed_entities;
+cvar_t  *sv_parallel_pmove;
 
 cvar_t  *sv_strafejump_hack;
 cvar_t  *sv_waterjump_hack;
@@ -624,6 +626,7 @@ typedef struct {
     int         maxlength;
     int         nctype;
     bool        has_zlib;
+    bool        has_packed;
 
     int         reserved;   // hidden client slots
     char        reconnect_var[16];
@@ -807,6 +810,10 @@ static bool parse_enhanced_params(conn_params_t *p)
         } else {
             p->version = PROTOCOL_VERSION_Q2PRO_MINIMUM;
         }
+
+        // set packed entities (opt-in)
+        s = Cmd_Argv(9);
+        p->has_packed = *s && atoi(s) && sv_packed_entities->integer;
     }
 
     return true;
@@ -1009,6 +1016,9 @@ static void init_pmove_and_es_flags(client_t *newcl)
         if (newcl->version >= PROTOCOL_VERSION_Q2PRO_BEAM_ORIGIN) {
             newcl->esFlags |= MSG_ES_BEAMORIGIN;
         }
+        if (newcl->has_packed) {
+            newcl->esFlags |= MSG_ES_PACKED;
+        }
         force = 1;
     }
     newcl->pmp.waterhack = sv_waterjump_hack->integer >= force;
@@ -1017,6 +1027,7 @@ static void init_pmove_and_es_flags(client_t *newcl)
 static void send_connect_packet(client_t *newcl, int nctype)
 {
     const char *ncstring    = "";
+    const char *pestring    = "";
     const char *acstring    = "";
     const char *dlstring1   = "";
     const char *dlstring2   = "";
@@ -1026,6 +1037,8 @@ static void send_connect_packet(client_t *newcl, int nctype)
             ncstring = " nc=1";
         else
             ncstring = " nc=0";
+        if (newcl->has_packed)
+            pestring = " pe=1";
     }
 
     if (!sv_force_reconnect->string[0] || newcl->reconnect_var[0])
@@ -1036,8 +1049,8 @@ static void send_connect_packet(client_t *newcl, int nctype)
         dlstring2 = sv_downloadserver->string;
     }
 
-    Netchan_OutOfBand(NS_SERVER, &net_from, "client_connect%s%s%s%s map=%s",
-                      ncstring, acstring, dlstring1, dlstring2, newcl->mapname);
+    Netchan_OutOfBand(NS_SERVER, &net_from, "client_connect%s%s%s%s%s map=%s",
+                      ncstring, pestring, acstring, dlstring1, dlstring2, newcl->mapname);
 }
 
 // converts all the extra positional parameters to `connect' command into an
@@ -1098,6 +1111,7 @@ static void SVC_DirectConnect(void)
     newcl->protocol = params.protocol;
     newcl->version = params.version;
     newcl->has_zlib = params.has_zlib;
+    newcl->has_packed = params.has_packed;
     newcl->edict = EDICT_NUM(number + 1);
     newcl->gamedir = fs_game->string;
     newcl->mapname = sv.name;
@@ -1912,6 +1926,9 @@ unsigned SV_Frame(unsigned msec)
     NET_GetPackets(NS_SERVER, SV_PacketEvent);
 
     if (svs.initialized) {
+        // run player moves queued while reading packets
+        SV_RunQueuedMoves();
+
         // run connection to the anticheat server
         AC_Run();
 
@@ -2114,6 +2131,13 @@ static void sv_hostname_changed(cvar_t *self)
 }
 #endif
 
+static void sv_parallel_pmove_changed(cvar_t *self)
+{
+    // dedicated server starts worker threads only when needed
+    if (self->integer)
+        Com_InitAsyncWork();
+}
+
 #if USE_ZLIB
 voidpf SV_zalloc(voidpf opaque, uInt items, uInt size)
 {
@@ -2211,6 +2235,10 @@ void SV_Init(void)
     sv_changemapcmd = Cvar_Get("sv_changemapcmd", "", 0);
     sv_max_download_size = Cvar_Get("sv_max_download_size", "8388608", 0);
     sv_max_packet_entities = Cvar_Get("sv_max_packet_entities", STRINGIFY(MAX_PACKET_ENTITIES), 0);
+    sv_packed_entities = Cvar_Get("sv_packed_entities", "0", 0);
+    sv_parallel_pmove = Cvar_Get("sv_parallel_pmove", "0", 0);
+    sv_parallel_pmove->changed = sv_parallel_pmove_changed;
+    sv_parallel_pmove_changed(sv_parallel_pmove);
 
     sv_strafejump_hack = Cvar_Get("sv_strafejump_hack", "1", CVAR_LATCH);
     sv_waterjump_hack = Cvar_Get("sv_waterjump_hack", "0", CVAR_LATCH);
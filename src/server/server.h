@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "shared/list.h"
 #include "shared/game.h"
 
+#include "common/async.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
 #include "common/cmodel.h"
@@ -268,6 +269,27 @@ typedef struct {
     int         max_edicts;
 } edict_pool_t;
 
+// moves that can be queued from packets before they are run
+#define MAX_QUEUED_MOVES    (20 + MAX_PACKET_FRAMES * MAX_PACKET_USERCMDS)
+
+// what PF_Pmove has learned about how the game moves a client,
+// used for running its queued moves ahead of time
+typedef struct {
+    bool            known;          // game's callbacks are predictable
+    int             spawncount;
+    trace_t         (* q_gameabi trace)(const vec3_t start, const vec3_t mins,
+                                        const vec3_t maxs, const vec3_t end);
+    edict_t         *passedict;     // what the trace callback passes to SV_Trace
+    int             contentmask;
+    vec3_t          mins, maxs;     // pmove_t bounds the game passes in
+    pmove_state_t   old_state;      // result of the last move
+
+    // predictions for queued moves in this frame
+    int             firstmove;
+    int             nummoves;
+    pmoveParams_t   pmp;            // parameters they were made with
+} pmpredict_t;
+
 typedef struct client_s {
     list_t          entry;
 
@@ -280,6 +302,7 @@ typedef struct client_s {
     bool            reconnected: 1;
     bool            nodata: 1;
     bool            has_zlib: 1;
+    bool            has_packed: 1;
     bool            drop_hack: 1;
 #if USE_ICMP
     bool            unreachable: 1;
@@ -374,6 +397,12 @@ typedef struct client_s {
     netchan_t       netchan;
     int             numpackets; // for that nasty packetdup hack
 
+    // moves received but not run yet (sv_parallel_pmove)
+    usercmd_t       moves[MAX_QUEUED_MOVES];
+    int             nummoves;
+    int             movespawncount;
+    pmpredict_t     pred;
+
     // misc
     time_t          connect_time; // time of initial connect
 	int             last_valid_cluster;
@@ -538,6 +567,7 @@ extern cvar_t       *sv_calcpings_method;
 extern cvar_t       *sv_changemapcmd;
 extern cvar_t       *sv_max_download_size;
 extern cvar_t       *sv_max_packet_entities;
+extern cvar_t       *sv_parallel_pmove;
 
 extern cvar_t       *sv_strafejump_hack;
 #if USE_PACKETDUP
@@ -765,6 +795,8 @@ void SV_ShutdownGameProgs(void);
 void SV_InitEdict(edict_t *e);
 
 void PF_Pmove(pmove_t *pm);
+void SV_RunMoves(client_t *client);
+void SV_RunQueuedMoves(void);
 
 //
 // sv_save.c
@@ -827,3 +859,39 @@ trace_t q_gameabi SV_Trace(const vec3_t start, const vec3_t mins,
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+// when set, SV_Trace counts calls and keeps its last arguments and result,
+// or only records the arguments when probing
+typedef struct {
+    int         count;
+    edict_t     *passedict;
+    int         contentmask;
+    trace_t     trace;
+    bool        probe;
+} tracewatch_t;
+
+extern tracewatch_t     *sv_tracewatch;
+
+// traces and point contents from worker threads, for predicting moves
+typedef struct {
+    edict_t     *passedict;
+    int         contentmask;
+
+    // point contents see passedict linked here instead of where it is
+    bool        passlinked;
+    vec3_t      passorigin, passmins, passmaxs;
+    vec3_t      passabsmin, passabsmax;
+
+    boxhull_t   hull;
+    vec3_t      absmin, absmax;     // bounds of everything looked at
+    bool        error;              // hit something only the main thread handles
+} worldquery_t;
+
+void SV_InitWorldQuery(worldquery_t *q, edict_t *passedict, int contentmask);
+void SV_LinkQueryPass(worldquery_t *q, const vec3_t origin,
+                      const vec3_t mins, const vec3_t maxs);
+bool SV_QueryPassMatches(const worldquery_t *q);
+void SV_QueryTrace(void *arg, trace_t *tr, const vec3_t start, const vec3_t mins,
+                   const vec3_t maxs, const vec3_t end);
+int SV_QueryPointContents(void *arg, const vec3_t p);
+int SV_QueryEdicts(const worldquery_t *q, edict_t **list, int maxcount);
+
@@ -1038,7 +1038,17 @@ static inline void SV_ClientThink(usercmd_t *cmd)
         sv_client->lastactivity = svs.realtime;
     }
 
-    ge->ClientThink(sv_player, cmd);
+    if (!sv_parallel_pmove->integer) {
+        ge->ClientThink(sv_player, cmd);
+        return;
+    }
+
+    // run later together with moves of other clients
+    if (sv_client->nummoves == MAX_QUEUED_MOVES)
+        SV_RunMoves(sv_client);
+    if (!sv_client->nummoves)
+        sv_client->movespawncount = sv.spawncount;
+    sv_client->moves[sv_client->nummoves++] = *cmd;
 }
 
 static void SV_SetLastFrame(int lastframe)
@@ -1519,6 +1529,10 @@ void SV_ExecuteClientMessage(client_t *client)
             }
         }
 
+        // anything else must see the effect of moves before it
+        if (c != clc_nop && c != clc_move)
+            SV_RunMoves(client);
+
         switch (c) {
         default:
 badbyte:
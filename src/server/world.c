@@ -42,10 +42,14 @@ typedef struct areanode_s {
 static areanode_t   sv_areanodes[AREA_NODES];
 static int          sv_numareanodes;
 
-static const vec_t  *area_mins, *area_maxs;
-static edict_t      **area_list;
-static int          area_count, area_maxcount;
-static int          area_type;
+// state of one SV_AreaEdicts call, kept on the stack so that
+// queries can run from several threads at once
+typedef struct {
+    const vec_t *mins, *maxs;
+    edict_t     **list;
+    int         count, maxcount;
+    int         type;
+} areaquery_t;
 
 /*
 ===============
@@ -342,13 +346,13 @@ SV_AreaEdicts_r
 
 ====================
 */
-static void SV_AreaEdicts_r(areanode_t *node)
+static void SV_AreaEdicts_r(areaquery_t *q, areanode_t *node)
 {
     list_t      *start;
     edict_t     *check;
 
     // touch linked edicts
-    if (area_type == AREA_SOLID)
+    if (q->type == AREA_SOLID)
         start = &node->solid_edicts;
     else
         start = &node->trigger_edicts;
@@ -356,51 +360,56 @@ static void SV_AreaEdicts_r(areanode_t *node)
     LIST_FOR_EACH(edict_t, check, start, area) {
         if (check->solid == SOLID_NOT)
             continue;        // deactivated
-        if (check->absmin[0] > area_maxs[0]
-            || check->absmin[1] > area_maxs[1]
-            || check->absmin[2] > area_maxs[2]
-            || check->absmax[0] < area_mins[0]
-            || check->absmax[1] < area_mins[1]
-            || check->absmax[2] < area_mins[2])
+        if (check->absmin[0] > q->maxs[0]
+            || check->absmin[1] > q->maxs[1]
+            || check->absmin[2] > q->maxs[2]
+            || check->absmax[0] < q->mins[0]
+            || check->absmax[1] < q->mins[1]
+            || check->absmax[2] < q->mins[2])
             continue;        // not touching
 
-        if (area_count == area_maxcount) {
+        if (q->count == q->maxcount) {
             Com_WPrintf("SV_AreaEdicts: MAXCOUNT\n");
             return;
         }
 
-        area_list[area_count] = check;
-        area_count++;
+        q->list[q->count] = check;
+        q->count++;
     }
 
     if (node->axis == -1)
         return;        // terminal node
 
     // recurse down both sides
-    if (area_maxs[node->axis] > node->dist)
-        SV_AreaEdicts_r(node->children[0]);
-    if (area_mins[node->axis] < node->dist)
-        SV_AreaEdicts_r(node->children[1]);
+    if (q->maxs[node->axis] > node->dist)
+        SV_AreaEdicts_r(q, node->children[0]);
+    if (q->mins[node->axis] < node->dist)
+        SV_AreaEdicts_r(q, node->children[1]);
 }
 
 /*
 ================
 SV_AreaEdicts
+
+Doesn't modify any global state, so it's safe to call from worker threads
+while the world isn't being changed, as long as maxcount is large enough
+to hold all edicts.
 ================
 */
 int SV_AreaEdicts(const vec3_t mins, const vec3_t maxs,
                   edict_t **list, int maxcount, int areatype)
 {
-    area_mins = mins;
-    area_maxs = maxs;
-    area_list = list;
-    area_count = 0;
-    area_maxcount = maxcount;
-    area_type = areatype;
+    areaquery_t q = {
+        .mins = mins,
+        .maxs = maxs,
+        .list = list,
+        .maxcount = maxcount,
+        .type = areatype
+    };
 
-    SV_AreaEdicts_r(sv_areanodes);
+    SV_AreaEdicts_r(&q, sv_areanodes);
 
-    return area_count;
+    return q.count;
 }
 
 
@@ -411,39 +420,58 @@ int SV_AreaEdicts(const vec3_t mins, const vec3_t maxs,
 SV_HullForEntity
 
 Returns a headnode that can be used for testing or clipping an
-object of mins/maxs size.
+object of mins/maxs size. Uses the shared box hull unless given a
+private one, in which case bad models return NULL instead of erroring.
 ================
 */
-static mnode_t *SV_HullForEntity(edict_t *ent)
+static mnode_t *SV_HullForEntity(edict_t *ent, boxhull_t *hull)
 {
     if (ent->solid == SOLID_BSP) {
         int i = ent->s.modelindex - 1;
 
         // explicit hulls in the BSP model
-        if (i <= 0 || i >= sv.cm.cache->nummodels)
+        if (i <= 0 || i >= sv.cm.cache->nummodels) {
+            if (hull)
+                return NULL;
             Com_Error(ERR_DROP, "%s: inline model %d out of range", __func__, i);
+        }
 
         return sv.cm.cache->models[i].headnode;
     }
 
     // create a temp hull from bounding box sizes
+    if (hull)
+        return CM_HeadnodeForBoxHull(hull, ent->mins, ent->maxs);
+
     return CM_HeadnodeForBox(ent->mins, ent->maxs);
 }
 
+// box hulls are never rotated, don't rotate private ones either
+static inline const vec_t *SV_AnglesForEntity(const edict_t *ent)
+{
+    return ent->solid == SOLID_BSP ? ent->s.angles : vec3_origin;
+}
+
+static inline bool SV_BoxTouchesPoint(const vec3_t mins, const vec3_t maxs, const vec3_t p)
+{
+    return mins[0] <= p[0] && mins[1] <= p[1] && mins[2] <= p[2]
+        && maxs[0] >= p[0] && maxs[1] >= p[1] && maxs[2] >= p[2];
+}
+
 /*
 =============
-SV_PointContents
+SV_PointContents_
+
+Contents from the world and all solid entities. With a query, runs off
+the main thread and sees passedict as the query says it is linked.
 =============
 */
-int SV_PointContents(const vec3_t p)
+static int SV_PointContents_(const vec3_t p, worldquery_t *q)
 {
     edict_t     *touch[MAX_EDICTS], *hit;
     int         i, num;
     int         contents;
-
-    if (!sv.cm.cache) {
-        Com_Error(ERR_DROP, "%s: no map loaded", __func__);
-    }
+    mnode_t     *headnode;
 
     // get base contents from world
     contents = CM_PointContents(p, sv.cm.cache->nodes);
@@ -453,31 +481,54 @@ int SV_PointContents(const vec3_t p)
 
     for (i = 0; i < num; i++) {
         hit = touch[i];
+        if (q && hit == q->passedict)
+            continue;
+
+        headnode = SV_HullForEntity(hit, q ? &q->hull : NULL);
+        if (!headnode) {
+            q->error = true;
+            continue;
+        }
 
         // might intersect, so do an exact clip
-        contents |= CM_TransformedPointContents(p, SV_HullForEntity(hit),
-                                                hit->s.origin, hit->s.angles);
+        contents |= CM_TransformedPointContents(p, headnode, hit->s.origin,
+                                                SV_AnglesForEntity(hit));
+    }
+
+    if (q && q->passlinked && SV_BoxTouchesPoint(q->passabsmin, q->passabsmax, p)) {
+        headnode = CM_HeadnodeForBoxHull(&q->hull, q->passmins, q->passmaxs);
+        contents |= CM_TransformedPointContents(p, headnode, q->passorigin, vec3_origin);
     }
 
     return contents;
 }
 
+/*
+=============
+SV_PointContents
+=============
+*/
+int SV_PointContents(const vec3_t p)
+{
+    if (!sv.cm.cache) {
+        Com_Error(ERR_DROP, "%s: no map loaded", __func__);
+    }
+
+    return SV_PointContents_(p, NULL);
+}
+
 /*
 ====================
 SV_ClipMoveToEntities
 
 ====================
 */
-static void SV_ClipMoveToEntities(const vec3_t start, const vec3_t mins,
-                                  const vec3_t maxs, const vec3_t end,
-                                  edict_t *passedict, int contentmask, trace_t *tr)
+static void SV_MoveBounds(const vec3_t start, const vec3_t mins,
+                          const vec3_t maxs, const vec3_t end,
+                          vec3_t boxmins, vec3_t boxmaxs)
 {
-    vec3_t      boxmins, boxmaxs;
-    int         i, num;
-    edict_t     *touchlist[MAX_EDICTS], *touch;
-    trace_t     trace;
+    int         i;
 
-    // create the bounding box of the entire move
     for (i = 0; i < 3; i++) {
         if (end[i] > start[i]) {
             boxmins[i] = start[i] + mins[i] - 1;
@@ -487,6 +538,21 @@ static void SV_ClipMoveToEntities(const vec3_t start, const vec3_t mins,
             boxmaxs[i] = start[i] + maxs[i] + 1;
         }
     }
+}
+
+static void SV_ClipMoveToEntities(const vec3_t start, const vec3_t mins,
+                                  const vec3_t maxs, const vec3_t end,
+                                  edict_t *passedict, int contentmask, trace_t *tr,
+                                  worldquery_t *q)
+{
+    vec3_t      boxmins, boxmaxs;
+    int         i, num;
+    edict_t     *touchlist[MAX_EDICTS], *touch;
+    trace_t     trace;
+    mnode_t     *headnode;
+
+    // create the bounding box of the entire move
+    SV_MoveBounds(start, mins, maxs, end, boxmins, boxmaxs);
 
     num = SV_AreaEdicts(boxmins, boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
 
@@ -511,10 +577,16 @@ static void SV_ClipMoveToEntities(const vec3_t start, const vec3_t mins,
             && (touch->svflags & SVF_DEADMONSTER))
             continue;
 
+        headnode = SV_HullForEntity(touch, q ? &q->hull : NULL);
+        if (!headnode) {
+            q->error = true;
+            continue;
+        }
+
         // might intersect, so do an exact clip
         CM_TransformedBoxTrace(&trace, start, end, mins, maxs,
-                               SV_HullForEntity(touch), contentmask,
-                               touch->s.origin, touch->s.angles);
+                               headnode, contentmask,
+                               touch->s.origin, SV_AnglesForEntity(touch));
 
         CM_ClipEntity(tr, &trace, touch);
     }
@@ -528,10 +600,26 @@ Moves the given mins/maxs volume through the world from start to end.
 Passedict and edicts owned by passedict are explicitly not checked.
 ==================
 */
+static void SV_Trace_(trace_t *trace, const vec3_t start, const vec3_t mins,
+                      const vec3_t maxs, const vec3_t end,
+                      edict_t *passedict, int contentmask, worldquery_t *q)
+{
+    // clip to world
+    CM_BoxTrace(trace, start, end, mins, maxs, sv.cm.cache->nodes, contentmask);
+    trace->ent = ge->edicts;
+    if (trace->fraction == 0) {
+        return;         // blocked by the world
+    }
+
+    // clip to other solid entities
+    SV_ClipMoveToEntities(start, mins, maxs, end, passedict, contentmask, trace, q);
+}
+
 trace_t q_gameabi SV_Trace(const vec3_t start, const vec3_t mins,
                            const vec3_t maxs, const vec3_t end,
                            edict_t *passedict, int contentmask)
 {
+    tracewatch_t *w = sv_tracewatch;
     trace_t     trace;
 
     if (!sv.cm.cache) {
@@ -543,15 +631,147 @@ trace_t q_gameabi SV_Trace(const vec3_t start, const vec3_t mins,
     if (!maxs)
         maxs = vec3_origin;
 
-    // clip to world
-    CM_BoxTrace(&trace, start, end, mins, maxs, sv.cm.cache->nodes, contentmask);
-    trace.ent = ge->edicts;
-    if (trace.fraction == 0) {
-        return trace;   // blocked by the world
+    if (w) {
+        w->count++;
+        w->passedict = passedict;
+        w->contentmask = contentmask;
+        if (w->probe) {
+            memset(&trace, 0, sizeof(trace));
+            trace.fraction = 1;
+            VectorCopy(end, trace.endpos);
+            return trace;
+        }
     }
 
-    // clip to other solid entities
-    SV_ClipMoveToEntities(start, mins, maxs, end, passedict, contentmask, &trace);
+    SV_Trace_(&trace, start, mins, maxs, end, passedict, contentmask, NULL);
+
+    if (w)
+        w->trace = trace;
+
     return trace;
 }
 
+/*
+===============================================================================
+
+WORLD QUERIES
+
+Traces and point contents for running player movement on worker threads.
+Nothing may change the world while they run. Bounds of everything a query
+looked at are kept, so that the results can be checked against the world
+again later on the main thread.
+
+===============================================================================
+*/
+
+tracewatch_t    *sv_tracewatch;
+
+static void SV_AddQueryBounds(worldquery_t *q, const vec3_t mins, const vec3_t maxs)
+{
+    int         i;
+
+    for (i = 0; i < 3; i++) {
+        q->absmin[i] = min(q->absmin[i], mins[i]);
+        q->absmax[i] = max(q->absmax[i], maxs[i]);
+    }
+}
+
+void SV_InitWorldQuery(worldquery_t *q, edict_t *passedict, int contentmask)
+{
+    CM_InitBoxHull(&q->hull);
+
+    q->passedict = passedict;
+    q->contentmask = contentmask;
+    q->passlinked = false;
+    ClearBounds(q->absmin, q->absmax);
+    q->error = false;
+}
+
+/*
+================
+SV_LinkQueryPass
+
+Makes point contents see passedict linked at the given position, the same
+way SV_LinkEdict would link a box there. Doesn't touch the entity itself.
+================
+*/
+void SV_LinkQueryPass(worldquery_t *q, const vec3_t origin,
+                      const vec3_t mins, const vec3_t maxs)
+{
+    int         i;
+
+    q->passlinked = true;
+    VectorCopy(origin, q->passorigin);
+    VectorCopy(mins, q->passmins);
+    VectorCopy(maxs, q->passmaxs);
+
+    for (i = 0; i < 3; i++) {
+        q->passabsmin[i] = origin[i] + mins[i] - 1;
+        q->passabsmax[i] = origin[i] + maxs[i] + 1;
+    }
+}
+
+// returns true if passedict is currently linked the way the query sees it
+bool SV_QueryPassMatches(const worldquery_t *q)
+{
+    const edict_t *ent = q->passedict;
+    bool linked = ent->area.prev && ent->solid == SOLID_BBOX;
+
+    if (linked != q->passlinked)
+        return false;
+    if (!linked)
+        return true;
+
+    return VectorCompare(ent->s.origin, q->passorigin)
+        && VectorCompare(ent->mins, q->passmins)
+        && VectorCompare(ent->maxs, q->passmaxs)
+        && VectorCompare(ent->absmin, q->passabsmin)
+        && VectorCompare(ent->absmax, q->passabsmax);
+}
+
+void SV_QueryTrace(void *arg, trace_t *tr, const vec3_t start, const vec3_t mins,
+                   const vec3_t maxs, const vec3_t end)
+{
+    worldquery_t *q = arg;
+    vec3_t      boxmins, boxmaxs;
+
+    SV_MoveBounds(start, mins, maxs, end, boxmins, boxmaxs);
+    SV_AddQueryBounds(q, boxmins, boxmaxs);
+
+    SV_Trace_(tr, start, mins, maxs, end, q->passedict, q->contentmask, q);
+}
+
+int SV_QueryPointContents(void *arg, const vec3_t p)
+{
+    worldquery_t *q = arg;
+
+    SV_AddQueryBounds(q, p, p);
+
+    return SV_PointContents_(p, q);
+}
+
+/*
+================
+SV_QueryEdicts
+
+Lists solid edicts other than passedict that touch the query bounds, in
+the order traces visit them. Returns -1 if there are more than maxcount.
+================
+*/
+int SV_QueryEdicts(const worldquery_t *q, edict_t **list, int maxcount)
+{
+    edict_t     *touch[MAX_EDICTS];
+    int         i, num, count;
+
+    num = SV_AreaEdicts(q->absmin, q->absmax, touch, MAX_EDICTS, AREA_SOLID);
+
+    for (i = count = 0; i < num; i++) {
+        if (touch[i] == q->passedict)
+            continue;
+        if (count == maxcount)
+            return -1;
+        list[count++] = touch[i];
+    }
+
+    return count;
+}
@@ -80,6 +80,13 @@ unsigned Sys_Milliseconds(void)
     return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
 }
 
+uint64_t Sys_Microseconds(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000ULL;
+}
+
 /*
 =================
 Sys_Quit
@@ -133,6 +140,12 @@ const char *Sys_ErrorString(int err)
     return strerror(err);
 }
 
+int Sys_NumCPUs(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+}
+
 #if USE_AC_CLIENT
 bool Sys_GetAntiCheatAPI(void)
 {
@@ -875,6 +875,15 @@ unsigned Sys_Milliseconds(void)
     return tm.QuadPart * 1000ULL / timer_freq.QuadPart;
 }
 
+uint64_t Sys_Microseconds(void)
+{
+    LARGE_INTEGER tm;
+    QueryPerformanceCounter(&tm);
+    // split to avoid overflow with high frequency counters
+    return tm.QuadPart / timer_freq.QuadPart * 1000000ULL +
+           tm.QuadPart % timer_freq.QuadPart * 1000000ULL / timer_freq.QuadPart;
+}
+
 void Sys_AddDefaultConfig(void)
 {
 }
@@ -884,6 +893,13 @@ void Sys_Sleep(int msec)
     Sleep(msec);
 }
 
+int Sys_NumCPUs(void)
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return max(si.dwNumberOfProcessors, 1);
+}
+
 const char *Sys_ErrorString(int err)
 {
     static char buf[256];